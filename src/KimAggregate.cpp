@@ -0,0 +1,555 @@
+//
+// Aggregate functions and GROUP BY for KimTable queries.
+//
+
+#include "KimAggregate.h"
+#include "KimFileHead.h"
+#include "KimThreadPool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <string_view>
+#include <unordered_map>
+
+namespace {
+
+// Running aggregate of one output over one group
+struct Accumulator {
+    KimBlockSummary value; // the row count, and for numeric columns the sum and extremes
+    std::string textMin; // string columns; their rows are value.minRow and maxRow
+    std::string textMax;
+};
+
+uint64_t mixKey(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb93fe53db34fULL;
+    value ^= value >> 33;
+    return value;
+}
+
+// Open-addressing map from a group key of up to 8 bytes to its group
+class IntGroupMap {
+public:
+    // The group of key, which becomes `fresh` if the key is new
+    uint32_t insert(uint64_t key, uint32_t fresh) {
+        if ((used + 1) * 2 > slots.size()) {
+            grow();
+        }
+        size_t mask = slots.size() - 1;
+        for (size_t i = mixKey(key) & mask;; i = (i + 1) & mask) {
+            Slot& slot = slots[i];
+            if (slot.group == kEmpty) {
+                slot = {key, fresh};
+                ++used;
+                return fresh;
+            }
+            if (slot.key == key) {
+                return slot.group;
+            }
+        }
+    }
+
+private:
+    static constexpr uint32_t kEmpty = UINT32_MAX;
+    struct Slot {
+        uint64_t key = 0;
+        uint32_t group = kEmpty;
+    };
+    std::vector<Slot> slots;
+    size_t used = 0;
+
+    void grow() {
+        std::vector<Slot> old(std::max<size_t>(64, slots.size() * 2));
+        old.swap(slots);
+        used = 0;
+        for (const auto& slot : old) {
+            if (slot.group != kEmpty) {
+                insert(slot.key, slot.group);
+            }
+        }
+    }
+};
+
+// The groups and partial aggregates of one thread
+struct Partial {
+    IntGroupMap intGroups; // one GROUP BY column of at most 8 bytes
+    std::unordered_map<std::string, uint32_t> byteGroups; // any other GROUP BY
+    std::vector<uint64_t> intKeys; // per group
+    std::vector<std::string> byteKeys;
+    std::vector<size_t> firstRows; // per group
+    std::vector<Accumulator> accumulators; // per group, one per output
+
+    // Scratch space for one batch
+    std::vector<uint32_t> groups;
+    std::vector<int64_t> ints;
+    std::vector<double> floats;
+    std::vector<std::string_view> views;
+    std::vector<KimBlockPin> pins; // keeps the blocks of a paged table that `views` point into
+    std::string key;
+
+    uint64_t rows = 0;
+    uint64_t bytes = 0;
+    uint64_t nanos = 0;
+};
+
+bool isInt(const KimColumn& column) {
+    return column.kind == KimStorageKind::Int32 || column.kind == KimStorageKind::Int64;
+}
+
+void addInt(KimBlockSummary& summary, int64_t value, size_t row) {
+    ++summary.count;
+    summary.intSum = static_cast<int64_t>(static_cast<uint64_t>(summary.intSum) + static_cast<uint64_t>(value));
+    if (value < summary.intMin) {
+        summary.intMin = value;
+        summary.minRow = row;
+    }
+    if (value > summary.intMax) {
+        summary.intMax = value;
+        summary.maxRow = row;
+    }
+}
+
+void addFloat(KimBlockSummary& summary, double value, size_t row) {
+    ++summary.count;
+    summary.floatSum += value;
+    if (value < summary.floatMin) {
+        summary.floatMin = value;
+        summary.minRow = row;
+    }
+    if (value > summary.floatMax) {
+        summary.floatMax = value;
+        summary.maxRow = row;
+    }
+}
+
+void addText(Accumulator& accumulator, std::string_view value, size_t row) {
+    KimBlockSummary& summary = accumulator.value;
+    ++summary.count;
+    if (summary.minRow == SIZE_MAX || value < accumulator.textMin) {
+        accumulator.textMin.assign(value.data(), value.size());
+        summary.minRow = row;
+    }
+    if (summary.maxRow == SIZE_MAX || value > accumulator.textMax) {
+        accumulator.textMax.assign(value.data(), value.size());
+        summary.maxRow = row;
+    }
+}
+
+// Whether `from` holds a smaller (or, with `larger`, greater) extreme than
+// `into`, ties going to the earlier row
+template <typename T>
+bool better(const T& from, size_t fromRow, const T& into, size_t intoRow, bool larger) {
+    if (fromRow == SIZE_MAX) {
+        return false;
+    }
+    if (intoRow == SIZE_MAX) {
+        return true;
+    }
+    return (larger ? from > into : from < into) || (from == into && fromRow < intoRow);
+}
+
+void mergeSummary(KimBlockSummary& into, const KimBlockSummary& from, bool ints) {
+    into.count += from.count;
+    into.intSum = static_cast<int64_t>(static_cast<uint64_t>(into.intSum) + static_cast<uint64_t>(from.intSum));
+    into.floatSum += from.floatSum;
+    if (ints ? better(from.intMin, from.minRow, into.intMin, into.minRow, false)
+             : better(from.floatMin, from.minRow, into.floatMin, into.minRow, false)) {
+        into.intMin = from.intMin;
+        into.floatMin = from.floatMin;
+        into.minRow = from.minRow;
+    }
+    if (ints ? better(from.intMax, from.maxRow, into.intMax, into.maxRow, true)
+             : better(from.floatMax, from.maxRow, into.floatMax, into.maxRow, true)) {
+        into.intMax = from.intMax;
+        into.floatMax = from.floatMax;
+        into.maxRow = from.maxRow;
+    }
+}
+
+void mergeText(Accumulator& into, const Accumulator& from) {
+    into.value.count += from.value.count;
+    if (better(from.textMin, from.value.minRow, into.textMin, into.value.minRow, false)) {
+        into.textMin = from.textMin;
+        into.value.minRow = from.value.minRow;
+    }
+    if (better(from.textMax, from.value.maxRow, into.textMax, into.value.maxRow, true)) {
+        into.textMax = from.textMax;
+        into.value.maxRow = from.value.maxRow;
+    }
+}
+
+class Aggregator {
+public:
+    Aggregator(const KimTable& table, const KimQueryPlan& plan, size_t participants)
+        : table(table), plan(plan), partials(participants) {
+        if (plan.groupBy.size() == 1) {
+            const KimColumn& column = table.columns[plan.groupBy.front()];
+            intKeys = column.kind != KimStorageKind::String && column.width <= sizeof(uint64_t);
+        }
+        if (plan.groupBy.empty()) {
+            for (auto& partial : partials) {
+                addGroup(partial, SIZE_MAX);
+            }
+        }
+    }
+
+    Partial& partial(size_t participant) { return partials[participant]; }
+
+    // Aggregates a batch of ascending rows: the rows are assigned to groups
+    // first, then each output reads its column for the whole batch
+    void consume(Partial& partial, const std::vector<size_t>& rows) {
+        size_t n = rows.size();
+        assignGroups(partial, rows);
+        size_t stride = plan.outputs.size();
+        for (size_t o = 0; o < stride; ++o) {
+            const KimPlanOutput& output = plan.outputs[o];
+            Accumulator* accumulators = partial.accumulators.data() + o;
+            const uint32_t* groups = partial.groups.data();
+            if (output.aggregate == KimAggregate::None) {
+                continue;
+            }
+            if (output.aggregate == KimAggregate::Count) {
+                for (size_t i = 0; i < n; ++i) {
+                    ++accumulators[groups[i] * stride].value.count;
+                }
+                continue;
+            }
+            const KimColumn& column = table.columns[output.column];
+            if (isInt(column)) {
+                partial.ints.resize(n);
+                column.gatherInts(rows.data(), n, partial.ints.data());
+                for (size_t i = 0; i < n; ++i) {
+                    addInt(accumulators[groups[i] * stride].value, partial.ints[i], rows[i]);
+                }
+                partial.bytes += n * column.width;
+            } else if (column.isNumeric()) {
+                partial.floats.resize(n);
+                column.gatherFloats(rows.data(), n, partial.floats.data());
+                for (size_t i = 0; i < n; ++i) {
+                    addFloat(accumulators[groups[i] * stride].value, partial.floats[i], rows[i]);
+                }
+                partial.bytes += n * column.width;
+            } else {
+                partial.views.resize(n);
+                column.gatherViews(rows.data(), n, partial.views.data());
+                for (size_t i = 0; i < n; ++i) {
+                    addText(accumulators[groups[i] * stride], partial.views[i], rows[i]);
+                    partial.bytes += partial.views[i].size();
+                }
+            }
+        }
+        partial.rows += n;
+    }
+
+    // Folds block b, which has no deleted rows, into the single group
+    void summarize(Partial& partial, size_t b) {
+        size_t count = table.columns.front().blocks[b]->count;
+        for (size_t o = 0; o < plan.outputs.size(); ++o) {
+            const KimPlanOutput& output = plan.outputs[o];
+            Accumulator& accumulator = partial.accumulators[o];
+            if (output.aggregate == KimAggregate::Count) {
+                accumulator.value.count += count;
+                continue;
+            }
+            const KimColumn& column = table.columns[output.column];
+            KimBlockSummary summary;
+            column.summarizeBlock(b, summary);
+            mergeSummary(accumulator.value, summary, isInt(column));
+            partial.bytes += column.blockBytes(b);
+        }
+        partial.rows += count;
+    }
+
+    // Merges every thread's groups into the first thread's, orders the
+    // groups by their first row and formats at most `limit` of them
+    std::vector<std::vector<std::string>> finish(size_t limit) {
+        Partial& total = partials.front();
+        size_t stride = plan.outputs.size();
+        for (size_t p = 1; p < partials.size(); ++p) {
+            Partial& part = partials[p];
+            for (size_t g = 0; g < part.firstRows.size(); ++g) {
+                uint32_t into = 0;
+                if (!plan.groupBy.empty()) {
+                    into = intKeys ? findGroup(total, part.intKeys[g], part.firstRows[g])
+                                   : findGroup(total, part.byteKeys[g], part.firstRows[g]);
+                }
+                total.firstRows[into] = std::min(total.firstRows[into], part.firstRows[g]);
+                for (size_t o = 0; o < stride; ++o) {
+                    merge(plan.outputs[o], total.accumulators[into * stride + o], part.accumulators[g * stride + o]);
+                }
+            }
+        }
+
+        std::vector<uint32_t> order(total.firstRows.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(),
+                  [&](uint32_t a, uint32_t b) { return total.firstRows[a] < total.firstRows[b]; });
+        order.resize(std::min(order.size(), limit));
+        std::vector<std::vector<std::string>> result(order.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            uint32_t g = order[i];
+            for (size_t o = 0; o < stride; ++o) {
+                result[i].push_back(format(plan.outputs[o], total.accumulators[g * stride + o], total.firstRows[g]));
+            }
+        }
+        return result;
+    }
+
+private:
+    const KimTable& table;
+    const KimQueryPlan& plan;
+    std::vector<Partial> partials;
+    bool intKeys = false;
+
+    uint32_t addGroup(Partial& partial, size_t row) {
+        partial.firstRows.push_back(row);
+        partial.accumulators.resize(partial.accumulators.size() + plan.outputs.size());
+        return static_cast<uint32_t>(partial.firstRows.size() - 1);
+    }
+
+    uint32_t findGroup(Partial& partial, uint64_t key, size_t row) {
+        uint32_t fresh = static_cast<uint32_t>(partial.firstRows.size());
+        uint32_t group = partial.intGroups.insert(key, fresh);
+        if (group == fresh) {
+            addGroup(partial, row);
+            partial.intKeys.push_back(key);
+        }
+        return group;
+    }
+
+    uint32_t findGroup(Partial& partial, const std::string& key, size_t row) {
+        auto inserted = partial.byteGroups.emplace(key, static_cast<uint32_t>(partial.firstRows.size()));
+        if (inserted.second) {
+            addGroup(partial, row);
+            partial.byteKeys.push_back(key);
+        }
+        return inserted.first->second;
+    }
+
+    void assignGroups(Partial& partial, const std::vector<size_t>& rows) {
+        size_t n = rows.size();
+        partial.groups.assign(n, 0);
+        if (plan.groupBy.empty()) {
+            return;
+        }
+        if (intKeys) {
+            // Ints and floats by value, so 0 and -0 meet; other kinds by their stored bytes
+            const KimColumn& column = table.columns[plan.groupBy.front()];
+            partial.ints.resize(n);
+            if (isInt(column)) {
+                column.gatherInts(rows.data(), n, partial.ints.data());
+            } else if (column.isNumeric()) {
+                partial.floats.resize(n);
+                column.gatherFloats(rows.data(), n, partial.floats.data());
+                for (size_t i = 0; i < n; ++i) {
+                    double value = partial.floats[i] + 0.0;
+                    std::memcpy(&partial.ints[i], &value, sizeof(value));
+                }
+            } else {
+                partial.views.resize(n);
+                column.gatherRaw(rows.data(), n, partial.views.data());
+                for (size_t i = 0; i < n; ++i) {
+                    uint64_t key = 0;
+                    std::memcpy(&key, partial.views[i].data(), partial.views[i].size());
+                    partial.ints[i] = static_cast<int64_t>(key);
+                }
+            }
+            partial.bytes += n * column.width;
+            for (size_t i = 0; i < n; ++i) {
+                partial.groups[i] = findGroup(partial, static_cast<uint64_t>(partial.ints[i]), rows[i]);
+            }
+            return;
+        }
+
+        // The stored bytes of every GROUP BY column, variable-length ones
+        // preceded by their length
+        size_t columns = plan.groupBy.size();
+        partial.views.resize(n * columns);
+        partial.pins.clear();
+        for (size_t c = 0; c < columns; ++c) {
+            table.columns[plan.groupBy[c]].gatherRaw(rows.data(), n, partial.views.data() + c * n, &partial.pins);
+        }
+        for (size_t i = 0; i < n; ++i) {
+            partial.key.clear();
+            for (size_t c = 0; c < columns; ++c) {
+                std::string_view raw = partial.views[c * n + i];
+                if (table.columns[plan.groupBy[c]].kind == KimStorageKind::String) {
+                    uint32_t length = static_cast<uint32_t>(raw.size());
+                    partial.key.append(reinterpret_cast<const char*>(&length), sizeof(length));
+                }
+                partial.key.append(raw.data(), raw.size());
+            }
+            partial.bytes += partial.key.size();
+            partial.groups[i] = findGroup(partial, partial.key, rows[i]);
+        }
+    }
+
+    void merge(const KimPlanOutput& output, Accumulator& into, const Accumulator& from) const {
+        if (output.aggregate == KimAggregate::None || output.aggregate == KimAggregate::Count) {
+            into.value.count += from.value.count;
+            return;
+        }
+        const KimColumn& column = table.columns[output.column];
+        if (column.isNumeric()) {
+            mergeSummary(into.value, from.value, isInt(column));
+        } else {
+            mergeText(into, from);
+        }
+    }
+
+    std::string format(const KimPlanOutput& output, const Accumulator& accumulator, size_t firstRow) const {
+        const KimBlockSummary& value = accumulator.value;
+        switch (output.aggregate) {
+            case KimAggregate::None:
+                return table.columns[output.column].getString(firstRow);
+            case KimAggregate::Count:
+                return std::to_string(value.count);
+            case KimAggregate::Sum:
+            case KimAggregate::Avg: {
+                if (value.count == 0) {
+                    return std::string();
+                }
+                bool ints = isInt(table.columns[output.column]);
+                if (output.aggregate == KimAggregate::Sum) {
+                    return ints ? std::to_string(value.intSum) : kimFormatFloat(value.floatSum);
+                }
+                double sum = ints ? static_cast<double>(value.intSum) : value.floatSum;
+                return kimFormatFloat(sum / static_cast<double>(value.count));
+            }
+            default: {
+                size_t row = output.aggregate == KimAggregate::Min ? value.minRow : value.maxRow;
+                return row == SIZE_MAX ? std::string() : table.columns[output.column].getString(row);
+            }
+        }
+    }
+};
+
+// Ungrouped aggregates of numeric columns over a whole table can be taken
+// from block summaries
+bool fromSummaries(const KimTable& table, const KimQueryPlan& plan) {
+    if (!plan.groupBy.empty() || !plan.predicates.empty() || table.columns.empty()) {
+        return false;
+    }
+    for (const auto& output : plan.outputs) {
+        if (output.aggregate != KimAggregate::Count && !table.columns[output.column].isNumeric()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool blockHasDeleted(const KimTable& table, size_t b) {
+    if (table.deletedCount == 0) {
+        return false;
+    }
+    size_t end = std::min(table.deletedRows.size(), (b + 1) * kKimBlockRows / 64);
+    for (size_t word = b * kKimBlockRows / 64; word < end; ++word) {
+        if (table.deletedRows[word] != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+KimOperatorStats aggregateOperator(const KimTable& table, const KimQueryPlan& plan,
+                                   const std::vector<std::string>& values, bool summaries) {
+    std::string detail;
+    for (const auto& output : plan.outputs) {
+        if (output.aggregate != KimAggregate::None) {
+            detail += (detail.empty() ? "" : ", ") + output.name;
+        }
+    }
+    for (size_t c = 0; c < plan.groupBy.size(); ++c) {
+        detail += (c == 0 ? " GROUP BY " : ", ") + std::string(table.columnHeaders[plan.groupBy[c]].ColumnName);
+    }
+    if (summaries) {
+        detail += " from block summaries";
+    }
+    if (plan.hasLimit) {
+        detail += " LIMIT " + (plan.limit.parameter ? values[plan.limit.index] : plan.limit.text);
+    }
+    return {plan.groupBy.empty() ? "Aggregate" : "HashAggregate", detail};
+}
+
+} // namespace
+
+std::vector<std::vector<std::string>> kimAggregate(const KimTable& table, const KimQueryPlan& plan,
+                                                   const std::vector<std::string>& values, size_t limit,
+                                                   size_t parallelism, KimQueryStats* stats) {
+    KimThreadPool& pool = kimThreadPool();
+    Aggregator aggregator(table, plan, pool.size());
+    bool summaries = fromSummaries(table, plan);
+    if (summaries) {
+        // Blocks with deleted rows fall back to aggregating their live rows
+        size_t blocks = table.columns.front().blocks.size();
+        size_t morsels = (blocks + kKimMorselBlocks - 1) / kKimMorselBlocks;
+        std::vector<std::vector<size_t>> buffers(pool.size());
+        pool.run(morsels, parallelism, [&](size_t participant, size_t morsel) {
+            Partial& partial = aggregator.partial(participant);
+            uint64_t start = stats ? kimNowNanos() : 0;
+            size_t end = std::min(blocks, (morsel + 1) * kKimMorselBlocks);
+            for (size_t b = morsel * kKimMorselBlocks; b < end; ++b) {
+                if (!blockHasDeleted(table, b)) {
+                    aggregator.summarize(partial, b);
+                    continue;
+                }
+                std::vector<size_t>& rows = buffers[participant];
+                rows.clear();
+                size_t last = std::min(table.rowCount(), (b + 1) * kKimBlockRows);
+                for (size_t row = b * kKimBlockRows; row < last; ++row) {
+                    if (!table.isDeleted(row)) {
+                        rows.push_back(row);
+                    }
+                }
+                aggregator.consume(partial, rows);
+            }
+            if (stats) {
+                partial.nanos += kimNowNanos() - start;
+            }
+        });
+    } else {
+        kimForEachMorsel(
+            table, plan, values, parallelism,
+            [&](size_t participant, const std::vector<size_t>& rows) {
+                Partial& partial = aggregator.partial(participant);
+                uint64_t start = stats ? kimNowNanos() : 0;
+                aggregator.consume(partial, rows);
+                if (stats) {
+                    partial.nanos += kimNowNanos() - start;
+                }
+            },
+            stats);
+    }
+
+    uint64_t mergeStart = stats ? kimNowNanos() : 0;
+    std::vector<std::vector<std::string>> result = aggregator.finish(limit);
+    if (stats) {
+        KimOperatorStats aggregate = aggregateOperator(table, plan, values, summaries);
+        for (size_t p = 0; p < pool.size(); ++p) {
+            const Partial& partial = aggregator.partial(p);
+            aggregate.rowsIn += partial.rows;
+            aggregate.bytesRead += partial.bytes;
+            aggregate.nanos += partial.nanos;
+        }
+        aggregate.nanos += kimNowNanos() - mergeStart;
+        aggregate.rowsOut = result.size();
+        stats->operators.push_back(aggregate);
+        stats->bytesRead += aggregate.bytesRead;
+        if (summaries) {
+            stats->rowsScanned += aggregate.rowsIn;
+        }
+    }
+    return result;
+}
+
+void kimDescribeAggregate(const KimTable& table, const KimQueryPlan& plan, const std::vector<std::string>& values,
+                          std::vector<KimOperatorStats>& operators) {
+    bool summaries = fromSummaries(table, plan);
+    if (!summaries) {
+        kimDescribePlan(table, plan, values, operators);
+    }
+    operators.push_back(aggregateOperator(table, plan, values, summaries));
+}
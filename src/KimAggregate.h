@@ -0,0 +1,34 @@
+//
+// Aggregate functions and GROUP BY for KimTable queries.
+//
+
+#ifndef KIMDB_KIMAGGREGATE_H
+#define KIMDB_KIMAGGREGATE_H
+
+#include "KimQuery.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class KimTable;
+
+// Result rows of a plan with a select list, one per group in the order of
+// each group's first row; without GROUP BY, exactly one row. COUNT counts
+// rows; SUM and AVG of an empty input, and MIN and MAX of one, are empty.
+// SUM of an int column is an int (wrapping on overflow), otherwise a float.
+//
+// Matching rows are consumed a morsel at a time on up to `parallelism`
+// threads. Each thread keeps partial aggregates in its own hash table keyed
+// by the GROUP BY values, updated one column at a time over each batch of
+// rows, and the partial tables are merged once the scan is done. An
+// ungrouped query without WHERE reads each block's summary instead of its
+// rows where the block has no deleted rows and its columns are numeric.
+std::vector<std::vector<std::string>> kimAggregate(const KimTable& table, const KimQueryPlan& plan,
+                                                   const std::vector<std::string>& values, size_t limit,
+                                                   size_t parallelism = 1, KimQueryStats* stats = nullptr);
+// Appends the operators kimAggregate would run, without running them
+void kimDescribeAggregate(const KimTable& table, const KimQueryPlan& plan, const std::vector<std::string>& values,
+                          std::vector<KimOperatorStats>& operators);
+
+#endif //KIMDB_KIMAGGREGATE_H
@@ -0,0 +1,335 @@
+//
+// Ordered B+tree index over one numeric column of a KimTable.
+//
+
+#include "KimBPlusTree.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+// Deeper than any tree this order can build; bounds the walk over a corrupt mapped file.
+static constexpr size_t kMaxDepth = 32;
+
+static bool entryLess(uint64_t keyA, uint64_t rowA, uint64_t keyB, uint64_t rowB) {
+    return keyA < keyB || (keyA == keyB && rowA < rowB);
+}
+
+// Number of entries in `node` that are <= (key, row): the child to descend
+// into for an internal node, the insert position for a leaf.
+static size_t upperBound(const KimTreeNode& node, uint64_t key, uint64_t row) {
+    size_t low = 0;
+    size_t high = node.count;
+    while (low < high) {
+        size_t middle = (low + high) / 2;
+        if (entryLess(key, row, node.keys[middle], node.rows[middle])) {
+            high = middle;
+        } else {
+            low = middle + 1;
+        }
+    }
+    return low;
+}
+
+static size_t lowerBound(const KimTreeNode& node, uint64_t key, uint64_t row) {
+    size_t low = 0;
+    size_t high = node.count;
+    while (low < high) {
+        size_t middle = (low + high) / 2;
+        if (entryLess(node.keys[middle], node.rows[middle], key, row)) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+KimBPlusTree::KimBPlusTree(size_t column) : column(column) {}
+
+void KimBPlusTree::clear() {
+    nodes.clear();
+    mappedNodes = nullptr;
+    nodeCount = 0;
+    root = kKimNoNode;
+    entries = 0;
+}
+
+uint32_t KimBPlusTree::newNode(bool leaf) {
+    KimTreeNode node;
+    std::memset(&node, 0, sizeof(node));
+    node.leaf = leaf ? 1 : 0;
+    node.next = kKimNoNode;
+    nodes.push_back(node);
+    nodeCount = nodes.size();
+    return static_cast<uint32_t>(nodes.size() - 1);
+}
+
+void KimBPlusTree::splitChild(uint32_t parent, size_t childIndex) {
+    uint32_t child = nodes[parent].children[childIndex];
+    uint32_t right = newNode(nodes[child].leaf != 0);
+    KimTreeNode& left = nodes[child];
+    KimTreeNode& sibling = nodes[right];
+    size_t middle = kKimTreeOrder / 2;
+    uint64_t separatorKey;
+    uint64_t separatorRow;
+
+    if (left.leaf) {
+        // Leaves copy their first right-hand entry up as the separator
+        sibling.count = static_cast<uint32_t>(left.count - middle);
+        std::copy(left.keys + middle, left.keys + left.count, sibling.keys);
+        std::copy(left.rows + middle, left.rows + left.count, sibling.rows);
+        left.count = static_cast<uint32_t>(middle);
+        sibling.next = left.next;
+        left.next = right;
+        separatorKey = sibling.keys[0];
+        separatorRow = sibling.rows[0];
+    } else {
+        // Internal nodes move their middle separator up
+        separatorKey = left.keys[middle];
+        separatorRow = left.rows[middle];
+        sibling.count = static_cast<uint32_t>(left.count - middle - 1);
+        std::copy(left.keys + middle + 1, left.keys + left.count, sibling.keys);
+        std::copy(left.rows + middle + 1, left.rows + left.count, sibling.rows);
+        std::copy(left.children + middle + 1, left.children + left.count + 1, sibling.children);
+        left.count = static_cast<uint32_t>(middle);
+    }
+
+    KimTreeNode& node = nodes[parent];
+    std::copy_backward(node.keys + childIndex, node.keys + node.count, node.keys + node.count + 1);
+    std::copy_backward(node.rows + childIndex, node.rows + node.count, node.rows + node.count + 1);
+    std::copy_backward(node.children + childIndex + 1, node.children + node.count + 1,
+                       node.children + node.count + 2);
+    node.keys[childIndex] = separatorKey;
+    node.rows[childIndex] = separatorRow;
+    node.children[childIndex + 1] = right;
+    ++node.count;
+}
+
+void KimBPlusTree::insert(uint64_t key, uint64_t row) {
+    materialize();
+    if (root == kKimNoNode) {
+        root = newNode(true);
+    }
+    if (nodes[root].count == kKimTreeOrder) {
+        uint32_t newRoot = newNode(false);
+        nodes[newRoot].children[0] = root;
+        root = newRoot;
+        splitChild(newRoot, 0);
+    }
+
+    // Full children are split on the way down, so the leaf always has room
+    uint32_t current = root;
+    while (!nodes[current].leaf) {
+        size_t childIndex = upperBound(nodes[current], key, row);
+        uint32_t child = nodes[current].children[childIndex];
+        if (nodes[child].count == kKimTreeOrder) {
+            splitChild(current, childIndex);
+            if (!entryLess(key, row, nodes[current].keys[childIndex], nodes[current].rows[childIndex])) {
+                ++childIndex;
+            }
+            child = nodes[current].children[childIndex];
+        }
+        current = child;
+    }
+
+    KimTreeNode& leaf = nodes[current];
+    size_t position = upperBound(leaf, key, row);
+    std::copy_backward(leaf.keys + position, leaf.keys + leaf.count, leaf.keys + leaf.count + 1);
+    std::copy_backward(leaf.rows + position, leaf.rows + leaf.count, leaf.rows + leaf.count + 1);
+    leaf.keys[position] = key;
+    leaf.rows[position] = row;
+    ++leaf.count;
+    ++entries;
+}
+
+uint32_t KimBPlusTree::findLeaf(uint64_t key, uint64_t row) const {
+    const KimTreeNode* data = nodeData();
+    uint32_t current = root;
+    for (size_t depth = 0; depth < kMaxDepth; ++depth) {
+        if (current >= nodeCount || data[current].count > kKimTreeOrder) {
+            return kKimNoNode;
+        }
+        if (data[current].leaf) {
+            return current;
+        }
+        current = data[current].children[upperBound(data[current], key, row)];
+    }
+    return kKimNoNode;
+}
+
+void KimBPlusTree::erase(uint64_t key, uint64_t row) {
+    uint32_t current = findLeaf(key, row);
+    if (current == kKimNoNode) {
+        return;
+    }
+    materialize();
+    KimTreeNode& leaf = nodes[current];
+    size_t position = lowerBound(leaf, key, row);
+    if (position < leaf.count && leaf.keys[position] == key && leaf.rows[position] == row) {
+        std::copy(leaf.keys + position + 1, leaf.keys + leaf.count, leaf.keys + position);
+        std::copy(leaf.rows + position + 1, leaf.rows + leaf.count, leaf.rows + position);
+        --leaf.count;
+        --entries;
+    }
+}
+
+void KimBPlusTree::range(uint64_t low, uint64_t high, std::vector<size_t>& out, size_t limit) const {
+    if (limit == 0 || low > high) {
+        return;
+    }
+    const KimTreeNode* data = nodeData();
+    uint32_t current = findLeaf(low, 0);
+    size_t found = 0;
+    size_t position = current == kKimNoNode ? 0 : lowerBound(data[current], low, 0);
+
+    // The leaf chain is walked at most once; a corrupt chain cannot loop forever
+    for (size_t visited = 0; current != kKimNoNode && visited < nodeCount; ++visited) {
+        const KimTreeNode& leaf = data[current];
+        if (current >= nodeCount || !leaf.leaf || leaf.count > kKimTreeOrder) {
+            return;
+        }
+        for (; position < leaf.count; ++position) {
+            if (leaf.keys[position] > high) {
+                return;
+            }
+            out.push_back(leaf.rows[position]);
+            if (++found == limit) {
+                return;
+            }
+        }
+        current = leaf.next;
+        position = 0;
+    }
+}
+
+void KimBPlusTree::walk(uint64_t low, uint64_t high, bool descending,
+                        const std::function<bool(size_t)>& visit) const {
+    if (root != kKimNoNode && low <= high) {
+        walkNode(root, 0, low, high, descending, visit);
+    }
+}
+
+bool KimBPlusTree::walkNode(uint32_t node, size_t depth, uint64_t low, uint64_t high, bool descending,
+                            const std::function<bool(size_t)>& visit) const {
+    const KimTreeNode* data = nodeData();
+    if (node >= nodeCount || depth >= kMaxDepth || data[node].count > kKimTreeOrder) {
+        return true;
+    }
+    const KimTreeNode& current = data[node];
+    if (current.leaf) {
+        for (size_t i = 0; i < current.count; ++i) {
+            size_t position = descending ? current.count - 1 - i : i;
+            uint64_t key = current.keys[position];
+            if (key >= low && key <= high && !visit(current.rows[position])) {
+                return false;
+            }
+        }
+        return true;
+    }
+    // Child i holds the entries from separator i - 1 up to separator i
+    for (size_t i = 0; i <= current.count; ++i) {
+        size_t child = descending ? current.count - i : i;
+        bool belowLow = child < current.count && current.keys[child] < low;
+        bool aboveHigh = child > 0 && current.keys[child - 1] > high;
+        if (!belowLow && !aboveHigh &&
+            !walkNode(current.children[child], depth + 1, low, high, descending, visit)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void KimBPlusTree::build(const KimColumn& values, const std::vector<uint64_t>& deleted) {
+    clear();
+    std::vector<std::pair<uint64_t, uint64_t>> sorted;
+    sorted.reserve(values.size());
+    for (size_t row = 0; row < values.size(); ++row) {
+        if (!kimIsDeleted(deleted, row)) {
+            sorted.emplace_back(values.orderedKey(row), row);
+        }
+    }
+    std::sort(sorted.begin(), sorted.end());
+    if (sorted.empty()) {
+        return;
+    }
+
+    // Pack the sorted entries into full leaves, then stack internal levels on
+    // top of them, spreading children evenly across each level
+    std::vector<uint32_t> level;
+    for (size_t begin = 0; begin < sorted.size(); begin += kKimTreeOrder) {
+        uint32_t leaf = newNode(true);
+        size_t end = std::min(sorted.size(), begin + kKimTreeOrder);
+        for (size_t i = begin; i < end; ++i) {
+            nodes[leaf].keys[i - begin] = sorted[i].first;
+            nodes[leaf].rows[i - begin] = sorted[i].second;
+        }
+        nodes[leaf].count = static_cast<uint32_t>(end - begin);
+        if (!level.empty()) {
+            nodes[level.back()].next = leaf;
+        }
+        level.push_back(leaf);
+    }
+    entries = sorted.size();
+
+    std::vector<uint32_t> firstOf(level.begin(), level.end()); // leaf holding each subtree's first entry
+    while (level.size() > 1) {
+        size_t parents = (level.size() + kKimTreeOrder) / (kKimTreeOrder + 1);
+        std::vector<uint32_t> nextLevel;
+        std::vector<uint32_t> nextFirst;
+        size_t child = 0;
+        for (size_t p = 0; p < parents; ++p) {
+            size_t take = (level.size() - child) / (parents - p);
+            uint32_t parent = newNode(false);
+            for (size_t i = 0; i < take; ++i, ++child) {
+                nodes[parent].children[i] = level[child];
+                if (i > 0) {
+                    const KimTreeNode& first = nodes[firstOf[child]];
+                    nodes[parent].keys[i - 1] = first.keys[0];
+                    nodes[parent].rows[i - 1] = first.rows[0];
+                }
+            }
+            nodes[parent].count = static_cast<uint32_t>(take - 1);
+            nextLevel.push_back(parent);
+            nextFirst.push_back(firstOf[child - take]);
+        }
+        level.swap(nextLevel);
+        firstOf.swap(nextFirst);
+    }
+    root = level.front();
+}
+
+uint64_t KimBPlusTree::serializedSize() const {
+    return 3 * sizeof(uint64_t) + nodeCount * sizeof(KimTreeNode);
+}
+
+void KimBPlusTree::write(std::ostream& os) const {
+    uint64_t counts[3] = {nodeCount, root, entries};
+    os.write(reinterpret_cast<const char*>(counts), sizeof(counts));
+    os.write(reinterpret_cast<const char*>(nodeData()), static_cast<std::streamsize>(nodeCount * sizeof(KimTreeNode)));
+}
+
+bool KimBPlusTree::map(const char* section, size_t available) {
+    uint64_t counts[3];
+    if (available < sizeof(counts)) {
+        return false;
+    }
+    std::memcpy(counts, section, sizeof(counts));
+    if (counts[0] > (available - sizeof(counts)) / sizeof(KimTreeNode) || counts[0] >= kKimNoNode ||
+        (counts[0] == 0 ? counts[1] != kKimNoNode : counts[1] >= counts[0])) {
+        return false;
+    }
+    clear();
+    nodeCount = counts[0];
+    root = static_cast<uint32_t>(counts[1]);
+    entries = counts[2];
+    mappedNodes = nodeCount ? reinterpret_cast<const KimTreeNode*>(section + sizeof(counts)) : nullptr;
+    return true;
+}
+
+void KimBPlusTree::materialize() {
+    if (mappedNodes) {
+        nodes.assign(mappedNodes, mappedNodes + nodeCount);
+        mappedNodes = nullptr;
+    }
+}
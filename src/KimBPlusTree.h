@@ -0,0 +1,81 @@
+//
+// Ordered B+tree index over one numeric column of a KimTable.
+//
+
+#ifndef KIMDB_KIMBPLUSTREE_H
+#define KIMDB_KIMBPLUSTREE_H
+
+#include "KimColumnStore.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <vector>
+
+// Entries per node. Nodes are fixed-size records addressed by index, which is
+// what lets the whole tree be written out and mapped back as one array.
+constexpr size_t kKimTreeOrder = 64;
+
+struct KimTreeNode {
+    uint32_t leaf;
+    uint32_t count;
+    uint32_t next; // right sibling of a leaf, kKimNoNode at the end of the chain
+    uint32_t reserved;
+    uint64_t keys[kKimTreeOrder];
+    uint64_t rows[kKimTreeOrder];
+    uint32_t children[kKimTreeOrder + 1];
+    uint32_t padding;
+};
+
+constexpr uint32_t kKimNoNode = UINT32_MAX;
+
+// Entries are (orderedKey, row) pairs kept in that order, so duplicate keys
+// are allowed and every entry can be located exactly for deletion. Internal
+// nodes hold the first entry of each right-hand subtree as separator.
+// Deletion removes entries from their leaf without merging nodes; the tree
+// stays valid and a later rebuild restores full occupancy.
+class KimBPlusTree {
+public:
+    explicit KimBPlusTree(size_t column);
+
+    size_t column;
+
+    size_t size() const { return entries; }
+    void clear();
+    // Indexes every row not marked in the tombstone bitmap `deleted`
+    void build(const KimColumn& values, const std::vector<uint64_t>& deleted = {});
+    void insert(uint64_t key, uint64_t row);
+    void erase(uint64_t key, uint64_t row);
+
+    // Appends the rows whose key lies in [low, high], in key order.
+    void range(uint64_t low, uint64_t high, std::vector<size_t>& out, size_t limit = SIZE_MAX) const;
+    // Calls visit(row) for the entries whose key lies in [low, high], in
+    // (key, row) order or, when `descending`, the reverse, until visit
+    // returns false. Subtrees outside the bounds are not entered.
+    void walk(uint64_t low, uint64_t high, bool descending, const std::function<bool(size_t)>& visit) const;
+
+    // Tree section of a version 5 file: node count, root, entry count and
+    // the node array, which can be searched in place when mapped.
+    uint64_t serializedSize() const;
+    void write(std::ostream& os) const;
+    bool map(const char* section, size_t available);
+    void materialize();
+
+private:
+    std::vector<KimTreeNode> nodes;
+    const KimTreeNode* mappedNodes = nullptr;
+    size_t nodeCount = 0;
+    uint32_t root = kKimNoNode;
+    size_t entries = 0;
+
+    const KimTreeNode* nodeData() const { return mappedNodes ? mappedNodes : nodes.data(); }
+    uint32_t newNode(bool leaf);
+    void splitChild(uint32_t parent, size_t childIndex);
+    uint32_t findLeaf(uint64_t key, uint64_t row) const;
+    // False once visit has asked to stop
+    bool walkNode(uint32_t node, size_t depth, uint64_t low, uint64_t high, bool descending,
+                  const std::function<bool(size_t)>& visit) const;
+};
+
+#endif //KIMDB_KIMBPLUSTREE_H
@@ -0,0 +1,250 @@
+//
+// Bounded cache of column blocks read on demand from .kim files.
+//
+
+#include "KimBufferPool.h"
+#include "KimMetrics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static std::atomic<uint64_t> nextFileId{1};
+
+KimPagedFile::KimPagedFile() : fileId(nextFileId.fetch_add(1)) {}
+
+KimPagedFile::~KimPagedFile() {
+    close();
+}
+
+#ifdef _WIN32
+
+bool KimPagedFile::open(const std::string& fileName) {
+    close();
+    HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    LARGE_INTEGER fileSize;
+    if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize)) {
+        std::cerr << "Failed to open file: " << fileName << std::endl;
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+        }
+        return false;
+    }
+    handle = file;
+    length = static_cast<uint64_t>(fileSize.QuadPart);
+    return true;
+}
+
+void KimPagedFile::close() {
+    if (handle) {
+        CloseHandle(handle);
+        kimBufferPool().forget(fileId);
+    }
+    handle = nullptr;
+    length = 0;
+}
+
+bool KimPagedFile::read(uint64_t offset, void* out, size_t bytes) const {
+    char* position = static_cast<char*>(out);
+    while (bytes > 0) {
+        OVERLAPPED overlapped{};
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD chunk = static_cast<DWORD>(std::min<size_t>(bytes, 1u << 30));
+        DWORD got = 0;
+        if (!ReadFile(handle, position, chunk, &got, &overlapped) || got == 0) {
+            return false;
+        }
+        position += got;
+        offset += got;
+        bytes -= got;
+    }
+    return true;
+}
+
+#else
+
+bool KimPagedFile::open(const std::string& fileName) {
+    close();
+    int file = ::open(fileName.c_str(), O_RDONLY);
+    struct stat info{};
+    if (file < 0 || fstat(file, &info) != 0) {
+        std::cerr << "Failed to open file: " << fileName << std::endl;
+        if (file >= 0) {
+            ::close(file);
+        }
+        return false;
+    }
+    fd = file;
+    length = static_cast<uint64_t>(info.st_size);
+    return true;
+}
+
+void KimPagedFile::close() {
+    if (fd >= 0) {
+        ::close(fd);
+        kimBufferPool().forget(fileId);
+    }
+    fd = -1;
+    length = 0;
+}
+
+bool KimPagedFile::read(uint64_t offset, void* out, size_t bytes) const {
+    char* position = static_cast<char*>(out);
+    while (bytes > 0) {
+        ssize_t got = pread(fd, position, bytes, static_cast<off_t>(offset));
+        if (got <= 0) {
+            return false;
+        }
+        position += got;
+        offset += static_cast<uint64_t>(got);
+        bytes -= static_cast<size_t>(got);
+    }
+    return true;
+}
+
+#endif
+
+size_t KimBufferPool::KeyHash::operator()(const KimPageKey& key) const {
+    uint64_t value = key.offset * 0x9e3779b97f4a7c15ULL ^ key.file;
+    return static_cast<size_t>(value ^ value >> 29);
+}
+
+namespace {
+
+struct KimPoolMetrics {
+    KimCounter& hits = kimMetrics().counter("kimdb_buffer_pool_hits_total", "Blocks found in the buffer pool");
+    KimCounter& misses = kimMetrics().counter("kimdb_buffer_pool_misses_total", "Blocks read from disk");
+    KimCounter& evictions = kimMetrics().counter("kimdb_buffer_pool_evictions_total", "Blocks evicted");
+};
+
+KimPoolMetrics& poolMetrics() {
+    static KimPoolMetrics metrics;
+    return metrics;
+}
+
+} // namespace
+
+size_t KimBufferPool::budget() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return limit;
+}
+
+void KimBufferPool::setBudget(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    limit = bytes;
+    makeRoom(0);
+}
+
+KimBufferPool::Page KimBufferPool::find(const KimPageKey& key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = lookup.find(key);
+    if (it == lookup.end()) {
+        return nullptr;
+    }
+    Frame& frame = frames[it->second];
+    frame.referenced = true;
+    ++counts.hits;
+    if (kimMetrics().enabled()) {
+        poolMetrics().hits.add();
+    }
+    return frame.page;
+}
+
+KimBufferPool::Page KimBufferPool::insert(const KimPageKey& key, Page page, size_t bytes, bool readAhead) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = lookup.find(key);
+    if (it != lookup.end()) {
+        frames[it->second].referenced = true;
+        return frames[it->second].page;
+    }
+    makeRoom(bytes);
+    size_t frame;
+    if (freeFrames.empty()) {
+        frame = frames.size();
+        frames.emplace_back();
+    } else {
+        frame = freeFrames.back();
+        freeFrames.pop_back();
+    }
+    // A page read ahead has not been used yet, so it is the first to go
+    frames[frame] = {key, page, bytes, !readAhead};
+    lookup.emplace(key, frame);
+    resident += bytes;
+    ++(readAhead ? counts.readAhead : counts.misses);
+    if (!readAhead && kimMetrics().enabled()) {
+        poolMetrics().misses.add();
+    }
+    return page;
+}
+
+void KimBufferPool::forget(uint64_t file) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t frame = 0; frame < frames.size(); ++frame) {
+        if (frames[frame].page && frames[frame].key.file == file) {
+            release(frame);
+        }
+    }
+}
+
+void KimBufferPool::release(size_t frame) {
+    Frame& victim = frames[frame];
+    lookup.erase(victim.key);
+    resident -= victim.bytes;
+    victim = Frame();
+    freeFrames.push_back(frame);
+}
+
+void KimBufferPool::makeRoom(size_t incoming) {
+    // Two sweeps clear every reference bit, so a third finding nothing means
+    // every page left is pinned
+    size_t steps = 0;
+    uint64_t evicted = 0;
+    while (resident + incoming > limit && resident > 0 && steps < 2 * frames.size() + 1) {
+        hand = hand < frames.size() ? hand : 0;
+        Frame& frame = frames[hand];
+        // The pool holds one reference; any other is a pin
+        if (frame.page && frame.page.use_count() == 1) {
+            if (frame.referenced) {
+                frame.referenced = false;
+            } else {
+                release(hand);
+                ++evicted;
+                steps = 0;
+            }
+        }
+        ++hand;
+        ++steps;
+    }
+    counts.evictions += evicted;
+    if (evicted && kimMetrics().enabled()) {
+        poolMetrics().evictions.add(evicted);
+    }
+}
+
+KimBufferPoolStats KimBufferPool::stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    KimBufferPoolStats current = counts;
+    current.residentBytes = resident;
+    current.pages = lookup.size();
+    return current;
+}
+
+void KimBufferPool::resetStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    counts = KimBufferPoolStats();
+}
+
+KimBufferPool& kimBufferPool() {
+    static KimBufferPool pool;
+    return pool;
+}
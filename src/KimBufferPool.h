@@ -0,0 +1,117 @@
+//
+// Bounded cache of column blocks read on demand from .kim files.
+//
+
+#ifndef KIMDB_KIMBUFFERPOOL_H
+#define KIMDB_KIMBUFFERPOOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct KimColumnBlock;
+
+// A file read with positioned reads, so many threads can read it at once.
+// Its column blocks are cached by kimBufferPool(), which drops them when the
+// file is closed.
+class KimPagedFile {
+public:
+    KimPagedFile();
+    ~KimPagedFile();
+    KimPagedFile(const KimPagedFile&) = delete;
+    KimPagedFile& operator=(const KimPagedFile&) = delete;
+
+    bool open(const std::string& fileName);
+    void close();
+
+    // Names the file's pages in the pool; never reused by another file
+    uint64_t id() const { return fileId; }
+    uint64_t size() const { return length; }
+    bool read(uint64_t offset, void* out, size_t bytes) const;
+
+private:
+    uint64_t fileId;
+    uint64_t length = 0;
+#ifdef _WIN32
+    void* handle = nullptr;
+#else
+    int fd = -1;
+#endif
+};
+
+struct KimPageKey {
+    uint64_t file; // KimPagedFile::id
+    uint64_t offset; // of the block in the file
+
+    bool operator==(const KimPageKey& other) const { return file == other.file && offset == other.offset; }
+};
+
+struct KimBufferPoolStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    uint64_t readAhead = 0; // pages read ahead of a sequential scan
+    size_t residentBytes = 0;
+    size_t pages = 0;
+};
+
+// Pages are column blocks, each charged its size on disk plus the size of the
+// decoded copy an encoded block may get. A page is pinned for as long as a
+// pointer returned by find or insert lives, and pinned pages are never
+// evicted. Once the pages exceed the budget, a CLOCK hand sweeps the frames:
+// a page used since the hand last passed gets a second chance, and the first
+// unpinned one that was not is evicted. Pinned pages may take the pool over
+// its budget, which it returns to as they are unpinned.
+class KimBufferPool {
+public:
+    using Page = std::shared_ptr<const KimColumnBlock>;
+    static constexpr size_t kDefaultBudget = size_t(256) << 20;
+
+    size_t budget() const;
+    // Evicts down to the new budget as far as pins allow
+    void setBudget(size_t bytes);
+
+    // The resident page for key, or null
+    Page find(const KimPageKey& key);
+    // Makes page resident under key; returns the resident page, which is
+    // another thread's when that one inserted the key first
+    Page insert(const KimPageKey& key, Page page, size_t bytes, bool readAhead = false);
+    // Drops every page of a file
+    void forget(uint64_t file);
+
+    KimBufferPoolStats stats() const;
+    void resetStats();
+
+private:
+    struct Frame {
+        KimPageKey key{};
+        Page page; // null for a free frame
+        size_t bytes = 0;
+        bool referenced = false;
+    };
+    struct KeyHash {
+        size_t operator()(const KimPageKey& key) const;
+    };
+
+    mutable std::mutex mutex;
+    size_t limit = kDefaultBudget;
+    size_t resident = 0;
+    std::vector<Frame> frames;
+    std::vector<size_t> freeFrames;
+    std::unordered_map<KimPageKey, size_t, KeyHash> lookup;
+    size_t hand = 0;
+    KimBufferPoolStats counts;
+
+    // Evicts until `incoming` more bytes fit or every page left is pinned
+    void makeRoom(size_t incoming);
+    void release(size_t frame);
+};
+
+// Process-wide pool that paged tables read through.
+KimBufferPool& kimBufferPool();
+
+#endif //KIMDB_KIMBUFFERPOOL_H
@@ -0,0 +1,121 @@
+//
+// Parallel loading of CSV and TSV files into a KimTable.
+//
+
+#include "KimBulkLoad.h"
+#include "KimThreadPool.h"
+
+#include <algorithm>
+#include <cstring>
+
+std::vector<size_t> kimRecordBoundaries(const char* data, size_t size, size_t parts, size_t parallelism) {
+    parts = std::max<size_t>(1, std::min(parts, size));
+    size_t step = size / parts;
+    auto partStart = [&](size_t part) { return part == parts ? size : part * step; };
+
+    // quotes[part] counts the quotes before the part's nominal start
+    std::vector<size_t> quotes(parts + 1, 0);
+    kimThreadPool().run(parts, parallelism, [&](size_t, size_t part) {
+        quotes[part + 1] = std::count(data + partStart(part), data + partStart(part + 1), '"');
+    });
+    for (size_t part = 1; part <= parts; ++part) {
+        quotes[part] += quotes[part - 1];
+    }
+
+    std::vector<size_t> bounds(parts + 1, size);
+    bounds[0] = 0;
+    kimThreadPool().run(parts - 1, parallelism, [&](size_t, size_t index) {
+        size_t part = index + 1;
+        bool quoted = quotes[part] % 2 != 0;
+        for (size_t i = partStart(part); i < size; ++i) {
+            if (data[i] == '"') {
+                quoted = !quoted;
+            } else if (data[i] == '\n' && !quoted) {
+                bounds[part] = i + 1;
+                return;
+            }
+        }
+    });
+    // A record longer than a part leaves the boundaries after it out of order
+    for (size_t part = 1; part <= parts; ++part) {
+        bounds[part] = std::max(bounds[part], bounds[part - 1]);
+    }
+    return bounds;
+}
+
+// Reads the field at p into `field` and returns the position after it and its
+// delimiter; `last` is set when the field ends the record.
+static const char* readField(const char* p, const char* end, char delimiter, std::string& field, bool& last) {
+    field.clear();
+    if (p < end && *p == '"') {
+        ++p;
+        while (p < end) {
+            const char* quote = static_cast<const char*>(std::memchr(p, '"', end - p));
+            if (!quote) {
+                field.append(p, end);
+                p = end;
+                break;
+            }
+            field.append(p, quote);
+            p = quote + 1;
+            if (p == end || *p != '"') {
+                break;
+            }
+            field.push_back('"');
+            ++p;
+        }
+    }
+
+    // Unquoted text, or whatever follows a closing quote, runs to the delimiter
+    const char* stop = p;
+    while (stop < end && *stop != delimiter && *stop != '\n') {
+        ++stop;
+    }
+    last = stop == end || *stop == '\n';
+    const char* text = stop;
+    if (last && text > p && text[-1] == '\r') {
+        --text;
+    }
+    field.append(p, text);
+    return stop == end ? end : stop + 1;
+}
+
+size_t kimParseRecords(const char* begin, const char* end, char delimiter, std::vector<KimColumn>& columns,
+                       size_t& rejected) {
+    std::string field;
+    size_t appended = 0;
+    const char* p = begin;
+    while (p < end) {
+        if (*p == '\n') {
+            ++p;
+            continue;
+        }
+        if (*p == '\r' && p + 1 < end && p[1] == '\n') {
+            p += 2;
+            continue;
+        }
+
+        // Each field goes straight into its column; a record that turns out
+        // not to fit is taken back out
+        size_t filled = 0;
+        bool valid = true;
+        bool last = false;
+        while (!last) {
+            p = readField(p, end, delimiter, field, last);
+            if (valid && filled < columns.size() && columns[filled].append(field)) {
+                ++filled;
+            } else {
+                valid = false;
+            }
+        }
+        if (valid && filled == columns.size()) {
+            ++appended;
+            continue;
+        }
+        for (size_t i = 0; i < filled; ++i) {
+            columns[i].erase(columns[i].size() - 1);
+        }
+        ++rejected;
+    }
+    return appended;
+}
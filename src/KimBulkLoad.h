@@ -0,0 +1,35 @@
+//
+// Parallel loading of CSV and TSV files into a KimTable.
+//
+
+#ifndef KIMDB_KIMBULKLOAD_H
+#define KIMDB_KIMBULKLOAD_H
+
+#include "KimColumnStore.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+struct KimLoadOptions {
+    char delimiter = 0; // 0 picks a tab for .tsv and .tab files, else a comma
+    bool header = false; // the first record names the columns and is skipped
+    size_t parallelism = 0; // parsing threads, 0 for every core
+};
+
+// Record boundaries that split [data, data + size) into at most `parts`
+// chunks, returned as parts + 1 ascending offsets. A newline ends a record
+// unless an odd number of quotes precedes it, so the quotes of each part are
+// counted in parallel first and a boundary is the first newline after the
+// nominal split point with an even count before it.
+std::vector<size_t> kimRecordBoundaries(const char* data, size_t size, size_t parts, size_t parallelism);
+
+// Parses the records of [begin, end) into `columns`, one field per column.
+// A field may be quoted, with "" standing for a quote; \r\n ends a record
+// as well as \n, and empty lines are skipped. Records whose field count or
+// values do not fit the columns are left out and counted in `rejected`.
+// Returns the number of records appended.
+size_t kimParseRecords(const char* begin, const char* end, char delimiter, std::vector<KimColumn>& columns,
+                       size_t& rejected);
+
+#endif //KIMDB_KIMBULKLOAD_H
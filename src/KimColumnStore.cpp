@@ -0,0 +1,1870 @@
+//
+// Column-major storage used by KimTable.
+//
+
+#include "KimColumnStore.h"
+#include "KimCompression.h"
+#include "KimSimd.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <limits>
+
+bool kimParseInt(const std::string& text, int64_t& out) {
+    const char* first = text.data();
+    const char* last = first + text.size();
+    if (first != last && *first == '+') {
+        ++first;
+    }
+    auto result = std::from_chars(first, last, out);
+    return first != last && result.ec == std::errc() && result.ptr == last;
+}
+
+bool kimParseFloat(const std::string& text, double& out) {
+    const char* first = text.data();
+    const char* last = first + text.size();
+    if (first != last && *first == '+') {
+        ++first;
+    }
+    auto result = std::from_chars(first, last, out);
+    return first != last && result.ec == std::errc() && result.ptr == last;
+}
+
+std::string kimFormatFloat(double value) {
+    char buffer[32];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    return std::string(buffer, result.ptr);
+}
+
+// The only reference to `shared`, copying what it points to when other
+// owners remain. A count of one means every other owner has let go, and the
+// fence orders their last reads before the caller's writes.
+template <typename T>
+static T& unshare(std::shared_ptr<T>& shared) {
+    if (shared.use_count() != 1) {
+        shared = std::make_shared<T>(*shared);
+    } else {
+        std::atomic_thread_fence(std::memory_order_acquire);
+    }
+    return *shared;
+}
+
+static std::string formatFloat32(float value) {
+    char buffer[32];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    return std::string(buffer, result.ptr);
+}
+
+KimColumn::KimColumn(uint8_t dataType, uint16_t dataSize) {
+    switch (static_cast<KimDataType>(dataType)) {
+        case KimDataType::Int:
+            kind = dataSize == 4 ? KimStorageKind::Int32 : KimStorageKind::Int64;
+            break;
+        case KimDataType::Float:
+            kind = dataSize == 4 ? KimStorageKind::Float32 : KimStorageKind::Float64;
+            break;
+        case KimDataType::FixedString:
+            kind = dataSize > 0 ? KimStorageKind::FixedString : KimStorageKind::String;
+            break;
+        case KimDataType::Dictionary:
+            kind = KimStorageKind::Dictionary;
+            dictionary = std::make_shared<KimDictionary>();
+            break;
+        default:
+            kind = KimStorageKind::String;
+            break;
+    }
+
+    switch (kind) {
+        case KimStorageKind::Int32:
+        case KimStorageKind::Float32:
+        case KimStorageKind::Dictionary:
+            width = 4;
+            break;
+        case KimStorageKind::Int64:
+        case KimStorageKind::Float64:
+            width = 8;
+            break;
+        case KimStorageKind::FixedString:
+            width = dataSize;
+            break;
+        default:
+            width = 0;
+            break;
+    }
+}
+
+bool KimColumn::encode(const std::string& value, char* out) const {
+    switch (kind) {
+        case KimStorageKind::Int32: {
+            int64_t parsed;
+            if (!kimParseInt(value, parsed) || parsed < std::numeric_limits<int32_t>::min() ||
+                parsed > std::numeric_limits<int32_t>::max()) {
+                return false;
+            }
+            int32_t narrowed = static_cast<int32_t>(parsed);
+            std::memcpy(out, &narrowed, sizeof(narrowed));
+            return true;
+        }
+        case KimStorageKind::Int64: {
+            int64_t parsed;
+            if (!kimParseInt(value, parsed)) {
+                return false;
+            }
+            std::memcpy(out, &parsed, sizeof(parsed));
+            return true;
+        }
+        case KimStorageKind::Float32: {
+            double parsed;
+            if (!kimParseFloat(value, parsed)) {
+                return false;
+            }
+            float narrowed = static_cast<float>(parsed) + 0.0f; // fold -0 into 0 so equal values share bytes
+            std::memcpy(out, &narrowed, sizeof(narrowed));
+            return true;
+        }
+        case KimStorageKind::Float64: {
+            double parsed;
+            if (!kimParseFloat(value, parsed)) {
+                return false;
+            }
+            parsed += 0.0; // fold -0 into 0 so equal values share bytes
+            std::memcpy(out, &parsed, sizeof(parsed));
+            return true;
+        }
+        case KimStorageKind::FixedString: {
+            if (!accepts(value)) {
+                return false;
+            }
+            std::memcpy(out, value.data(), value.size());
+            std::memset(out + value.size(), 0, width - value.size());
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+bool KimColumn::accepts(const std::string& value) const {
+    if (kind == KimStorageKind::String) {
+        return value.size() <= std::numeric_limits<uint32_t>::max();
+    }
+    if (kind == KimStorageKind::Dictionary) {
+        uint32_t code;
+        return !dictionary->full() || dictionary->find(value, code);
+    }
+    if (kind == KimStorageKind::FixedString) {
+        // A NUL would be indistinguishable from the padding
+        return value.size() <= width && value.find('\0') == std::string::npos;
+    }
+    char scratch[8];
+    return encode(value, scratch);
+}
+
+bool KimColumn::encodeKey(const std::string& value, std::string& key) const {
+    if (!isNumeric()) {
+        key = value;
+        return accepts(value);
+    }
+    char encoded[8];
+    if (!encode(value, encoded)) {
+        return false;
+    }
+    key.assign(encoded, width);
+    return true;
+}
+
+KimColumnBlock& KimColumn::tailBlock() {
+    if (blocks.empty() || blocks.back()->count == kKimBlockRows) {
+        auto block = std::make_shared<KimColumnBlock>();
+        block->zoneMin = UINT64_MAX;
+        block->zoneMax = 0;
+        if (kind == KimStorageKind::String) {
+            block->offsets.reserve(kKimBlockRows + 1);
+            block->offsets.push_back(0);
+        } else {
+            block->values.reserve(kKimBlockRows * width);
+        }
+        blocks.push_back(std::move(block));
+    }
+    return ownBlock(blocks.size() - 1);
+}
+
+KimColumnBlock& KimColumn::ownBlock(size_t b) {
+    KimColumnBlock& block = unshare(blocks[b]);
+    block.distinct = 0;
+    return block;
+}
+
+uint32_t KimColumn::intern(std::string_view value) {
+    // Values already stored leave a shared dictionary as it is
+    uint32_t code;
+    if (dictionary->find(value, code)) {
+        return code;
+    }
+    return unshare(dictionary).intern(value);
+}
+
+// Paged blocks a thread read last stay pinned, so that references and views
+// into them outlive the call that read them
+constexpr size_t kKimRecentPins = 8;
+// Blocks read ahead of a sequential scan on a miss
+constexpr size_t kKimReadAheadBlocks = 4;
+
+const KimColumnBlock& KimColumn::plainBlock(size_t b) const {
+    KimBlockPin pin;
+    const KimColumnBlock& block = storedBlock(b, pin);
+    if (pin) {
+        thread_local KimBlockPin recent[kKimRecentPins];
+        thread_local size_t next = 0;
+        recent[next++ % kKimRecentPins] = std::move(pin);
+    }
+    return plainCopy(block);
+}
+
+const KimColumnBlock& KimColumn::plainCopy(const KimColumnBlock& block) const {
+    if (!block.isEncoded()) {
+        return block;
+    }
+    // Readers may race to decode; the first copy stored is the one kept
+    std::shared_ptr<const KimColumnBlock> decoded = std::atomic_load(&block.decoded);
+    if (!decoded) {
+        auto fresh = std::make_shared<KimColumnBlock>();
+        decodeBlock(block, *fresh);
+        std::shared_ptr<const KimColumnBlock> expected;
+        decoded = fresh;
+        if (!std::atomic_compare_exchange_strong(&block.decoded, &expected, decoded)) {
+            decoded = expected;
+        }
+    }
+    return *decoded;
+}
+
+const KimColumnBlock& KimColumn::storedBlock(size_t b, KimBlockPin& pin) const {
+    const KimColumnBlock& block = *blocks[b];
+    if (!block.isPaged()) {
+        return block;
+    }
+    pin = readPage(b);
+    return *pin;
+}
+
+KimBlockPin KimColumn::pinBlock(size_t b) const {
+    return blocks[b]->isPaged() ? readPage(b) : nullptr;
+}
+
+std::string_view KimColumn::rawAt(size_t row) const {
+    return rawAt(plainBlock(row / kKimBlockRows), row % kKimBlockRows);
+}
+
+std::string_view KimColumn::rawAt(const KimColumnBlock& block, size_t index) const {
+    if (kind == KimStorageKind::String) {
+        const uint32_t* offsets = block.offsetData();
+        return std::string_view(block.byteData() + offsets[index], offsets[index + 1] - offsets[index]);
+    }
+    return std::string_view(block.valueData() + index * width, width);
+}
+
+void KimColumn::pushRaw(KimColumnBlock& block, std::string_view raw) const {
+    widenZone(block, raw);
+    if (kind == KimStorageKind::String) {
+        block.bytes.insert(block.bytes.end(), raw.begin(), raw.end());
+        block.offsets.push_back(static_cast<uint32_t>(block.bytes.size()));
+    } else {
+        block.values.insert(block.values.end(), raw.begin(), raw.end());
+    }
+    ++block.count;
+}
+
+void KimColumn::removeAt(KimColumnBlock& block, size_t index) const {
+    if (kind == KimStorageKind::String) {
+        uint32_t begin = block.offsets[index];
+        uint32_t length = block.offsets[index + 1] - begin;
+        block.bytes.erase(block.bytes.begin() + begin, block.bytes.begin() + begin + length);
+        block.offsets.erase(block.offsets.begin() + index + 1);
+        for (size_t i = index + 1; i < block.offsets.size(); ++i) {
+            block.offsets[i] -= length;
+        }
+    } else {
+        block.values.erase(block.values.begin() + index * width,
+                           block.values.begin() + (index + 1) * width);
+    }
+    --block.count;
+}
+
+bool KimColumn::append(const std::string& value) {
+    if (kind == KimStorageKind::Dictionary) {
+        if (!accepts(value)) {
+            return false;
+        }
+        uint32_t code = intern(value);
+        pushRaw(tailBlock(), std::string_view(reinterpret_cast<const char*>(&code), sizeof(code)));
+    } else if (kind == KimStorageKind::String) {
+        if (!accepts(value)) {
+            return false;
+        }
+        pushRaw(tailBlock(), value);
+    } else if (kind == KimStorageKind::FixedString) {
+        if (!accepts(value)) {
+            return false;
+        }
+        KimColumnBlock& block = tailBlock();
+        block.values.resize(block.values.size() + width);
+        encode(value, block.values.data() + block.values.size() - width);
+        widenZone(block, std::string_view(block.values.data() + block.values.size() - width, width));
+        ++block.count;
+    } else {
+        char encoded[8];
+        if (!encode(value, encoded)) {
+            return false;
+        }
+        pushRaw(tailBlock(), std::string_view(encoded, width));
+    }
+    ++numRows;
+    return true;
+}
+
+bool KimColumn::set(size_t row, const std::string& value) {
+    if (kind == KimStorageKind::Dictionary) {
+        if (!accepts(value)) {
+            return false;
+        }
+        uint32_t code = intern(value);
+        setRaw(row, std::string_view(reinterpret_cast<const char*>(&code), sizeof(code)));
+        return true;
+    }
+    if (kind != KimStorageKind::String) {
+        // Encoded aside, so a rejected value does not copy a shared block
+        std::string encoded(width, '\0');
+        if (!encode(value, &encoded[0])) {
+            return false;
+        }
+        setRaw(row, encoded);
+        return true;
+    }
+    if (!accepts(value)) {
+        return false;
+    }
+    setRaw(row, value);
+    return true;
+}
+
+void KimColumn::setRaw(size_t row, std::string_view raw) {
+    KimColumnBlock& block = ownBlock(row / kKimBlockRows);
+    size_t index = row % kKimBlockRows;
+    widenZone(block, raw);
+    if (kind != KimStorageKind::String) {
+        std::memcpy(block.values.data() + index * width, raw.data(), width);
+        return;
+    }
+
+    uint32_t begin = block.offsets[index];
+    uint32_t oldLength = block.offsets[index + 1] - begin;
+    block.bytes.erase(block.bytes.begin() + begin, block.bytes.begin() + begin + oldLength);
+    block.bytes.insert(block.bytes.begin() + begin, raw.begin(), raw.end());
+    int64_t delta = static_cast<int64_t>(raw.size()) - oldLength;
+    for (size_t i = index + 1; i < block.offsets.size(); ++i) {
+        block.offsets[i] = static_cast<uint32_t>(block.offsets[i] + delta);
+    }
+}
+
+void KimColumn::appendFrom(const KimColumn& source, size_t sourceRow) {
+    if (kind == KimStorageKind::Dictionary) {
+        // Codes belong to the source's dictionary, so the value is interned again
+        uint32_t code = intern(source.getView(sourceRow));
+        pushRaw(tailBlock(), std::string_view(reinterpret_cast<const char*>(&code), sizeof(code)));
+    } else {
+        pushRaw(tailBlock(), source.rawAt(sourceRow));
+    }
+    ++numRows;
+}
+
+void KimColumn::setFrom(size_t row, const KimColumn& source, size_t sourceRow) {
+    if (kind == KimStorageKind::Dictionary) {
+        uint32_t code = intern(source.getView(sourceRow));
+        setRaw(row, std::string_view(reinterpret_cast<const char*>(&code), sizeof(code)));
+        return;
+    }
+    // Copied before the write, which may move the bytes when both are one column
+    std::string raw(source.rawAt(sourceRow));
+    setRaw(row, raw);
+}
+
+static uint32_t readCode(std::string_view raw) {
+    uint32_t code;
+    std::memcpy(&code, raw.data(), sizeof(code));
+    return code;
+}
+
+void KimColumn::appendColumn(const KimColumn& source) {
+    if (kind == KimStorageKind::Dictionary) {
+        // Each source code is interned once, when first seen
+        std::vector<uint32_t> remap(source.dictionary->size(), UINT32_MAX);
+        for (size_t row = 0; row < source.size(); ++row) {
+            uint32_t code = readCode(source.rawAt(row));
+            if (remap[code] == UINT32_MAX) {
+                remap[code] = intern(source.dictionary->value(code));
+            }
+            pushRaw(tailBlock(), std::string_view(reinterpret_cast<const char*>(&remap[code]), sizeof(uint32_t)));
+        }
+        numRows += source.size();
+        return;
+    }
+    for (size_t b = 0; b < source.blocks.size(); ++b) {
+        const KimColumnBlock& block = source.plainBlock(b);
+        if (kind == KimStorageKind::String) {
+            for (size_t index = 0; index < block.count; ++index) {
+                pushRaw(tailBlock(), rawAt(block, index));
+            }
+            continue;
+        }
+        for (size_t index = 0; index < block.count;) {
+            KimColumnBlock& tail = tailBlock();
+            size_t take = std::min(block.count - index, kKimBlockRows - tail.count);
+            const char* values = block.valueData() + index * width;
+            for (size_t i = 0; i < take; ++i) {
+                widenZone(tail, std::string_view(values + i * width, width));
+            }
+            tail.values.insert(tail.values.end(), values, values + take * width);
+            tail.count += take;
+            index += take;
+        }
+    }
+    numRows += source.size();
+}
+
+void KimColumn::erase(size_t row) {
+    size_t b = row / kKimBlockRows;
+    removeAt(ownBlock(b), row % kKimBlockRows);
+
+    // Pull the first value of every following block back by one so all blocks
+    // but the last stay full.
+    for (; b + 1 < blocks.size(); ++b) {
+        KimColumnBlock& next = ownBlock(b + 1);
+        pushRaw(*blocks[b], rawAt(next, 0));
+        removeAt(next, 0);
+    }
+    if (blocks.back()->count == 0) {
+        blocks.pop_back();
+    }
+    --numRows;
+}
+
+void KimColumn::clear() {
+    blocks.clear();
+    pagedFile.reset();
+    if (dictionary) {
+        dictionary = std::make_shared<KimDictionary>();
+    }
+    numRows = 0;
+}
+
+static std::string_view trimPadding(std::string_view raw) {
+    const void* padding = std::memchr(raw.data(), '\0', raw.size());
+    return padding ? raw.substr(0, static_cast<const char*>(padding) - raw.data()) : raw;
+}
+
+std::string_view KimColumn::getView(size_t row) const {
+    std::string_view raw = rawAt(row);
+    if (kind == KimStorageKind::Dictionary) {
+        return dictionary->value(readCode(raw));
+    }
+    return kind == KimStorageKind::FixedString ? trimPadding(raw) : raw;
+}
+
+int64_t KimColumn::getInt(size_t row) const {
+    const char* value = plainBlock(row / kKimBlockRows).valueData() + (row % kKimBlockRows) * width;
+    if (kind == KimStorageKind::Int32) {
+        int32_t narrowed;
+        std::memcpy(&narrowed, value, sizeof(narrowed));
+        return narrowed;
+    }
+    int64_t wide;
+    std::memcpy(&wide, value, sizeof(wide));
+    return wide;
+}
+
+double KimColumn::getFloat(size_t row) const {
+    const char* value = plainBlock(row / kKimBlockRows).valueData() + (row % kKimBlockRows) * width;
+    if (kind == KimStorageKind::Float32) {
+        float narrowed;
+        std::memcpy(&narrowed, value, sizeof(narrowed));
+        return narrowed;
+    }
+    double wide;
+    std::memcpy(&wide, value, sizeof(wide));
+    return wide;
+}
+
+std::string KimColumn::getString(size_t row) const {
+    switch (kind) {
+        case KimStorageKind::Int32:
+        case KimStorageKind::Int64:
+            return std::to_string(getInt(row));
+        case KimStorageKind::Float32:
+            return formatFloat32(static_cast<float>(getFloat(row)));
+        case KimStorageKind::Float64:
+            return kimFormatFloat(getFloat(row));
+        default:
+            return std::string(getView(row));
+    }
+}
+
+static uint64_t orderedInt(int64_t value) {
+    return static_cast<uint64_t>(value) ^ (uint64_t(1) << 63);
+}
+
+static uint64_t orderedFloat(double value) {
+    uint64_t bits;
+    value += 0.0;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return (bits & (uint64_t(1) << 63)) ? ~bits : bits | (uint64_t(1) << 63);
+}
+
+uint64_t KimColumn::orderedKey(size_t row) const {
+    if (kind == KimStorageKind::Int32 || kind == KimStorageKind::Int64) {
+        return orderedInt(getInt(row));
+    }
+    return orderedFloat(getFloat(row));
+}
+
+// Bound of an integer column as an inclusive value; a fractional literal
+// rounds towards the values it admits.
+static bool intBound(const std::string& literal, bool inclusive, bool lower, int64_t& out) {
+    int64_t value;
+    if (kimParseInt(literal, value)) {
+        if (!inclusive) {
+            if (lower ? value == INT64_MAX : value == INT64_MIN) {
+                return false;
+            }
+            value += lower ? 1 : -1;
+        }
+        out = value;
+        return true;
+    }
+    double parsed;
+    if (!kimParseFloat(literal, parsed) || parsed != parsed) {
+        return false;
+    }
+    double rounded = lower ? std::ceil(parsed) : std::floor(parsed);
+    if (rounded == parsed && !inclusive) {
+        rounded += lower ? 1 : -1;
+    }
+    if (rounded >= 9.2233720368547758e18) {
+        if (lower) {
+            return false;
+        }
+        out = INT64_MAX;
+    } else if (rounded < -9.2233720368547758e18) {
+        if (!lower) {
+            return false;
+        }
+        out = INT64_MIN;
+    } else {
+        out = static_cast<int64_t>(rounded);
+    }
+    return true;
+}
+
+// A range bound on a float column. On a Float32 column the literal is narrowed
+// to float first, as = and IN narrow theirs, so `g <= 0.1` admits the rows
+// `g = 0.1` finds; literals beyond the float range are left wide.
+static bool floatBound(KimStorageKind kind, const std::string& literal, double& out) {
+    if (!kimParseFloat(literal, out) || out != out) {
+        return false;
+    }
+    if (kind == KimStorageKind::Float32 && std::fabs(out) <= std::numeric_limits<float>::max()) {
+        out = static_cast<float>(out);
+    }
+    return true;
+}
+
+bool KimColumn::orderedRange(const KimRange& range, uint64_t& low, uint64_t& high) const {
+    low = 0;
+    high = UINT64_MAX;
+    if (kind == KimStorageKind::Int32 || kind == KimStorageKind::Int64) {
+        int64_t value;
+        if (range.hasLow) {
+            if (!intBound(range.low, range.lowInclusive, true, value)) {
+                return false;
+            }
+            low = orderedInt(value);
+        }
+        if (range.hasHigh) {
+            if (!intBound(range.high, range.highInclusive, false, value)) {
+                return false;
+            }
+            high = orderedInt(value);
+        }
+        return low <= high;
+    }
+
+    // Stored floats widen to double exactly, so the bounds are compared in
+    // double space; the infinities keep NaN values out of every range
+    double value;
+    low = orderedFloat(-INFINITY);
+    high = orderedFloat(INFINITY);
+    if (range.hasLow) {
+        if (!floatBound(kind, range.low, value)) {
+            return false;
+        }
+        low = orderedFloat(value);
+        if (!range.lowInclusive) {
+            ++low;
+        }
+    }
+    if (range.hasHigh) {
+        if (!floatBound(kind, range.high, value)) {
+            return false;
+        }
+        high = orderedFloat(value);
+        if (!range.highInclusive) {
+            --high;
+        }
+    }
+    return low <= high;
+}
+
+KimColumnFilter KimColumn::equalFilter(const std::string& literal) const {
+    KimColumnFilter filter;
+    if (kind == KimStorageKind::Dictionary) {
+        // A value the dictionary lacks is stored in no row
+        uint32_t code = 0;
+        filter.empty = !dictionary->find(literal, code);
+        filter.intLow = filter.intHigh = code;
+        return filter;
+    }
+    if (kind == KimStorageKind::String) {
+        filter.equal = true;
+        filter.key = literal;
+        return filter;
+    }
+    if (kind == KimStorageKind::FixedString) {
+        filter.equal = true;
+        filter.key.resize(width);
+        filter.empty = !encode(literal, &filter.key[0]);
+        return filter;
+    }
+
+    // The literal cannot be represented in this column, so nothing matches
+    char encoded[8];
+    if (!encode(literal, encoded)) {
+        filter.empty = true;
+        return filter;
+    }
+    switch (kind) {
+        case KimStorageKind::Int32: {
+            int32_t value;
+            std::memcpy(&value, encoded, sizeof(value));
+            filter.intLow = filter.intHigh = value;
+            break;
+        }
+        case KimStorageKind::Int64: {
+            int64_t value;
+            std::memcpy(&value, encoded, sizeof(value));
+            filter.intLow = filter.intHigh = value;
+            break;
+        }
+        case KimStorageKind::Float32: {
+            float value;
+            std::memcpy(&value, encoded, sizeof(value));
+            filter.floatLow = filter.floatHigh = value;
+            break;
+        }
+        default: {
+            double value;
+            std::memcpy(&value, encoded, sizeof(value));
+            filter.floatLow = filter.floatHigh = value;
+            break;
+        }
+    }
+    return filter;
+}
+
+KimColumnFilter KimColumn::notEqualFilter(const std::string& literal) const {
+    KimColumnFilter filter = equalFilter(literal);
+    filter.negate = true;
+    return filter;
+}
+
+static bool inRange(std::string_view value, const KimRange& range) {
+    if (range.hasLow && (range.lowInclusive ? value < range.low : value <= range.low)) {
+        return false;
+    }
+    return !(range.hasHigh && (range.highInclusive ? value > range.high : value >= range.high));
+}
+
+KimColumnFilter KimColumn::rangeFilter(const KimRange& range) const {
+    KimColumnFilter filter;
+    if (kind == KimStorageKind::Dictionary) {
+        // Codes are not in value order, so each value is compared once up front
+        filter.empty = true;
+        filter.codes.resize(dictionary->size());
+        for (size_t code = 0; code < dictionary->size(); ++code) {
+            filter.codes[code] = inRange(dictionary->value(static_cast<uint32_t>(code)), range);
+            filter.empty = filter.empty && !filter.codes[code];
+        }
+        return filter;
+    }
+    if (kind == KimStorageKind::String || kind == KimStorageKind::FixedString) {
+        filter.range = range;
+        return filter;
+    }
+
+    if (kind == KimStorageKind::Int32 || kind == KimStorageKind::Int64) {
+        int64_t low = INT64_MIN;
+        int64_t high = INT64_MAX;
+        if ((range.hasLow && !intBound(range.low, range.lowInclusive, true, low)) ||
+            (range.hasHigh && !intBound(range.high, range.highInclusive, false, high))) {
+            filter.empty = true;
+            return filter;
+        }
+        if (kind == KimStorageKind::Int32) {
+            low = std::max<int64_t>(low, INT32_MIN);
+            high = std::min<int64_t>(high, INT32_MAX);
+        }
+        filter.intLow = low;
+        filter.intHigh = high;
+        filter.empty = low > high;
+        return filter;
+    }
+
+    // Exclusive bounds step to the next representable double
+    double low = -INFINITY;
+    double high = INFINITY;
+    if (range.hasLow) {
+        if (!floatBound(kind, range.low, low)) {
+            filter.empty = true;
+            return filter;
+        }
+        if (!range.lowInclusive) {
+            low = std::nextafter(low, INFINITY);
+        }
+    }
+    if (range.hasHigh) {
+        if (!floatBound(kind, range.high, high)) {
+            filter.empty = true;
+            return filter;
+        }
+        if (!range.highInclusive) {
+            high = std::nextafter(high, -INFINITY);
+        }
+    }
+    filter.floatLow = low;
+    filter.floatHigh = high;
+    filter.empty = !(low <= high);
+    return filter;
+}
+
+KimColumnFilter KimColumn::inFilter(const std::vector<std::string>& literals) const {
+    KimColumnFilter filter;
+    filter.empty = true;
+    if (kind == KimStorageKind::Dictionary) {
+        filter.codes.resize(dictionary->size());
+        for (const auto& literal : literals) {
+            uint32_t code;
+            if (dictionary->find(literal, code)) {
+                filter.codes[code] = 1;
+                filter.empty = false;
+            }
+        }
+        return filter;
+    }
+
+    // Values the column cannot hold, and NaN, which equals nothing, are dropped
+    filter.in = true;
+    for (const auto& literal : literals) {
+        std::string key;
+        if (kind == KimStorageKind::FixedString) {
+            key.resize(width);
+            if (!encode(literal, &key[0])) {
+                continue;
+            }
+        } else if (!encodeKey(literal, key)) {
+            continue;
+        }
+        if (kind == KimStorageKind::Float32 || kind == KimStorageKind::Float64) {
+            double value;
+            if (kimParseFloat(literal, value) && value != value) {
+                continue;
+            }
+        }
+        filter.keys.push_back(std::move(key));
+    }
+    std::sort(filter.keys.begin(), filter.keys.end());
+    filter.keys.erase(std::unique(filter.keys.begin(), filter.keys.end()), filter.keys.end());
+    filter.empty = filter.keys.empty();
+    return filter;
+}
+
+// Float32 bounds that admit exactly the floats inside the double bounds
+static void float32Bounds(double low, double high, float& lowOut, float& highOut) {
+    lowOut = static_cast<float>(low);
+    if (static_cast<double>(lowOut) < low) {
+        lowOut = std::nextafter(lowOut, INFINITY);
+    }
+    highOut = static_cast<float>(high);
+    if (static_cast<double>(highOut) > high) {
+        highOut = std::nextafter(highOut, -INFINITY);
+    }
+}
+
+void KimColumn::selectBlock(const KimColumnFilter& filter, size_t b, uint64_t* selection) const {
+    KimBlockPin pin;
+    const KimColumnBlock& stored = storedBlock(b, pin);
+    size_t count = stored.count;
+    size_t words = kimSelectionWords(count);
+
+    if (filter.empty) {
+        std::fill(selection, selection + words, 0);
+    } else if (!stored.isEncoded() || !selectEncoded(filter, stored, selection)) {
+        // Other encodings are decoded into per-thread scratch space, so a scan
+        // does not leave a decoded copy of every block behind
+        thread_local KimColumnBlock scratch;
+        std::shared_ptr<const KimColumnBlock> cached;
+        const KimColumnBlock* block = &stored;
+        if (stored.isEncoded()) {
+            cached = std::atomic_load(&stored.decoded);
+            if (!cached) {
+                decodeBlock(stored, scratch);
+            }
+            block = cached ? cached.get() : &scratch;
+        }
+        selectPlain(filter, *block, selection);
+    }
+
+    if (filter.negate) {
+        for (size_t word = 0; word < words; ++word) {
+            selection[word] = ~selection[word];
+        }
+        if (count % 64) {
+            selection[words - 1] &= (uint64_t(1) << (count % 64)) - 1;
+        }
+    }
+}
+
+size_t KimColumn::blockBytes(size_t b) const {
+    const KimColumnBlock& block = *blocks[b];
+    if (block.isPaged()) {
+        return block.pageBytes;
+    }
+    if (block.isEncoded()) {
+        return sizeof(KimBlockHeader) + block.header.Size;
+    }
+    if (kind == KimStorageKind::String) {
+        return (block.count + 1) * sizeof(uint32_t) + block.offsetData()[block.count];
+    }
+    return block.count * width;
+}
+
+void KimColumn::selectPlain(const KimColumnFilter& filter, const KimColumnBlock& block, uint64_t* selection) const {
+    size_t count = block.count;
+    if (filter.in) {
+        std::fill(selection, selection + kimSelectionWords(count), 0);
+        for (size_t i = 0; i < count; ++i) {
+            if (rawMatches(filter, rawAt(block, i))) {
+                selection[i / 64] |= uint64_t(1) << (i % 64);
+            }
+        }
+        return;
+    }
+    switch (kind) {
+        case KimStorageKind::Dictionary: {
+            const uint32_t* codes = reinterpret_cast<const uint32_t*>(block.valueData());
+            if (filter.codes.empty()) {
+                kimSelectBetween(reinterpret_cast<const int32_t*>(codes), count, static_cast<int32_t>(filter.intLow),
+                                 static_cast<int32_t>(filter.intHigh), selection);
+                break;
+            }
+            // One table lookup per row
+            size_t known = filter.codes.size();
+            for (size_t word = 0; word < kimSelectionWords(count); ++word) {
+                uint64_t bits = 0;
+                size_t end = std::min(count, (word + 1) * 64);
+                for (size_t i = word * 64; i < end; ++i) {
+                    uint64_t hit = codes[i] < known && filter.codes[codes[i]];
+                    bits |= hit << (i % 64);
+                }
+                selection[word] = bits;
+            }
+            break;
+        }
+        case KimStorageKind::Int32:
+            kimSelectBetween(reinterpret_cast<const int32_t*>(block.valueData()), count,
+                             static_cast<int32_t>(filter.intLow), static_cast<int32_t>(filter.intHigh), selection);
+            break;
+        case KimStorageKind::Int64:
+            kimSelectBetween(reinterpret_cast<const int64_t*>(block.valueData()), count, filter.intLow,
+                             filter.intHigh, selection);
+            break;
+        case KimStorageKind::Float32: {
+            float low, high;
+            float32Bounds(filter.floatLow, filter.floatHigh, low, high);
+            kimSelectBetween(reinterpret_cast<const float*>(block.valueData()), count, low, high, selection);
+            break;
+        }
+        case KimStorageKind::Float64:
+            kimSelectBetween(reinterpret_cast<const double*>(block.valueData()), count, filter.floatLow,
+                             filter.floatHigh, selection);
+            break;
+        default:
+            if (kind == KimStorageKind::FixedString && filter.equal) {
+                kimSelectEqualBytes(block.valueData(), count, width, filter.key.data(), selection);
+                break;
+            }
+            std::fill(selection, selection + kimSelectionWords(count), 0);
+            for (size_t i = 0; i < count; ++i) {
+                if (rawMatches(filter, rawAt(block, i))) {
+                    selection[i / 64] |= uint64_t(1) << (i % 64);
+                }
+            }
+            break;
+    }
+}
+
+bool KimColumn::matches(const KimColumnFilter& filter, size_t row) const {
+    bool hit = false;
+    if (!filter.empty && filter.in) {
+        hit = rawMatches(filter, rawAt(row));
+    } else if (!filter.empty) {
+        switch (kind) {
+            case KimStorageKind::Int32:
+            case KimStorageKind::Int64: {
+                int64_t value = getInt(row);
+                hit = value >= filter.intLow && value <= filter.intHigh;
+                break;
+            }
+            case KimStorageKind::Float32:
+            case KimStorageKind::Float64: {
+                double value = getFloat(row);
+                hit = value >= filter.floatLow && value <= filter.floatHigh;
+                break;
+            }
+            default:
+                hit = rawMatches(filter, rawAt(row));
+                break;
+        }
+    }
+    return hit != filter.negate;
+}
+
+size_t kimAppendSelection(const uint64_t* selection, size_t count, size_t base, std::vector<size_t>& out,
+                          size_t limit) {
+    size_t found = 0;
+    for (size_t word = 0; word < kimSelectionWords(count) && found < limit; ++word) {
+        for (uint64_t bits = selection[word]; bits != 0 && found < limit; bits &= bits - 1) {
+            out.push_back(base + word * 64 + kimCountTrailingZeros(bits));
+            ++found;
+        }
+    }
+    return found;
+}
+
+void kimClearDeleted(const std::vector<uint64_t>& deleted, size_t b, size_t count, uint64_t* selection) {
+    size_t first = b * (kKimBlockRows / 64);
+    for (size_t word = 0; word < kimSelectionWords(count) && first + word < deleted.size(); ++word) {
+        selection[word] &= ~deleted[first + word];
+    }
+}
+
+static uint64_t alignTo8(uint64_t offset) {
+    return (offset + 7) & ~uint64_t(7);
+}
+
+static int64_t readInt(const char* raw, size_t width) {
+    if (width == 4) {
+        int32_t narrowed;
+        std::memcpy(&narrowed, raw, sizeof(narrowed));
+        return narrowed;
+    }
+    int64_t wide;
+    std::memcpy(&wide, raw, sizeof(wide));
+    return wide;
+}
+
+static double readFloat(const char* raw, size_t width) {
+    if (width == 4) {
+        float narrowed;
+        std::memcpy(&narrowed, raw, sizeof(narrowed));
+        return narrowed;
+    }
+    double wide;
+    std::memcpy(&wide, raw, sizeof(wide));
+    return wide;
+}
+
+static void writeInt(int64_t value, size_t width, char* out) {
+    if (width == 4) {
+        int32_t narrowed = static_cast<int32_t>(value);
+        std::memcpy(out, &narrowed, sizeof(narrowed));
+    } else {
+        std::memcpy(out, &value, sizeof(value));
+    }
+}
+
+// Sets bits [begin, end) of a selection bitmap
+static void setBits(uint64_t* selection, size_t begin, size_t end) {
+    for (size_t bit = begin; bit < end;) {
+        size_t word = bit / 64;
+        size_t last = std::min(end, (word + 1) * 64);
+        uint64_t span = last - bit == 64 ? ~uint64_t(0) : ((uint64_t(1) << (last - bit)) - 1) << (bit % 64);
+        selection[word] |= span;
+        bit = last;
+    }
+}
+
+// The run values of an Rle block, as a block of header.Runs values
+// pointing into its payload
+static KimColumnBlock runValues(const KimColumn& column, const KimColumnBlock& block) {
+    KimColumnBlock runs;
+    runs.count = block.header.Runs;
+    const char* values = block.encoded + alignTo8(block.header.Runs * sizeof(uint32_t));
+    if (column.kind == KimStorageKind::String) {
+        runs.mappedOffsets = reinterpret_cast<const uint32_t*>(values);
+        runs.mappedBytes = values + (runs.count + 1) * sizeof(uint32_t);
+    } else {
+        runs.mappedValues = values;
+    }
+    return runs;
+}
+
+template <typename Read>
+void KimColumn::forEachRow(const size_t* rows, size_t count, Read read, std::vector<KimBlockPin>* pins) const {
+    size_t current = SIZE_MAX;
+    const KimColumnBlock* block = nullptr;
+    for (size_t i = 0; i < count; ++i) {
+        size_t b = rows[i] / kKimBlockRows;
+        if (b != current) {
+            if (pins && blocks[b]->isPaged()) {
+                pins->push_back(readPage(b));
+                block = &plainCopy(*pins->back());
+            } else {
+                block = &plainBlock(b);
+            }
+            current = b;
+        }
+        read(i, *block, rows[i] % kKimBlockRows);
+    }
+}
+
+void KimColumn::gatherInts(const size_t* rows, size_t count, int64_t* out) const {
+    forEachRow(rows, count, [&](size_t i, const KimColumnBlock& block, size_t index) {
+        out[i] = readInt(block.valueData() + index * width, width);
+    });
+}
+
+void KimColumn::gatherFloats(const size_t* rows, size_t count, double* out) const {
+    bool ints = kind == KimStorageKind::Int32 || kind == KimStorageKind::Int64;
+    forEachRow(rows, count, [&](size_t i, const KimColumnBlock& block, size_t index) {
+        out[i] = ints ? static_cast<double>(readInt(block.valueData() + index * width, width))
+                      : readFloat(block.valueData() + index * width, width);
+    });
+}
+
+void KimColumn::gatherRaw(const size_t* rows, size_t count, std::string_view* out,
+                          std::vector<KimBlockPin>* pins) const {
+    forEachRow(rows, count, [&](size_t i, const KimColumnBlock& block, size_t index) {
+        out[i] = rawAt(block, index);
+    }, pins);
+}
+
+void KimColumn::gatherViews(const size_t* rows, size_t count, std::string_view* out,
+                            std::vector<KimBlockPin>* pins) const {
+    forEachRow(rows, count, [&](size_t i, const KimColumnBlock& block, size_t index) {
+        std::string_view raw = rawAt(block, index);
+        if (kind == KimStorageKind::Dictionary) {
+            out[i] = dictionary->value(readCode(raw));
+        } else {
+            out[i] = kind == KimStorageKind::FixedString ? trimPadding(raw) : raw;
+        }
+    }, pins);
+}
+
+// Folds `repeat` copies of the value at `row` into a summary
+static void summarize(const KimColumn& column, std::string_view raw, size_t row, size_t repeat, KimBlockSummary& out) {
+    if (column.kind == KimStorageKind::Int32 || column.kind == KimStorageKind::Int64) {
+        int64_t value = readInt(raw.data(), column.width);
+        out.intSum = static_cast<int64_t>(static_cast<uint64_t>(out.intSum) +
+                                          static_cast<uint64_t>(value) * static_cast<uint64_t>(repeat));
+        if (value < out.intMin) {
+            out.intMin = value;
+            out.minRow = row;
+        }
+        if (value > out.intMax) {
+            out.intMax = value;
+            out.maxRow = row;
+        }
+    } else {
+        double value = readFloat(raw.data(), column.width);
+        out.floatSum += value * static_cast<double>(repeat);
+        if (value < out.floatMin) {
+            out.floatMin = value;
+            out.minRow = row;
+        }
+        if (value > out.floatMax) {
+            out.floatMax = value;
+            out.maxRow = row;
+        }
+    }
+    out.count += repeat;
+}
+
+void KimColumn::summarizeBlock(size_t b, KimBlockSummary& out) const {
+    KimBlockPin pin;
+    const KimColumnBlock& block = storedBlock(b, pin);
+    size_t base = b * kKimBlockRows;
+    if (block.isEncoded() && static_cast<KimBlockEncoding>(block.header.Encoding) == KimBlockEncoding::Rle) {
+        KimColumnBlock runs = runValues(*this, block);
+        size_t begin = 0;
+        for (size_t run = 0; run < runs.count; ++run) {
+            uint32_t end;
+            std::memcpy(&end, block.encoded + run * sizeof(uint32_t), sizeof(end));
+            summarize(*this, rawAt(runs, run), base + begin, end - begin, out);
+            begin = end;
+        }
+        return;
+    }
+    const KimColumnBlock& plain = plainCopy(block);
+    for (size_t i = 0; i < plain.count; ++i) {
+        summarize(*this, std::string_view(plain.valueData() + i * width, width), base + i, 1, out);
+    }
+}
+
+// Whether stored bytes pass the filter, negation aside
+uint64_t KimColumn::zoneKey(std::string_view raw) const {
+    switch (kind) {
+        case KimStorageKind::Int32:
+        case KimStorageKind::Int64:
+            return orderedInt(readInt(raw.data(), width));
+        case KimStorageKind::Float32:
+        case KimStorageKind::Float64:
+            return orderedFloat(readFloat(raw.data(), width));
+        case KimStorageKind::Dictionary:
+            return readCode(raw);
+        default: {
+            // Big-endian, so byte order is key order; padding and missing bytes are 0
+            uint64_t key = 0;
+            for (size_t i = 0; i < sizeof(key); ++i) {
+                key = key << 8 | (i < raw.size() ? static_cast<uint8_t>(raw[i]) : 0);
+            }
+            return key;
+        }
+    }
+}
+
+void KimColumn::widenZone(KimColumnBlock& block, std::string_view raw) const {
+    uint64_t key = zoneKey(raw);
+    block.zoneMin = std::min(block.zoneMin, key);
+    block.zoneMax = std::max(block.zoneMax, key);
+}
+
+bool KimColumn::mayMatch(const KimColumnFilter& filter, size_t b) const {
+    if (filter.negate) {
+        return true;
+    }
+    if (filter.empty) {
+        return false;
+    }
+    // Keys of the values the filter admits, [low, high]
+    uint64_t low = UINT64_MAX;
+    uint64_t high = 0;
+    if (filter.in) {
+        for (const auto& key : filter.keys) {
+            low = std::min(low, zoneKey(key));
+            high = std::max(high, zoneKey(key));
+        }
+    } else if (kind == KimStorageKind::Int32 || kind == KimStorageKind::Int64) {
+        low = orderedInt(filter.intLow);
+        high = orderedInt(filter.intHigh);
+    } else if (kind == KimStorageKind::Float32 || kind == KimStorageKind::Float64) {
+        low = orderedFloat(filter.floatLow);
+        high = orderedFloat(filter.floatHigh);
+    } else if (kind == KimStorageKind::Dictionary) {
+        if (!filter.codes.empty()) {
+            return true;
+        }
+        low = static_cast<uint64_t>(filter.intLow);
+        high = static_cast<uint64_t>(filter.intHigh);
+    } else if (filter.equal) {
+        low = high = zoneKey(filter.key);
+    } else {
+        low = filter.range.hasLow ? zoneKey(filter.range.low) : 0;
+        high = filter.range.hasHigh ? zoneKey(filter.range.high) : UINT64_MAX;
+    }
+    const KimColumnBlock& block = *blocks[b];
+    return low <= block.zoneMax && high >= block.zoneMin;
+}
+
+KimZoneEntry KimColumn::zoneEntry(size_t b) const {
+    // A block unchanged since it was read from a file still has that file's entry
+    if (blocks[b]->distinct != 0) {
+        return {blocks[b]->zoneMin, blocks[b]->zoneMax, 0, blocks[b]->distinct};
+    }
+    KimBlockPin pin;
+    const KimColumnBlock& stored = storedBlock(b, pin);
+
+    // Encoded blocks are decoded aside, as selectBlock does
+    KimColumnBlock scratch;
+    std::shared_ptr<const KimColumnBlock> cached;
+    const KimColumnBlock* block = &stored;
+    if (stored.isEncoded()) {
+        cached = std::atomic_load(&stored.decoded);
+        if (!cached) {
+            decodeBlock(stored, scratch);
+        }
+        block = cached ? cached.get() : &scratch;
+    }
+
+    // Distinct values are counted exactly up to 8 bytes and by hash beyond
+    KimZoneEntry entry{UINT64_MAX, 0, 0, 0};
+    std::vector<uint64_t> values(block->count);
+    for (size_t index = 0; index < block->count; ++index) {
+        std::string_view raw = rawAt(*block, index);
+        uint64_t key = zoneKey(raw);
+        entry.Min = std::min(entry.Min, key);
+        entry.Max = std::max(entry.Max, key);
+        if (raw.size() <= sizeof(uint64_t) && kind != KimStorageKind::String) {
+            values[index] = 0;
+            std::memcpy(&values[index], raw.data(), raw.size());
+        } else {
+            values[index] = std::hash<std::string_view>()(raw);
+        }
+    }
+    std::sort(values.begin(), values.end());
+    entry.Distinct = static_cast<uint32_t>(std::unique(values.begin(), values.end()) - values.begin());
+    return entry;
+}
+
+bool KimColumn::mapZones(const char* section, size_t size) {
+    if (size != blocks.size() * sizeof(KimZoneEntry)) {
+        return false;
+    }
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        KimZoneEntry entry;
+        std::memcpy(&entry, section + b * sizeof(entry), sizeof(entry));
+        // A zone that excludes everything would hide the block's rows
+        if (entry.Min <= entry.Max) {
+            blocks[b]->zoneMin = entry.Min;
+            blocks[b]->zoneMax = entry.Max;
+            blocks[b]->distinct = entry.Distinct;
+        }
+    }
+    return true;
+}
+
+bool KimColumn::rawMatches(const KimColumnFilter& filter, std::string_view raw) const {
+    if (filter.in) {
+        return std::binary_search(filter.keys.begin(), filter.keys.end(), raw);
+    }
+    switch (kind) {
+        case KimStorageKind::Dictionary: {
+            uint32_t code = readCode(raw);
+            if (filter.codes.empty()) {
+                return code >= filter.intLow && code <= filter.intHigh;
+            }
+            return code < filter.codes.size() && filter.codes[code];
+        }
+        case KimStorageKind::Int32:
+        case KimStorageKind::Int64: {
+            int64_t value = readInt(raw.data(), width);
+            return value >= filter.intLow && value <= filter.intHigh;
+        }
+        case KimStorageKind::Float32: {
+            float value;
+            std::memcpy(&value, raw.data(), sizeof(value));
+            return value >= filter.floatLow && value <= filter.floatHigh;
+        }
+        case KimStorageKind::Float64: {
+            double value;
+            std::memcpy(&value, raw.data(), sizeof(value));
+            return value >= filter.floatLow && value <= filter.floatHigh;
+        }
+        default:
+            if (filter.equal) {
+                return raw == filter.key; // FixedString keys are padded like the stored values
+            }
+            return inRange(kind == KimStorageKind::FixedString ? trimPadding(raw) : raw, filter.range);
+    }
+}
+
+bool KimColumn::selectEncoded(const KimColumnFilter& filter, const KimColumnBlock& block, uint64_t* selection) const {
+    const KimBlockHeader& header = block.header;
+    size_t count = block.count;
+    switch (static_cast<KimBlockEncoding>(header.Encoding)) {
+        case KimBlockEncoding::Rle: {
+            // One test per run
+            std::fill(selection, selection + kimSelectionWords(count), 0);
+            const char* runEnds = block.encoded;
+            KimColumnBlock runs = runValues(*this, block);
+            size_t begin = 0;
+            for (size_t run = 0; run < runs.count; ++run) {
+                uint32_t end;
+                std::memcpy(&end, runEnds + run * sizeof(uint32_t), sizeof(end));
+                if (rawMatches(filter, rawAt(runs, run))) {
+                    setBits(selection, begin, end);
+                }
+                begin = end;
+            }
+            return true;
+        }
+        case KimBlockEncoding::FrameOfReference: {
+            // The bounds are moved into the packed domain once, so each value
+            // is compared as it is unpacked, without adding the base back
+            if (filter.in || !filter.codes.empty()) {
+                return false;
+            }
+            std::fill(selection, selection + kimSelectionWords(count), 0);
+            uint64_t base = static_cast<uint64_t>(header.Base);
+            uint64_t maxPacked = header.Bits == 64 ? UINT64_MAX : (uint64_t(1) << header.Bits) - 1;
+            if (filter.intHigh < header.Base) {
+                return true;
+            }
+            uint64_t low = filter.intLow <= header.Base ? 0 : static_cast<uint64_t>(filter.intLow) - base;
+            uint64_t high = std::min(maxPacked, static_cast<uint64_t>(filter.intHigh) - base);
+            if (low > high) {
+                return true;
+            }
+            for (size_t i = 0; i < count; ++i) {
+                if (kimBitUnpack(block.encoded, i, header.Bits) - low <= high - low) {
+                    selection[i / 64] |= uint64_t(1) << (i % 64);
+                }
+            }
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+void KimColumn::decodeBlock(const KimColumnBlock& block, KimColumnBlock& out) const {
+    const KimBlockHeader& header = block.header;
+    size_t count = block.count;
+    out = KimColumnBlock();
+    if (kind == KimStorageKind::String) {
+        out.offsets.push_back(0);
+    }
+
+    bool valid = true;
+    switch (static_cast<KimBlockEncoding>(header.Encoding)) {
+        case KimBlockEncoding::Rle: {
+            KimColumnBlock runs = runValues(*this, block);
+            size_t begin = 0;
+            for (size_t run = 0; run < runs.count; ++run) {
+                uint32_t end;
+                std::memcpy(&end, block.encoded + run * sizeof(uint32_t), sizeof(end));
+                std::string_view value = rawAt(runs, run);
+                for (size_t i = begin; i < end; ++i) {
+                    pushRaw(out, value);
+                }
+                begin = end;
+            }
+            break;
+        }
+        case KimBlockEncoding::FrameOfReference:
+        case KimBlockEncoding::Delta: {
+            bool delta = header.Encoding == static_cast<uint8_t>(KimBlockEncoding::Delta);
+            out.values.resize(count * width);
+            uint64_t value = static_cast<uint64_t>(header.Base);
+            for (size_t i = 0; i < count; ++i) {
+                if (!delta) {
+                    value = static_cast<uint64_t>(header.Base) + kimBitUnpack(block.encoded, i, header.Bits);
+                } else if (i > 0) {
+                    value += static_cast<uint64_t>(header.Reference) + kimBitUnpack(block.encoded, i - 1, header.Bits);
+                }
+                writeInt(static_cast<int64_t>(value), width, out.values.data() + i * width);
+            }
+            out.count = count;
+            break;
+        }
+        case KimBlockEncoding::Lz: {
+            std::vector<char> raw(header.RawSize);
+            valid = kimLzDecompress(block.encoded, header.Size, raw.data(), raw.size());
+            if (valid && kind != KimStorageKind::String) {
+                out.values = std::move(raw);
+                out.count = count;
+                break;
+            }
+            size_t offsetBytes = (count + 1) * sizeof(uint32_t);
+            if (valid) {
+                out.offsets.resize(count + 1);
+                std::memcpy(out.offsets.data(), raw.data(), offsetBytes);
+                valid = out.offsets[0] == 0 && out.offsets[count] == raw.size() - offsetBytes &&
+                        std::is_sorted(out.offsets.begin(), out.offsets.end());
+                out.bytes.assign(raw.begin() + offsetBytes, raw.end());
+                out.count = count;
+            }
+            break;
+        }
+        default:
+            valid = false;
+            break;
+    }
+
+    if (!valid || out.count != count) {
+        std::cerr << "Corrupt column block; reading it as empty values" << std::endl;
+        out = KimColumnBlock();
+        out.count = count;
+        out.values.assign(count * width, 0);
+        if (kind == KimStorageKind::String) {
+            out.offsets.assign(count + 1, 0);
+        }
+    }
+}
+
+void KimColumn::encodeBlock(const KimColumnBlock& stored, bool compress, std::vector<char>& out) const {
+    KimBlockHeader header{};
+    std::vector<char> encoded;
+    auto append = [&](const char* data, size_t size) {
+        header.Size = size;
+        out.insert(out.end(), reinterpret_cast<const char*>(&header), reinterpret_cast<const char*>(&header) + sizeof(header));
+        out.insert(out.end(), data, data + size);
+        out.resize(alignTo8(out.size()));
+    };
+
+    // Blocks mapped from an encoded file are written as they were read
+    if (stored.isEncoded() && compress) {
+        header = stored.header;
+        append(stored.encoded, stored.header.Size);
+        return;
+    }
+    KimColumnBlock decoded;
+    if (stored.isEncoded()) {
+        decodeBlock(stored, decoded);
+    }
+    const KimColumnBlock& block = stored.isEncoded() ? decoded : stored;
+    size_t count = block.count;
+    header.Count = static_cast<uint32_t>(count);
+
+    // The Plain payload, and what each encoding would take
+    bool fixed = kind != KimStorageKind::String;
+    size_t byteCount = fixed ? 0 : block.offsetData()[count];
+    size_t plainSize = fixed ? count * width : (count + 1) * sizeof(uint32_t) + byteCount;
+    auto plainPayload = [&](std::vector<char>& target) {
+        if (fixed) {
+            target.insert(target.end(), block.valueData(), block.valueData() + count * width);
+        } else {
+            const char* offsets = reinterpret_cast<const char*>(block.offsetData());
+            target.insert(target.end(), offsets, offsets + (count + 1) * sizeof(uint32_t));
+            target.insert(target.end(), block.byteData(), block.byteData() + byteCount);
+        }
+    };
+    if (!compress || count == 0) {
+        plainPayload(encoded);
+        append(encoded.data(), encoded.size());
+        return;
+    }
+
+    size_t runs = 1;
+    size_t runBytes = rawAt(block, 0).size();
+    for (size_t i = 1; i < count; ++i) {
+        std::string_view value = rawAt(block, i);
+        if (value != rawAt(block, i - 1)) {
+            ++runs;
+            runBytes += value.size();
+        }
+    }
+    KimBlockEncoding best = KimBlockEncoding::Plain;
+    size_t bestSize = plainSize;
+    auto consider = [&](KimBlockEncoding encoding, size_t size) {
+        if (size < bestSize) {
+            best = encoding;
+            bestSize = size;
+        }
+    };
+
+    int64_t minimum = 0, maximum = 0, minDelta = 0, maxDelta = 0;
+    bool integer = kind == KimStorageKind::Int32 || kind == KimStorageKind::Int64 || kind == KimStorageKind::Dictionary;
+    if (integer) {
+        minimum = maximum = readInt(block.valueData(), width);
+        for (size_t i = 1; i < count; ++i) {
+            int64_t value = readInt(block.valueData() + i * width, width);
+            int64_t delta = static_cast<int64_t>(static_cast<uint64_t>(value) -
+                                                 static_cast<uint64_t>(readInt(block.valueData() + (i - 1) * width, width)));
+            minimum = std::min(minimum, value);
+            maximum = std::max(maximum, value);
+            minDelta = i == 1 ? delta : std::min(minDelta, delta);
+            maxDelta = i == 1 ? delta : std::max(maxDelta, delta);
+        }
+        header.Bits = static_cast<uint8_t>(kimBitWidth(static_cast<uint64_t>(maximum) - static_cast<uint64_t>(minimum)));
+        consider(KimBlockEncoding::FrameOfReference, kimPackedBytes(count, header.Bits));
+        unsigned deltaBits = kimBitWidth(static_cast<uint64_t>(maxDelta) - static_cast<uint64_t>(minDelta));
+        consider(KimBlockEncoding::Delta, kimPackedBytes(count - 1, deltaBits));
+        if (best == KimBlockEncoding::Delta) {
+            header.Bits = static_cast<uint8_t>(deltaBits);
+        }
+    }
+    consider(KimBlockEncoding::Rle, alignTo8(runs * sizeof(uint32_t)) +
+                                    (fixed ? runs * width : (runs + 1) * sizeof(uint32_t) + runBytes));
+
+    // Text gets the LZ codec when it saves at least an eighth more than the
+    // others, since decoding it costs more
+    std::vector<char> plain;
+    if ((kind == KimStorageKind::String || kind == KimStorageKind::FixedString) && plainSize <= UINT32_MAX) {
+        plainPayload(plain);
+        std::vector<char> compressed;
+        kimLzCompress(plain.data(), plain.size(), compressed);
+        if (compressed.size() + compressed.size() / 8 < bestSize) {
+            best = KimBlockEncoding::Lz;
+            header.RawSize = static_cast<uint32_t>(plain.size());
+            encoded = std::move(compressed);
+        }
+    }
+
+    header.Encoding = static_cast<uint8_t>(best);
+    switch (best) {
+        case KimBlockEncoding::FrameOfReference:
+        case KimBlockEncoding::Delta: {
+            std::vector<uint64_t> packed;
+            packed.reserve(count);
+            bool delta = best == KimBlockEncoding::Delta;
+            header.Base = delta ? readInt(block.valueData(), width) : minimum;
+            header.Reference = delta ? minDelta : 0;
+            for (size_t i = delta ? 1 : 0; i < count; ++i) {
+                uint64_t value = static_cast<uint64_t>(readInt(block.valueData() + i * width, width));
+                uint64_t previous = delta ? static_cast<uint64_t>(readInt(block.valueData() + (i - 1) * width, width)) : 0;
+                packed.push_back(delta ? value - previous - static_cast<uint64_t>(minDelta)
+                                       : value - static_cast<uint64_t>(minimum));
+            }
+            kimBitPack(packed.data(), packed.size(), header.Bits, encoded);
+            break;
+        }
+        case KimBlockEncoding::Rle: {
+            header.Bits = 0;
+            header.Runs = static_cast<uint32_t>(runs);
+            KimColumnBlock values;
+            values.offsets.push_back(0);
+            encoded.resize(alignTo8(runs * sizeof(uint32_t)));
+            size_t run = 0;
+            for (size_t i = 0; i < count; ++i) {
+                if (i + 1 == count || rawAt(block, i + 1) != rawAt(block, i)) {
+                    uint32_t end = static_cast<uint32_t>(i + 1);
+                    std::memcpy(encoded.data() + run * sizeof(uint32_t), &end, sizeof(end));
+                    pushRaw(values, rawAt(block, i));
+                    ++run;
+                }
+            }
+            if (fixed) {
+                encoded.insert(encoded.end(), values.values.begin(), values.values.end());
+            } else {
+                const char* offsets = reinterpret_cast<const char*>(values.offsets.data());
+                encoded.insert(encoded.end(), offsets, offsets + values.offsets.size() * sizeof(uint32_t));
+                encoded.insert(encoded.end(), values.bytes.begin(), values.bytes.end());
+            }
+            break;
+        }
+        case KimBlockEncoding::Lz:
+            header.Bits = 0;
+            break;
+        default:
+            header.Bits = 0;
+            if (plain.empty()) {
+                plainPayload(plain);
+            }
+            encoded = std::move(plain);
+            break;
+    }
+    append(encoded.data(), encoded.size());
+}
+
+void KimColumn::encodeSection(bool compress, std::vector<char>& out) const {
+    out.assign(blocks.size() * sizeof(uint64_t), 0);
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        uint64_t offset = out.size();
+        std::memcpy(out.data() + b * sizeof(uint64_t), &offset, sizeof(offset));
+        KimBlockPin pin;
+        encodeBlock(storedBlock(b, pin), compress, out);
+    }
+}
+
+bool KimColumn::map(const char* section, size_t available, size_t rows) {
+    clear();
+    size_t numBlocks = (rows + kKimBlockRows - 1) / kKimBlockRows;
+
+    if (kind != KimStorageKind::String) {
+        if (rows > available / width) {
+            return false;
+        }
+        for (size_t b = 0; b < numBlocks; ++b) {
+            auto block = std::make_shared<KimColumnBlock>();
+            block->count = std::min(kKimBlockRows, rows - b * kKimBlockRows);
+            block->mappedValues = section + b * kKimBlockRows * width;
+            blocks.push_back(std::move(block));
+        }
+        numRows = rows;
+        return true;
+    }
+
+    if (numBlocks > available / sizeof(uint64_t)) {
+        return false;
+    }
+    for (size_t b = 0; b < numBlocks; ++b) {
+        uint64_t start;
+        std::memcpy(&start, section + b * sizeof(uint64_t), sizeof(start));
+        size_t count = std::min(kKimBlockRows, rows - b * kKimBlockRows);
+        uint64_t offsetBytes = (count + 1) * sizeof(uint32_t);
+        if (start % sizeof(uint32_t) != 0 || start > available || offsetBytes > available - start) {
+            blocks.clear();
+            return false;
+        }
+        const uint32_t* offsets = reinterpret_cast<const uint32_t*>(section + start);
+        if (offsets[0] != 0 || offsets[count] > available - start - offsetBytes) {
+            blocks.clear();
+            return false;
+        }
+        auto block = std::make_shared<KimColumnBlock>();
+        block->count = count;
+        block->mappedOffsets = offsets;
+        block->mappedBytes = section + start + offsetBytes;
+        blocks.push_back(std::move(block));
+    }
+    numRows = rows;
+    return true;
+}
+
+// Extents of a version 7 block, and the run and offset tables that views
+// into it rely on. Packed and compressed payloads are checked as they are decoded.
+static bool checkBlock(const KimColumn& column, const KimBlockHeader& header, const char* payload) {
+    size_t count = header.Count;
+    bool fixed = column.kind != KimStorageKind::String;
+    auto checkOffsets = [&](const char* data, size_t values, size_t available) {
+        size_t offsetBytes = (values + 1) * sizeof(uint32_t);
+        if (offsetBytes > available) {
+            return false;
+        }
+        const uint32_t* offsets = reinterpret_cast<const uint32_t*>(data);
+        return offsets[0] == 0 && offsets[values] <= available - offsetBytes &&
+               std::is_sorted(offsets, offsets + values + 1);
+    };
+    switch (static_cast<KimBlockEncoding>(header.Encoding)) {
+        case KimBlockEncoding::Plain:
+            return fixed ? header.Size >= count * column.width : checkOffsets(payload, count, header.Size);
+        case KimBlockEncoding::Rle: {
+            size_t runs = header.Runs;
+            size_t valuesAt = alignTo8(runs * sizeof(uint32_t));
+            if (runs == 0 || runs > count || valuesAt > header.Size) {
+                return false;
+            }
+            uint32_t previous = 0;
+            for (size_t run = 0; run < runs; ++run) {
+                uint32_t end;
+                std::memcpy(&end, payload + run * sizeof(uint32_t), sizeof(end));
+                if (end <= previous) {
+                    return false;
+                }
+                previous = end;
+            }
+            if (previous != count) {
+                return false;
+            }
+            return fixed ? header.Size - valuesAt >= runs * column.width
+                         : checkOffsets(payload + valuesAt, runs, header.Size - valuesAt);
+        }
+        case KimBlockEncoding::FrameOfReference:
+        case KimBlockEncoding::Delta: {
+            bool delta = header.Encoding == static_cast<uint8_t>(KimBlockEncoding::Delta);
+            bool integer = column.kind == KimStorageKind::Int32 || column.kind == KimStorageKind::Int64 ||
+                           column.kind == KimStorageKind::Dictionary;
+            return integer && header.Bits <= 64 &&
+                   count > 0 && header.Size >= kimPackedBytes(delta ? count - 1 : count, header.Bits);
+        }
+        case KimBlockEncoding::Lz:
+            return fixed ? header.RawSize == count * column.width : header.RawSize >= (count + 1) * sizeof(uint32_t);
+        default:
+            return false;
+    }
+}
+
+// Points `block` at the version 7 block whose header is at `at`, given the
+// `available` bytes from there on and the count the block should have
+static bool mapBlock(const KimColumn& column, const char* at, size_t available, size_t count, KimColumnBlock& block) {
+    KimBlockHeader header;
+    if (sizeof(header) > available) {
+        return false;
+    }
+    std::memcpy(&header, at, sizeof(header));
+    const char* payload = at + sizeof(header);
+    if (header.Count != count || header.Size > available - sizeof(header) || !checkBlock(column, header, payload)) {
+        return false;
+    }
+    block.count = count;
+    if (header.Encoding != static_cast<uint8_t>(KimBlockEncoding::Plain)) {
+        block.header = header;
+        block.encoded = payload;
+    } else if (column.kind == KimStorageKind::String) {
+        block.mappedOffsets = reinterpret_cast<const uint32_t*>(payload);
+        block.mappedBytes = payload + (count + 1) * sizeof(uint32_t);
+    } else {
+        block.mappedValues = payload;
+    }
+    return true;
+}
+
+bool KimColumn::mapBlocks(const char* section, size_t available, size_t rows) {
+    clear();
+    size_t numBlocks = (rows + kKimBlockRows - 1) / kKimBlockRows;
+    if (numBlocks > available / sizeof(uint64_t)) {
+        return false;
+    }
+    for (size_t b = 0; b < numBlocks; ++b) {
+        uint64_t start;
+        std::memcpy(&start, section + b * sizeof(uint64_t), sizeof(start));
+        size_t count = std::min(kKimBlockRows, rows - b * kKimBlockRows);
+        auto block = std::make_shared<KimColumnBlock>();
+        if (start % 8 != 0 || start > available ||
+            !mapBlock(*this, section + start, available - start, count, *block)) {
+            blocks.clear();
+            return false;
+        }
+        blocks.push_back(std::move(block));
+    }
+    numRows = rows;
+    return true;
+}
+
+bool KimColumn::pageBlocks(const std::shared_ptr<const KimPagedFile>& file, uint64_t offset, uint64_t end,
+                           size_t rows) {
+    clear();
+    size_t numBlocks = (rows + kKimBlockRows - 1) / kKimBlockRows;
+    if (offset > end || numBlocks > (end - offset) / sizeof(uint64_t)) {
+        return false;
+    }
+    std::vector<uint64_t> starts(numBlocks);
+    if (!file->read(offset, starts.data(), numBlocks * sizeof(uint64_t))) {
+        return false;
+    }
+    // A block runs to the start of the next one, the last to the end of the section
+    for (size_t b = 0; b < numBlocks; ++b) {
+        uint64_t start = starts[b];
+        uint64_t next = b + 1 < numBlocks ? starts[b + 1] : end - offset;
+        if (start % 8 != 0 || start < numBlocks * sizeof(uint64_t) || next > end - offset || start >= next) {
+            blocks.clear();
+            return false;
+        }
+        auto block = std::make_shared<KimColumnBlock>();
+        block->count = std::min(kKimBlockRows, rows - b * kKimBlockRows);
+        block->pageOffset = offset + start;
+        block->pageBytes = next - start;
+        blocks.push_back(std::move(block));
+    }
+    pagedFile = file;
+    numRows = rows;
+    return true;
+}
+
+namespace {
+
+// A paged block as read into the buffer pool; the block points into `bytes`
+struct KimPage {
+    std::vector<char> bytes;
+    KimColumnBlock block;
+};
+
+} // namespace
+
+KimBlockPin KimColumn::readPage(size_t b) const {
+    KimBufferPool& pool = kimBufferPool();
+    uint64_t file = pagedFile->id();
+
+    // The block of each column a thread read last, to spot sequential scans
+    struct Recent {
+        const KimColumn* column = nullptr;
+        size_t block = 0;
+    };
+    thread_local Recent recent[kKimRecentPins];
+    Recent& last = recent[reinterpret_cast<uintptr_t>(this) / sizeof(KimColumn) % kKimRecentPins];
+    bool sequential = last.column == this && last.block + 1 == b;
+    last = {this, b};
+
+    if (KimBlockPin page = pool.find({file, blocks[b]->pageOffset})) {
+        return page;
+    }
+
+    // A miss in a sequential scan reads the next few blocks with it, in one read
+    size_t end = sequential ? std::min(blocks.size(), b + 1 + kKimReadAheadBlocks) : b + 1;
+    uint64_t begin = blocks[b]->pageOffset;
+    std::vector<char> run;
+    bool read = true;
+    if (end > b + 1) {
+        run.resize(blocks[end - 1]->pageOffset + blocks[end - 1]->pageBytes - begin);
+        read = pagedFile->read(begin, run.data(), run.size());
+    }
+    KimBlockPin result;
+    for (size_t i = b; i < end && read; ++i) {
+        const KimColumnBlock& stub = *blocks[i];
+        auto page = std::make_shared<KimPage>();
+        if (run.empty()) {
+            page->bytes.resize(stub.pageBytes);
+            read = pagedFile->read(stub.pageOffset, page->bytes.data(), page->bytes.size());
+        } else {
+            const char* slice = run.data() + (stub.pageOffset - begin);
+            page->bytes.assign(slice, slice + stub.pageBytes);
+        }
+        if (!read || !mapBlock(*this, page->bytes.data(), page->bytes.size(), stub.count, page->block)) {
+            break;
+        }
+        page->block.zoneMin = stub.zoneMin;
+        page->block.zoneMax = stub.zoneMax;
+        page->block.distinct = stub.distinct;
+
+        // Charged for the decoded copy an encoded block may be given too; for
+        // strings that is an estimate
+        size_t charge = stub.pageBytes;
+        if (page->block.isEncoded()) {
+            const KimBlockHeader& header = page->block.header;
+            charge += kind == KimStorageKind::String ? std::max<size_t>(header.RawSize, 2 * header.Size)
+                                                     : stub.count * width;
+        }
+        KimBlockPin pinned = pool.insert({file, stub.pageOffset}, KimBlockPin(page, &page->block), charge, i != b);
+        if (i == b) {
+            result = std::move(pinned);
+        }
+    }
+    if (!result) {
+        std::cerr << "Failed to read the column block at offset " << begin << "; reading it as empty values"
+                  << std::endl;
+        auto empty = std::make_shared<KimColumnBlock>();
+        empty->count = blocks[b]->count;
+        empty->values.assign(empty->count * width, 0);
+        if (kind == KimStorageKind::String) {
+            empty->offsets.assign(empty->count + 1, 0);
+        }
+        result = std::move(empty);
+    }
+    return result;
+}
+
+void KimColumn::materialize() {
+    if (dictionary) {
+        unshare(dictionary).materialize();
+    }
+    // Each block is replaced rather than changed, since snapshots may share it
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        KimBlockPin pin;
+        const KimColumnBlock& stored = storedBlock(b, pin);
+        auto plain = std::make_shared<KimColumnBlock>();
+        plain->count = stored.count;
+        if (stored.isEncoded()) {
+            decodeBlock(stored, *plain);
+        } else if (stored.mappedValues) {
+            plain->values.assign(stored.mappedValues, stored.mappedValues + stored.count * width);
+        } else if (stored.mappedOffsets) {
+            plain->offsets.assign(stored.mappedOffsets, stored.mappedOffsets + stored.count + 1);
+            plain->bytes.assign(stored.mappedBytes, stored.mappedBytes + plain->offsets[stored.count]);
+        } else if (pin) {
+            // A page that failed to read is already owned empty values
+            *plain = stored;
+        } else {
+            continue;
+        }
+        plain->zoneMin = blocks[b]->zoneMin;
+        plain->zoneMax = blocks[b]->zoneMax;
+        plain->distinct = blocks[b]->distinct;
+        blocks[b] = std::move(plain);
+    }
+    pagedFile.reset();
+}
@@ -0,0 +1,274 @@
+//
+// Column-major storage used by KimTable.
+//
+
+#ifndef KIMDB_KIMCOLUMNSTORE_H
+#define KIMDB_KIMCOLUMNSTORE_H
+
+#include "KimBufferPool.h"
+#include "KimDictionary.h"
+#include "KimFileFormat.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Rows per column block. Every block except the last one is full, so a row id
+// maps straight to (row / kKimBlockRows, row % kKimBlockRows) and growing a
+// column never moves the values that are already stored.
+constexpr size_t kKimBlockRows = 4096;
+
+// Physical layout of a column, picked from ColumnHeader::DataType and DataSize.
+enum class KimStorageKind : uint8_t {
+    Int32,
+    Int64,
+    Float32,
+    Float64,
+    String,
+    FixedString, // char[width]; values shorter than width are NUL-padded
+    Dictionary, // uint32 codes into KimColumn::dictionary
+};
+
+// Bounds of a range predicate, as the literals written in the query.
+struct KimRange {
+    bool hasLow = false;
+    bool lowInclusive = true;
+    std::string low;
+    bool hasHigh = false;
+    bool highInclusive = true;
+    std::string high;
+};
+
+// A predicate compiled against one column: the literal is parsed and
+// converted to the column's type once, so testing a block is one kernel call
+// that produces a selection bitmap.
+struct KimColumnFilter {
+    bool empty = false; // the bounds admit no value
+    bool negate = false; // select the rows outside the bounds (!=)
+    bool equal = false; // string kinds: exact match against `key`
+    int64_t intLow = 0, intHigh = 0; // int kinds, inclusive
+    double floatLow = 0, floatHigh = 0; // float kinds, inclusive
+    std::string key; // string kinds: the value, NUL-padded for FixedString
+    KimRange range; // string kinds, when not `equal`
+    bool in = false; // IN list: match any of `keys`
+    std::vector<std::string> keys; // stored bytes of each IN value, sorted
+    // Dictionary kind: nonzero for each matching code. Empty when the
+    // predicate is one code, which is then held in intLow and intHigh.
+    std::vector<uint8_t> codes;
+};
+
+// Count, sum and extremes of one block of a numeric column. Int kinds fill
+// the int fields and float kinds the float ones; minRow and maxRow hold the
+// first row with the smallest and the largest value.
+struct KimBlockSummary {
+    size_t count = 0;
+    int64_t intSum = 0; // wraps on overflow
+    int64_t intMin = INT64_MAX;
+    int64_t intMax = INT64_MIN;
+    double floatSum = 0;
+    double floatMin = HUGE_VAL;
+    double floatMax = -HUGE_VAL;
+    size_t minRow = SIZE_MAX;
+    size_t maxRow = SIZE_MAX;
+};
+
+// A run of up to kKimBlockRows values of one column. Fixed-width kinds keep
+// the values packed in `values`; strings keep count + 1 offsets into `bytes`.
+// A block of a mapped table points into the file instead of owning vectors.
+// A mapped block stored encoded (see KimBlockEncoding) points `encoded` at
+// its payload; the value accessors then belong to a decoded copy. A block of
+// a paged table holds only its count, zone and extent in the file; its data
+// is read into the buffer pool when it is used (see KimBufferPool). Blocks are
+// shared between copies of a column, such as table snapshots, and are copied
+// by the column that changes one while another still holds it.
+struct KimColumnBlock {
+    size_t count = 0;
+    std::vector<char> values;
+    std::vector<uint32_t> offsets;
+    std::vector<char> bytes;
+
+    const char* mappedValues = nullptr;
+    const uint32_t* mappedOffsets = nullptr;
+    const char* mappedBytes = nullptr;
+
+    KimBlockHeader header{};
+    const char* encoded = nullptr;
+    mutable std::shared_ptr<const KimColumnBlock> decoded; // made on first random access
+
+    // Zone map: the zoneKey of every value lies in [zoneMin, zoneMax]. Writes
+    // only widen it, so it may be loose after updates and erases. Unknown,
+    // the whole key range, for blocks mapped from files without zone maps.
+    uint64_t zoneMin = 0;
+    uint64_t zoneMax = UINT64_MAX;
+    uint32_t distinct = 0; // estimated distinct values as read from a file, 0 once written to
+
+    uint64_t pageOffset = 0; // of the block header in KimColumn::pagedFile
+    uint64_t pageBytes = 0; // 0 when the block is in memory
+
+    const char* valueData() const { return mappedValues ? mappedValues : values.data(); }
+    const uint32_t* offsetData() const { return mappedOffsets ? mappedOffsets : offsets.data(); }
+    const char* byteData() const { return mappedBytes ? mappedBytes : bytes.data(); }
+    bool isEncoded() const { return encoded != nullptr; }
+    bool isPaged() const { return pageBytes != 0; }
+};
+
+// Keeps a paged block in the buffer pool; views into it stay valid while held
+using KimBlockPin = std::shared_ptr<const KimColumnBlock>;
+
+class KimColumn {
+public:
+    KimColumn(uint8_t dataType, uint16_t dataSize);
+
+    KimStorageKind kind;
+    size_t width; // bytes per value, 0 for variable-length strings
+    std::vector<std::shared_ptr<KimColumnBlock>> blocks;
+    std::shared_ptr<KimDictionary> dictionary; // Dictionary kind only; shared like the blocks
+    std::shared_ptr<const KimPagedFile> pagedFile; // set while the blocks are read through the buffer pool
+
+    size_t size() const { return numRows; }
+    bool accepts(const std::string& value) const;
+    // Stored bytes of `value` in this column, as returned by getView; used to
+    // hash and compare index keys.
+    bool encodeKey(const std::string& value, std::string& key) const;
+    bool append(const std::string& value);
+    bool set(size_t row, const std::string& value);
+    // Copy a stored value of another column of the same kind, without parsing
+    void appendFrom(const KimColumn& source, size_t sourceRow);
+    void setFrom(size_t row, const KimColumn& source, size_t sourceRow);
+    // Appends every value of `source`, a column of the same kind, copying the
+    // stored bytes a block at a time
+    void appendColumn(const KimColumn& source);
+    void erase(size_t row);
+    void clear();
+
+    std::string getString(size_t row) const;
+    std::string_view getView(size_t row) const; // stored bytes; the text itself for strings
+    int64_t getInt(size_t row) const;
+    double getFloat(size_t row) const;
+
+    KimColumnFilter equalFilter(const std::string& literal) const;
+    KimColumnFilter notEqualFilter(const std::string& literal) const;
+    KimColumnFilter rangeFilter(const KimRange& range) const;
+    KimColumnFilter inFilter(const std::vector<std::string>& literals) const;
+    // Writes the selection bitmap of block b (kimSelectionWords(count) words).
+    // Fixed-width kinds go through the SIMD kernels of KimSimd.h.
+    void selectBlock(const KimColumnFilter& filter, size_t b, uint64_t* selection) const;
+    // Bytes selectBlock reads from block b: the encoded payload of an encoded
+    // block, else its values, or offsets and text for strings
+    size_t blockBytes(size_t b) const;
+    bool matches(const KimColumnFilter& filter, size_t row) const;
+    // Batch reads: the value of each of `count` ascending rows, with every
+    // block they fall in located and decoded once. Views into a paged column
+    // stay valid while the pins appended to `pins` are held.
+    void gatherInts(const size_t* rows, size_t count, int64_t* out) const; // int kinds
+    void gatherFloats(const size_t* rows, size_t count, double* out) const; // numeric kinds
+    void gatherViews(const size_t* rows, size_t count, std::string_view* out,
+                     std::vector<KimBlockPin>* pins = nullptr) const; // as getView
+    // Stored bytes, as getView but with Dictionary codes and FixedString padding
+    void gatherRaw(const size_t* rows, size_t count, std::string_view* out,
+                   std::vector<KimBlockPin>* pins = nullptr) const;
+    // Block b of a paged column, read into the buffer pool if it is not
+    // there; null for a block held in memory. getView views into the block
+    // stay valid while the pin is held; otherwise only until the thread has
+    // read a few other paged blocks.
+    KimBlockPin pinBlock(size_t b) const;
+    // Numeric kinds: aggregates of block b. An Rle block is summed a run at a
+    // time without decoding; other blocks are read in one pass.
+    void summarizeBlock(size_t b, KimBlockSummary& out) const;
+
+    // Order of zone maps: numeric kinds by value, Dictionary by code and
+    // strings by their first 8 bytes, so a range of values is a range of keys
+    uint64_t zoneKey(std::string_view raw) const;
+    // False when the zone map of block b shows that no row can match filter
+    bool mayMatch(const KimColumnFilter& filter, size_t b) const;
+    // Exact statistics of block b, read from its values unless the block is
+    // unchanged since it was read from a file with a zone map
+    KimZoneEntry zoneEntry(size_t b) const;
+    // Sets each block's zone from a zone map section; false when it does not
+    // have one entry per block
+    bool mapZones(const char* section, size_t size);
+
+    // Numeric values mapped to uint64 so that unsigned order matches value
+    // order; shared by range scans and the B+tree index.
+    bool isNumeric() const {
+        return kind != KimStorageKind::String && kind != KimStorageKind::FixedString && kind != KimStorageKind::Dictionary;
+    }
+    uint64_t orderedKey(size_t row) const;
+    // Inclusive key interval covering `range`; false when nothing can match.
+    bool orderedRange(const KimRange& range, uint64_t& low, uint64_t& high) const;
+
+    // Column data section of a version 7 file (see KimBlockHeader). With
+    // `compress` each block is stored with the encoding that makes it
+    // smallest, judged from its run count, value range and delta range;
+    // otherwise every block is Plain.
+    void encodeSection(bool compress, std::vector<char>& out) const;
+    // Points the blocks at a column section inside a mapped file. Only the
+    // extents are checked, so opening costs O(blocks) rather than O(bytes).
+    // Version 4 and 5 sections hold fixed-width values back to back, and for
+    // strings a table of block offsets, then each block's offsets and bytes.
+    bool map(const char* section, size_t available, size_t rows);
+    bool mapBlocks(const char* section, size_t available, size_t rows); // version 7
+    // Same for a version 7 column section read through the buffer pool: the
+    // offset table is read now, each block when it is first used. The
+    // section spans [offset, end) of the file.
+    bool pageBlocks(const std::shared_ptr<const KimPagedFile>& file, uint64_t offset, uint64_t end, size_t rows);
+    // Copies mapped and paged blocks and the dictionary into owned storage,
+    // decoding encoded blocks, so the mapping or file can be dropped.
+    void materialize();
+
+private:
+    size_t numRows = 0;
+
+    bool encode(const std::string& value, char* out) const;
+    // An encoded block's decoded copy, made once and kept; plain blocks are their own
+    const KimColumnBlock& plainBlock(size_t b) const;
+    const KimColumnBlock& plainCopy(const KimColumnBlock& block) const;
+    // Block b with its data: the block itself, or for a paged block its page,
+    // which `pin` keeps resident
+    const KimColumnBlock& storedBlock(size_t b, KimBlockPin& pin) const;
+    KimBlockPin readPage(size_t b) const;
+    void decodeBlock(const KimColumnBlock& block, KimColumnBlock& out) const;
+    void encodeBlock(const KimColumnBlock& block, bool compress, std::vector<char>& out) const;
+    // Predicates on Rle and FrameOfReference blocks, evaluated per run or on
+    // the packed values; false for encodings that need decoding first
+    bool selectEncoded(const KimColumnFilter& filter, const KimColumnBlock& block, uint64_t* selection) const;
+    void selectPlain(const KimColumnFilter& filter, const KimColumnBlock& block, uint64_t* selection) const;
+    bool rawMatches(const KimColumnFilter& filter, std::string_view raw) const;
+    std::string_view rawAt(size_t row) const;
+    std::string_view rawAt(const KimColumnBlock& block, size_t index) const;
+    void pushRaw(KimColumnBlock& block, std::string_view raw) const;
+    void widenZone(KimColumnBlock& block, std::string_view raw) const;
+    void setRaw(size_t row, std::string_view raw);
+    void removeAt(KimColumnBlock& block, size_t index) const;
+    KimColumnBlock& tailBlock();
+    // Block b, copied first when another column shares it
+    KimColumnBlock& ownBlock(size_t b);
+    uint32_t intern(std::string_view value);
+    // Calls read(i, block, index) for each of `count` ascending rows
+    template <typename Read>
+    void forEachRow(const size_t* rows, size_t count, Read read, std::vector<KimBlockPin>* pins = nullptr) const;
+};
+
+// Appends base + i for each set bit i of a selection bitmap over `count`
+// rows, stopping after `limit`; returns the number appended.
+size_t kimAppendSelection(const uint64_t* selection, size_t count, size_t base, std::vector<size_t>& out,
+                          size_t limit = SIZE_MAX);
+
+// Tombstone bitmaps: bit row % 64 of word row / 64 is set once the row is
+// deleted. Words past the end of the bitmap are all live rows.
+inline bool kimIsDeleted(const std::vector<uint64_t>& deleted, size_t row) {
+    return row / 64 < deleted.size() && ((deleted[row / 64] >> (row % 64)) & 1) != 0;
+}
+
+// Clears the bits of deleted rows from the selection bitmap of block b
+void kimClearDeleted(const std::vector<uint64_t>& deleted, size_t b, size_t count, uint64_t* selection);
+
+bool kimParseInt(const std::string& text, int64_t& out);
+bool kimParseFloat(const std::string& text, double& out);
+std::string kimFormatFloat(double value);
+
+#endif //KIMDB_KIMCOLUMNSTORE_H
@@ -0,0 +1,147 @@
+//
+// Codecs used for the encoded column blocks of version 7 files.
+//
+
+#include "KimCompression.h"
+
+#include <algorithm>
+
+static constexpr size_t kMinMatch = 4;
+static constexpr size_t kMaxOffset = 65535;
+static constexpr unsigned kHashBits = 12;
+
+static void writeLength(size_t length, std::vector<char>& out) {
+    for (; length >= 255; length -= 255) {
+        out.push_back(static_cast<char>(255));
+    }
+    out.push_back(static_cast<char>(length));
+}
+
+static void emitSequence(const char* literals, size_t literalLength, size_t matchLength, size_t offset,
+                         std::vector<char>& out) {
+    size_t matchCode = matchLength ? matchLength - kMinMatch : 0;
+    uint8_t token = static_cast<uint8_t>((std::min<size_t>(literalLength, 15) << 4) | std::min<size_t>(matchCode, 15));
+    out.push_back(static_cast<char>(token));
+    if (literalLength >= 15) {
+        writeLength(literalLength - 15, out);
+    }
+    out.insert(out.end(), literals, literals + literalLength);
+    if (matchLength == 0) {
+        return;
+    }
+    out.push_back(static_cast<char>(offset & 0xff));
+    out.push_back(static_cast<char>(offset >> 8));
+    if (matchCode >= 15) {
+        writeLength(matchCode - 15, out);
+    }
+}
+
+void kimLzCompress(const char* input, size_t size, std::vector<char>& out) {
+    // Greedy matching against the last position of each hashed 4-byte prefix
+    std::vector<size_t> last(size_t(1) << kHashBits, SIZE_MAX);
+    size_t anchor = 0;
+    size_t position = 0;
+    while (position + kMinMatch <= size) {
+        uint32_t prefix;
+        std::memcpy(&prefix, input + position, sizeof(prefix));
+        uint32_t hash = (prefix * 2654435761u) >> (32 - kHashBits);
+        size_t candidate = last[hash];
+        last[hash] = position;
+        if (candidate == SIZE_MAX || position - candidate > kMaxOffset ||
+            std::memcmp(input + candidate, input + position, kMinMatch) != 0) {
+            ++position;
+            continue;
+        }
+        size_t length = kMinMatch;
+        while (position + length < size && input[candidate + length] == input[position + length]) {
+            ++length;
+        }
+        emitSequence(input + anchor, position - anchor, length, position - candidate, out);
+        position += length;
+        anchor = position;
+    }
+    emitSequence(input + anchor, size - anchor, 0, 0, out);
+}
+
+static bool readLength(const uint8_t* input, size_t size, size_t& in, size_t& length) {
+    uint8_t next;
+    do {
+        if (in >= size) {
+            return false;
+        }
+        next = input[in++];
+        length += next;
+    } while (next == 255);
+    return true;
+}
+
+bool kimLzDecompress(const char* compressed, size_t size, char* out, size_t outSize) {
+    const uint8_t* input = reinterpret_cast<const uint8_t*>(compressed);
+    size_t in = 0;
+    size_t written = 0;
+    while (in < size) {
+        uint8_t token = input[in++];
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !readLength(input, size, in, literalLength)) {
+            return false;
+        }
+        if (literalLength > size - in || literalLength > outSize - written) {
+            return false;
+        }
+        std::memcpy(out + written, input + in, literalLength);
+        in += literalLength;
+        written += literalLength;
+        if (in == size) {
+            break;
+        }
+
+        if (size - in < 2) {
+            return false;
+        }
+        size_t offset = input[in] | (size_t(input[in + 1]) << 8);
+        in += 2;
+        size_t matchLength = (token & 15) + kMinMatch;
+        if ((token & 15) == 15 && !readLength(input, size, in, matchLength)) {
+            return false;
+        }
+        if (offset == 0 || offset > written || matchLength > outSize - written) {
+            return false;
+        }
+        // Byte by byte: a match may overlap the bytes it produces
+        for (size_t i = 0; i < matchLength; ++i) {
+            out[written + i] = out[written - offset + i];
+        }
+        written += matchLength;
+    }
+    return written == outSize;
+}
+
+void kimBitPack(const uint64_t* values, size_t count, unsigned bits, std::vector<char>& out) {
+    size_t start = out.size();
+    out.resize(start + kimPackedBytes(count, bits));
+    if (bits == 0) {
+        return;
+    }
+    char* packed = out.data() + start;
+    uint64_t word = 0;
+    unsigned used = 0;
+    size_t wordIndex = 0;
+    auto flush = [&] {
+        std::memcpy(packed + wordIndex * sizeof(uint64_t), &word, sizeof(word));
+        ++wordIndex;
+    };
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t value = bits == 64 ? values[i] : values[i] & ((uint64_t(1) << bits) - 1);
+        word |= value << used;
+        if (used + bits >= 64) {
+            flush();
+            word = used == 0 ? 0 : value >> (64 - used);
+            used = used + bits - 64;
+        } else {
+            used += bits;
+        }
+    }
+    if (used > 0) {
+        flush();
+    }
+}
@@ -0,0 +1,60 @@
+//
+// Codecs used for the encoded column blocks of version 7 files.
+//
+
+#ifndef KIMDB_KIMCOMPRESSION_H
+#define KIMDB_KIMCOMPRESSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Byte-oriented LZ77 in the style of LZ4. The input is a series of sequences,
+// each a token byte whose high nibble is the literal length and low nibble
+// the match length minus 4 (15 meaning more length bytes follow, each adding
+// up to 255), the literals, and a little-endian uint16 match offset. The last
+// sequence has literals only.
+void kimLzCompress(const char* input, size_t size, std::vector<char>& out);
+// Fills out[0, outSize) from a compressed input; false if the input is
+// malformed or does not expand to exactly outSize bytes
+bool kimLzDecompress(const char* input, size_t size, char* out, size_t outSize);
+
+// Bits needed for values up to maxValue
+inline unsigned kimBitWidth(uint64_t maxValue) {
+    unsigned bits = 0;
+    while (maxValue) {
+        ++bits;
+        maxValue >>= 1;
+    }
+    return bits;
+}
+
+// Bytes taken by count values of `bits` bits packed into uint64 words
+inline size_t kimPackedBytes(size_t count, unsigned bits) {
+    return (count * bits + 63) / 64 * sizeof(uint64_t);
+}
+
+// Appends count values of `bits` bits to out, least significant bit first
+void kimBitPack(const uint64_t* values, size_t count, unsigned bits, std::vector<char>& out);
+
+// Value `index` of a packed array
+inline uint64_t kimBitUnpack(const char* packed, size_t index, unsigned bits) {
+    if (bits == 0) {
+        return 0;
+    }
+    size_t bit = index * bits;
+    size_t word = bit / 64;
+    unsigned shift = bit % 64;
+    uint64_t low;
+    std::memcpy(&low, packed + word * sizeof(uint64_t), sizeof(low));
+    uint64_t value = low >> shift;
+    if (shift + bits > 64) {
+        uint64_t high;
+        std::memcpy(&high, packed + (word + 1) * sizeof(uint64_t), sizeof(high));
+        value |= high << (64 - shift);
+    }
+    return bits == 64 ? value : value & ((uint64_t(1) << bits) - 1);
+}
+
+#endif //KIMDB_KIMCOMPRESSION_H
@@ -0,0 +1,311 @@
+//
+// Many KimTables stored together in one .kim file.
+//
+
+#include "KimDatabase.h"
+#include "KimSqlParser.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+// Current name of an entry: a loaded table may have been renamed
+static const char* nameOf(const std::unique_ptr<KimTable>& table, const std::string& name) {
+    return table ? table->header.TableName : name.c_str();
+}
+
+bool KimDatabase::open(const std::string& fileName, bool mapTables) {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    mapped = mapTables;
+
+    auto file = std::make_shared<KimMappedFile>();
+    if (!file->open(fileName)) {
+        return false;
+    }
+    KimFileHeaderV3 fileHeader{};
+    if (file->size() < sizeof(fileHeader)) {
+        std::cerr << "Invalid file header: " << fileName << std::endl;
+        return false;
+    }
+    std::memcpy(&fileHeader, file->data(), sizeof(fileHeader));
+
+    // Single-table files are a database of one table
+    if (fileHeader.FileFormatVersion == kKimFormatRowText) {
+        Entry entry;
+        entry.table = std::make_unique<KimTable>();
+        entry.table->loadFromFile(fileName);
+        entry.name = entry.table->header.TableName;
+        entries.push_back(std::move(entry));
+        return true;
+    }
+    if (fileHeader.FileFormatVersion == kKimFormatColumnar || fileHeader.FileFormatVersion == kKimFormatSections ||
+        fileHeader.FileFormatVersion == kKimFormatEncoded || fileHeader.FileFormatVersion == kKimFormatChecked) {
+        // The table name leads the table header, which follows a file header
+        // of either layout
+        bool checked = fileHeader.FileFormatVersion == kKimFormatChecked;
+        size_t nameOffset = checked ? sizeof(KimFileHeaderV8) : sizeof(fileHeader);
+        char tableName[sizeof(TableHeader::TableName)];
+        if (file->size() < nameOffset + (checked ? sizeof(KimTableHeaderV8) : sizeof(TableHeader))) {
+            std::cerr << "Invalid table header: " << fileName << std::endl;
+            return false;
+        }
+        std::memcpy(tableName, file->data() + nameOffset, sizeof(tableName));
+        tableName[sizeof(tableName) - 1] = '\0';
+        Entry entry;
+        entry.name = tableName;
+        entry.source = file;
+        entry.size = file->size();
+        entries.push_back(std::move(entry));
+        return true;
+    }
+
+    // Version 6: the trailer at the end of the file locates the directory
+    if (fileHeader.FileFormatVersion != kKimFormatDatabase) {
+        std::cerr << "Invalid or unsupported database file: " << fileName << std::endl;
+        return false;
+    }
+    std::vector<KimTableEntry> directory;
+    if (!kimReadDirectory(file->data(), file->size(), directory)) {
+        std::cerr << "Invalid table directory: " << fileName << std::endl;
+        return false;
+    }
+    for (const auto& tableEntry : directory) {
+        Entry entry;
+        entry.name = tableEntry.TableName;
+        entry.source = file;
+        entry.offset = tableEntry.Offset;
+        entry.size = tableEntry.Size;
+        entries.push_back(std::move(entry));
+    }
+    return true;
+}
+
+bool KimDatabase::writeToFile(const std::string& fileName, bool durable) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string tempFileName = fileName + ".tmp";
+    std::ofstream ofs(tempFileName, std::ios::binary);
+    if (!ofs) {
+        std::cerr << "Failed to open file: " << fileName << std::endl;
+        return false;
+    }
+
+    KimFileHeaderV3 fileHeader{};
+    fileHeader.FileFormatVersion = kKimFormatDatabase;
+    fileHeader.NumTables = static_cast<uint16_t>(entries.size());
+    ofs.write(reinterpret_cast<const char*>(&fileHeader), sizeof(fileHeader));
+
+    // Each image starts on an 8-byte boundary so its sections can be mapped in place
+    const char padding[8] = {};
+    uint64_t position = sizeof(fileHeader);
+    std::vector<KimTableEntry> directory(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const Entry& entry = entries[i];
+        uint64_t aligned = (position + 7) & ~uint64_t(7);
+        ofs.write(padding, static_cast<std::streamsize>(aligned - position));
+        position = aligned;
+
+        KimTableEntry& tableEntry = directory[i];
+        // The directory is zeroed, so a name cut to fit stays NUL-terminated
+        const char* name = nameOf(entry.table, entry.name);
+        std::memcpy(tableEntry.TableName, name, std::min(std::strlen(name), sizeof(tableEntry.TableName) - 1));
+        tableEntry.Offset = position;
+        if (entry.table) {
+            tableEntry.Size = entry.table->writeImage(ofs);
+        } else {
+            ofs.write(entry.source->data() + entry.offset, static_cast<std::streamsize>(entry.size));
+            tableEntry.Size = entry.size;
+        }
+        position += tableEntry.Size;
+    }
+
+    KimDirectoryTrailer trailer{};
+    trailer.DirectoryOffset = position;
+    trailer.NumTables = directory.size();
+    std::memcpy(trailer.Magic, kKimDirectoryMagic, sizeof(trailer.Magic));
+    ofs.write(reinterpret_cast<const char*>(directory.data()), directory.size() * sizeof(KimTableEntry));
+    ofs.write(reinterpret_cast<const char*>(&trailer), sizeof(trailer));
+
+    // FileSize is only 32 bits wide; the trailer is what readers rely on
+    position += directory.size() * sizeof(KimTableEntry) + sizeof(trailer);
+    fileHeader.FileSize = static_cast<uint32_t>(position);
+    ofs.seekp(0);
+    ofs.write(reinterpret_cast<const char*>(&fileHeader), sizeof(fileHeader));
+    ofs.close();
+
+    // Unloaded tables keep reading from the file they were opened from, which
+    // stays mapped even when the new file replaces it
+    return kimReplaceFile(tempFileName, fileName, !ofs, durable);
+}
+
+KimTable* KimDatabase::createTable(const std::string& name, const std::vector<ColumnHeader>& headers) {
+    auto table = std::make_unique<KimTable>();
+    table->setTableName(name);
+    table->createTable(headers);
+    return addTable(std::move(table));
+}
+
+KimTable* KimDatabase::addTable(std::unique_ptr<KimTable> table) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!table || find(table->header.TableName)) {
+        std::cerr << "Error: table '" << (table ? table->header.TableName : "") << "' already exists." << std::endl;
+        return nullptr;
+    }
+    Entry entry;
+    entry.name = table->header.TableName;
+    entry.table = std::move(table);
+    entries.push_back(std::move(entry));
+    return entries.back().table.get();
+}
+
+bool KimDatabase::dropTable(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+        if (name == nameOf(it->table, it->name)) {
+            entries.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+
+KimDatabase::Entry* KimDatabase::find(const std::string& name) {
+    for (auto& entry : entries) {
+        if (name == nameOf(entry.table, entry.name)) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+const KimDatabase::Entry* KimDatabase::find(const std::string& name) const {
+    return const_cast<KimDatabase*>(this)->find(name);
+}
+
+KimTable* KimDatabase::load(Entry& entry) {
+    if (entry.table) {
+        return entry.table.get();
+    }
+    // Opening only checks the headers, so the sections are checked here,
+    // whether the table is then mapped or copied
+    auto table = std::make_unique<KimTable>();
+    if (!kimVerifyImage(entry.source->data() + entry.offset, entry.size) ||
+        !table->openMapped(entry.source, entry.offset, entry.size)) {
+        std::cerr << "Invalid table image: " << entry.name << std::endl;
+        return nullptr;
+    }
+    if (!mapped) {
+        table->materialize();
+    }
+    entry.table = std::move(table);
+    entry.source.reset();
+    return entry.table.get();
+}
+
+KimTable* KimDatabase::table(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry* entry = find(name);
+    return entry ? load(*entry) : nullptr;
+}
+
+bool KimDatabase::hasTable(const std::string& name) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return find(name) != nullptr;
+}
+
+bool KimDatabase::isLoaded(const std::string& name) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    const Entry* entry = find(name);
+    return entry && entry->table;
+}
+
+std::vector<std::string> KimDatabase::tableNames() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::string> names;
+    for (const auto& entry : entries) {
+        names.emplace_back(nameOf(entry.table, entry.name));
+    }
+    return names;
+}
+
+size_t KimDatabase::tableCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
+
+size_t KimDatabase::loadedTableCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t loaded = 0;
+    for (const auto& entry : entries) {
+        loaded += entry.table ? 1 : 0;
+    }
+    return loaded;
+}
+
+// Parses just enough of sqlQuery to name the tables it reads
+static bool tablesOf(const std::string& sqlQuery, KimSelectStatement& statement) {
+    std::vector<KimToken> tokens;
+    std::string error;
+    KimNormalizedSql normalized;
+    if (kimTokenize(sqlQuery, tokens, error)) {
+        kimNormalize(tokens, normalized);
+    }
+    if (!error.empty() || !kimParseSelect(normalized.tokens, statement, error)) {
+        std::cerr << "Invalid SQL query: " << error << std::endl;
+        return false;
+    }
+    return true;
+}
+
+KimPreparedStatement KimDatabase::prepare(const std::string& sqlQuery) {
+    KimSelectStatement statement;
+    if (!tablesOf(sqlQuery, statement)) {
+        return KimPreparedStatement();
+    }
+    KimTable* from = table(statement.table);
+    if (!from) {
+        std::cerr << "Unknown table: " << statement.table << std::endl;
+        return KimPreparedStatement();
+    }
+    return from->prepare(sqlQuery);
+}
+
+KimCursor KimDatabase::openCursor(const std::string& sqlQuery) {
+    KimPreparedStatement statement = prepare(sqlQuery);
+    return statement.valid() ? statement.openWith({}) : KimCursor();
+}
+
+std::vector<std::string> KimDatabase::selectRowWithSQL(const std::string& sqlQuery) {
+    KimSelectStatement statement;
+    if (!tablesOf(sqlQuery, statement)) {
+        return {};
+    }
+    KimTable* from = table(statement.table);
+    if (!from) {
+        std::cerr << "Unknown table: " << statement.table << std::endl;
+        return {};
+    }
+    if (statement.join) {
+        std::vector<std::vector<std::string>> rows = selectRowsWithSQL(sqlQuery);
+        return rows.empty() ? std::vector<std::string>() : rows.front();
+    }
+    return from->selectRowWithSQL(*from, sqlQuery);
+}
+
+std::vector<std::vector<std::string>> KimDatabase::selectRowsWithSQL(const std::string& sqlQuery) {
+    KimSelectStatement statement;
+    if (!tablesOf(sqlQuery, statement)) {
+        return {};
+    }
+    KimTable* from = table(statement.table);
+    KimTable* joined = statement.join ? table(statement.joinTable) : from;
+    if (!from || !joined) {
+        std::cerr << "Unknown table: " << (from ? statement.joinTable : statement.table) << std::endl;
+        return {};
+    }
+    if (statement.join) {
+        return from->selectRowsWithSQL(*from, *joined, sqlQuery);
+    }
+    return from->selectRowsWithSQL(*from, sqlQuery);
+}
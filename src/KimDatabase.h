@@ -0,0 +1,74 @@
+//
+// Many KimTables stored together in one .kim file.
+//
+
+#ifndef KIMDB_KIMDATABASE_H
+#define KIMDB_KIMDATABASE_H
+
+#include "KimFileHead.h"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Owns a set of tables and reads and writes them as one version 6 file (see
+// KimFileFormat.h). Opening a file reads only its header and table
+// directory; a table is loaded, or mapped, the first time it is asked for,
+// so a query against one table of a large database touches only that
+// table's pages.
+class KimDatabase {
+public:
+    KimDatabase() = default;
+    KimDatabase(const KimDatabase&) = delete;
+    KimDatabase& operator=(const KimDatabase&) = delete;
+
+    // Replaces the tables with those of fileName. Version 4, 5, 7 and 8 files open
+    // as a database of their one table. With mapTables the tables are mapped
+    // read-only instead of being copied into memory when first used.
+    bool open(const std::string& fileName, bool mapTables = false);
+    // Writes every table; tables that were never loaded are copied from the
+    // file they were opened from without being parsed
+    bool writeToFile(const std::string& fileName, bool durable = false);
+
+    // Adds an empty table; returns null when the name is taken
+    KimTable* createTable(const std::string& name, const std::vector<ColumnHeader>& headers);
+    // Takes over a table built elsewhere, under its TableName
+    KimTable* addTable(std::unique_ptr<KimTable> table);
+    bool dropTable(const std::string& name);
+
+    // The named table, loading it on first use; null when there is none or it
+    // cannot be read
+    KimTable* table(const std::string& name);
+    bool hasTable(const std::string& name) const;
+    bool isLoaded(const std::string& name) const;
+    std::vector<std::string> tableNames() const;
+    size_t tableCount() const;
+    size_t loadedTableCount() const;
+
+    // Runs a query against the tables it names, loading them as needed
+    KimPreparedStatement prepare(const std::string& sqlQuery);
+    std::vector<std::string> selectRowWithSQL(const std::string& sqlQuery);
+    std::vector<std::vector<std::string>> selectRowsWithSQL(const std::string& sqlQuery);
+    KimCursor openCursor(const std::string& sqlQuery); // single-table queries
+
+private:
+    struct Entry {
+        std::string name;
+        std::unique_ptr<KimTable> table; // null until first used
+        std::shared_ptr<KimMappedFile> source; // file holding the image of an unloaded table
+        uint64_t offset = 0;
+        uint64_t size = 0;
+    };
+
+    mutable std::mutex mutex; // guards entries; loading a table holds it
+    std::vector<Entry> entries;
+    bool mapped = false;
+
+    Entry* find(const std::string& name);
+    const Entry* find(const std::string& name) const;
+    KimTable* load(Entry& entry);
+};
+
+#endif //KIMDB_KIMDATABASE_H
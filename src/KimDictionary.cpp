@@ -0,0 +1,152 @@
+//
+// Distinct values of a dictionary-encoded string column.
+//
+
+#include "KimDictionary.h"
+
+#include <algorithm>
+#include <cstring>
+
+KimDictionary::KimDictionary(const KimDictionary& other) {
+    *this = other;
+}
+
+KimDictionary& KimDictionary::operator=(const KimDictionary& other) {
+    // Re-interned in code order, so every value keeps its code
+    if (this != &other) {
+        clear();
+        values.reserve(other.values.size());
+        codes.reserve(other.values.size());
+        for (std::string_view value : other.values) {
+            intern(value);
+        }
+    }
+    return *this;
+}
+
+bool KimDictionary::find(std::string_view value, uint32_t& code) const {
+    auto it = codes.find(value);
+    if (it == codes.end()) {
+        return false;
+    }
+    code = it->second;
+    return true;
+}
+
+std::string_view KimDictionary::store(std::string_view value) {
+    if (value.empty()) {
+        return std::string_view();
+    }
+    // Values larger than a chunk get a chunk of their own, leaving the
+    // current one open for the small values that follow
+    if (value.size() > kChunkBytes / 4) {
+        std::unique_ptr<char[]> data(new char[value.size()]);
+        std::memcpy(data.get(), value.data(), value.size());
+        std::string_view stored(data.get(), value.size());
+        chunks.insert(chunks.empty() ? chunks.end() : chunks.end() - 1, std::move(data));
+        return stored;
+    }
+    if (value.size() > chunkCapacity - chunkUsed) {
+        chunks.emplace_back(new char[kChunkBytes]);
+        chunkUsed = 0;
+        chunkCapacity = kChunkBytes;
+    }
+    char* data = chunks.back().get() + chunkUsed;
+    std::memcpy(data, value.data(), value.size());
+    chunkUsed += value.size();
+    return std::string_view(data, value.size());
+}
+
+uint32_t KimDictionary::intern(std::string_view value) {
+    uint32_t code;
+    if (find(value, code)) {
+        return code;
+    }
+    code = static_cast<uint32_t>(values.size());
+    std::string_view stored = store(value);
+    values.push_back(stored);
+    codes.emplace(stored, code);
+    return code;
+}
+
+void KimDictionary::clear() {
+    chunks.clear();
+    chunkUsed = 0;
+    chunkCapacity = 0;
+    values.clear();
+    codes.clear();
+    mapped = false;
+}
+
+static uint64_t alignTo8(uint64_t offset) {
+    return (offset + 7) & ~uint64_t(7);
+}
+
+uint64_t KimDictionary::serializedSize() const {
+    uint64_t bytes = 0;
+    for (std::string_view value : values) {
+        bytes += value.size();
+    }
+    return alignTo8((values.size() + 2) * sizeof(uint64_t) + bytes);
+}
+
+void KimDictionary::write(std::ostream& os) const {
+    uint64_t count = values.size();
+    std::vector<uint64_t> offsets;
+    offsets.reserve(count + 2);
+    offsets.push_back(count);
+    offsets.push_back(0);
+    for (std::string_view value : values) {
+        offsets.push_back(offsets.back() + value.size());
+    }
+    os.write(reinterpret_cast<const char*>(offsets.data()), static_cast<std::streamsize>(offsets.size() * sizeof(uint64_t)));
+    for (std::string_view value : values) {
+        os.write(value.data(), static_cast<std::streamsize>(value.size()));
+    }
+    const char padding[8] = {};
+    os.write(padding, static_cast<std::streamsize>(alignTo8(offsets.back()) - offsets.back()));
+}
+
+bool KimDictionary::map(const char* section, size_t available) {
+    uint64_t count;
+    if (available < sizeof(count)) {
+        return false;
+    }
+    std::memcpy(&count, section, sizeof(count));
+    if (count > kKimMaxDictionaryCodes || count + 2 > available / sizeof(uint64_t)) {
+        return false;
+    }
+    const char* offsets = section + sizeof(uint64_t);
+    const char* bytes = offsets + (count + 1) * sizeof(uint64_t);
+    uint64_t byteCount = available - (count + 2) * sizeof(uint64_t);
+    auto offsetAt = [&](size_t i) {
+        uint64_t offset;
+        std::memcpy(&offset, offsets + i * sizeof(uint64_t), sizeof(offset));
+        return offset;
+    };
+    if (offsetAt(0) != 0 || offsetAt(count) > byteCount) {
+        return false;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (offsetAt(i + 1) < offsetAt(i)) {
+            return false;
+        }
+    }
+
+    clear();
+    values.reserve(count);
+    codes.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        values.emplace_back(bytes + offsetAt(i), offsetAt(i + 1) - offsetAt(i));
+        codes.emplace(values.back(), static_cast<uint32_t>(i));
+    }
+    mapped = true;
+    return true;
+}
+
+void KimDictionary::materialize() {
+    if (mapped) {
+        KimDictionary owned(*this);
+        *this = std::move(owned);
+    }
+}
@@ -0,0 +1,62 @@
+//
+// Distinct values of a dictionary-encoded string column.
+//
+
+#ifndef KIMDB_KIMDICTIONARY_H
+#define KIMDB_KIMDICTIONARY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Codes fit in the int32 values of a column block, so scans compare them
+// with the Int32 kernels.
+constexpr size_t kKimMaxDictionaryCodes = INT32_MAX;
+
+// Interns strings into an arena of fixed-size chunks and numbers them in the
+// order they were first seen. Values never move once stored, so the views it
+// hands out stay valid for the dictionary's lifetime, and the code map keys
+// point at them instead of holding copies.
+class KimDictionary {
+public:
+    KimDictionary() = default;
+    KimDictionary(const KimDictionary& other);
+    KimDictionary& operator=(const KimDictionary& other);
+    KimDictionary(KimDictionary&& other) noexcept = default;
+    KimDictionary& operator=(KimDictionary&& other) noexcept = default;
+
+    size_t size() const { return values.size(); }
+    bool full() const { return values.size() >= kKimMaxDictionaryCodes; }
+    // Empty for codes the dictionary does not hold, which only a damaged file stores
+    std::string_view value(uint32_t code) const { return code < values.size() ? values[code] : std::string_view(); }
+    bool find(std::string_view value, uint32_t& code) const;
+    // Code of value, adding it when it is new; check full() first
+    uint32_t intern(std::string_view value);
+    void clear();
+
+    // Dictionary section of a version 7 file: a uint64 count, uint64
+    // offsets[count + 1] into the bytes that follow, padded to 8 bytes. A
+    // mapped dictionary points its values into the section.
+    uint64_t serializedSize() const;
+    void write(std::ostream& os) const;
+    bool map(const char* section, size_t available);
+    void materialize();
+
+private:
+    static constexpr size_t kChunkBytes = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> chunks;
+    size_t chunkUsed = 0;
+    size_t chunkCapacity = 0;
+    std::vector<std::string_view> values; // by code
+    std::unordered_map<std::string_view, uint32_t> codes;
+    bool mapped = false; // values point into a mapped section rather than the chunks
+
+    std::string_view store(std::string_view value);
+};
+
+#endif //KIMDB_KIMDICTIONARY_H
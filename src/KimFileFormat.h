@@ -0,0 +1,237 @@
+//
+// On-disk header structures for the .kim file format.
+//
+
+#ifndef KIMDB_KIMFILEFORMAT_H
+#define KIMDB_KIMFILEFORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Files are written in the host's byte order, which for every host kimdb
+// runs on is little-endian
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "kimdb files are little-endian; big-endian hosts are not supported"
+#endif
+
+// Values stored in ColumnHeader::DataType. A zero-initialised header is a
+// string column, which keeps tables created from plain column names working.
+enum class KimDataType : uint8_t {
+    String = 0,
+    Int = 1,
+    Float = 2,
+    FixedString = 3, // char[DataSize], NUL-padded
+    Dictionary = 4, // strings stored as uint32 codes into a per-column dictionary
+};
+
+// FileFormatVersion values. Version 3 stores rows as null-terminated text
+// cells; version 4 stores each column as its own 8-byte aligned section that
+// can be read in place from a memory mapping:
+//
+//   KimFileHeaderV3, TableHeader, uint32 numColumns, ColumnHeader[numColumns],
+//   uint64 numRows, padding to 8, uint64 columnOffsets[numColumns],
+//   one column data section per column (see KimColumn::write)
+//
+// Version 5 adds a section directory right after the column offset table,
+// uint64 numSections followed by KimSectionEntry[numSections], for data that
+// is derived from the columns, such as indexes. Readers skip kinds they do
+// not know.
+//
+// Version 6 is a database of many tables. After the file header, whose
+// NumTables counts them, each table is a table image starting on an
+// 8-byte boundary, with offsets relative to its own start. A table directory
+// follows the images and a fixed-size trailer ends the file, so the
+// directory is found by reading the last bytes:
+//
+//   KimFileHeaderV3, padding to 8, table images,
+//   KimTableEntry[numTables], KimDirectoryTrailer
+//
+// Version 7 images store every column section as a table of uint64 block
+// offsets, relative to the section, followed by each block as a
+// KimBlockHeader and its payload, padded to 8 bytes. A version 6 database
+// holds version 5, 7 or 8 images.
+//
+// Version 8 keeps the sections of version 7 but replaces the headers, whose
+// structs had compiler-dependent padding and 16- and 32-bit counts, with
+// structs of fixed layout and 64-bit counts and offsets. It adds a size and a
+// CRC-32C checksum (kimCrc32c) to every section, and a checksum of the
+// headers themselves:
+//
+//   KimFileHeaderV8, KimTableHeaderV8, KimColumnHeaderV8[NumColumns],
+//   KimColumnEntry[NumColumns], KimSectionEntryV8[NumSections], sections
+//
+// Every version keeps FileFormatVersion in the first byte, which is how
+// readers tell them apart.
+constexpr uint8_t kKimFormatRowText = 3;
+constexpr uint8_t kKimFormatColumnar = 4;
+constexpr uint8_t kKimFormatSections = 5;
+constexpr uint8_t kKimFormatDatabase = 6;
+constexpr uint8_t kKimFormatEncoded = 7;
+constexpr uint8_t kKimFormatChecked = 8;
+
+enum class KimSectionKind : uint32_t {
+    HashIndex = 1,
+    TreeIndex = 2,
+    LinkKeys = 3, // uint64 count followed by KimLinkKey[count]
+    LogSequence = 4, // uint64 sequence of the last write-ahead log record the file includes
+    Tombstones = 5, // uint64 words, bit row % 64 of word row / 64 set for deleted rows
+    Dictionary = 6, // values of a Dictionary column, see KimDictionary
+    ZoneMap = 7, // KimZoneEntry[blocks] of a column
+};
+
+// How a column block of a version 7 file is stored. Payloads:
+//   Plain             the block as version 5 stores it: count values, or for
+//                     strings uint32 offsets[count + 1] followed by the bytes
+//   Rle               uint32 runEnds[Runs] (exclusive), padding to 8, then the
+//                     value of each run laid out as a Plain payload of Runs values
+//   FrameOfReference  int columns: value - Base, Bits bits each, packed
+//                     least significant bit first into uint64 words
+//   Delta             int columns: the first value is Base; each later one is
+//                     the previous plus Reference plus its packed Bits-bit word
+//   Lz                the Plain payload, RawSize bytes, compressed with kimLzCompress
+enum class KimBlockEncoding : uint8_t {
+    Plain = 0,
+    Rle = 1,
+    FrameOfReference = 2,
+    Delta = 3,
+    Lz = 4,
+};
+
+struct KimBlockHeader {
+    uint8_t Encoding;
+    uint8_t Bits;
+    uint16_t Reserved;
+    uint32_t Count; // values in the block
+    uint32_t Runs;
+    uint32_t RawSize;
+    int64_t Base;
+    int64_t Reference;
+    uint64_t Size; // payload bytes after the header, padding excluded
+};
+
+// Statistics of one column block, which let a scan skip blocks that cannot
+// hold a value a predicate asks for. Min and Max bound the block's values as
+// KimColumn::zoneKey orders them.
+struct KimZoneEntry {
+    uint64_t Min;
+    uint64_t Max;
+    uint32_t NullCount; // always 0 for now; columns cannot hold NULL yet
+    uint32_t Distinct; // estimated number of distinct values
+};
+
+struct KimSectionEntry {
+    uint32_t Kind;
+    uint32_t ColumnIndex;
+    uint64_t Offset;
+    uint64_t Size;
+};
+
+// Entry of the link keys section: a column that links tables together, named
+// by the index of its table within the file and its index within the table.
+struct KimLinkKey {
+    uint32_t TableIndex;
+    uint32_t ColumnIndex;
+};
+
+struct KimTableEntry {
+    char TableName[64];
+    uint64_t Offset; // of the table image from the start of the file
+    uint64_t Size;
+};
+
+constexpr char kKimDirectoryMagic[8] = {'K', 'I', 'M', 'D', 'I', 'R', '0', '1'};
+
+struct KimDirectoryTrailer {
+    uint64_t DirectoryOffset;
+    uint64_t NumTables;
+    char Magic[8]; // kKimDirectoryMagic
+};
+
+struct KimFileHeaderV8 {
+    uint8_t FileFormatVersion; // kKimFormatChecked
+    uint8_t Reserved[3];
+    uint32_t HeaderChecksum; // of the HeaderSize bytes from the start, this field taken as 0
+    uint64_t FileSize; // of the image
+    uint64_t HeaderSize; // up to the end of the section directory
+    uint64_t NumRows;
+};
+
+struct KimTableHeaderV8 {
+    char TableName[64];
+    uint32_t NumColumns;
+    int32_t LinkColumnIndex;
+    uint64_t NumSections;
+    uint8_t HasUniqueRows;
+    uint8_t Reserved[7];
+};
+
+struct KimColumnHeaderV8 {
+    char ColumnName[64];
+    uint8_t DataType;
+    uint8_t IsIndexed;
+    uint8_t IsLinkKey;
+    uint8_t IsUnique;
+    uint8_t IsPrimaryKey;
+    uint8_t Reserved;
+    uint16_t DataSize;
+};
+
+// Where a column data section of a version 8 image lies
+struct KimColumnEntry {
+    uint64_t Offset;
+    uint64_t Size;
+    uint32_t Checksum;
+    uint32_t Reserved;
+};
+
+struct KimSectionEntryV8 {
+    uint32_t Kind;
+    uint32_t ColumnIndex;
+    uint64_t Offset;
+    uint64_t Size;
+    uint32_t Checksum;
+    uint32_t Reserved;
+};
+
+// The version 8 structs are written as they are, so their layout must not
+// depend on the compiler
+static_assert(sizeof(KimFileHeaderV8) == 32 && offsetof(KimFileHeaderV8, FileSize) == 8, "KimFileHeaderV8 layout");
+static_assert(sizeof(KimTableHeaderV8) == 88 && offsetof(KimTableHeaderV8, NumSections) == 72,
+              "KimTableHeaderV8 layout");
+static_assert(sizeof(KimColumnHeaderV8) == 72 && offsetof(KimColumnHeaderV8, DataSize) == 70,
+              "KimColumnHeaderV8 layout");
+static_assert(sizeof(KimColumnEntry) == 24, "KimColumnEntry layout");
+static_assert(sizeof(KimSectionEntryV8) == 32 && offsetof(KimSectionEntryV8, Checksum) == 24,
+              "KimSectionEntryV8 layout");
+static_assert(sizeof(KimBlockHeader) == 40 && sizeof(KimZoneEntry) == 24 && sizeof(KimLinkKey) == 8,
+              "section struct layout");
+
+// Header of files up to version 7 and of version 6 databases. FileSize and
+// LinkKeysSectionOffset are only 32 bits wide; readers of version 4 and later
+// rely on neither.
+struct KimFileHeaderV3 {
+    uint8_t FileFormatVersion;
+    uint32_t FileSize;
+    uint16_t NumTables;
+    uint32_t LinkKeysSectionOffset;
+};
+
+struct ColumnHeader {
+    char ColumnName[64];
+    uint8_t DataType;
+    uint16_t DataSize;
+    bool IsIndexed;
+    bool IsLinkKey;
+    bool IsUnique;
+    bool IsPrimaryKey;
+};
+
+struct TableHeader {
+    char TableName[64];
+    uint16_t NumColumns;
+    uint16_t NumRows; // unused; row counts are stored as uint64 outside this struct
+    int16_t LinkColumnIndex;
+    bool HasUniqueRows;
+};
+
+#endif //KIMDB_KIMFILEFORMAT_H
@@ -2,36 +2,519 @@
 //
 
 #include "KimFileHead.h"
+#include "KimSimd.h"
+#include "KimThreadPool.h"
 #include <iostream>
 #include <fstream>
 #include <vector>
 #include <cstring>
-#include <regex>
+#include <cstdio>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <thread>
+
+// A compaction started by KimTable::compactInBackground
+struct KimCompaction {
+    std::thread worker;
+    std::atomic<bool> done{false};
+
+    // Taken when the compaction started; changes after that are carried over
+    // when the result is installed
+    size_t boundary = 0; // rows at the start
+    std::vector<uint64_t> deletedAtStart;
+    std::vector<std::pair<size_t, size_t>> updates; // (row, column) updated meanwhile
+
+    // Built by the worker: the rows below boundary that were live at the
+    // start, their indexes, and the deleted rows before each tombstone word
+    std::vector<KimColumn> columns;
+    std::vector<KimHashIndex> hashIndexes;
+    std::vector<KimBPlusTree> treeIndexes;
+    std::vector<size_t> deletedBefore;
+
+    ~KimCompaction() {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    // Id in the result of a row below boundary that was live at the start
+    size_t newRow(size_t row) const {
+        size_t word = row / 64;
+        uint64_t bits = word < deletedAtStart.size() ? deletedAtStart[word] : 0;
+        return row - deletedBefore[word] - kimPopCount(bits & ((uint64_t(1) << (row % 64)) - 1));
+    }
+};
+
+// The headers and section directory at the start of a version 4, 5, 7 or 8
+// file. Older versions leave the sizes and checksums 0.
+struct KimFileLayout {
+    uint8_t version = 0;
+    TableHeader tableHeader{};
+    std::vector<ColumnHeader> headers;
+    uint64_t numRows = 0;
+    std::vector<KimColumnEntry> columns;
+    std::vector<KimSectionEntryV8> sections;
+};
+
+// Version 8: the headers are read whole and checked against their checksum
+template <typename Read>
+static bool readLayoutV8(Read read, uint64_t size, KimFileLayout& layout) {
+    KimFileHeaderV8 fileHeader{};
+    if (size < sizeof(fileHeader) || !read(0, &fileHeader, sizeof(fileHeader))) {
+        return false;
+    }
+    if (fileHeader.FileSize > size) {
+        std::cerr << "File is truncated: " << size << " of " << fileHeader.FileSize << " bytes" << std::endl;
+        return false;
+    }
+    uint64_t fixed = sizeof(KimFileHeaderV8) + sizeof(KimTableHeaderV8);
+    if (fileHeader.HeaderSize < fixed || fileHeader.HeaderSize > fileHeader.FileSize) {
+        return false;
+    }
+    std::vector<char> head(fileHeader.HeaderSize);
+    if (!read(0, head.data(), head.size())) {
+        return false;
+    }
+    uint32_t checksum = fileHeader.HeaderChecksum;
+    std::memset(head.data() + offsetof(KimFileHeaderV8, HeaderChecksum), 0, sizeof(checksum));
+    if (kimCrc32c(head.data(), head.size()) != checksum) {
+        std::cerr << "Header checksum mismatch" << std::endl;
+        return false;
+    }
+
+    KimTableHeaderV8 tableHeader{};
+    std::memcpy(&tableHeader, head.data() + sizeof(KimFileHeaderV8), sizeof(tableHeader));
+    uint64_t numColumns = tableHeader.NumColumns;
+    uint64_t numSections = tableHeader.NumSections;
+    if (numColumns > UINT16_MAX || numSections > fileHeader.HeaderSize / sizeof(KimSectionEntryV8) ||
+        fileHeader.HeaderSize != fixed + numColumns * (sizeof(KimColumnHeaderV8) + sizeof(KimColumnEntry)) +
+                                     numSections * sizeof(KimSectionEntryV8)) {
+        return false;
+    }
+    layout.version = fileHeader.FileFormatVersion;
+    std::memcpy(layout.tableHeader.TableName, tableHeader.TableName, sizeof(tableHeader.TableName));
+    layout.tableHeader.TableName[sizeof(layout.tableHeader.TableName) - 1] = '\0';
+    layout.tableHeader.NumColumns = static_cast<uint16_t>(numColumns);
+    layout.tableHeader.LinkColumnIndex = static_cast<int16_t>(tableHeader.LinkColumnIndex);
+    layout.tableHeader.HasUniqueRows = tableHeader.HasUniqueRows != 0;
+    layout.numRows = fileHeader.NumRows;
+
+    const char* position = head.data() + fixed;
+    layout.headers.resize(numColumns);
+    for (auto& columnHeader : layout.headers) {
+        KimColumnHeaderV8 stored;
+        std::memcpy(&stored, position, sizeof(stored));
+        position += sizeof(stored);
+        std::memcpy(columnHeader.ColumnName, stored.ColumnName, sizeof(stored.ColumnName));
+        columnHeader.ColumnName[sizeof(columnHeader.ColumnName) - 1] = '\0';
+        columnHeader.DataType = stored.DataType;
+        columnHeader.DataSize = stored.DataSize;
+        columnHeader.IsIndexed = stored.IsIndexed != 0;
+        columnHeader.IsLinkKey = stored.IsLinkKey != 0;
+        columnHeader.IsUnique = stored.IsUnique != 0;
+        columnHeader.IsPrimaryKey = stored.IsPrimaryKey != 0;
+    }
+    layout.columns.resize(numColumns);
+    std::memcpy(layout.columns.data(), position, numColumns * sizeof(KimColumnEntry));
+    position += numColumns * sizeof(KimColumnEntry);
+    layout.sections.resize(numSections);
+    if (numSections != 0) {
+        std::memcpy(layout.sections.data(), position, numSections * sizeof(KimSectionEntryV8));
+    }
+    for (const auto& column : layout.columns) {
+        if (column.Offset % 8 != 0 || column.Offset > fileHeader.FileSize ||
+            column.Size > fileHeader.FileSize - column.Offset) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Reads and validates the layout of a file of `size` bytes through
+// read(offset, out, bytes)
+template <typename Read>
+static bool readLayout(Read read, uint64_t size, KimFileLayout& layout) {
+    uint8_t version = 0;
+    if (size == 0 || !read(0, &version, 1)) {
+        return false;
+    }
+    if (version == kKimFormatChecked) {
+        return readLayoutV8(read, size, layout);
+    }
+
+    uint64_t position = 0;
+    auto readAt = [&](void* out, uint64_t bytes) {
+        if (bytes > size - position || (bytes > 0 && !read(position, out, bytes))) {
+            return false;
+        }
+        position += bytes;
+        return true;
+    };
+
+    KimFileHeaderV3 fileHeader{};
+    uint32_t numColumns = 0;
+    if (!readAt(&fileHeader, sizeof(fileHeader)) || fileHeader.FileFormatVersion < kKimFormatColumnar ||
+        fileHeader.FileFormatVersion > kKimFormatEncoded || fileHeader.FileFormatVersion == kKimFormatDatabase ||
+        fileHeader.NumTables == 0 || !readAt(&layout.tableHeader, sizeof(layout.tableHeader)) ||
+        !readAt(&numColumns, sizeof(numColumns)) || numColumns > UINT16_MAX) {
+        return false;
+    }
+    layout.version = fileHeader.FileFormatVersion;
+
+    layout.headers.resize(numColumns);
+    if (!readAt(layout.headers.data(), numColumns * sizeof(ColumnHeader))) {
+        return false;
+    }
+    for (auto& columnHeader : layout.headers) {
+        columnHeader.ColumnName[sizeof(columnHeader.ColumnName) - 1] = '\0';
+    }
+    if (!readAt(&layout.numRows, sizeof(layout.numRows))) {
+        return false;
+    }
+    position = (position + 7) & ~uint64_t(7);
+    std::vector<uint64_t> columnOffsets(numColumns);
+    if (position > size || !readAt(columnOffsets.data(), numColumns * sizeof(uint64_t))) {
+        return false;
+    }
+    uint64_t numSections = 0;
+    if (fileHeader.FileFormatVersion >= kKimFormatSections &&
+        (!readAt(&numSections, sizeof(numSections)) || numSections > (size - position) / sizeof(KimSectionEntry))) {
+        return false;
+    }
+    std::vector<KimSectionEntry> sections(numSections);
+    if (!readAt(sections.data(), numSections * sizeof(KimSectionEntry))) {
+        return false;
+    }
+    layout.tableHeader.TableName[sizeof(layout.tableHeader.TableName) - 1] = '\0';
+    for (uint64_t offset : columnOffsets) {
+        layout.columns.push_back({offset, 0, 0, 0});
+    }
+    for (const auto& section : sections) {
+        layout.sections.push_back({section.Kind, section.ColumnIndex, section.Offset, section.Size, 0, 0});
+    }
+    return true;
+}
+
+bool kimVerifyImage(const char* data, uint64_t size) {
+    KimFileLayout layout;
+    auto read = [&](uint64_t offset, void* out, uint64_t bytes) {
+        std::memcpy(out, data + offset, bytes);
+        return true;
+    };
+    if (!readLayout(read, size, layout)) {
+        return false;
+    }
+    if (layout.version < kKimFormatChecked) {
+        return true;
+    }
+    for (size_t i = 0; i < layout.columns.size(); ++i) {
+        const KimColumnEntry& column = layout.columns[i];
+        if (kimCrc32c(data + column.Offset, column.Size) != column.Checksum) {
+            std::cerr << "Checksum mismatch in the data of column " << i << std::endl;
+            return false;
+        }
+    }
+    for (size_t i = 0; i < layout.sections.size(); ++i) {
+        const KimSectionEntryV8& section = layout.sections[i];
+        if (section.Offset > size || section.Size > size - section.Offset ||
+            kimCrc32c(data + section.Offset, section.Size) != section.Checksum) {
+            std::cerr << "Checksum mismatch in section " << i << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Creates the table a layout describes. mapColumn(column, entry) points a
+// column at its data section; sectionData(section) returns the bytes of any
+// other section, or null when they cannot be read. Indexes and dictionaries
+// are left pointing into those bytes.
+template <typename MapColumn, typename SectionData>
+static bool loadLayout(KimTable& table, const KimFileLayout& layout, uint64_t size, MapColumn mapColumn,
+                       SectionData sectionData) {
+    uint64_t numRows = layout.numRows;
+    size_t numColumns = layout.headers.size();
+    table.createTable(layout.headers);
+    table.header = layout.tableHeader;
+    table.header.NumColumns = numColumns;
+    for (size_t i = 0; i < numColumns; ++i) {
+        if (!mapColumn(table.columns[i], layout.columns[i])) {
+            table.createTable(std::vector<ColumnHeader>());
+            return false;
+        }
+    }
+
+    // Indexes stored in the file are probed in place; any flagged column
+    // without a stored index gets one built from its values
+    std::vector<bool> hashLoaded(table.hashIndexes.size(), false);
+    std::vector<bool> treeLoaded(table.treeIndexes.size(), false);
+    for (const auto& section : layout.sections) {
+        if (section.Offset % 8 != 0 || section.Offset > size || section.Size > size - section.Offset) {
+            continue;
+        }
+        const char* data = sectionData(section);
+        if (!data) {
+            continue;
+        }
+        if (section.Kind == static_cast<uint32_t>(KimSectionKind::HashIndex)) {
+            for (size_t i = 0; i < table.hashIndexes.size(); ++i) {
+                if (table.hashIndexes[i].column == section.ColumnIndex && !hashLoaded[i]) {
+                    hashLoaded[i] = table.hashIndexes[i].map(data, section.Size);
+                }
+            }
+        } else if (section.Kind == static_cast<uint32_t>(KimSectionKind::TreeIndex)) {
+            for (size_t i = 0; i < table.treeIndexes.size(); ++i) {
+                if (table.treeIndexes[i].column == section.ColumnIndex && !treeLoaded[i]) {
+                    treeLoaded[i] = table.treeIndexes[i].map(data, section.Size);
+                }
+            }
+        } else if (section.Kind == static_cast<uint32_t>(KimSectionKind::LinkKeys) && section.Size >= sizeof(uint64_t)) {
+            uint64_t numLinkKeys;
+            std::memcpy(&numLinkKeys, data, sizeof(numLinkKeys));
+            if (numLinkKeys <= (section.Size - sizeof(uint64_t)) / sizeof(KimLinkKey)) {
+                table.linkKeys.resize(numLinkKeys);
+                std::memcpy(table.linkKeys.data(), data + sizeof(uint64_t), numLinkKeys * sizeof(KimLinkKey));
+            }
+        } else if (section.Kind == static_cast<uint32_t>(KimSectionKind::LogSequence) &&
+                   section.Size == sizeof(uint64_t)) {
+            std::memcpy(&table.logSequence, data, sizeof(uint64_t));
+        } else if (section.Kind == static_cast<uint32_t>(KimSectionKind::Tombstones) &&
+                   section.Size == kimSelectionWords(numRows) * sizeof(uint64_t)) {
+            table.deletedRows.resize(section.Size / sizeof(uint64_t));
+            std::memcpy(table.deletedRows.data(), data, section.Size);
+            for (uint64_t word : table.deletedRows) {
+                table.deletedCount += kimPopCount(word);
+            }
+        } else if (section.Kind == static_cast<uint32_t>(KimSectionKind::Dictionary) && section.ColumnIndex < numColumns &&
+                   table.columns[section.ColumnIndex].kind == KimStorageKind::Dictionary) {
+            table.columns[section.ColumnIndex].dictionary->map(data, section.Size);
+        } else if (section.Kind == static_cast<uint32_t>(KimSectionKind::ZoneMap) && section.ColumnIndex < numColumns) {
+            table.columns[section.ColumnIndex].mapZones(data, section.Size);
+        }
+    }
+    for (size_t i = 0; i < table.hashIndexes.size(); ++i) {
+        if (!hashLoaded[i]) {
+            table.hashIndexes[i].build(table.columns[table.hashIndexes[i].column], table.deletedRows);
+        }
+    }
+    for (size_t i = 0; i < table.treeIndexes.size(); ++i) {
+        if (!treeLoaded[i]) {
+            table.treeIndexes[i].build(table.columns[table.treeIndexes[i].column], table.deletedRows);
+        }
+    }
+    return true;
+}
+
+// Validates the header section of a version 4, 5 or 7 file in place and points
+// the table's columns and indexes at their data sections. Nothing beyond the
+// headers, the section directory and the string block directories is touched.
+static bool mapTableSections(KimTable& table, const char* data, size_t size) {
+    KimFileLayout layout;
+    auto read = [&](uint64_t offset, void* out, uint64_t bytes) {
+        std::memcpy(out, data + offset, bytes);
+        return true;
+    };
+    if (!readLayout(read, size, layout)) {
+        return false;
+    }
+    // Version 8 records each column section's size; before it a section runs
+    // to the end of the file as far as mapping is concerned
+    bool encoded = layout.version >= kKimFormatEncoded;
+    bool sized = layout.version >= kKimFormatChecked;
+    return loadLayout(
+        table, layout, size,
+        [&](KimColumn& column, const KimColumnEntry& entry) {
+            uint64_t offset = entry.Offset;
+            if (offset % 8 != 0 || offset > size) {
+                return false;
+            }
+            uint64_t available = sized ? entry.Size : size - offset;
+            return encoded ? column.mapBlocks(data + offset, available, layout.numRows)
+                           : column.map(data + offset, available, layout.numRows);
+        },
+        [&](const KimSectionEntryV8& section) { return data + section.Offset; });
+}
+
+// Opens a version 7 or 8 file whose column blocks are read through the buffer
+// pool. Only the headers, the block offset tables and the other sections are
+// read now; indexes and dictionaries are copied into owned storage.
+static bool pageTableSections(KimTable& table, const std::shared_ptr<const KimPagedFile>& file) {
+    KimFileLayout layout;
+    uint64_t size = file->size();
+    auto read = [&](uint64_t offset, void* out, uint64_t bytes) { return file->read(offset, out, bytes); };
+    if (!readLayout(read, size, layout) || layout.version < kKimFormatEncoded) {
+        return false;
+    }
+
+    // Before version 8 a column section runs to the start of the next
+    // section, or the end of the file
+    std::vector<uint64_t> starts;
+    for (const auto& column : layout.columns) {
+        starts.push_back(column.Offset);
+    }
+    for (const auto& section : layout.sections) {
+        starts.push_back(section.Offset);
+    }
+    starts.push_back(size);
+    std::sort(starts.begin(), starts.end());
+    std::vector<std::vector<char>> buffers;
+    bool loaded = loadLayout(
+        table, layout, size,
+        [&](KimColumn& column, const KimColumnEntry& entry) {
+            uint64_t offset = entry.Offset;
+            uint64_t end = layout.version >= kKimFormatChecked
+                               ? offset + entry.Size
+                               : *std::upper_bound(starts.begin(), starts.end() - 1, offset);
+            return offset % 8 == 0 && offset <= size && column.pageBlocks(file, offset, end, layout.numRows);
+        },
+        [&](const KimSectionEntryV8& section) -> const char* {
+            buffers.emplace_back(section.Size);
+            return file->read(section.Offset, buffers.back().data(), section.Size) ? buffers.back().data() : nullptr;
+        });
+    if (!loaded) {
+        return false;
+    }
+    for (auto& index : table.hashIndexes) {
+        index.materialize();
+    }
+    for (auto& tree : table.treeIndexes) {
+        tree.materialize();
+    }
+    for (auto& column : table.columns) {
+        if (column.dictionary) {
+            column.dictionary->materialize();
+        }
+    }
+    return true;
+}
+
+void KimTable::openMapped(const std::string& fileName) {
+    auto lock = lockForWrite();
+    auto file = std::make_shared<KimMappedFile>();
+    mapping.reset();
+    createTable(std::vector<ColumnHeader>());
+    if (!file->open(fileName)) {
+        return;
+    }
+    if (!openMapped(file, 0, file->size())) {
+        std::cerr << "Invalid or unsupported file for mapping: " << fileName << std::endl;
+    }
+}
+
+bool KimTable::openMapped(const std::shared_ptr<KimMappedFile>& file, uint64_t offset, uint64_t size) {
+    auto lock = lockForWrite();
+    mapping.reset();
+    createTable(std::vector<ColumnHeader>());
+    if (!file || offset % 8 != 0 || offset > file->size() || size > file->size() - offset ||
+        !mapTableSections(*this, file->data() + offset, size)) {
+        return false;
+    }
+    mapping = file;
+    return true;
+}
+
+void KimTable::openPaged(const std::string& fileName) {
+    auto lock = lockForWrite();
+    auto file = std::make_shared<KimPagedFile>();
+    createTable(std::vector<ColumnHeader>());
+    if (!file->open(fileName)) {
+        return;
+    }
+    if (!pageTableSections(*this, file)) {
+        std::cerr << "Invalid or unsupported file for paging: " << fileName << std::endl;
+        return;
+    }
+    pagedFile = file;
+}
+
+void KimTable::materialize() {
+    auto lock = lockForWrite();
+    for (auto& column : columns) {
+        column.materialize();
+    }
+    for (auto& index : hashIndexes) {
+        index.materialize();
+    }
+    for (auto& tree : treeIndexes) {
+        tree.materialize();
+    }
+    mapping.reset();
+    pagedFile.reset();
+}
+
+static bool logFailed(const KimTableLog& log); // defined with the log below
+
+bool KimTable::isReadOnly() const {
+    return mapping != nullptr || pagedFile != nullptr || (log && logFailed(*log));
+}
 
     void KimTable::loadFromFile(const std::string& fileName) {
+    auto lock = lockForWrite();
     std::ifstream ifs(fileName, std::ios::binary);
     if (!ifs) {
         std::cerr << "Failed to open file: " << fileName << std::endl;
         return;
     }
 
-    // Read file header
+    // Read file header; NumTables only means something before version 8
     KimFileHeaderV3 fileHeader{};
     ifs.read(reinterpret_cast<char*>(&fileHeader), sizeof(KimFileHeaderV3));
+    if (!ifs || (fileHeader.FileFormatVersion < kKimFormatColumnar && fileHeader.NumTables == 0)) {
+        std::cerr << "Invalid file header: " << fileName << std::endl;
+        return;
+    }
+
+    // Columnar files are mapped, checked against their checksums and copied
+    // into owned storage
+    if (fileHeader.FileFormatVersion >= kKimFormatColumnar) {
+        ifs.close();
+        auto file = std::make_shared<KimMappedFile>();
+        createTable(std::vector<ColumnHeader>());
+        if (!file->open(fileName)) {
+            return;
+        }
+        if (!kimVerifyImage(file->data(), file->size()) || !openMapped(file, 0, file->size())) {
+            std::cerr << "Invalid or unsupported file: " << fileName << std::endl;
+            return;
+        }
+        materialize();
+        return;
+    }
 
-    // Read table headers and column headers
-    for (int i = 0; i < fileHeader.NumTables; ++i) {
-        TableHeader tableHeader;
-        ifs.read(reinterpret_cast<char*>(&tableHeader), sizeof(TableHeader));
-        // Set the table name in the header object
-        std::memcpy(header.TableName, tableHeader.TableName, sizeof(tableHeader.TableName));
+    // Read the table header and column headers (writeToFile stores a single table)
+    TableHeader tableHeader{};
+    ifs.read(reinterpret_cast<char*>(&tableHeader), sizeof(TableHeader));
+    uint32_t numColumns = 0;
+    ifs.read(reinterpret_cast<char*>(&numColumns), sizeof(uint32_t));
+
+    std::vector<ColumnHeader> headers(numColumns);
+    for (auto& columnHeader : headers) {
+        ifs.read(reinterpret_cast<char*>(&columnHeader), sizeof(ColumnHeader));
+    }
+    if (!ifs) {
+        std::cerr << "Invalid table header: " << fileName << std::endl;
+        return;
+    }
+    createTable(headers);
+    header = tableHeader;
+    header.NumColumns = numColumns;
 
-        for (int j = 0; j < tableHeader.NumColumns; ++j) {
-            ColumnHeader columnHeader;
-            ifs.read(reinterpret_cast<char*>(&columnHeader), sizeof(ColumnHeader));
-            columnHeaders.push_back(columnHeader);
+    // Read the rows; cells are stored row by row as null-terminated text and
+    // converted into the typed column storage as they are read
+    uint32_t numRows = 0;
+    ifs.read(reinterpret_cast<char*>(&numRows), sizeof(uint32_t));
+    std::string cell;
+    for (uint32_t i = 0; i < numRows && ifs; ++i) {
+        for (auto& column : columns) {
+            if (!std::getline(ifs, cell, '\0') || !column.append(cell)) {
+                std::cerr << "Corrupt row data at row " << i << " in file: " << fileName << std::endl;
+                rebuildIndexes();
+                return;
+            }
         }
     }
+    rebuildIndexes();
 
     // Read link keys section (if present)
     if (fileHeader.LinkKeysSectionOffset > 0) {
@@ -39,227 +522,1440 @@
         uint32_t numLinkKeys;
         ifs.read(reinterpret_cast<char*>(&numLinkKeys), sizeof(uint32_t));
 
-        for (uint32_t i = 0; i < numLinkKeys; ++i) {
-            uint32_t tableIndex, columnIndex;
-            ifs.read(reinterpret_cast<char*>(&tableIndex), sizeof(uint32_t));
-            ifs.read(reinterpret_cast<char*>(&columnIndex), sizeof(uint32_t));
-            // Process link keys as needed for your specific application
-        }
-    }
-
-    // Read data (assuming it's stored as binary format)
-    // You may need to adjust this section based on the actual data storage format
-    for (int i = 0; i < fileHeader.NumTables; ++i) {
-        TableHeader tableHeader;
-        ifs.read(reinterpret_cast<char*>(&tableHeader), sizeof(TableHeader));
-
-        for (int j = 0; j < tableHeader.NumRows; ++j) {
-            std::vector<std::basic_string<char>> row(tableHeader.NumColumns * sizeof(uint64_t));
-            ifs.read(reinterpret_cast<char*>(row.data()), row.size());
-             rows.push_back(row);
+        for (uint32_t i = 0; i < numLinkKeys && ifs; ++i) {
+            KimLinkKey linkKey{};
+            ifs.read(reinterpret_cast<char*>(&linkKey.TableIndex), sizeof(uint32_t));
+            ifs.read(reinterpret_cast<char*>(&linkKey.ColumnIndex), sizeof(uint32_t));
+            if (ifs) {
+                linkKeys.push_back(linkKey); // used to pick join columns
+            }
         }
     }
 
     ifs.close();
 }
 void KimTable::createTable(const std::vector<std::string>& columnNames) {
-    // Set the number of columns for the table header
-    header.NumColumns = columnNames.size();
+    std::vector<ColumnHeader> headers;
 
     // Add the column names to the columnHeader vector
     for (const auto& columnName : columnNames) {
         ColumnHeader columnHeader{};
         std::memset(columnHeader.ColumnName, 0, sizeof(columnHeader.ColumnName));
         std::strncpy(columnHeader.ColumnName, columnName.c_str(), sizeof(columnHeader.ColumnName) - 1);
-        columnHeaders.push_back(columnHeader);
+        headers.push_back(columnHeader);
+    }
+    createTable(headers);
+}
+
+void KimTable::createTable(const std::vector<ColumnHeader>& headers) {
+    auto lock = lockForWrite();
+    compaction.reset(); // joins a background compaction of the old rows
+    mapping.reset();
+    pagedFile.reset();
+    ++schemaVersion;
+    planCache.clear();
+    resultCache.clear();
+
+    // Set the number of columns for the table header
+    header.NumColumns = headers.size();
+    linkKeys.clear();
+    logSequence = 0;
+    deletedRows.clear();
+    deletedCount = 0;
+    columnHeaders = headers;
+
+    // Each column picks its storage layout from DataType/DataSize
+    columns.clear();
+    hashIndexes.clear();
+    treeIndexes.clear();
+    for (size_t i = 0; i < columnHeaders.size(); ++i) {
+        const ColumnHeader& columnHeader = columnHeaders[i];
+        columns.emplace_back(columnHeader.DataType, columnHeader.DataSize);
+        if (columnHeader.IsIndexed || columnHeader.IsUnique || columnHeader.IsPrimaryKey) {
+            hashIndexes.emplace_back(i, columnHeader.IsUnique || columnHeader.IsPrimaryKey);
+        }
+        if (columnHeader.IsIndexed && columns.back().isNumeric()) {
+            treeIndexes.emplace_back(i);
+        }
+    }
+}
+
+size_t KimTable::rowCount() const {
+    return columns.empty() ? 0 : columns.front().size();
+}
+
+size_t KimTable::liveRowCount() const {
+    return rowCount() - deletedCount;
+}
+
+bool KimTable::isDeleted(size_t row) const {
+    return kimIsDeleted(deletedRows, row);
+}
+
+KimHashIndex* KimTable::hashIndexFor(size_t columnIndex) {
+    for (auto& index : hashIndexes) {
+        if (index.column == columnIndex) {
+            return &index;
+        }
+    }
+    return nullptr;
+}
+
+const KimHashIndex* KimTable::hashIndexFor(size_t columnIndex) const {
+    return const_cast<KimTable*>(this)->hashIndexFor(columnIndex);
+}
+
+KimBPlusTree* KimTable::treeIndexFor(size_t columnIndex) {
+    for (auto& tree : treeIndexes) {
+        if (tree.column == columnIndex) {
+            return &tree;
+        }
+    }
+    return nullptr;
+}
+
+const KimBPlusTree* KimTable::treeIndexFor(size_t columnIndex) const {
+    return const_cast<KimTable*>(this)->treeIndexFor(columnIndex);
+}
+
+std::vector<size_t> KimTable::linkColumns() const {
+    std::vector<size_t> result;
+    auto add = [&](size_t column) {
+        if (column < columnHeaders.size() && std::find(result.begin(), result.end(), column) == result.end()) {
+            result.push_back(column);
+        }
+    };
+    for (size_t i = 0; i < columnHeaders.size(); ++i) {
+        if (columnHeaders[i].IsLinkKey) {
+            add(i);
+        }
+    }
+    for (const auto& linkKey : linkKeys) {
+        if (linkKey.TableIndex == 0) {
+            add(linkKey.ColumnIndex);
+        }
+    }
+    return result;
+}
+
+void KimTable::rebuildIndexes() {
+    for (auto& index : hashIndexes) {
+        index.build(columns[index.column], deletedRows);
+    }
+    for (auto& tree : treeIndexes) {
+        tree.build(columns[tree.column], deletedRows);
+    }
+}
+
+// Column scan that skips deleted rows
+static void scanLiveRows(const KimTable& table, const KimColumn& column, const KimColumnFilter& filter,
+                         std::vector<size_t>& out, size_t limit) {
+    uint64_t selection[kKimBlockRows / 64];
+    size_t found = 0;
+    for (size_t b = 0; b < column.blocks.size() && found < limit; ++b) {
+        column.selectBlock(filter, b, selection);
+        kimClearDeleted(table.deletedRows, b, column.blocks[b]->count, selection);
+        found += kimAppendSelection(selection, column.blocks[b]->count, b * kKimBlockRows, out, limit - found);
+    }
+}
+
+std::vector<size_t> KimTable::findEqualRows(size_t columnIndex, const std::string& value, size_t limit) const {
+    std::vector<size_t> matches;
+    const KimHashIndex* index = hashIndexFor(columnIndex);
+    if (!index) {
+        scanLiveRows(*this, columns[columnIndex], columns[columnIndex].equalFilter(value), matches, limit);
+        return matches;
+    }
+
+    // Point probe; the literal is converted to the stored bytes once
+    std::string key;
+    if (!columns[columnIndex].encodeKey(value, key)) {
+        return matches;
+    }
+    index->find(columns[columnIndex], key, matches);
+    std::sort(matches.begin(), matches.end());
+    if (matches.size() > limit) {
+        matches.resize(limit);
+    }
+    return matches;
+}
+
+std::vector<size_t> KimTable::findRangeRows(size_t columnIndex, const KimRange& range, size_t limit) const {
+    std::vector<size_t> matches;
+    const KimBPlusTree* tree = treeIndexFor(columnIndex);
+    if (!tree) {
+        scanLiveRows(*this, columns[columnIndex], columns[columnIndex].rangeFilter(range), matches, limit);
+        return matches;
     }
+
+    // O(log n + k): descend to the first key in range and walk the leaf chain
+    uint64_t low, high;
+    if (!columns[columnIndex].orderedRange(range, low, high)) {
+        return matches;
+    }
+    tree->range(low, high, matches);
+    std::sort(matches.begin(), matches.end());
+    if (matches.size() > limit) {
+        matches.resize(limit);
+    }
+    return matches;
 }
 
-void KimTable::addRow(const std::vector<std::string>& rowData) {
+bool KimTable::addRow(const std::vector<std::string>& rowData) {
+    if (isReadOnly()) {
+        std::cerr << "Error: table is opened read-only." << std::endl;
+        return false;
+    }
+    auto lock = lockForWrite();
+    finishCompaction(false);
+
     // Check if rowData size matches the number of columns in the table
     if (rowData.size() != columnHeaders.size()) {
         std::cerr << "Error: rowData size (" << rowData.size() << ") doesn't match the number of columns ("
                   << columnHeaders.size() << ")." << std::endl;
-        return;
+        return false;
+    }
+
+    // Validate every cell first so a bad value never leaves a partial row behind
+    for (size_t i = 0; i < columns.size(); ++i) {
+        if (!columns[i].accepts(rowData[i])) {
+            std::cerr << "Error: value '" << rowData[i] << "' is not valid for column "
+                      << columnHeaders[i].ColumnName << "." << std::endl;
+            return false;
+        }
+    }
+
+    // Unique and primary key columns reject a value that is already present
+    std::vector<std::string> keys(hashIndexes.size());
+    for (size_t i = 0; i < hashIndexes.size(); ++i) {
+        const KimHashIndex& index = hashIndexes[i];
+        columns[index.column].encodeKey(rowData[index.column], keys[i]);
+        if (index.unique && index.contains(columns[index.column], keys[i])) {
+            std::cerr << "Error: duplicate value '" << rowData[index.column] << "' for unique column "
+                      << columnHeaders[index.column].ColumnName << "." << std::endl;
+            return false;
+        }
+    }
+
+    // The row is logged before it is applied, so a row the log lost is never
+    // visible; snapshots need not wait for the log. Relocking bumps the
+    // version again, so a snapshot taken meanwhile is not reused afterwards.
+    if (log) {
+        KimLogRecord record;
+        record.type = KimLogRecordType::AddRow;
+        record.values = rowData;
+        lock.unlock();
+        if (!logMutation(record)) {
+            return false;
+        }
+        lock = lockForWrite();
     }
 
-    // Add the row data to the rows vector
-    rows.push_back(rowData);
+    // Append each cell to its column
+    size_t rowIndex = rowCount();
+    for (size_t i = 0; i < columns.size(); ++i) {
+        columns[i].append(rowData[i]);
+    }
+    for (size_t i = 0; i < hashIndexes.size(); ++i) {
+        hashIndexes[i].insert(keys[i], rowIndex);
+    }
+    for (auto& tree : treeIndexes) {
+        tree.insert(columns[tree.column].orderedKey(rowIndex), rowIndex);
+    }
+    checkpointIfDue();
+    return true;
 }
 void KimTable::writeToFile(const std::string& fileName) {
-    std::ofstream ofs(fileName, std::ios::binary);
+    std::cout << "Writing to file: " << fileName << std::endl;
+    writeFileImage(fileName, false);
+}
+
+bool KimTable::writeFileImage(const std::string& fileName, bool durable) const {
+    // Write to a temporary file first so a table mapped from fileName keeps
+    // reading valid pages until the new file replaces it
+    std::string tempFileName = fileName + ".tmp";
+    std::ofstream ofs(tempFileName, std::ios::binary);
     if (!ofs) {
         std::cerr << "Failed to open file: " << fileName << std::endl;
-        return;
+        return false;
     }
-    std::cout << "Writing to file: " << fileName << std::endl;
-
-    // Write the KimFileHeaderV3
-    KimFileHeaderV3 fileHeader;
-    fileHeader.NumTables = 1; // Assuming only one table for now
-    ofs.write(reinterpret_cast<const char*>(&fileHeader), sizeof(KimFileHeaderV3));
-
-    // Write the TableHeader
-    TableHeader tableHeader;
-    std::memset(tableHeader.TableName, 0, sizeof(tableHeader.TableName));
-    std::strncpy(tableHeader.TableName, header.TableName, sizeof(tableHeader.TableName) - 1);
-    tableHeader.NumColumns = columnHeaders.size();
-    ofs.write(reinterpret_cast<const char*>(&tableHeader), sizeof(TableHeader));
+    writeImage(ofs);
+    ofs.close();
+    return kimReplaceFile(tempFileName, fileName, !ofs, durable);
+}
 
-    // Write the number of columns
-    uint32_t numColumns = columnHeaders.size();
-    ofs.write(reinterpret_cast<char*>(&numColumns), sizeof(uint32_t));
+bool kimConvertFile(const std::string& source, const std::string& target) {
+    std::ifstream ifs(source, std::ios::binary);
+    char version = 0;
+    if (!ifs.get(version)) {
+        std::cerr << "Failed to open file: " << source << std::endl;
+        return false;
+    }
+    ifs.close();
 
-    // Write the column headers
-    for (const auto& columnHeader : columnHeaders) {
-        ofs.write(reinterpret_cast<const char*>(&columnHeader), sizeof(ColumnHeader));
+    KimTable table;
+    uint8_t format = static_cast<uint8_t>(version);
+    if (format == kKimFormatRowText) {
+        table.loadFromFile(source);
+    } else if (format >= kKimFormatColumnar && format <= kKimFormatChecked && format != kKimFormatDatabase) {
+        table.openMapped(source);
+    } else {
+        std::cerr << "Unsupported file for conversion: " << source << std::endl;
+        return false;
+    }
+    if (table.columnHeaders.empty()) {
+        return false;
     }
+    return table.writeFileImage(target, true);
+}
 
-    // Write the number of rows
-    uint32_t numRows = rows.size();
-    ofs.write(reinterpret_cast<char*>(&numRows), sizeof(uint32_t));
+bool kimReadDirectory(const char* data, uint64_t size, std::vector<KimTableEntry>& directory) {
+    KimFileHeaderV3 fileHeader{};
+    KimDirectoryTrailer trailer{};
+    if (size < sizeof(fileHeader) + sizeof(trailer)) {
+        return false;
+    }
+    std::memcpy(&fileHeader, data, sizeof(fileHeader));
+    uint64_t trailerOffset = size - sizeof(trailer);
+    std::memcpy(&trailer, data + trailerOffset, sizeof(trailer));
+    if (std::memcmp(trailer.Magic, kKimDirectoryMagic, sizeof(trailer.Magic)) != 0 ||
+        trailer.NumTables != fileHeader.NumTables || trailer.DirectoryOffset > trailerOffset ||
+        trailer.NumTables != (trailerOffset - trailer.DirectoryOffset) / sizeof(KimTableEntry)) {
+        return false;
+    }
+    directory.resize(trailer.NumTables);
+    std::memcpy(directory.data(), data + trailer.DirectoryOffset, directory.size() * sizeof(KimTableEntry));
+    for (auto& tableEntry : directory) {
+        if (tableEntry.Offset % 8 != 0 || tableEntry.Offset > trailer.DirectoryOffset ||
+            tableEntry.Size > trailer.DirectoryOffset - tableEntry.Offset) {
+            directory.clear();
+            return false;
+        }
+        tableEntry.TableName[sizeof(tableEntry.TableName) - 1] = '\0';
+    }
+    return true;
+}
 
-    // Write the rows
-    for (const auto& row : rows) {
-        for (const auto& value : row) {
-            ofs.write(value.c_str(), value.size() + 1); // +1 for null terminator
+bool kimVerifyFile(const std::string& fileName) {
+    KimMappedFile file;
+    if (!file.open(fileName)) {
+        return false;
+    }
+    if (file.size() == 0 || static_cast<uint8_t>(file.data()[0]) != kKimFormatDatabase) {
+        if (!kimVerifyImage(file.data(), file.size())) {
+            std::cerr << "File failed verification: " << fileName << std::endl;
+            return false;
         }
+        return true;
     }
 
-    ofs.close();
-    std::cout << "Writing to file: " << fileName << std::endl;
+    // A database is verified one table image at a time
+    std::vector<KimTableEntry> directory;
+    if (!kimReadDirectory(file.data(), file.size(), directory)) {
+        std::cerr << "Invalid table directory: " << fileName << std::endl;
+        return false;
+    }
+    bool ok = true;
+    for (const auto& tableEntry : directory) {
+        if (!kimVerifyImage(file.data() + tableEntry.Offset, tableEntry.Size)) {
+            std::cerr << "Table " << tableEntry.TableName << " failed verification: " << fileName << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
 
+bool kimReplaceFile(const std::string& tempFileName, const std::string& fileName, bool failed, bool durable) {
     // Check if the file has been written successfully
-    if (!ofs) {
+    if (failed || (durable && !kimSyncFile(tempFileName))) {
         std::cerr << "An error occurred while writing to the file: " << fileName << std::endl;
+        std::remove(tempFileName.c_str());
+        return false;
     }
-    std::cout << "Writing to file: " << fileName << std::endl;
+    // The old file stays in place unless the new one atomically replaces it
+    if (!kimRenameOver(tempFileName, fileName)) {
+        std::cerr << "An error occurred while replacing the file: " << fileName << std::endl;
+        std::remove(tempFileName.c_str());
+        return false;
+    }
+    if (durable) {
+        kimSyncDirectoryOf(fileName);
+    }
+    return true;
+}
+
+namespace {
+
+// Passes writes on to another stream buffer, keeping the CRC-32C and the
+// count of the bytes written since the last call to take()
+class KimChecksumBuffer : public std::streambuf {
+public:
+    explicit KimChecksumBuffer(std::streambuf* target) : target(target) {}
+
+    void take(uint32_t& checksum, uint64_t& size) {
+        checksum = crc;
+        size = count;
+        crc = 0;
+        count = 0;
+    }
+
+protected:
+    std::streamsize xsputn(const char* data, std::streamsize size) override {
+        std::streamsize written = target->sputn(data, size);
+        crc = kimCrc32c(data, static_cast<size_t>(written), crc);
+        count += static_cast<uint64_t>(written);
+        return written;
+    }
+
+    int_type overflow(int_type ch) override {
+        if (traits_type::eq_int_type(ch, traits_type::eof())) {
+            return traits_type::not_eof(ch);
+        }
+        char c = traits_type::to_char_type(ch);
+        return xsputn(&c, 1) == 1 ? ch : traits_type::eof();
+    }
+
+private:
+    std::streambuf* target;
+    uint32_t crc = 0;
+    uint64_t count = 0;
+};
+
+} // namespace
+
+uint64_t KimTable::writeImage(std::ostream& ofs) const {
+    // The sections are written one at a time behind room left for the
+    // headers, which are filled in last, once every section's offset, size
+    // and checksum is known. Only one column's encoded blocks are held in
+    // memory at a time.
+    uint32_t numColumns = columnHeaders.size();
+    std::vector<KimSectionEntryV8> sections;
+    auto addSection = [&](KimSectionKind kind, size_t column) {
+        KimSectionEntryV8 section{};
+        section.Kind = static_cast<uint32_t>(kind);
+        section.ColumnIndex = static_cast<uint32_t>(column);
+        sections.push_back(section);
+    };
+    for (const auto& index : hashIndexes) {
+        addSection(KimSectionKind::HashIndex, index.column);
+    }
+    for (const auto& tree : treeIndexes) {
+        addSection(KimSectionKind::TreeIndex, tree.column);
+    }
+    if (!linkKeys.empty()) {
+        addSection(KimSectionKind::LinkKeys, 0);
+    }
+    if (logSequence) {
+        addSection(KimSectionKind::LogSequence, 0);
+    }
+    if (deletedCount) {
+        addSection(KimSectionKind::Tombstones, 0);
+    }
+    for (size_t i = 0; i < columns.size(); ++i) {
+        if (columns[i].kind == KimStorageKind::Dictionary) {
+            addSection(KimSectionKind::Dictionary, i);
+        }
+    }
+    for (size_t i = 0; i < columns.size(); ++i) {
+        if (!columns[i].blocks.empty()) {
+            addSection(KimSectionKind::ZoneMap, i);
+        }
+    }
+    uint64_t headerSize = sizeof(KimFileHeaderV8) + sizeof(KimTableHeaderV8) +
+                          numColumns * (sizeof(KimColumnHeaderV8) + sizeof(KimColumnEntry)) +
+                          sections.size() * sizeof(KimSectionEntryV8);
+    std::streampos start = ofs.tellp();
+    std::vector<char> head(headerSize, 0);
+    ofs.write(head.data(), static_cast<std::streamsize>(headerSize));
+
+    KimChecksumBuffer buffer(ofs.rdbuf());
+    std::ostream out(&buffer);
+    uint64_t position = headerSize;
+    // Records where the section just written lies and pads it to 8 bytes
+    auto finish = [&](uint64_t& offset, uint64_t& size, uint32_t& checksum) {
+        buffer.take(checksum, size);
+        offset = position;
+        position += size;
+        const char padding[8] = {};
+        uint64_t aligned = (position + 7) & ~uint64_t(7);
+        out.write(padding, static_cast<std::streamsize>(aligned - position));
+        uint32_t paddingChecksum;
+        uint64_t paddingSize;
+        buffer.take(paddingChecksum, paddingSize);
+        position = aligned;
+    };
+
+    std::vector<KimColumnEntry> columnEntries(numColumns);
+    std::vector<char> encoded;
+    for (size_t i = 0; i < columns.size(); ++i) {
+        columns[i].encodeSection(compressBlocks, encoded);
+        out.write(encoded.data(), static_cast<std::streamsize>(encoded.size()));
+        finish(columnEntries[i].Offset, columnEntries[i].Size, columnEntries[i].Checksum);
+    }
+    encoded = std::vector<char>();
+
+    // The other sections, in the order they were listed
+    auto next = sections.begin();
+    auto finishSection = [&]() {
+        finish(next->Offset, next->Size, next->Checksum);
+        ++next;
+    };
+    for (const auto& index : hashIndexes) {
+        index.write(out);
+        finishSection();
+    }
+    for (const auto& tree : treeIndexes) {
+        tree.write(out);
+        finishSection();
+    }
+    if (!linkKeys.empty()) {
+        uint64_t numLinkKeys = linkKeys.size();
+        out.write(reinterpret_cast<const char*>(&numLinkKeys), sizeof(uint64_t));
+        out.write(reinterpret_cast<const char*>(linkKeys.data()), numLinkKeys * sizeof(KimLinkKey));
+        finishSection();
+    }
+    if (logSequence) {
+        out.write(reinterpret_cast<const char*>(&logSequence), sizeof(uint64_t));
+        finishSection();
+    }
+    if (deletedCount) {
+        std::vector<uint64_t> tombstones = deletedRows;
+        tombstones.resize(kimSelectionWords(rowCount()));
+        out.write(reinterpret_cast<const char*>(tombstones.data()), tombstones.size() * sizeof(uint64_t));
+        finishSection();
+    }
+    for (const auto& column : columns) {
+        if (column.kind == KimStorageKind::Dictionary) {
+            column.dictionary->write(out);
+            finishSection();
+        }
+    }
+    for (const auto& column : columns) {
+        if (column.blocks.empty()) {
+            continue;
+        }
+        for (size_t b = 0; b < column.blocks.size(); ++b) {
+            KimZoneEntry zone = column.zoneEntry(b);
+            out.write(reinterpret_cast<const char*>(&zone), sizeof(zone));
+        }
+        finishSection();
+    }
+
+    // Fill in the headers
+    KimFileHeaderV8 fileHeader{};
+    fileHeader.FileFormatVersion = kKimFormatChecked;
+    fileHeader.FileSize = position;
+    fileHeader.HeaderSize = headerSize;
+    fileHeader.NumRows = rowCount();
+    KimTableHeaderV8 tableHeader{};
+    // tableHeader is zeroed, so the name stays NUL-terminated
+    const char* nameEnd = std::find(header.TableName, header.TableName + sizeof(tableHeader.TableName) - 1, '\0');
+    std::memcpy(tableHeader.TableName, header.TableName, static_cast<size_t>(nameEnd - header.TableName));
+    tableHeader.NumColumns = numColumns;
+    tableHeader.LinkColumnIndex = header.LinkColumnIndex;
+    tableHeader.NumSections = sections.size();
+    tableHeader.HasUniqueRows = header.HasUniqueRows ? 1 : 0;
+
+    char* at = head.data() + sizeof(fileHeader);
+    std::memcpy(at, &tableHeader, sizeof(tableHeader));
+    at += sizeof(tableHeader);
+    for (const auto& columnHeader : columnHeaders) {
+        KimColumnHeaderV8 stored{};
+        std::memcpy(stored.ColumnName, columnHeader.ColumnName, sizeof(stored.ColumnName));
+        stored.DataType = columnHeader.DataType;
+        stored.DataSize = columnHeader.DataSize;
+        stored.IsIndexed = columnHeader.IsIndexed ? 1 : 0;
+        stored.IsLinkKey = columnHeader.IsLinkKey ? 1 : 0;
+        stored.IsUnique = columnHeader.IsUnique ? 1 : 0;
+        stored.IsPrimaryKey = columnHeader.IsPrimaryKey ? 1 : 0;
+        std::memcpy(at, &stored, sizeof(stored));
+        at += sizeof(stored);
+    }
+    std::memcpy(at, columnEntries.data(), numColumns * sizeof(KimColumnEntry));
+    at += numColumns * sizeof(KimColumnEntry);
+    if (!sections.empty()) {
+        std::memcpy(at, sections.data(), sections.size() * sizeof(KimSectionEntryV8));
+    }
+    std::memcpy(head.data(), &fileHeader, sizeof(fileHeader));
+    fileHeader.HeaderChecksum = kimCrc32c(head.data(), head.size());
+    std::memcpy(head.data(), &fileHeader, sizeof(fileHeader));
 
+    ofs.seekp(start);
+    ofs.write(head.data(), static_cast<std::streamsize>(headerSize));
+    ofs.seekp(start + static_cast<std::streamoff>(position));
+    return position;
 }
 
 
 void KimTable::setTableName(const std::string &tableName) {
+    auto lock = lockForWrite();
     std::memset(header.TableName, 0, sizeof(header.TableName));
     std::strncpy(header.TableName, tableName.c_str(), sizeof(header.TableName) - 1);
+    ++schemaVersion;
+    planCache.clear();
+    resultCache.clear();
 }
 
 
-std::string select(const KimTable& table, size_t rowIndex, size_t columnIndex) {
-    if (rowIndex < table.rows.size() && columnIndex < table.columnHeaders.size()) {
-        return table.rows[rowIndex][columnIndex];
+std::string KimTable::select(const KimTable& table, size_t rowIndex, size_t columnIndex) const {
+    if (rowIndex < table.rowCount() && !table.isDeleted(rowIndex) && columnIndex < table.columnHeaders.size()) {
+        return table.columns[columnIndex].getString(rowIndex);
     } else {
         std::cerr << "Invalid row or column index" << std::endl;
         return "";
     }
 }
 
-std::vector<std::string> KimTable::selectRow(const KimTable& table, size_t rowIndex) {
-    if (rowIndex < table.rows.size()) {
-        return table.rows[rowIndex];
+std::vector<std::string> KimTable::selectRow(const KimTable& table, size_t rowIndex) const {
+    if (rowIndex < table.rowCount() && !table.isDeleted(rowIndex)) {
+        std::vector<std::string> row;
+        row.reserve(table.columns.size());
+        for (const auto& column : table.columns) {
+            row.push_back(column.getString(rowIndex));
+        }
+        return row;
     } else {
         std::cerr << "Invalid row index" << std::endl;
         return std::vector<std::string>();
     }
 }
 
-void KimTable::deleteRow(size_t rowIndex) {
-    if (rowIndex < rows.size()) {
-        rows.erase(rows.begin() + rowIndex);
+std::vector<std::string> KimTable::selectRow(const KimTable& table, size_t rowIndex,
+                                             const std::vector<size_t>& columns) const {
+    if (rowIndex >= table.rowCount() || table.isDeleted(rowIndex)) {
+        std::cerr << "Invalid row index" << std::endl;
+        return std::vector<std::string>();
     }
+    std::vector<std::string> row;
+    row.reserve(columns.size());
+    for (size_t column : columns) {
+        if (column >= table.columns.size()) {
+            std::cerr << "Invalid row or column index" << std::endl;
+            return std::vector<std::string>();
+        }
+        row.push_back(table.columns[column].getString(rowIndex));
+    }
+    return row;
 }
-void KimTable::updateRow(KimTable& table, size_t rowIndex, size_t columnIndex, const std::string& newValue) {
-    if (rowIndex < table.rows.size() && columnIndex < table.columnHeaders.size()) {
-        table.rows[rowIndex][columnIndex] = newValue;
-    } else {
+
+bool KimTable::deleteRow(size_t rowIndex) {
+    if (isReadOnly()) {
+        std::cerr << "Error: table is opened read-only." << std::endl;
+        return false;
+    }
+    // O(1) apart from the index entries: the row is only marked, so later
+    // rows keep their ids until the table is compacted
+    auto lock = lockForWrite();
+    if (rowIndex >= rowCount() || isDeleted(rowIndex)) {
+        return false;
+    }
+    if (log) {
+        KimLogRecord record;
+        record.type = KimLogRecordType::DeleteRow;
+        record.row = rowIndex;
+        lock.unlock(); // snapshots need not wait for the log
+        if (!logMutation(record)) {
+            return false;
+        }
+        lock = lockForWrite();
+    }
+    for (auto& index : hashIndexes) {
+        index.erase(columns[index.column].getView(rowIndex), rowIndex);
+    }
+    for (auto& tree : treeIndexes) {
+        tree.erase(columns[tree.column].orderedKey(rowIndex), rowIndex);
+    }
+    if (deletedRows.size() <= rowIndex / 64) {
+        deletedRows.resize(kimSelectionWords(rowCount()));
+    }
+    deletedRows[rowIndex / 64] |= uint64_t(1) << (rowIndex % 64);
+    ++deletedCount;
+    checkpointIfDue();
+    lock.unlock();
+
+    if (compactionThreshold > 0 && !compaction && deletedCount >= compactionThreshold * rowCount()) {
+        compactInBackground();
+    }
+    return true;
+}
+bool KimTable::updateRow(KimTable& table, size_t rowIndex, size_t columnIndex, const std::string& newValue) {
+    if (table.isReadOnly()) {
+        std::cerr << "Error: table is opened read-only." << std::endl;
+        return false;
+    }
+    auto lock = table.lockForWrite();
+    if (rowIndex >= table.rowCount() || table.isDeleted(rowIndex) || columnIndex >= table.columnHeaders.size()) {
         std::cerr << "Invalid row or column index" << std::endl;
+        return false;
     }
+    KimColumn& column = table.columns[columnIndex];
+    std::string key;
+    if (!column.encodeKey(newValue, key)) {
+        std::cerr << "Invalid value for column " << table.columnHeaders[columnIndex].ColumnName << std::endl;
+        return false;
+    }
+    KimHashIndex* index = table.hashIndexFor(columnIndex);
+    if (index && index->unique && index->contains(column, key, rowIndex)) {
+        std::cerr << "Duplicate value '" << newValue << "' for unique column "
+                  << table.columnHeaders[columnIndex].ColumnName << std::endl;
+        return false;
+    }
+    if (table.log) {
+        KimLogRecord record;
+        record.type = KimLogRecordType::UpdateRow;
+        record.row = rowIndex;
+        record.column = static_cast<uint32_t>(columnIndex);
+        record.values.push_back(newValue);
+        lock.unlock(); // snapshots need not wait for the log
+        if (!table.logMutation(record)) {
+            return false;
+        }
+        lock = table.lockForWrite();
+    }
+
+    KimBPlusTree* tree = table.treeIndexFor(columnIndex);
+    if (index) {
+        index->erase(column.getView(rowIndex), rowIndex);
+    }
+    if (tree) {
+        tree->erase(column.orderedKey(rowIndex), rowIndex);
+    }
+    column.set(rowIndex, newValue);
+    if (index) {
+        index->insert(key, rowIndex);
+    }
+    if (tree) {
+        tree->insert(column.orderedKey(rowIndex), rowIndex);
+    }
+    if (table.compaction) {
+        table.compaction->updates.emplace_back(rowIndex, columnIndex);
+    }
+    table.checkpointIfDue();
+    return true;
 }
 
 
-//================================================SQL==========================================================================/
-std::vector<std::string> KimTable::selectRowWithSQL(const  KimTable& table, const std::string& sqlQuery) {
-    std::regex selectRowRegex(R"(SELECT\s+\*\s+FROM\s+(\w+)\s+WHERE\s+(\w+)\s*=\s*(['"]?)(.+)\3)", std::regex::icase);
+//================================================BULK LOAD====================================================================/
+size_t KimTable::loadDelimited(const std::string& fileName, const KimLoadOptions& options) {
+    if (isReadOnly()) {
+        std::cerr << "Error: table is opened read-only." << std::endl;
+        return 0;
+    }
+    KimMappedFile file;
+    if (!file.open(fileName)) {
+        return 0;
+    }
+    char delimiter = options.delimiter;
+    if (delimiter == 0) {
+        size_t dot = fileName.find_last_of('.');
+        std::string extension = dot == std::string::npos ? std::string() : fileName.substr(dot);
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        delimiter = extension == ".tsv" || extension == ".tab" ? '\t' : ',';
+    }
+    const char* data = file.data();
+    size_t size = file.size();
+    if (size >= 3 && std::memcmp(data, "\xEF\xBB\xBF", 3) == 0) {
+        data += 3; // UTF-8 byte order mark
+        size -= 3;
+    }
+    if (options.header) {
+        size_t skip = 0;
+        bool quoted = false;
+        for (; skip < size && (data[skip] != '\n' || quoted); ++skip) {
+            quoted = data[skip] == '"' ? !quoted : quoted;
+        }
+        skip = std::min(size, skip + 1);
+        data += skip;
+        size -= skip;
+    }
+    finishCompaction(true);
 
-    std::smatch match;
-    if (std::regex_search(sqlQuery, match, selectRowRegex)) {
-        std::string tableName = match[1];
-        std::string columnName = match[2];
-        std::string value = match[4];
+    // Chunks of about 4 MiB are parsed a wave at a time, two per thread, so
+    // only one wave's rows are held outside the table at once
+    constexpr size_t chunkBytes = size_t(4) << 20;
+    KimThreadPool& pool = kimThreadPool();
+    size_t threads = options.parallelism == 0 ? pool.size() : std::min(options.parallelism, pool.size());
+    size_t parts = (size + chunkBytes - 1) / chunkBytes;
+    std::vector<size_t> bounds = kimRecordBoundaries(data, size, parts, threads);
+    parts = bounds.size() - 1;
+    size_t firstRow = rowCount();
+    size_t rejected = 0;
+    for (size_t first = 0; first < parts; first += threads * 2) {
+        size_t count = std::min(threads * 2, parts - first);
+        std::vector<std::vector<KimColumn>> chunks(count);
+        std::vector<size_t> chunkRejected(count, 0);
+        pool.run(count, threads, [&](size_t, size_t chunk) {
+            for (const auto& columnHeader : columnHeaders) {
+                chunks[chunk].emplace_back(columnHeader.DataType, columnHeader.DataSize);
+            }
+            kimParseRecords(data + bounds[first + chunk], data + bounds[first + chunk + 1], delimiter, chunks[chunk],
+                            chunkRejected[chunk]);
+        });
+        auto lock = lockForWrite();
+        for (size_t chunk = 0; chunk < count; ++chunk) {
+            for (size_t i = 0; i < columns.size(); ++i) {
+                columns[i].appendColumn(chunks[chunk][i]);
+            }
+            rejected += chunkRejected[chunk];
+        }
+    }
 
-        if (tableName != table.header.TableName) {
-            std::cerr << "Table name does not match" << std::endl;
-            return {};
+    // A row whose unique key an earlier row already holds is deleted, which
+    // keeps row ids in file order
+    auto lock = lockForWrite();
+    size_t duplicates = 0;
+    for (size_t row = firstRow; row < rowCount(); ++row) {
+        bool duplicate = false;
+        for (const auto& index : hashIndexes) {
+            duplicate = duplicate ||
+                        (index.unique && index.contains(columns[index.column], columns[index.column].getView(row)));
+        }
+        if (duplicate) {
+            deletedRows.resize(kimSelectionWords(rowCount()));
+            deletedRows[row / 64] |= uint64_t(1) << (row % 64);
+            ++deletedCount;
+            ++duplicates;
+            continue;
+        }
+        for (auto& index : hashIndexes) {
+            if (index.unique) {
+                index.insert(columns[index.column].getView(row), row);
+            }
         }
+    }
+    for (auto& index : hashIndexes) {
+        if (!index.unique) {
+            index.build(columns[index.column], deletedRows);
+        }
+    }
+    for (auto& tree : treeIndexes) {
+        tree.build(columns[tree.column], deletedRows);
+    }
+    size_t added = rowCount() - firstRow - duplicates;
+    lock.unlock();
 
-        int columnIndex = -1;
-        for (int i = 0; i < table.header.NumColumns; ++i) {
-            if (table.columnHeaders[i].ColumnName == columnName) {
-                columnIndex = i;
-                break;
+    if (rejected + duplicates > 0) {
+        std::cerr << "Skipped " << rejected << " invalid and " << duplicates << " duplicate records in file: "
+                  << fileName << std::endl;
+    }
+    // The rows are not logged, so records logged after them are only valid
+    // on a file that holds them
+    if (log && rowCount() > firstRow && !checkpoint(true)) {
+        std::cerr << "Error: the loaded rows could not be checkpointed; the table is no longer logged." << std::endl;
+        closeLog();
+    }
+    return added;
+}
+
+
+//================================================SNAPSHOTS====================================================================/
+std::unique_lock<std::recursive_mutex> KimTable::lockForWrite() {
+    std::unique_lock<std::recursive_mutex> lock(versions.mutex);
+    ++versions.version;
+    return lock;
+}
+
+std::shared_ptr<const KimTable> KimTable::snapshot() const {
+    std::lock_guard<std::recursive_mutex> lock(versions.mutex);
+    std::shared_ptr<const KimTable> latest = versions.snapshot.lock();
+    if (latest && versions.snapshotVersion == versions.version) {
+        return latest;
+    }
+
+    // Indexes, the log and compactions stay with the writer
+    auto copy = std::make_shared<KimTable>();
+    copy->header = header;
+    copy->columnHeaders = columnHeaders;
+    copy->columns = columns;
+    copy->linkKeys = linkKeys;
+    copy->deletedRows = deletedRows;
+    copy->deletedCount = deletedCount;
+    copy->compactionThreshold = 0;
+    copy->compactionCount = compactionCount;
+    copy->schemaVersion = schemaVersion;
+    copy->parallelism = parallelism;
+    copy->logSequence = logSequence;
+    copy->compressBlocks = compressBlocks;
+    copy->mapping = mapping;
+    copy->pagedFile = pagedFile;
+    versions.snapshot = copy;
+    versions.snapshotVersion = versions.version;
+    return copy;
+}
+
+
+//================================================COMPACTION===================================================================/
+// New columns holding the listed rows of `source`, copied as stored bytes
+static std::vector<KimColumn> copyRows(const std::vector<ColumnHeader>& headers, const std::vector<KimColumn>& source,
+                                       const std::vector<size_t>& rows) {
+    std::vector<KimColumn> result;
+    for (size_t i = 0; i < source.size(); ++i) {
+        result.emplace_back(headers[i].DataType, headers[i].DataSize);
+        for (size_t row : rows) {
+            result.back().appendFrom(source[i], row);
+        }
+    }
+    return result;
+}
+
+void KimTable::compactRows(size_t boundary, const std::vector<uint64_t>& keepDeleted) {
+    std::vector<uint64_t> keep(deletedRows.size());
+    for (uint64_t row : keepDeleted) {
+        if (row / 64 < keep.size()) {
+            keep[row / 64] |= uint64_t(1) << (row % 64);
+        }
+    }
+    std::vector<size_t> rows;
+    std::vector<uint64_t> tombstones;
+    size_t tombstoneCount = 0;
+    rows.reserve(liveRowCount());
+    for (size_t row = 0; row < rowCount(); ++row) {
+        bool deleted = isDeleted(row);
+        if (deleted && row < boundary && !kimIsDeleted(keep, row)) {
+            continue;
+        }
+        if (deleted) {
+            tombstones.resize(kimSelectionWords(rows.size() + 1));
+            tombstones[rows.size() / 64] |= uint64_t(1) << (rows.size() % 64);
+            ++tombstoneCount;
+        }
+        rows.push_back(row);
+    }
+
+    columns = copyRows(columnHeaders, columns, rows);
+    deletedRows = std::move(tombstones);
+    deletedCount = tombstoneCount;
+    rebuildIndexes();
+    ++compactionCount;
+
+    if (log) {
+        KimLogRecord record;
+        record.type = KimLogRecordType::Compact;
+        record.row = boundary;
+        record.rows = keepDeleted;
+        if (logMutation(record)) {
+            checkpointIfDue();
+        }
+    }
+}
+
+void KimTable::compact() {
+    if (isReadOnly()) {
+        std::cerr << "Error: table is opened read-only." << std::endl;
+        return;
+    }
+    auto lock = lockForWrite();
+    finishCompaction(true);
+    if (deletedCount > 0) {
+        compactRows(rowCount(), {});
+    }
+}
+
+void KimTable::compactInBackground() {
+    if (isReadOnly() || compaction || deletedCount == 0) {
+        return;
+    }
+    auto job = std::make_shared<KimCompaction>();
+    job->boundary = rowCount();
+    job->deletedAtStart = deletedRows;
+    for (const auto& index : hashIndexes) {
+        job->hashIndexes.emplace_back(index.column, index.unique);
+    }
+    for (const auto& tree : treeIndexes) {
+        job->treeIndexes.emplace_back(tree.column);
+    }
+
+    // The worker reads a copy, which shares the blocks until updates change them
+    auto source = std::make_shared<std::vector<KimColumn>>(columns);
+    KimCompaction* state = job.get();
+    std::vector<ColumnHeader> headers = columnHeaders;
+    job->worker = std::thread([state, source, headers] {
+        size_t words = kimSelectionWords(state->boundary);
+        state->deletedBefore.assign(words + 1, 0);
+        for (size_t word = 0; word < words; ++word) {
+            uint64_t bits = word < state->deletedAtStart.size() ? state->deletedAtStart[word] : 0;
+            state->deletedBefore[word + 1] = state->deletedBefore[word] + kimPopCount(bits);
+        }
+        std::vector<size_t> rows;
+        rows.reserve(state->boundary - state->deletedBefore.back());
+        for (size_t row = 0; row < state->boundary; ++row) {
+            if (!kimIsDeleted(state->deletedAtStart, row)) {
+                rows.push_back(row);
             }
         }
+        state->columns = copyRows(headers, *source, rows);
+        for (auto& index : state->hashIndexes) {
+            index.build(state->columns[index.column]);
+        }
+        for (auto& tree : state->treeIndexes) {
+            tree.build(state->columns[tree.column]);
+        }
+        state->done = true;
+    });
+    compaction = job;
+}
 
-        if (columnIndex == -1) {
-            std::cerr << "Column not found" << std::endl;
-            return std::vector<std::string>();
+bool KimTable::finishCompaction(bool wait) {
+    if (!compaction || (!wait && !compaction->done)) {
+        return false;
+    }
+    auto lock = lockForWrite();
+    compaction->worker.join();
+    installCompaction();
+    return true;
+}
+
+void KimTable::installCompaction() {
+    std::shared_ptr<KimCompaction> job = std::move(compaction);
+    std::vector<KimColumn>& result = job->columns;
+    auto eraseEntries = [&](size_t row) {
+        for (auto& index : job->hashIndexes) {
+            index.erase(result[index.column].getView(row), row);
+        }
+        for (auto& tree : job->treeIndexes) {
+            tree.erase(result[tree.column].orderedKey(row), row);
+        }
+    };
+    auto insertEntries = [&](size_t row) {
+        for (auto& index : job->hashIndexes) {
+            index.insert(result[index.column].getView(row), row);
+        }
+        for (auto& tree : job->treeIndexes) {
+            tree.insert(result[tree.column].orderedKey(row), row);
+        }
+    };
+
+    // Values updated meanwhile are copied over, with their index entries
+    for (const auto& update : job->updates) {
+        size_t row = update.first;
+        size_t column = update.second;
+        if (row >= job->boundary || kimIsDeleted(job->deletedAtStart, row)) {
+            continue;
+        }
+        size_t target = job->newRow(row);
+        KimHashIndex* index = nullptr;
+        KimBPlusTree* tree = nullptr;
+        for (auto& candidate : job->hashIndexes) {
+            index = candidate.column == column ? &candidate : index;
         }
+        for (auto& candidate : job->treeIndexes) {
+            tree = candidate.column == column ? &candidate : tree;
+        }
+        if (index) {
+            index->erase(result[column].getView(target), target);
+        }
+        if (tree) {
+            tree->erase(result[column].orderedKey(target), target);
+        }
+        result[column].setFrom(target, columns[column], row);
+        if (index) {
+            index->insert(result[column].getView(target), target);
+        }
+        if (tree) {
+            tree->insert(result[column].orderedKey(target), target);
+        }
+    }
 
-        for (size_t i = 0; i < table.rows.size(); ++i) {
-            if (table.rows[i][columnIndex] == value) {
-                return selectRow(table, i);
+    // Rows deleted meanwhile stay as tombstones, and the log says so, so that
+    // a replay renumbers the rows exactly as this did
+    std::vector<uint64_t> tombstones;
+    std::vector<uint64_t> keptDeleted;
+    auto markDeleted = [&](size_t row) {
+        if (tombstones.size() <= row / 64) {
+            tombstones.resize(row / 64 + 1);
+        }
+        tombstones[row / 64] |= uint64_t(1) << (row % 64);
+    };
+    size_t boundaryWords = std::min(deletedRows.size(), kimSelectionWords(job->boundary));
+    for (size_t word = 0; word < boundaryWords; ++word) {
+        uint64_t before = word < job->deletedAtStart.size() ? job->deletedAtStart[word] : 0;
+        for (uint64_t bits = deletedRows[word] & ~before; bits != 0; bits &= bits - 1) {
+            size_t row = word * 64 + kimCountTrailingZeros(bits);
+            if (row >= job->boundary) {
+                break;
             }
+            size_t target = job->newRow(row);
+            keptDeleted.push_back(row);
+            eraseEntries(target);
+            markDeleted(target);
         }
-    } else {
-        std::cerr << "Invalid SQL query" << std::endl;
     }
 
-    return std::vector<std::string>();
+    // Rows added meanwhile follow, deleted ones as tombstones
+    for (size_t row = job->boundary; row < rowCount(); ++row) {
+        size_t target = result.empty() ? 0 : result.front().size();
+        for (size_t i = 0; i < result.size(); ++i) {
+            result[i].appendFrom(columns[i], row);
+        }
+        if (isDeleted(row)) {
+            markDeleted(target);
+        } else {
+            insertEntries(target);
+        }
+    }
+
+    columns = std::move(result);
+    hashIndexes = std::move(job->hashIndexes);
+    treeIndexes = std::move(job->treeIndexes);
+    deletedRows = std::move(tombstones);
+    deletedCount = 0;
+    for (uint64_t word : deletedRows) {
+        deletedCount += kimPopCount(word);
+    }
+    ++compactionCount;
+
+    if (log) {
+        KimLogRecord record;
+        record.type = KimLogRecordType::Compact;
+        record.row = job->boundary;
+        record.rows = std::move(keptDeleted);
+        if (logMutation(record)) {
+            checkpointIfDue();
+        }
+    }
+}
+
+//================================================LOG==========================================================================/
+struct KimTableLog {
+    std::string fileName;
+    KimWriteAheadLog wal;
+    std::thread checkpointer;
+    std::atomic<bool> checkpointing{false};
+    // fileName.wal.1 holds records the file does not include yet: set while a
+    // checkpoint runs, and left set when it fails
+    std::atomic<bool> retiredPending{false};
+
+    ~KimTableLog() {
+        if (checkpointer.joinable()) {
+            checkpointer.join();
+        }
+    }
+};
+
+static bool logFailed(const KimTableLog& log) {
+    return log.wal.hasFailed();
+}
+
+static std::string logPathOf(const std::string& fileName) {
+    return fileName + ".wal";
+}
+
+static std::string retiredLogPathOf(const std::string& fileName) {
+    return fileName + ".wal.1";
+}
+
+void KimTable::applyLogRecord(const KimLogRecord& record) {
+    auto lock = lockForWrite();
+    switch (record.type) {
+        case KimLogRecordType::AddRow:
+            addRow(record.values);
+            break;
+        case KimLogRecordType::UpdateRow:
+            updateRow(*this, record.row, record.column, record.values.empty() ? std::string() : record.values[0]);
+            break;
+        case KimLogRecordType::DeleteRow:
+            deleteRow(record.row);
+            break;
+        case KimLogRecordType::Compact:
+            compactRows(record.row, record.rows);
+            break;
+    }
 }
 
-std::vector<std::vector<std::string>> selectRowsWithSQL(const KimTable& table, const std::string& sqlQuery) {
-    std::istringstream iss(sqlQuery);
-    std::string token, tableName, columnName, value;
-    std::vector<std::string> tokens;
-    std::vector<std::vector<std::string>> result;
+bool KimTable::openLogged(const std::string& fileName, const KimWalOptions& options) {
+    closeLog();
+    if (std::ifstream(fileName, std::ios::binary)) {
+        loadFromFile(fileName);
+        if (columnHeaders.empty()) {
+            std::cerr << "Failed to load checkpoint: " << fileName << std::endl;
+            return false;
+        }
+    } else if (!writeFileImage(fileName, true)) {
+        return false; // the first checkpoint holds the schema
+    }
 
-    while (iss >> token) {
-        tokens.push_back(token);
+    // Records the file already includes are skipped, so a crash between a
+    // checkpoint and the removal of the log it folded in replays nothing twice
+    auto apply = [this](const KimLogRecord& record) {
+        if (record.sequence > logSequence) {
+            applyLogRecord(record);
+            logSequence = record.sequence;
+        }
+    };
+    std::string retiredPath = retiredLogPathOf(fileName);
+    bool hasRetired = static_cast<bool>(std::ifstream(retiredPath, std::ios::binary));
+    uint64_t retiredLength, validLength;
+    // Compactions are replayed where the log recorded them, never started by
+    // the replayed deletes
+    double threshold = compactionThreshold;
+    compactionThreshold = 0;
+    bool replayed = KimWriteAheadLog::replay(retiredPath, apply, retiredLength) &&
+                    KimWriteAheadLog::replay(logPathOf(fileName), apply, validLength);
+    compactionThreshold = threshold;
+    if (!replayed) {
+        return false;
+    }
+    // An interrupted checkpoint is finished before new records are logged
+    if (hasRetired) {
+        if (!writeFileImage(fileName, true)) {
+            return false;
+        }
+        std::remove(retiredPath.c_str());
+        kimSyncDirectoryOf(retiredPath);
     }
 
-    if (tokens.size() != 8 || tokens[0] != "SELECT" || tokens[1] != "*" || tokens[2] != "FROM" || tokens[4] != "WHERE" || tokens[6] != "=") {
-        std::cerr << "Invalid SQL query" << std::endl;
-        return result;
+    auto tableLog = std::make_shared<KimTableLog>();
+    tableLog->fileName = fileName;
+    if (!tableLog->wal.open(logPathOf(fileName), validLength, logSequence + 1, options)) {
+        return false;
     }
+    log = tableLog;
+    return true;
+}
 
-    tableName = tokens[3];
-    columnName = tokens[5];
-    value = tokens[7];
+bool KimTable::logMutation(KimLogRecord& record) {
+    uint64_t sequence = log->wal.append(record);
+    if (sequence == 0 || (log->wal.options().sync == KimLogSync::EveryCommit && !log->wal.sync(sequence))) {
+        std::cerr << "Error: the change could not be logged; the table is read-only from now on." << std::endl;
+        return false;
+    }
+    logSequence = sequence;
+    return true;
+}
 
-    if (tableName != table.header.TableName) {
-        std::cerr << "Table name does not match" << std::endl;
-        return result;
+void KimTable::checkpointIfDue() {
+    size_t threshold = log ? log->wal.options().checkpointBytes : 0;
+    if (threshold > 0 && log->wal.size() >= threshold && !log->checkpointing && !log->retiredPending) {
+        checkpoint();
     }
+}
 
-    int columnIndex = -1;
-    for (int i = 0; i < table.header.NumColumns; ++i) {
-        if (table.columnHeaders[i].ColumnName == columnName) {
-            columnIndex = i;
-            break;
+bool KimTable::checkpoint(bool wait) {
+    if (!log) {
+        std::cerr << "Error: table is not opened with openLogged." << std::endl;
+        return false;
+    }
+    if (log->checkpointer.joinable()) {
+        log->checkpointer.join();
+    }
+    // The log is rotated unless an earlier checkpoint failed to fold the
+    // retired segment; then this one folds both and the current segment's
+    // records are skipped by sequence on the next open
+    if (!log->retiredPending) {
+        if (!log->wal.rotate(retiredLogPathOf(log->fileName))) {
+            return false;
         }
+        log->retiredPending = true;
     }
 
-    if (columnIndex == -1) {
-        std::cerr << "Column not found" << std::endl;
-        return result;
+    // The file is written from a copy, so mutations continue meanwhile
+    auto snapshot = std::make_shared<KimTable>(*this);
+    snapshot->log.reset();
+    snapshot->compaction.reset();
+    KimTableLog* tableLog = log.get();
+    tableLog->checkpointing = true;
+    tableLog->checkpointer = std::thread([snapshot, tableLog] {
+        if (snapshot->writeFileImage(tableLog->fileName, true)) {
+            std::string retiredPath = retiredLogPathOf(tableLog->fileName);
+            std::remove(retiredPath.c_str());
+            kimSyncDirectoryOf(retiredPath);
+            tableLog->retiredPending = false;
+        }
+        tableLog->checkpointing = false;
+    });
+    if (!wait) {
+        return true;
     }
+    log->checkpointer.join();
+    return !log->retiredPending;
+}
 
-    for (size_t i = 0; i < table.rows.size(); ++i) {
-        if (table.rows[i][columnIndex] == value) {
-            result.push_back(table.rows[i]);
+bool KimTable::syncLog() {
+    return log && log->wal.sync();
+}
+
+void KimTable::closeLog() {
+    if (log) {
+        if (log->checkpointer.joinable()) {
+            log->checkpointer.join();
         }
+        log->wal.close();
+        log.reset();
     }
+}
 
-    return result;
+
+//================================================SQL==========================================================================/
+KimPreparedStatement KimTable::prepare(const std::string& sqlQuery) const {
+    uint64_t start = kimNowNanos();
+    std::vector<KimToken> tokens;
+    std::string error;
+    if (!kimTokenize(sqlQuery, tokens, error)) {
+        std::cerr << "Invalid SQL query: " << error << std::endl;
+        kimRecordQueryError();
+        return KimPreparedStatement();
+    }
+    KimNormalizedSql normalized;
+    kimNormalize(tokens, normalized);
+
+    std::shared_ptr<const KimQueryPlan> plan = planCache.find(normalized.key);
+    bool cached = plan != nullptr;
+    if (!plan) {
+        KimSelectStatement statement;
+        if (!kimParseSelect(normalized.tokens, statement, error)) {
+            std::cerr << "Invalid SQL query: " << error << std::endl;
+            kimRecordQueryError();
+            return KimPreparedStatement();
+        }
+        plan = kimPlanQuery(*this, statement, error);
+        if (!plan) {
+            std::cerr << error << std::endl;
+            kimRecordQueryError();
+            return KimPreparedStatement();
+        }
+        planCache.insert(normalized.key, plan);
+    }
+    uint64_t nanos = kimNowNanos() - start;
+    kimRecordPrepare(nanos, cached);
+    return KimPreparedStatement(this, schemaVersion, plan, std::move(normalized.arguments),
+                                normalized.callerParameters, nanos, cached, normalized.key);
+}
+
+std::vector<std::string> KimTable::selectRowWithSQL(const  KimTable& table, const std::string& sqlQuery) {
+    return static_cast<const KimTable*>(this)->selectRowWithSQL(table, sqlQuery);
+}
+
+std::vector<std::string> KimTable::selectRowWithSQL(const  KimTable& table, const std::string& sqlQuery) const {
+    // Only the first match is read, and assembled into a row; aggregates and
+    // EXPLAIN have no rows to stream, so they run whole
+    KimPreparedStatement statement = table.prepare(sqlQuery);
+    if (!statement.valid()) {
+        return std::vector<std::string>();
+    }
+    const KimQueryPlan* plan = statement.queryPlan();
+    if (plan->explain || !plan->outputs.empty()) {
+        std::vector<std::vector<std::string>> rows = statement.execute();
+        return rows.empty() ? std::vector<std::string>() : rows.front();
+    }
+    KimCursor cursor = statement.openWith({}, 1);
+    KimRowView row;
+    if (cursor.next(row)) {
+        return row.toStrings();
+    }
+    return std::vector<std::string>();
+}
+
+KimCursor KimTable::openCursor(const std::string& sqlQuery) const {
+    KimPreparedStatement statement = prepare(sqlQuery);
+    if (!statement.valid()) {
+        return KimCursor();
+    }
+    return statement.openWith({});
+}
+
+std::vector<std::vector<std::string>> KimTable::selectRowsWithSQL(const KimTable& table, const std::string& sqlQuery) const {
+    KimPreparedStatement statement = table.prepare(sqlQuery);
+    if (!statement.valid()) {
+        return {};
+    }
+    return statement.execute();
+}
+
+std::vector<std::vector<std::string>> KimTable::selectRowsWithSQL(const KimTable& table, const KimTable& joined,
+                                                                  const std::string& sqlQuery) const {
+    uint64_t prepareStart = kimNowNanos();
+    std::vector<KimToken> tokens;
+    std::string error;
+    KimNormalizedSql normalized;
+    KimSelectStatement statement;
+    if (!kimTokenize(sqlQuery, tokens, error)) {
+        std::cerr << "Invalid SQL query: " << error << std::endl;
+        kimRecordQueryError();
+        return {};
+    }
+    kimNormalize(tokens, normalized);
+    if (!kimParseSelect(normalized.tokens, statement, error)) {
+        std::cerr << "Invalid SQL query: " << error << std::endl;
+        kimRecordQueryError();
+        return {};
+    }
+    if (normalized.callerParameters > 0) {
+        std::cerr << "Invalid SQL query: parameters are not supported here" << std::endl;
+        kimRecordQueryError();
+        return {};
+    }
+
+    // FROM names the left table, whichever of the two it is
+    bool swapped = statement.table == joined.header.TableName && statement.table != table.header.TableName;
+    const KimTable& left = swapped ? joined : table;
+    const KimTable& right = swapped ? table : joined;
+    std::shared_ptr<KimJoinPlan> plan = kimPlanJoin(left, right, statement, error);
+    if (!plan) {
+        std::cerr << error << std::endl;
+        kimRecordQueryError();
+        return {};
+    }
+
+    std::vector<std::string> values;
+    for (const auto& argument : normalized.arguments) {
+        values.push_back(argument.literal);
+    }
+    size_t limit = SIZE_MAX;
+    if (plan->hasLimit && !kimBindLimit(plan->limit, values, limit)) {
+        kimRecordQueryError();
+        return {};
+    }
+    KimQueryStats stats;
+    stats.prepareNanos = kimNowNanos() - prepareStart;
+    kimRecordPrepare(stats.prepareNanos, false);
+    size_t columns = plan->columns.empty() ? left.columns.size() + right.columns.size() : plan->columns.size();
+    std::string limitText = plan->hasLimit ? ", LIMIT " + std::to_string(limit) : std::string();
+    if (plan->explain && !plan->analyze) {
+        kimDescribeJoin(left, right, *plan, values, stats.operators);
+        stats.operators.push_back({"Project", std::to_string(columns) + " columns" + limitText});
+        return kimExplainRows(stats, false);
+    }
+
+    bool measured = plan->analyze || kimMetrics().enabled();
+    uint64_t start = measured ? kimNowNanos() : 0;
+    size_t threads = left.parallelism;
+    // A join has no ORDER BY, so its LIMIT stops the probe early
+    KimJoinPairs pairs = kimExecuteJoin(left, right, *plan, values, threads, measured ? &stats : nullptr, limit);
+    uint64_t projectStart = measured ? kimNowNanos() : 0;
+
+    std::vector<std::vector<std::string>> result(pairs.size());
+    size_t morsels = (pairs.size() + kKimBlockRows - 1) / kKimBlockRows;
+    kimThreadPool().run(morsels, threads, [&](size_t, size_t morsel) {
+        size_t end = std::min(pairs.size(), (morsel + 1) * kKimBlockRows);
+        for (size_t i = morsel * kKimBlockRows; i < end; ++i) {
+            std::vector<std::string>& row = result[i];
+            if (!plan->columns.empty()) {
+                // Only the selected columns of either side are read
+                row.reserve(plan->columns.size());
+                for (size_t column : plan->columns) {
+                    row.push_back(column < left.columns.size()
+                                      ? left.columns[column].getString(pairs[i].first)
+                                      : right.columns[column - left.columns.size()].getString(pairs[i].second));
+                }
+                continue;
+            }
+            row = selectRow(left, pairs[i].first);
+            std::vector<std::string> rightRow = selectRow(right, pairs[i].second);
+            row.insert(row.end(), std::make_move_iterator(rightRow.begin()), std::make_move_iterator(rightRow.end()));
+        }
+    });
+    if (measured) {
+        uint64_t end = kimNowNanos();
+        KimOperatorStats project = kimProjectOperator(columns, result, end - projectStart);
+        project.detail += limitText;
+        project.rowsIn = pairs.size();
+        stats.operators.push_back(project);
+        stats.bytesRead += project.bytesRead;
+        stats.nanos = end - start;
+        stats.rowsMatched = result.size();
+        kimRecordQuery(stats);
+    }
+    return plan->analyze ? kimExplainRows(stats, true) : result;
 }
 
 //================================================SQL==========================================================================/
@@ -15,34 +15,36 @@
 #include <fstream>
 #include <vector>
 #include <cstring>
-#include <regex>
 
-struct KimFileHeaderV3 {
-    uint8_t FileFormatVersion;
-    uint32_t FileSize;
-    uint16_t NumTables;
-    uint32_t LinkKeysSectionOffset;
-};
+#include "KimFileFormat.h"
+#include "KimColumnStore.h"
+#include "KimMappedFile.h"
+#include "KimHashIndex.h"
+#include "KimBPlusTree.h"
+#include "KimQuery.h"
+#include "KimWal.h"
+#include "KimBulkLoad.h"
 
-struct ColumnHeader {
-    char ColumnName[64];
-    uint8_t DataType;
-    uint16_t DataSize;
-    bool IsIndexed;
-    bool IsLinkKey;
-    bool IsUnique;
-    bool IsPrimaryKey;
-};
+#include <memory>
+#include <mutex>
 
-struct TableHeader {
-    char TableName[64];
-    uint16_t NumColumns;
-    uint16_t NumRows;
-    int16_t LinkColumnIndex;
-    bool HasUniqueRows;
-};
+class KimTable;
+struct KimTableLog; // write-ahead log state of a table opened with openLogged
+struct KimCompaction; // a compaction running on a background thread
 
+// Orders a table's mutations with the snapshots taken of it, and keeps the
+// last snapshot so readers that find the table unchanged share it. Copies of
+// a table get their own.
+struct KimTableVersions {
+    KimTableVersions() = default;
+    KimTableVersions(const KimTableVersions&) {}
+    KimTableVersions& operator=(const KimTableVersions&) { return *this; }
 
+    std::recursive_mutex mutex; // held by the writer while it changes the table
+    uint64_t version = 0; // bumped by every change
+    uint64_t snapshotVersion = 0;
+    std::weak_ptr<const KimTable> snapshot;
+};
 
 class KimTable {
 public:
@@ -52,22 +54,181 @@ public:
 
     TableHeader header;
     std::vector<ColumnHeader> columnHeaders;
-    std::vector<std::vector<std::string>> rows; // Replace std::string with the appropriate data type
-    void addRow(const std::vector<std::string>& rowData);
+    std::vector<KimColumn> columns; // column-major row data, one entry per column header
+    std::vector<KimHashIndex> hashIndexes; // one per IsIndexed/IsUnique/IsPrimaryKey column
+    std::vector<KimBPlusTree> treeIndexes; // one per IsIndexed int/float column
+    std::vector<KimLinkKey> linkKeys; // as read from the link keys section
+    // Columns that link this table to others: IsLinkKey columns, then link
+    // keys naming this table (TableIndex 0). LinkColumnIndex is not trusted,
+    // since tables created in memory leave it at 0.
+    std::vector<size_t> linkColumns() const;
+    size_t rowCount() const; // row ids in use, deleted rows included until compaction
+    size_t liveRowCount() const;
+    // Tombstones (see kimIsDeleted): a deleted row keeps its id and storage,
+    // and is skipped by scans, joins and indexes, until the table is compacted
+    std::vector<uint64_t> deletedRows;
+    size_t deletedCount = 0;
+    bool isDeleted(size_t row) const;
+    // Fraction of deleted rows at which deleteRow starts a background
+    // compaction, 0 never
+    double compactionThreshold = 0.5;
+    uint64_t compactionCount = 0; // bumped whenever compaction gives rows new ids
+    // Drops the deleted rows and rebuilds the indexes. Rows keep their order;
+    // each row after the first deleted one gets a new id.
+    void compact();
+    // Compacts a copy of the table on a background thread. The result is
+    // installed, with the changes made meanwhile carried over, by the next
+    // addRow or by finishCompaction; until then row ids stay as they are.
+    void compactInBackground();
+    // Installs a background compaction once it is done, waiting for it when
+    // `wait`; returns whether one was installed
+    bool finishCompaction(bool wait = true);
+    std::shared_ptr<KimCompaction> compaction;
+    KimHashIndex* hashIndexFor(size_t columnIndex);
+    const KimHashIndex* hashIndexFor(size_t columnIndex) const;
+    KimBPlusTree* treeIndexFor(size_t columnIndex);
+    const KimBPlusTree* treeIndexFor(size_t columnIndex) const;
+    void rebuildIndexes();
+    // Rows whose column equals value, in row order; probes the hash index when there is one
+    std::vector<size_t> findEqualRows(size_t columnIndex, const std::string& value, size_t limit = SIZE_MAX) const;
+    // Rows whose column lies in range, in row order; walks the B+tree when there is one
+    std::vector<size_t> findRangeRows(size_t columnIndex, const KimRange& range, size_t limit = SIZE_MAX) const;
+    // Compiles sqlQuery, reusing the cached plan of any earlier query that
+    // differs only in its literals; execute() binds the `?` placeholders
+    KimPreparedStatement prepare(const std::string& sqlQuery) const;
+    mutable KimPlanCache planCache; // keyed by normalised SQL
+    // Results of earlier queries, for as long as the table is unchanged;
+    // off until given a budget with resultCache.setBudget
+    mutable KimResultCache resultCache;
+    uint64_t schemaVersion = 0; // bumped whenever cached plans may no longer apply
+    size_t parallelism = 0; // threads per query scan, 0 for every core
+    // The table as of now, for readers on other threads. Column blocks and
+    // dictionaries are shared rather than copied, so taking one costs
+    // O(blocks) plus the tombstone bitmap; the writer copies a block before
+    // changing it while a snapshot holds it, and a version is freed with its
+    // last reader. Queries on a snapshot scan, since it carries no indexes.
+    // The mutating methods below may run on one writer thread meanwhile.
+    std::shared_ptr<const KimTable> snapshot() const;
+    mutable KimTableVersions versions;
+    // False, leaving the table unchanged, when the row is rejected or a
+    // logged table could not log it
+    bool addRow(const std::vector<std::string>& rowData);
     void setTableName(const std::string& tableName);
     std::vector<std::string> selectRowWithSQL(const  KimTable& table,const std::string& sqlQuery) const;
     void loadFromFile(const std::string& fileName);
-    std::string select(const KimTable& table, size_t rowIndex, size_t columnIndex);
-    std::vector<std::string> selectRow( const KimTable& table, size_t rowIndex);
-    void deleteRow(size_t rowIndex);
-    void updateRow(KimTable& table, size_t rowIndex, size_t columnIndex, const std::string& newValue);
+    // Appends the records of a CSV or TSV file. The file is mapped, split at
+    // record boundaries and parsed in parallel into columns of the table's
+    // types, which are appended a batch at a time; indexes are updated once at
+    // the end, and rows repeating a unique key become tombstones. A logged
+    // table is checkpointed afterwards instead of logging each row, and the
+    // load returns once that checkpoint is on disk; should it fail, the log
+    // is closed, since later records would number rows the file lacks.
+    // Returns the number of rows added.
+    size_t loadDelimited(const std::string& fileName, const KimLoadOptions& options = KimLoadOptions());
+    // Maps a version 4, 5, 7 or 8 file read-only; queries read straight from the mapped pages
+    void openMapped(const std::string& fileName);
+    // Maps the table image stored at [offset, offset + size) of file
+    bool openMapped(const std::shared_ptr<KimMappedFile>& file, uint64_t offset, uint64_t size);
+    // Opens a version 7 or 8 file read-only with its column blocks read on demand
+    // through kimBufferPool(), so a table may be larger than memory. Scans,
+    // point reads, joins and aggregates all read the blocks through the pool.
+    void openPaged(const std::string& fileName);
+    // Copies mapped or paged columns and indexes into owned storage and drops the file
+    void materialize();
+    // Mapped, paged, or logged to a log that has failed
+    bool isReadOnly() const;
+    std::shared_ptr<KimMappedFile> mapping; // set while the columns point into a mapped file
+    std::shared_ptr<const KimPagedFile> pagedFile; // set while the column blocks are read through the buffer pool
+    std::string select(const KimTable& table, size_t rowIndex, size_t columnIndex) const;
+    std::vector<std::string> selectRow( const KimTable& table, size_t rowIndex) const;
+    // Only the given columns, in that order; the others are not read, decoded or paged in
+    std::vector<std::string> selectRow(const KimTable& table, size_t rowIndex,
+                                       const std::vector<size_t>& columns) const;
+    // Both false, leaving the table unchanged, as addRow
+    bool deleteRow(size_t rowIndex);
+    bool updateRow(KimTable& table, size_t rowIndex, size_t columnIndex, const std::string& newValue);
     std::vector<std::string> selectRowWithSQL(const KimTable& table, const std::string& sqlQuery);
-    std::vector<std::vector<std::string>> selectRowsWithSQL(const KimTable& table, const std::string& sqlQuery);
+    std::vector<std::vector<std::string>> selectRowsWithSQL(const KimTable& table, const std::string& sqlQuery) const;
+    // Streams the rows of a query as views into the table, without copying
+    // them; invalid when the query cannot be prepared
+    KimCursor openCursor(const std::string& sqlQuery) const;
+    // SELECT * FROM a JOIN b ...: each result row holds a's columns followed
+    // by b's, where a and b are table and joined in either order; a column
+    // list selects columns of either
+    std::vector<std::vector<std::string>> selectRowsWithSQL(const KimTable& table, const KimTable& joined,
+                                                            const std::string& sqlQuery) const;
 
     void createTable(const std::vector<std::string> &columnNames);
+    void createTable(const std::vector<ColumnHeader> &headers);
 
     void writeToFile(const std::string &fileName);
+    // writeToFile without the progress message; `durable` syncs the new file
+    // and its directory before and after it replaces fileName
+    bool writeFileImage(const std::string& fileName, bool durable) const;
+    // Writes the table as a self-contained version 8 image whose offsets are
+    // relative to where it starts in ofs, which must be seekable: the headers
+    // and their checksums are filled in once the sections are written.
+    // Returns its size
+    uint64_t writeImage(std::ostream& ofs) const;
+    bool compressBlocks = true; // store each column block with the encoding that makes it smallest
+
+    // Opens fileName for incremental writes: loads its last checkpoint (or
+    // writes one of the current table when the file does not exist yet),
+    // replays fileName.wal over it and from then on appends each addRow,
+    // updateRow and deleteRow to that log instead of rewriting the file.
+    // Each change is logged before it is applied; once the log fails to write
+    // or sync, the change is refused and the table turns read-only.
+    // Schema changes are not logged; call checkpoint() after them. Copies of
+    // the table share its log, so only one of them should mutate.
+    bool openLogged(const std::string& fileName, const KimWalOptions& options = KimWalOptions());
+    // Starts folding the log into the file on a background thread; the log is
+    // switched to a new segment so mutations carry on meanwhile. With `wait`,
+    // returns once the file is written. False when the checkpoint could not
+    // start or, with `wait`, did not complete.
+    bool checkpoint(bool wait = false);
+    // Returns once every logged mutation is on disk
+    bool syncLog();
+    // Waits for a running checkpoint, syncs and closes the log
+    void closeLog();
+    void applyLogRecord(const KimLogRecord& record);
+    uint64_t logSequence = 0; // last logged mutation the table, and the file it was loaded from, includes
+    std::shared_ptr<KimTableLog> log;
+
+private:
+    // Holds off snapshots until the change is complete
+    std::unique_lock<std::recursive_mutex> lockForWrite();
+    // Appends record to the log and, under EveryCommit, waits for it to reach
+    // the disk. False when it could not; the table is read-only from then on.
+    bool logMutation(KimLogRecord& record);
+    // Starts a checkpoint once the log has reached checkpointBytes. Called with
+    // the write lock held after the logged change is applied, so the file
+    // written includes every record the retired log holds.
+    void checkpointIfDue();
+    // Drops the deleted rows below `boundary` that are not in keepDeleted
+    void compactRows(size_t boundary, const std::vector<uint64_t>& keepDeleted);
+    void installCompaction();
 };
 
+// Renames tempFileName over fileName unless writing it `failed`, which
+// removes it instead; `durable` syncs the file and its directory. Should
+// the rename fail, fileName is left as it was.
+bool kimReplaceFile(const std::string& tempFileName, const std::string& fileName, bool failed, bool durable);
+
+// Rewrites a table file of any earlier version (3, 4, 5 or 7) in the current
+// version 8 layout; target may be source. Columnar files are read through a
+// mapping and written a column at a time, so memory use is bounded by the
+// largest column rather than the file. Version 6 databases are rewritten by
+// KimDatabase::writeToFile.
+bool kimConvertFile(const std::string& source, const std::string& target);
+// Compares the checksum of every section of the version 8 table image at
+// data with its contents; older versions have none to compare
+bool kimVerifyImage(const char* data, uint64_t size);
+// Reads the table directory of the version 6 database at data, with every
+// name NUL-terminated; false when the trailer or an entry does not fit
+bool kimReadDirectory(const char* data, uint64_t size, std::vector<KimTableEntry>& directory);
+// Checks the headers and every section of a version 8 file against their
+// checksums; earlier versions only have their headers checked. A version 6
+// database has each of its table images checked the same way.
+bool kimVerifyFile(const std::string& fileName);
 
 #endif //KIMDB_KIMFILEHEAD_H
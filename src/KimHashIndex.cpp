@@ -0,0 +1,205 @@
+//
+// Open-addressing hash index over one column of a KimTable.
+//
+
+#include "KimHashIndex.h"
+
+#include <cstring>
+
+static constexpr uint64_t kEmptySlot = UINT64_MAX;
+static constexpr uint64_t kDeletedSlot = UINT64_MAX - 1;
+
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+uint64_t kimHash(std::string_view bytes) {
+    const char* data = bytes.data();
+    size_t length = bytes.size();
+    uint64_t hash = 0x9e3779b97f4a7c15ULL ^ length;
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ mix64(word)) * 0x100000001b3ULL;
+    }
+    if (i < length) {
+        uint64_t word = 0;
+        std::memcpy(&word, data + i, length - i);
+        hash = (hash ^ mix64(word)) * 0x100000001b3ULL;
+    }
+    return mix64(hash);
+}
+
+KimHashIndex::KimHashIndex(size_t column, bool unique) : column(column), unique(unique) {}
+
+void KimHashIndex::clear() {
+    slots.clear();
+    mappedSlots = nullptr;
+    capacity = 0;
+    used = 0;
+    deleted = 0;
+}
+
+void KimHashIndex::rehash(size_t newCapacity) {
+    std::vector<KimHashSlot> old(slotData(), slotData() + capacity);
+    slots.assign(newCapacity, KimHashSlot{0, kEmptySlot});
+    mappedSlots = nullptr;
+    capacity = newCapacity;
+    deleted = 0;
+
+    size_t mask = capacity - 1;
+    for (const auto& slot : old) {
+        if (slot.row >= kDeletedSlot) {
+            continue;
+        }
+        size_t position = slot.hash & mask;
+        while (slots[position].row != kEmptySlot) {
+            position = (position + 1) & mask;
+        }
+        slots[position] = slot;
+    }
+}
+
+void KimHashIndex::build(const KimColumn& values, const std::vector<uint64_t>& deleted) {
+    clear();
+    size_t wanted = 16;
+    while (wanted * 7 < values.size() * 10) {
+        wanted *= 2;
+    }
+    rehash(wanted);
+    for (size_t row = 0; row < values.size(); ++row) {
+        if (!kimIsDeleted(deleted, row)) {
+            insert(values.getView(row), row);
+        }
+    }
+}
+
+void KimHashIndex::insert(std::string_view key, size_t row) {
+    if ((used + deleted + 1) * 10 > capacity * 7) {
+        size_t wanted = 16;
+        while (wanted * 7 < (used + 1) * 20) {
+            wanted *= 2;
+        }
+        rehash(wanted);
+    } else if (mappedSlots) {
+        materialize();
+    }
+
+    uint64_t hash = kimHash(key);
+    size_t mask = capacity - 1;
+    size_t position = hash & mask;
+    while (slots[position].row < kDeletedSlot) {
+        position = (position + 1) & mask;
+    }
+    if (slots[position].row == kDeletedSlot) {
+        --deleted;
+    }
+    slots[position] = KimHashSlot{hash, row};
+    ++used;
+}
+
+void KimHashIndex::erase(std::string_view key, size_t row) {
+    if (capacity == 0) {
+        return;
+    }
+    if (mappedSlots) {
+        materialize();
+    }
+    uint64_t hash = kimHash(key);
+    size_t mask = capacity - 1;
+    size_t position = hash & mask;
+    for (size_t probes = 0; probes < capacity && slots[position].row != kEmptySlot; ++probes) {
+        if (slots[position].row == row && slots[position].hash == hash) {
+            slots[position].row = kDeletedSlot;
+            --used;
+            ++deleted;
+            return;
+        }
+        position = (position + 1) & mask;
+    }
+}
+
+bool KimHashIndex::contains(const KimColumn& values, std::string_view key, size_t ignoreRow) const {
+    if (capacity == 0) {
+        return false;
+    }
+    const KimHashSlot* data = slotData();
+    uint64_t hash = kimHash(key);
+    size_t mask = capacity - 1;
+    size_t position = hash & mask;
+    for (size_t probes = 0; probes < capacity && data[position].row != kEmptySlot; ++probes) {
+        const KimHashSlot& slot = data[position];
+        if (slot.hash == hash && slot.row < values.size() && slot.row != ignoreRow &&
+            values.getView(slot.row) == key) {
+            return true;
+        }
+        position = (position + 1) & mask;
+    }
+    return false;
+}
+
+void KimHashIndex::find(const KimColumn& values, std::string_view key, std::vector<size_t>& out,
+                        size_t limit) const {
+    if (capacity == 0 || limit == 0) {
+        return;
+    }
+    const KimHashSlot* data = slotData();
+    uint64_t hash = kimHash(key);
+    size_t mask = capacity - 1;
+    size_t found = 0;
+    size_t position = hash & mask;
+    for (size_t probes = 0; probes < capacity && data[position].row != kEmptySlot; ++probes) {
+        const KimHashSlot& slot = data[position];
+        if (slot.hash == hash && slot.row < values.size() && values.getView(slot.row) == key) {
+            out.push_back(slot.row);
+            if (++found == limit) {
+                return;
+            }
+        }
+        position = (position + 1) & mask;
+    }
+}
+
+uint64_t KimHashIndex::serializedSize() const {
+    return 3 * sizeof(uint64_t) + capacity * sizeof(KimHashSlot);
+}
+
+void KimHashIndex::write(std::ostream& os) const {
+    uint64_t counts[3] = {capacity, used, deleted};
+    os.write(reinterpret_cast<const char*>(counts), sizeof(counts));
+    os.write(reinterpret_cast<const char*>(slotData()), static_cast<std::streamsize>(capacity * sizeof(KimHashSlot)));
+}
+
+bool KimHashIndex::map(const char* section, size_t available) {
+    uint64_t counts[3];
+    if (available < sizeof(counts)) {
+        return false;
+    }
+    std::memcpy(counts, section, sizeof(counts));
+    uint64_t mappedCapacity = counts[0];
+    // The probe mask needs a power-of-two capacity, and a full table would leave no empty slot to stop on
+    if ((mappedCapacity & (mappedCapacity - 1)) != 0 ||
+        mappedCapacity > (available - sizeof(counts)) / sizeof(KimHashSlot) ||
+        (mappedCapacity != 0 && counts[1] + counts[2] >= mappedCapacity)) {
+        return false;
+    }
+    clear();
+    capacity = mappedCapacity;
+    used = counts[1];
+    deleted = counts[2];
+    mappedSlots = capacity ? reinterpret_cast<const KimHashSlot*>(section + sizeof(counts)) : nullptr;
+    return true;
+}
+
+void KimHashIndex::materialize() {
+    if (mappedSlots) {
+        slots.assign(mappedSlots, mappedSlots + capacity);
+        mappedSlots = nullptr;
+    }
+}
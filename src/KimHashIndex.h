@@ -0,0 +1,65 @@
+//
+// Open-addressing hash index over one column of a KimTable.
+//
+
+#ifndef KIMDB_KIMHASHINDEX_H
+#define KIMDB_KIMHASHINDEX_H
+
+#include "KimColumnStore.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+// 64-bit hash of a value's stored bytes. It is persisted with the index, so
+// it must not depend on anything that changes between processes.
+uint64_t kimHash(std::string_view bytes);
+
+struct KimHashSlot {
+    uint64_t hash;
+    uint64_t row;
+};
+
+// Maps the stored bytes of a column value to the rows holding it. Slots keep
+// only the hash and the row id; candidates are confirmed against the column
+// itself, so the index never duplicates string data. Linear probing keeps a
+// lookup to one or two cache lines in the common case.
+class KimHashIndex {
+public:
+    KimHashIndex(size_t column, bool unique);
+
+    size_t column;
+    bool unique;
+
+    size_t size() const { return used; }
+    void clear();
+    // Indexes every row not marked in the tombstone bitmap `deleted`
+    void build(const KimColumn& values, const std::vector<uint64_t>& deleted = {});
+    void insert(std::string_view key, size_t row);
+    void erase(std::string_view key, size_t row);
+
+    bool contains(const KimColumn& values, std::string_view key, size_t ignoreRow = SIZE_MAX) const;
+    void find(const KimColumn& values, std::string_view key, std::vector<size_t>& out,
+              size_t limit = SIZE_MAX) const;
+
+    // Index section of a version 5 file: capacity, used and deleted counts
+    // followed by the slot array, which can be probed in place when mapped.
+    uint64_t serializedSize() const;
+    void write(std::ostream& os) const;
+    bool map(const char* section, size_t available);
+    void materialize();
+
+private:
+    std::vector<KimHashSlot> slots;
+    const KimHashSlot* mappedSlots = nullptr;
+    size_t capacity = 0;
+    size_t used = 0;
+    size_t deleted = 0;
+
+    const KimHashSlot* slotData() const { return mappedSlots ? mappedSlots : slots.data(); }
+    void rehash(size_t newCapacity);
+};
+
+#endif //KIMDB_KIMHASHINDEX_H
@@ -0,0 +1,388 @@
+//
+// Equi-join of two KimTables.
+//
+
+#include "KimJoin.h"
+#include "KimFileHead.h"
+#include "KimThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Build rows per partition above which the build side is partitioned; a
+// partition's table of this many entries stays within a few hundred KiB.
+static constexpr size_t kPartitionRows = 16384;
+static constexpr size_t kMaxPartitionBits = 10;
+
+size_t KimJoinInput::size() const {
+    return rows ? rows->size() : table->rowCount();
+}
+
+static uint64_t mixKey(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb93fe53db34fULL;
+    value ^= value >> 33;
+    return value;
+}
+
+static uint64_t hashKey(int64_t key) {
+    return mixKey(static_cast<uint64_t>(key));
+}
+
+static uint64_t hashKey(double key) {
+    uint64_t bits;
+    key += 0.0; // -0 and 0 must hash alike
+    std::memcpy(&bits, &key, sizeof(bits));
+    return mixKey(bits);
+}
+
+static uint64_t hashKey(std::string_view key) {
+    return kimHash(key);
+}
+
+namespace {
+
+// Join keys of one input, extracted once so partitioning and probing read a
+// flat array. Rows whose key can never match (NaN) are left out.
+template <typename Key>
+struct KeyedRows {
+    std::vector<Key> keys;
+    std::vector<uint64_t> hashes;
+    std::vector<size_t> rows;
+};
+
+struct Partitioned {
+    std::vector<size_t> offsets; // partition p holds order[offsets[p] .. offsets[p + 1])
+    std::vector<uint32_t> order;
+};
+
+} // namespace
+
+template <typename Key, typename KeyOf>
+static KeyedRows<Key> extractKeys(const KimJoinInput& input, KeyOf keyOf) {
+    KeyedRows<Key> keyed;
+    size_t count = input.size();
+    keyed.keys.reserve(count);
+    keyed.hashes.reserve(count);
+    keyed.rows.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        size_t row = input.row(i);
+        if (input.table->isDeleted(row)) {
+            continue;
+        }
+        Key key = keyOf(row);
+        if constexpr (std::is_same_v<Key, double>) {
+            if (key != key) {
+                continue;
+            }
+        }
+        keyed.keys.push_back(key);
+        keyed.hashes.push_back(hashKey(key));
+        keyed.rows.push_back(row);
+    }
+    return keyed;
+}
+
+// Counting sort of entry indices on the top `bits` bits of their hash
+static Partitioned partition(const std::vector<uint64_t>& hashes, size_t bits) {
+    Partitioned result;
+    size_t partitions = size_t(1) << bits;
+    result.offsets.assign(partitions + 1, 0);
+    result.order.resize(hashes.size());
+    auto partitionOf = [bits](uint64_t hash) { return bits == 0 ? 0 : static_cast<size_t>(hash >> (64 - bits)); };
+    for (uint64_t hash : hashes) {
+        ++result.offsets[partitionOf(hash) + 1];
+    }
+    for (size_t p = 0; p < partitions; ++p) {
+        result.offsets[p + 1] += result.offsets[p];
+    }
+    std::vector<size_t> cursor(result.offsets.begin(), result.offsets.end() - 1);
+    for (size_t i = 0; i < hashes.size(); ++i) {
+        result.order[cursor[partitionOf(hashes[i])]++] = static_cast<uint32_t>(i);
+    }
+    return result;
+}
+
+template <typename Key>
+static void joinPartition(const KeyedRows<Key>& build, const uint32_t* buildEntries, size_t buildCount,
+                          const KeyedRows<Key>& probe, const uint32_t* probeEntries, size_t probeCount,
+                          bool buildIsLeft, KimJoinPairs& out) {
+    if (buildCount == 0 || probeCount == 0) {
+        return;
+    }
+    // Chained hash table over the partition: heads indexed by hash, entries
+    // with equal slots linked through `next`
+    size_t capacity = 1;
+    while (capacity < buildCount * 2) {
+        capacity <<= 1;
+    }
+    size_t mask = capacity - 1;
+    constexpr uint32_t kEnd = UINT32_MAX;
+    std::vector<uint32_t> heads(capacity, kEnd);
+    std::vector<uint32_t> next(buildCount);
+    for (size_t i = 0; i < buildCount; ++i) {
+        size_t slot = build.hashes[buildEntries[i]] & mask;
+        next[i] = heads[slot];
+        heads[slot] = static_cast<uint32_t>(i);
+    }
+
+    for (size_t j = 0; j < probeCount; ++j) {
+        uint32_t entry = probeEntries[j];
+        uint64_t hash = probe.hashes[entry];
+        for (uint32_t i = heads[hash & mask]; i != kEnd; i = next[i]) {
+            uint32_t candidate = buildEntries[i];
+            if (build.hashes[candidate] == hash && build.keys[candidate] == probe.keys[entry]) {
+                size_t buildRow = build.rows[candidate];
+                size_t probeRow = probe.rows[entry];
+                out.emplace_back(buildIsLeft ? buildRow : probeRow, buildIsLeft ? probeRow : buildRow);
+            }
+        }
+    }
+}
+
+template <typename Key, typename LeftKey, typename RightKey>
+static KimJoinPairs hashJoin(const KimJoinInput& left, LeftKey leftKey, const KimJoinInput& right, RightKey rightKey,
+                             size_t parallelism) {
+    KeyedRows<Key> leftRows = extractKeys<Key>(left, leftKey);
+    KeyedRows<Key> rightRows = extractKeys<Key>(right, rightKey);
+    bool buildIsLeft = leftRows.rows.size() <= rightRows.rows.size();
+    const KeyedRows<Key>& build = buildIsLeft ? leftRows : rightRows;
+    const KeyedRows<Key>& probe = buildIsLeft ? rightRows : leftRows;
+
+    size_t bits = 0;
+    while (bits < kMaxPartitionBits && (build.rows.size() >> bits) > kPartitionRows) {
+        ++bits;
+    }
+    Partitioned buildParts = partition(build.hashes, bits);
+    Partitioned probeParts = partition(probe.hashes, bits);
+
+    KimThreadPool& pool = kimThreadPool();
+    std::vector<KimJoinPairs> buffers(pool.size());
+    pool.run(size_t(1) << bits, parallelism, [&](size_t participant, size_t p) {
+        joinPartition(build, buildParts.order.data() + buildParts.offsets[p],
+                      buildParts.offsets[p + 1] - buildParts.offsets[p], probe,
+                      probeParts.order.data() + probeParts.offsets[p], probeParts.offsets[p + 1] - probeParts.offsets[p],
+                      buildIsLeft, buffers[participant]);
+    });
+
+    KimJoinPairs pairs;
+    for (auto& buffer : buffers) {
+        pairs.insert(pairs.end(), buffer.begin(), buffer.end());
+    }
+    return pairs;
+}
+
+// Joins with a LIMIT walk the left input in row order, a wave of morsels at a
+// time, and stop at the wave that completes `limit` pairs. probe(row, matches)
+// appends the right rows matching a left row.
+template <typename Probe>
+static KimJoinPairs probeInOrder(const KimJoinInput& left, size_t limit, size_t parallelism, Probe probe) {
+    KimThreadPool& pool = kimThreadPool();
+    size_t wave = parallelism == 0 ? pool.size() : std::min(parallelism, pool.size());
+    size_t count = left.size();
+    size_t morsels = (count + kKimBlockRows - 1) / kKimBlockRows;
+    std::vector<KimJoinPairs> buffers(wave);
+    KimJoinPairs pairs;
+    for (size_t first = 0; first < morsels && pairs.size() < limit; first += wave) {
+        size_t waveMorsels = std::min(wave, morsels - first);
+        pool.run(waveMorsels, parallelism, [&](size_t, size_t morsel) {
+            KimJoinPairs& out = buffers[morsel];
+            out.clear();
+            std::vector<size_t> matches;
+            size_t end = std::min(count, (first + morsel + 1) * kKimBlockRows);
+            for (size_t i = (first + morsel) * kKimBlockRows; i < end && out.size() < limit; ++i) {
+                size_t row = left.row(i);
+                if (left.table->isDeleted(row)) {
+                    continue;
+                }
+                matches.clear();
+                probe(row, matches);
+                std::sort(matches.begin(), matches.end());
+                for (size_t match : matches) {
+                    out.emplace_back(row, match);
+                }
+            }
+        });
+        for (size_t morsel = 0; morsel < waveMorsels; ++morsel) {
+            pairs.insert(pairs.end(), buffers[morsel].begin(), buffers[morsel].end());
+        }
+    }
+    if (pairs.size() > limit) {
+        pairs.resize(limit);
+    }
+    return pairs;
+}
+
+// hashJoin for a LIMIT: the right input is built into one hash table and the
+// left one probes it in row order until `limit` pairs are found. leftKey may
+// return an owning value that converts to Key.
+template <typename Key, typename LeftKey, typename RightKey>
+static KimJoinPairs orderedHashJoin(const KimJoinInput& left, LeftKey leftKey, const KimJoinInput& right,
+                                    RightKey rightKey, size_t limit, size_t parallelism) {
+    KeyedRows<Key> build = extractKeys<Key>(right, rightKey);
+    size_t capacity = 1;
+    while (capacity < build.rows.size() * 2) {
+        capacity <<= 1;
+    }
+    size_t mask = capacity - 1;
+    constexpr uint32_t kEnd = UINT32_MAX;
+    std::vector<uint32_t> heads(capacity, kEnd);
+    std::vector<uint32_t> next(build.rows.size());
+    for (size_t i = 0; i < build.rows.size(); ++i) {
+        size_t slot = build.hashes[i] & mask;
+        next[i] = heads[slot];
+        heads[slot] = static_cast<uint32_t>(i);
+    }
+
+    return probeInOrder(left, limit, parallelism, [&](size_t row, std::vector<size_t>& matches) {
+        auto owned = leftKey(row);
+        Key key = owned;
+        if constexpr (std::is_same_v<Key, double>) {
+            if (key != key) {
+                return;
+            }
+        }
+        uint64_t hash = hashKey(key);
+        for (uint32_t i = heads[hash & mask]; i != kEnd; i = next[i]) {
+            if (build.hashes[i] == hash && build.keys[i] == key) {
+                matches.push_back(build.rows[i]);
+            }
+        }
+    });
+}
+
+// Index nested loop: every row of `outer` looks its key up in the hash index
+// of `inner`, which covers all of inner's rows. With a `limit`, outer must
+// be the left input, which is then walked in row order.
+static KimJoinPairs indexJoin(const KimJoinInput& outer, const KimJoinInput& inner, const KimHashIndex& index,
+                              bool outerIsLeft, size_t limit, size_t parallelism) {
+    const KimColumn& outerColumn = outer.table->columns[outer.column];
+    const KimColumn& innerColumn = inner.table->columns[inner.column];
+    bool sameKind = outerColumn.kind == innerColumn.kind;
+    bool floatKeys = outerColumn.kind == KimStorageKind::Float32 || outerColumn.kind == KimStorageKind::Float64;
+    auto probe = [&](size_t row, std::vector<size_t>& matches) {
+        if (floatKeys && std::isnan(outerColumn.getFloat(row))) {
+            return; // NaN equals nothing, although its bytes would
+        }
+        std::string key;
+        if (sameKind) {
+            index.find(innerColumn, outerColumn.getView(row), matches);
+        } else if (innerColumn.encodeKey(outerColumn.getString(row), key)) {
+            index.find(innerColumn, key, matches);
+        }
+    };
+    if (limit != SIZE_MAX) {
+        return probeInOrder(outer, limit, parallelism, probe);
+    }
+    size_t count = outer.size();
+    size_t morsels = (count + kKimBlockRows - 1) / kKimBlockRows;
+
+    KimThreadPool& pool = kimThreadPool();
+    std::vector<KimJoinPairs> buffers(pool.size());
+    pool.run(morsels, parallelism, [&](size_t participant, size_t morsel) {
+        std::vector<size_t> matches;
+        size_t end = std::min(count, (morsel + 1) * kKimBlockRows);
+        for (size_t i = morsel * kKimBlockRows; i < end; ++i) {
+            size_t row = outer.row(i);
+            if (outer.table->isDeleted(row)) {
+                continue;
+            }
+            matches.clear();
+            probe(row, matches);
+            for (size_t match : matches) {
+                buffers[participant].emplace_back(outerIsLeft ? row : match, outerIsLeft ? match : row);
+            }
+        }
+    });
+
+    KimJoinPairs pairs;
+    for (auto& buffer : buffers) {
+        pairs.insert(pairs.end(), buffer.begin(), buffer.end());
+    }
+    return pairs;
+}
+
+static bool isIntKind(KimStorageKind kind) {
+    return kind == KimStorageKind::Int32 || kind == KimStorageKind::Int64;
+}
+
+KimJoinPairs kimHashJoin(const KimJoinInput& left, const KimJoinInput& right, size_t parallelism, size_t limit) {
+    const KimColumn& leftColumn = left.table->columns[left.column];
+    const KimColumn& rightColumn = right.table->columns[right.column];
+    KimJoinPairs pairs;
+    auto join = [&](auto key, auto leftKey, auto rightKey) {
+        using Key = decltype(key);
+        if (limit != SIZE_MAX) {
+            return orderedHashJoin<Key>(left, leftKey, right, rightKey, limit, parallelism);
+        }
+        return hashJoin<Key>(left, leftKey, right, rightKey, parallelism);
+    };
+
+    // An index on the larger side's join column replaces the build; only
+    // used when the value domains agree, so it finds exactly what hashing
+    // would. Under a limit the left input is probed in order, so only an
+    // index on the right one helps.
+    bool leftLarger = limit == SIZE_MAX && left.size() > right.size();
+    const KimJoinInput& outer = leftLarger ? right : left;
+    const KimJoinInput& inner = leftLarger ? left : right;
+    const KimHashIndex* index = inner.table->hashIndexFor(inner.column);
+    if (index && !inner.rows && leftColumn.isNumeric() == rightColumn.isNumeric()) {
+        pairs = indexJoin(outer, inner, *index, !leftLarger, limit, parallelism);
+    } else if (isIntKind(leftColumn.kind) && isIntKind(rightColumn.kind)) {
+        pairs = join(
+                int64_t(), [&](size_t row) { return leftColumn.getInt(row); },
+                [&](size_t row) { return rightColumn.getInt(row); });
+    } else if (leftColumn.isNumeric() && rightColumn.isNumeric()) {
+        auto valueOf = [](const KimColumn& column, size_t row) {
+            return isIntKind(column.kind) ? static_cast<double>(column.getInt(row)) : column.getFloat(row);
+        };
+        pairs = join(
+                double(), [&](size_t row) { return valueOf(leftColumn, row); },
+                [&](size_t row) { return valueOf(rightColumn, row); });
+    } else if (!leftColumn.isNumeric() && !rightColumn.isNumeric()) {
+        // The hash table holds views into the key columns, so the blocks of
+        // a paged table stay pinned until the join is done
+        std::vector<KimBlockPin> pins;
+        for (const KimColumn* column : {&leftColumn, &rightColumn}) {
+            for (size_t b = 0; column->pagedFile && b < column->blocks.size(); ++b) {
+                pins.push_back(column->pinBlock(b));
+            }
+        }
+        pairs = join(
+                std::string_view(), [&](size_t row) { return leftColumn.getView(row); },
+                [&](size_t row) { return rightColumn.getView(row); });
+    } else {
+        // Numeric against string: compare the text of each value
+        auto textOf = [](const KimJoinInput& input) {
+            std::vector<std::string> text(input.table->rowCount());
+            const KimColumn& column = input.table->columns[input.column];
+            for (size_t i = 0; i < input.size(); ++i) {
+                text[input.row(i)] = column.getString(input.row(i));
+            }
+            return text;
+        };
+        std::vector<std::string> rightText = textOf(right);
+        auto rightKey = [&](size_t row) { return std::string_view(rightText[row]); };
+        if (limit != SIZE_MAX) {
+            // The left rows past the limit are never probed, so their text
+            // is made as they are
+            pairs = orderedHashJoin<std::string_view>(
+                    left, [&](size_t row) { return leftColumn.getString(row); }, right, rightKey, limit,
+                    parallelism);
+        } else {
+            std::vector<std::string> leftText = textOf(left);
+            pairs = hashJoin<std::string_view>(
+                    left, [&](size_t row) { return std::string_view(leftText[row]); }, right, rightKey,
+                    parallelism);
+        }
+    }
+
+    std::sort(pairs.begin(), pairs.end());
+    return pairs;
+}
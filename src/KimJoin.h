@@ -0,0 +1,46 @@
+//
+// Equi-join of two KimTables.
+//
+
+#ifndef KIMDB_KIMJOIN_H
+#define KIMDB_KIMJOIN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+class KimTable;
+
+// Rows taking part in a join: the listed row ids, or every row of the table
+// when `rows` is null. Deleted rows never match.
+struct KimJoinInput {
+    const KimTable* table;
+    size_t column;
+    const std::vector<size_t>* rows;
+
+    size_t size() const;
+    size_t row(size_t i) const { return rows ? (*rows)[i] : i; }
+};
+
+using KimJoinPairs = std::vector<std::pair<size_t, size_t>>;
+
+// (left row, right row) pairs whose join columns hold equal values, ordered
+// by left row and then right row. Int columns compare as integers, any other
+// pair of numeric columns as doubles, string columns byte-wise, and a numeric
+// column against a string column by the value's text.
+//
+// The smaller input is the build side. When the larger input covers its
+// whole table and has a hash index on its join column, each build row probes
+// that index instead and no hash table is built. Otherwise both inputs are
+// radix-partitioned on the key hash so every partition's hash table stays
+// cache-sized, and the partitions are joined in parallel on up to
+// `parallelism` threads.
+//
+// With a `limit`, only the first `limit` pairs in that order are returned:
+// the right input is built whole (or its index used) and the left one probes
+// it in row order, stopping once the limit is reached.
+KimJoinPairs kimHashJoin(const KimJoinInput& left, const KimJoinInput& right, size_t parallelism = 1,
+                         size_t limit = SIZE_MAX);
+
+#endif //KIMDB_KIMJOIN_H
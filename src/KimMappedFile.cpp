@@ -0,0 +1,101 @@
+//
+// Read-only memory mapping of a .kim file.
+//
+
+#include "KimMappedFile.h"
+
+#include <iostream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+KimMappedFile::~KimMappedFile() {
+    close();
+}
+
+#ifdef _WIN32
+
+bool KimMappedFile::open(const std::string& fileName) {
+    close();
+    HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        std::cerr << "Failed to open file: " << fileName << std::endl;
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        std::cerr << "Failed to map empty file: " << fileName << std::endl;
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!view) {
+        std::cerr << "Failed to map file: " << fileName << std::endl;
+        if (mapping) {
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+        return false;
+    }
+    fileHandle = file;
+    mappingHandle = mapping;
+    base = static_cast<const char*>(view);
+    length = static_cast<size_t>(fileSize.QuadPart);
+    return true;
+}
+
+void KimMappedFile::close() {
+    if (base) {
+        UnmapViewOfFile(base);
+        CloseHandle(mappingHandle);
+        CloseHandle(fileHandle);
+    }
+    base = nullptr;
+    length = 0;
+    fileHandle = nullptr;
+    mappingHandle = nullptr;
+}
+
+#else
+
+bool KimMappedFile::open(const std::string& fileName) {
+    close();
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Failed to open file: " << fileName << std::endl;
+        return false;
+    }
+    struct stat info{};
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        std::cerr << "Failed to map empty file: " << fileName << std::endl;
+        ::close(fd);
+        return false;
+    }
+    void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd); // the mapping keeps its own reference to the file
+    if (view == MAP_FAILED) {
+        std::cerr << "Failed to map file: " << fileName << std::endl;
+        return false;
+    }
+    base = static_cast<const char*>(view);
+    length = static_cast<size_t>(info.st_size);
+    return true;
+}
+
+void KimMappedFile::close() {
+    if (base) {
+        munmap(const_cast<char*>(base), length);
+    }
+    base = nullptr;
+    length = 0;
+}
+
+#endif
@@ -0,0 +1,35 @@
+//
+// Read-only memory mapping of a .kim file.
+//
+
+#ifndef KIMDB_KIMMAPPEDFILE_H
+#define KIMDB_KIMMAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+
+// Maps a whole file read-only and shared, so every process that opens the same
+// file reads the same page-cache pages. The mapping lives as long as the object.
+class KimMappedFile {
+public:
+    KimMappedFile() = default;
+    ~KimMappedFile();
+    KimMappedFile(const KimMappedFile&) = delete;
+    KimMappedFile& operator=(const KimMappedFile&) = delete;
+
+    bool open(const std::string& fileName);
+    void close();
+
+    const char* data() const { return base; }
+    size_t size() const { return length; }
+
+private:
+    const char* base = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#endif
+};
+
+#endif //KIMDB_KIMMAPPEDFILE_H
@@ -0,0 +1,121 @@
+//
+// In-process counters and latency histograms that monitoring can poll.
+//
+
+#include "KimMetrics.h"
+
+#include <cstdio>
+
+void KimHistogram::record(uint64_t nanos) {
+    size_t b = 0;
+    while (b < kBounds && nanos > upperBound(b)) {
+        ++b;
+    }
+    buckets[b].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(nanos, std::memory_order_relaxed);
+}
+
+uint64_t KimHistogram::percentile(double p) const {
+    uint64_t values = count();
+    uint64_t rank = static_cast<uint64_t>(p * values);
+    uint64_t seen = 0;
+    for (size_t b = 0; b < kBounds; ++b) {
+        seen += bucketCount(b);
+        if (seen > rank || (seen == values && values > 0)) {
+            return upperBound(b);
+        }
+    }
+    return values == 0 ? 0 : UINT64_MAX;
+}
+
+void KimHistogram::reset() {
+    for (auto& bucket : buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    total.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+}
+
+KimCounter& KimMetrics::counter(const std::string& name, const std::string& help) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry<KimCounter>& entry = counters[name];
+    if (!entry.metric) {
+        entry.help = help;
+        entry.metric = std::make_unique<KimCounter>();
+    }
+    return *entry.metric;
+}
+
+KimHistogram& KimMetrics::histogram(const std::string& name, const std::string& help) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry<KimHistogram>& entry = histograms[name];
+    if (!entry.metric) {
+        entry.help = help;
+        entry.metric = std::make_unique<KimHistogram>();
+    }
+    return *entry.metric;
+}
+
+std::map<std::string, uint64_t> KimMetrics::counterValues() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::map<std::string, uint64_t> values;
+    for (const auto& entry : counters) {
+        values[entry.first] = entry.second.metric->value();
+    }
+    return values;
+}
+
+static void describe(std::string& out, const std::string& name, const std::string& help, const char* type) {
+    if (!help.empty()) {
+        out += "# HELP " + name + " " + help + "\n";
+    }
+    out += "# TYPE " + name + " " + type + "\n";
+}
+
+static std::string seconds(uint64_t nanos) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.9g", nanos / 1e9);
+    return text;
+}
+
+std::string KimMetrics::exposition() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string out;
+    for (const auto& entry : counters) {
+        describe(out, entry.first, entry.second.help, "counter");
+        out += entry.first + " " + std::to_string(entry.second.metric->value()) + "\n";
+    }
+    for (const auto& entry : histograms) {
+        const std::string& name = entry.first;
+        const KimHistogram& histogram = *entry.second.metric;
+        describe(out, name, entry.second.help, "histogram");
+        // Buckets are cumulative in this format
+        uint64_t cumulative = 0;
+        for (size_t b = 0; b < KimHistogram::kBounds; ++b) {
+            cumulative += histogram.bucketCount(b);
+            out += name + "_bucket{le=\"" + seconds(KimHistogram::upperBound(b)) + "\"} " +
+                   std::to_string(cumulative) + "\n";
+        }
+        uint64_t count = histogram.count();
+        out += name + "_bucket{le=\"+Inf\"} " + std::to_string(count) + "\n";
+        out += name + "_sum " + seconds(histogram.sumNanos()) + "\n";
+        out += name + "_count " + std::to_string(count) + "\n";
+    }
+    return out;
+}
+
+void KimMetrics::reset() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& entry : counters) {
+        entry.second.metric->reset();
+    }
+    for (auto& entry : histograms) {
+        entry.second.metric->reset();
+    }
+}
+
+KimMetrics& kimMetrics() {
+    static KimMetrics metrics;
+    return metrics;
+}
@@ -0,0 +1,93 @@
+//
+// In-process counters and latency histograms that monitoring can poll.
+//
+
+#ifndef KIMDB_KIMMETRICS_H
+#define KIMDB_KIMMETRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Monotonic clock in nanoseconds, for timing operators and queries.
+inline uint64_t kimNowNanos() {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+}
+
+// A cumulative count that any thread may add to.
+class KimCounter {
+public:
+    void add(uint64_t n = 1) { count.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t value() const { return count.load(std::memory_order_relaxed); }
+    void reset() { count.store(0, std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> count{0};
+};
+
+// Latencies counted in power-of-two buckets from 1 µs to about 69 s, plus one
+// for anything slower. Recording is a few relaxed atomic adds.
+class KimHistogram {
+public:
+    static constexpr size_t kBounds = 27; // upper bounds 2^10 .. 2^36 ns
+
+    static uint64_t upperBound(size_t bucket) { return uint64_t(1024) << bucket; }
+
+    void record(uint64_t nanos);
+    uint64_t count() const { return total.load(std::memory_order_relaxed); }
+    uint64_t sumNanos() const { return sum.load(std::memory_order_relaxed); }
+    // Values in bucket b, the last one being the overflow bucket
+    uint64_t bucketCount(size_t b) const { return buckets[b].load(std::memory_order_relaxed); }
+    // Upper bound of the bucket holding the p-th fraction of the values, in
+    // nanoseconds; UINT64_MAX when that is the overflow bucket
+    uint64_t percentile(double p) const;
+    void reset();
+
+private:
+    std::atomic<uint64_t> buckets[kBounds + 1] = {};
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint64_t> sum{0};
+};
+
+// Named counters and histograms. Entries are created on first use and live as
+// long as the registry, so callers look them up once and keep the reference.
+// Nothing records unless the registry is enabled, which it is not by default;
+// instrumented code checks enabled() once per query and skips every clock
+// read and count when it is off.
+class KimMetrics {
+public:
+    bool enabled() const { return on.load(std::memory_order_relaxed); }
+    void setEnabled(bool enable) { on.store(enable, std::memory_order_relaxed); }
+
+    KimCounter& counter(const std::string& name, const std::string& help = std::string());
+    KimHistogram& histogram(const std::string& name, const std::string& help = std::string());
+    std::map<std::string, uint64_t> counterValues() const;
+    // Every counter and histogram in the Prometheus text format, histograms in seconds
+    std::string exposition() const;
+    // Zeroes every entry; references stay valid
+    void reset();
+
+private:
+    template <typename T>
+    struct Entry {
+        std::string help;
+        std::unique_ptr<T> metric;
+    };
+
+    mutable std::mutex mutex;
+    std::map<std::string, Entry<KimCounter>> counters;
+    std::map<std::string, Entry<KimHistogram>> histograms;
+    std::atomic<bool> on{false};
+};
+
+// Process-wide registry the engine reports to.
+KimMetrics& kimMetrics();
+
+#endif //KIMDB_KIMMETRICS_H
@@ -0,0 +1,236 @@
+//
+// ORDER BY and top-K for KimTable queries.
+//
+
+#include "KimOrderBy.h"
+#include "KimFileHead.h"
+#include "KimThreadPool.h"
+
+#include <algorithm>
+#include <string_view>
+
+namespace {
+
+// A row being ranked, with the ordered key of its first ORDER BY column when
+// that column is numeric, so most comparisons read no column at all
+struct Candidate {
+    uint64_t key;
+    size_t row;
+};
+
+int compareKeys(uint64_t a, uint64_t b) {
+    return a < b ? -1 : a > b ? 1 : 0;
+}
+
+// Ranks candidates by the ORDER BY columns of a plan, then by row id
+class RowOrder {
+public:
+    RowOrder(const KimTable& table, const KimQueryPlan& plan)
+        : table(table), plan(plan), first(table.columns[plan.orderBy.front().column]),
+          numericFirst(first.isNumeric()) {}
+
+    Candidate candidate(size_t row) const { return {numericFirst ? first.orderedKey(row) : 0, row}; }
+
+    // Whether a ranks ahead of b
+    bool operator()(const Candidate& a, const Candidate& b) const {
+        for (size_t i = 0; i < plan.orderBy.size(); ++i) {
+            const KimPlanOrder& order = plan.orderBy[i];
+            int compared = i == 0 && numericFirst ? compareKeys(a.key, b.key)
+                                                  : compareRows(table.columns[order.column], a.row, b.row);
+            if (compared != 0) {
+                return order.descending ? compared > 0 : compared < 0;
+            }
+        }
+        return plan.orderBy.front().descending ? a.row > b.row : a.row < b.row;
+    }
+
+private:
+    const KimTable& table;
+    const KimQueryPlan& plan;
+    const KimColumn& first;
+    bool numericFirst;
+
+    static int compareRows(const KimColumn& column, size_t a, size_t b) {
+        if (column.isNumeric()) {
+            return compareKeys(column.orderedKey(a), column.orderedKey(b));
+        }
+        // Both views stay valid on a paged table: a thread's last few blocks stay pinned
+        std::string_view left = column.getView(a);
+        std::string_view right = column.getView(b);
+        int compared = left.compare(right);
+        return compared < 0 ? -1 : compared > 0 ? 1 : 0;
+    }
+};
+
+// The `limit` best candidates offered so far. While it is full it is a heap
+// whose front ranks last, so a candidate that cannot make it costs one
+// comparison.
+class TopK {
+public:
+    TopK(const RowOrder& order, size_t limit) : order(order), limit(limit) {}
+
+    void offer(size_t row) {
+        Candidate candidate = order.candidate(row);
+        if (kept.size() < limit) {
+            kept.push_back(candidate);
+            if (limit != SIZE_MAX) {
+                std::push_heap(kept.begin(), kept.end(), order);
+            }
+        } else if (order(candidate, kept.front())) {
+            std::pop_heap(kept.begin(), kept.end(), order);
+            kept.back() = candidate;
+            std::push_heap(kept.begin(), kept.end(), order);
+        }
+    }
+
+    std::vector<Candidate> kept;
+
+private:
+    const RowOrder& order;
+    size_t limit;
+};
+
+std::string orderText(const KimTable& table, const KimQueryPlan& plan) {
+    std::string text;
+    for (const auto& order : plan.orderBy) {
+        text += (text.empty() ? "" : ", ") + std::string(table.columnHeaders[order.column].ColumnName) +
+                (order.descending ? " DESC" : "");
+    }
+    return text;
+}
+
+std::string limitText(size_t limit) {
+    return limit == SIZE_MAX ? std::string() : " LIMIT " + std::to_string(limit);
+}
+
+// Walks the B+tree of the ORDER BY column, within the range of the predicate
+// on it when that is the plan's access path, and keeps the rows the other
+// predicates admit until there are `limit` of them
+std::vector<size_t> walkTree(const KimTable& table, const KimQueryPlan& plan, const std::vector<std::string>& values,
+                             size_t limit, KimOperatorStats* walk) {
+    std::vector<size_t> rows;
+    const KimPlanOrder& order = plan.orderBy.front();
+    const KimColumn& column = table.columns[order.column];
+    bool bounded = !plan.predicates.empty() && plan.access == KimAccessPath::TreeRange;
+    uint64_t low = 0, high = UINT64_MAX;
+    if (bounded && !column.orderedRange(kimPredicateRange(plan.predicates[plan.accessPredicate], values), low, high)) {
+        return rows;
+    }
+    std::vector<KimColumnFilter> filters;
+    if (limit == 0 || (!plan.predicates.empty() && !kimCompileFilters(table, plan, values, filters))) {
+        return rows;
+    }
+
+    uint64_t visited = 0, bytes = 0;
+    table.treeIndexFor(order.column)->walk(low, high, order.descending, [&](size_t row) {
+        ++visited;
+        if (table.isDeleted(row)) {
+            return true;
+        }
+        for (size_t i = 0; i < filters.size(); ++i) {
+            if (bounded && i == plan.accessPredicate) {
+                continue;
+            }
+            const KimColumn& filtered = table.columns[plan.predicates[i].column];
+            bytes += filtered.width ? filtered.width : filtered.getView(row).size();
+            if (!filtered.matches(filters[i], row)) {
+                return true;
+            }
+        }
+        rows.push_back(row);
+        return rows.size() < limit;
+    });
+    if (walk) {
+        walk->rowsIn = visited;
+        walk->rowsOut = rows.size();
+        walk->bytesRead = bytes;
+    }
+    return rows;
+}
+
+} // namespace
+
+std::vector<size_t> kimOrderRows(const KimTable& table, const KimQueryPlan& plan,
+                                 const std::vector<std::string>& values, size_t limit, size_t parallelism,
+                                 KimQueryStats* stats) {
+    uint64_t start = stats ? kimNowNanos() : 0;
+    if (plan.treeOrder) {
+        if (!stats) {
+            return walkTree(table, plan, values, limit, nullptr);
+        }
+        size_t first = stats->operators.size();
+        kimDescribeOrder(table, plan, values, limit, stats->operators);
+        KimOperatorStats& walk = stats->operators[first];
+        std::vector<size_t> rows = walkTree(table, plan, values, limit, &walk);
+        walk.nanos = kimNowNanos() - start;
+        stats->access = KimAccessPath::TreeRange;
+        stats->rowsScanned += walk.rowsIn;
+        stats->bytesRead += walk.bytesRead;
+        return rows;
+    }
+
+    // Each thread ranks the rows it scans into its own heap
+    RowOrder order(table, plan);
+    KimThreadPool& pool = kimThreadPool();
+    std::vector<TopK> heaps(pool.size(), TopK(order, limit));
+    std::vector<uint64_t> offered(pool.size()), nanos(pool.size());
+    if (limit > 0) {
+        kimForEachMorsel(
+            table, plan, values, parallelism,
+            [&](size_t participant, const std::vector<size_t>& rows) {
+                uint64_t begin = stats ? kimNowNanos() : 0;
+                for (size_t row : rows) {
+                    heaps[participant].offer(row);
+                }
+                if (stats) {
+                    offered[participant] += rows.size();
+                    nanos[participant] += kimNowNanos() - begin;
+                }
+            },
+            stats);
+    }
+
+    uint64_t mergeStart = stats ? kimNowNanos() : 0;
+    std::vector<Candidate> ranked;
+    for (const auto& heap : heaps) {
+        ranked.insert(ranked.end(), heap.kept.begin(), heap.kept.end());
+    }
+    if (ranked.size() > limit) {
+        std::partial_sort(ranked.begin(), ranked.begin() + limit, ranked.end(), order);
+        ranked.resize(limit);
+    } else {
+        std::sort(ranked.begin(), ranked.end(), order);
+    }
+    std::vector<size_t> rows;
+    rows.reserve(ranked.size());
+    for (const auto& candidate : ranked) {
+        rows.push_back(candidate.row);
+    }
+
+    if (stats) {
+        KimOperatorStats rank{limit == SIZE_MAX ? "Sort" : "TopK", orderText(table, plan) + limitText(limit)};
+        for (size_t i = 0; i < pool.size(); ++i) {
+            rank.rowsIn += offered[i];
+            rank.nanos += nanos[i];
+        }
+        rank.rowsOut = rows.size();
+        rank.nanos += kimNowNanos() - mergeStart;
+        stats->operators.push_back(rank);
+    }
+    return rows;
+}
+
+void kimDescribeOrder(const KimTable& table, const KimQueryPlan& plan, const std::vector<std::string>& values,
+                      size_t limit, std::vector<KimOperatorStats>& operators) {
+    if (!plan.treeOrder) {
+        kimDescribePlan(table, plan, values, operators);
+        operators.push_back({limit == SIZE_MAX ? "Sort" : "TopK", orderText(table, plan) + limitText(limit)});
+        return;
+    }
+    std::string conditions;
+    for (const auto& predicate : plan.predicates) {
+        conditions += (conditions.empty() ? ": " : " AND ") + kimDescribePredicate(table, predicate, values);
+    }
+    operators.push_back({"TreeOrder", std::string(table.header.TableName) + "." + orderText(table, plan) +
+                                          conditions + limitText(limit)});
+}
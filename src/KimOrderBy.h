@@ -0,0 +1,34 @@
+//
+// ORDER BY and top-K for KimTable queries.
+//
+
+#ifndef KIMDB_KIMORDERBY_H
+#define KIMDB_KIMORDERBY_H
+
+#include "KimQuery.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class KimTable;
+
+// Row ids of the rows plan matches in its ORDER BY order, at most `limit`
+// of them. Numbers compare by value and strings by their bytes; rows that
+// tie on every ORDER BY column come in row order, reversed when the first
+// column is DESC.
+//
+// A plan with treeOrder walks the B+tree of its ORDER BY column in key
+// order, checks the predicates on each row and stops at the limit. Any
+// other plan runs its access path on up to `parallelism` threads, each of
+// which keeps the best `limit` rows it has seen in a bounded heap; the
+// heaps are merged once the scan is done, so memory is O(limit) per thread
+// rather than O(matching rows). Without a limit every match is sorted.
+std::vector<size_t> kimOrderRows(const KimTable& table, const KimQueryPlan& plan,
+                                 const std::vector<std::string>& values, size_t limit, size_t parallelism = 1,
+                                 KimQueryStats* stats = nullptr);
+// Appends the operators kimOrderRows would run, without running them
+void kimDescribeOrder(const KimTable& table, const KimQueryPlan& plan, const std::vector<std::string>& values,
+                      size_t limit, std::vector<KimOperatorStats>& operators);
+
+#endif //KIMDB_KIMORDERBY_H
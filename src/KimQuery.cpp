@@ -0,0 +1,1404 @@
+//
+// Query plans, the plan cache and prepared statements for KimTable.
+//
+
+#include "KimQuery.h"
+#include "KimAggregate.h"
+#include "KimFileHead.h"
+#include "KimOrderBy.h"
+#include "KimSimd.h"
+#include "KimThreadPool.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+KimPlanCache& KimPlanCache::operator=(const KimPlanCache& other) {
+    if (this != &other) {
+        std::lock_guard<std::mutex> lock(mutex);
+        capacity = other.capacity;
+        entries.clear();
+        lookup.clear();
+    }
+    return *this;
+}
+
+std::shared_ptr<const KimQueryPlan> KimPlanCache::find(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = lookup.find(key);
+    if (it == lookup.end()) {
+        return nullptr;
+    }
+    entries.splice(entries.begin(), entries, it->second);
+    return it->second->second;
+}
+
+void KimPlanCache::insert(const std::string& key, std::shared_ptr<const KimQueryPlan> plan) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = lookup.find(key);
+    if (it != lookup.end()) {
+        it->second->second = std::move(plan);
+        entries.splice(entries.begin(), entries, it->second);
+        return;
+    }
+    entries.emplace_front(key, std::move(plan));
+    lookup[key] = entries.begin();
+    evict();
+}
+
+void KimPlanCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    lookup.clear();
+}
+
+void KimPlanCache::setCapacity(size_t newCapacity) {
+    std::lock_guard<std::mutex> lock(mutex);
+    capacity = newCapacity;
+    evict();
+}
+
+size_t KimPlanCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
+
+void KimPlanCache::evict() {
+    while (entries.size() > capacity) {
+        lookup.erase(entries.back().first);
+        entries.pop_back();
+    }
+}
+
+static bool findColumn(const KimTable& table, const std::string& name, size_t& index) {
+    for (size_t i = 0; i < table.columnHeaders.size(); ++i) {
+        if (table.columnHeaders[i].ColumnName == name) {
+            index = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void addPredicate(KimQueryPlan& plan, size_t column, const KimSqlCondition& condition) {
+    plan.predicates.push_back({column, condition.op, condition.value, condition.high, condition.list});
+    plan.parameterCount += (condition.value.parameter ? 1 : 0) + (condition.high.parameter ? 1 : 0);
+    for (const auto& operand : condition.list) {
+        plan.parameterCount += operand.parameter ? 1 : 0;
+    }
+}
+
+// An equality or IN on a hash index beats a range on a B+tree, which beats a
+// vectorised scan of every predicate's column
+static void chooseAccessPath(const KimTable& table, KimQueryPlan& plan) {
+    for (size_t i = 0; i < plan.predicates.size(); ++i) {
+        const KimPlanPredicate& predicate = plan.predicates[i];
+        bool point = predicate.op == KimCompareOp::Equal || predicate.op == KimCompareOp::In;
+        if (point && table.hashIndexFor(predicate.column)) {
+            plan.access = KimAccessPath::HashProbe;
+            plan.accessPredicate = i;
+            return;
+        }
+    }
+    for (size_t i = 0; i < plan.predicates.size(); ++i) {
+        KimCompareOp op = plan.predicates[i].op;
+        bool range = op != KimCompareOp::Equal && op != KimCompareOp::NotEqual && op != KimCompareOp::In;
+        if (range && table.treeIndexFor(plan.predicates[i].column)) {
+            plan.access = KimAccessPath::TreeRange;
+            plan.accessPredicate = i;
+            return;
+        }
+    }
+}
+
+static const char* aggregateName(KimAggregate aggregate) {
+    static const char* const kNames[] = {"", "COUNT", "SUM", "MIN", "MAX", "AVG"};
+    return kNames[static_cast<size_t>(aggregate)];
+}
+
+// Resolves the select list and GROUP BY columns. A list of plain columns is
+// a projection; with aggregates they must be grouped on, and only numbers
+// can be summed or averaged.
+static bool planOutputs(const KimTable& table, const KimSelectStatement& statement, KimQueryPlan& plan,
+                        std::string& error) {
+    auto resolve = [&](const KimSqlColumnRef& column, size_t& index) {
+        if ((!column.table.empty() && column.table != statement.table) || !findColumn(table, column.column, index)) {
+            error = "Column not found";
+            return false;
+        }
+        return true;
+    };
+    for (const auto& column : statement.groupBy) {
+        size_t index;
+        if (!resolve(column, index)) {
+            return false;
+        }
+        plan.groupBy.push_back(index);
+    }
+
+    bool aggregates = false;
+    for (const auto& item : statement.items) {
+        aggregates = aggregates || item.aggregate != KimAggregate::None;
+    }
+    if (!aggregates && plan.groupBy.empty()) {
+        for (const auto& item : statement.items) {
+            size_t index;
+            if (!resolve(item.column, index)) {
+                return false;
+            }
+            plan.columns.push_back(index);
+        }
+        return true;
+    }
+    for (const auto& item : statement.items) {
+        KimPlanOutput output;
+        output.aggregate = item.aggregate;
+        if (!item.star && !resolve(item.column, output.column)) {
+            return false;
+        }
+        output.name = item.star ? "*" : item.column.column;
+        if (item.aggregate == KimAggregate::None) {
+            if (std::find(plan.groupBy.begin(), plan.groupBy.end(), output.column) == plan.groupBy.end()) {
+                error = "Column " + output.name + " must appear in GROUP BY";
+                return false;
+            }
+        } else {
+            bool numeric = item.star || table.columns[output.column].isNumeric();
+            if ((item.aggregate == KimAggregate::Sum || item.aggregate == KimAggregate::Avg) && !numeric) {
+                error = std::string(aggregateName(item.aggregate)) + " needs a numeric column";
+                return false;
+            }
+            output.name = std::string(aggregateName(item.aggregate)) + "(" + output.name + ")";
+        }
+        plan.outputs.push_back(output);
+    }
+    if (statement.items.empty() && !plan.groupBy.empty()) {
+        error = "GROUP BY needs a select list";
+        return false;
+    }
+    return true;
+}
+
+// Resolves the ORDER BY columns; aggregate results are not ordered
+static bool planOrder(const KimTable& table, const KimSelectStatement& statement, KimQueryPlan& plan,
+                      std::string& error) {
+    for (const auto& item : statement.orderBy) {
+        size_t index;
+        if ((!item.column.table.empty() && item.column.table != statement.table) ||
+            !findColumn(table, item.column.column, index)) {
+            error = "Column not found";
+            return false;
+        }
+        plan.orderBy.push_back({index, item.descending});
+    }
+    if (!plan.orderBy.empty() && !plan.outputs.empty()) {
+        error = "ORDER BY is not supported with aggregates";
+        return false;
+    }
+    return true;
+}
+
+// A B+tree on the only ORDER BY column yields rows already ordered, so a
+// LIMIT stops the walk early. Predicates answered by a hash probe, or by a
+// range on another tree, usually leave fewer rows to rank than the walk
+// would visit, so they keep their access path.
+static void chooseOrderPath(const KimTable& table, KimQueryPlan& plan) {
+    if (plan.orderBy.size() != 1 || !plan.hasLimit || !table.treeIndexFor(plan.orderBy.front().column)) {
+        return;
+    }
+    plan.treeOrder = plan.predicates.empty() || plan.access == KimAccessPath::FullScan ||
+                     (plan.access == KimAccessPath::TreeRange &&
+                      plan.predicates[plan.accessPredicate].column == plan.orderBy.front().column);
+}
+
+std::shared_ptr<KimQueryPlan> kimPlanQuery(const KimTable& table, const KimSelectStatement& statement,
+                                           std::string& error) {
+    if (statement.table != table.header.TableName) {
+        error = "Table name does not match";
+        return nullptr;
+    }
+    if (statement.join) {
+        error = "JOIN needs the joined table";
+        return nullptr;
+    }
+
+    auto plan = std::make_shared<KimQueryPlan>();
+    for (const auto& condition : statement.where) {
+        size_t columnIndex;
+        if ((!condition.table.empty() && condition.table != statement.table) ||
+            !findColumn(table, condition.column, columnIndex)) {
+            error = "Column not found";
+            return nullptr;
+        }
+        addPredicate(*plan, columnIndex, condition);
+    }
+    plan->hasLimit = statement.hasLimit;
+    plan->limit = statement.limit;
+    plan->parameterCount += statement.limit.parameter ? 1 : 0;
+    plan->explain = statement.explain;
+    plan->analyze = statement.analyze;
+    if (!planOutputs(table, statement, *plan, error) || !planOrder(table, statement, *plan, error)) {
+        return nullptr;
+    }
+    chooseAccessPath(table, *plan);
+    chooseOrderPath(table, *plan);
+    return plan;
+}
+
+std::shared_ptr<KimJoinPlan> kimPlanJoin(const KimTable& left, const KimTable& right,
+                                         const KimSelectStatement& statement, std::string& error) {
+    if (!statement.join || statement.table != left.header.TableName ||
+        statement.joinTable != right.header.TableName) {
+        error = "Table name does not match";
+        return nullptr;
+    }
+    if (!statement.groupBy.empty() || !statement.orderBy.empty()) {
+        error = statement.groupBy.empty() ? "Joins do not support ORDER BY" : "Joins do not support GROUP BY";
+        return nullptr;
+    }
+
+    // Resolves a possibly unqualified column to a side: 0 left, 1 right
+    auto resolve = [&](const std::string& table, const std::string& column, int& side, size_t& index) {
+        bool inLeft = (table.empty() || table == statement.table) && findColumn(left, column, index);
+        size_t rightIndex;
+        bool inRight = (table.empty() || table == statement.joinTable) && findColumn(right, column, rightIndex);
+        if (inLeft && inRight) {
+            error = "Ambiguous column: " + column;
+            return false;
+        }
+        if (!inLeft && !inRight) {
+            error = "Column not found";
+            return false;
+        }
+        side = inLeft ? 0 : 1;
+        if (inRight) {
+            index = rightIndex;
+        }
+        return true;
+    };
+
+    auto plan = std::make_shared<KimJoinPlan>();
+    if (statement.hasOn) {
+        int firstSide, secondSide;
+        size_t first, second;
+        if (!resolve(statement.onLeft.table, statement.onLeft.column, firstSide, first) ||
+            !resolve(statement.onRight.table, statement.onRight.column, secondSide, second)) {
+            return nullptr;
+        }
+        if (firstSide == secondSide) {
+            error = "ON must compare a column of each table";
+            return nullptr;
+        }
+        plan->leftColumn = firstSide == 0 ? first : second;
+        plan->rightColumn = firstSide == 0 ? second : first;
+    } else if (!kimChooseLinkColumns(left, right, plan->leftColumn, plan->rightColumn)) {
+        error = "No ON clause and no link keys to join on";
+        return nullptr;
+    }
+
+    for (const auto& item : statement.items) {
+        int side;
+        size_t columnIndex;
+        if (item.aggregate != KimAggregate::None) {
+            error = "Joins do not support aggregates";
+            return nullptr;
+        }
+        if (!resolve(item.column.table, item.column.column, side, columnIndex)) {
+            return nullptr;
+        }
+        plan->columns.push_back(side == 0 ? columnIndex : left.columns.size() + columnIndex);
+    }
+    for (const auto& condition : statement.where) {
+        int side;
+        size_t columnIndex;
+        if (!resolve(condition.table, condition.column, side, columnIndex)) {
+            return nullptr;
+        }
+        addPredicate(side == 0 ? plan->left : plan->right, columnIndex, condition);
+    }
+    plan->hasLimit = statement.hasLimit;
+    plan->limit = statement.limit;
+    plan->explain = statement.explain;
+    plan->analyze = statement.analyze;
+    chooseAccessPath(left, plan->left);
+    chooseAccessPath(right, plan->right);
+    return plan;
+}
+
+static bool findPrimaryKey(const KimTable& table, size_t& index) {
+    for (size_t i = 0; i < table.columnHeaders.size(); ++i) {
+        if (table.columnHeaders[i].IsPrimaryKey) {
+            index = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool kimChooseLinkColumns(const KimTable& left, const KimTable& right, size_t& leftColumn, size_t& rightColumn) {
+    std::vector<size_t> leftLinks = left.linkColumns();
+    std::vector<size_t> rightLinks = right.linkColumns();
+
+    // A link column of one table matched to the other's column of the same
+    // name, else to the other's primary key
+    for (size_t column : leftLinks) {
+        if (findColumn(right, left.columnHeaders[column].ColumnName, rightColumn)) {
+            leftColumn = column;
+            return true;
+        }
+    }
+    for (size_t column : rightLinks) {
+        if (findColumn(left, right.columnHeaders[column].ColumnName, leftColumn)) {
+            rightColumn = column;
+            return true;
+        }
+    }
+    if (!leftLinks.empty() && findPrimaryKey(right, rightColumn)) {
+        leftColumn = leftLinks.front();
+        return true;
+    }
+    if (!rightLinks.empty() && findPrimaryKey(left, leftColumn)) {
+        rightColumn = rightLinks.front();
+        return true;
+    }
+    if (leftLinks.empty() || rightLinks.empty()) {
+        return false;
+    }
+    leftColumn = leftLinks.front();
+    rightColumn = rightLinks.front();
+    return true;
+}
+
+static KimRange rangeFor(KimCompareOp op, const std::string& value, const std::string& high) {
+    KimRange range;
+    if (op == KimCompareOp::Less || op == KimCompareOp::LessEqual) {
+        range.hasHigh = true;
+        range.highInclusive = op == KimCompareOp::LessEqual;
+        range.high = value;
+    } else if (op == KimCompareOp::Greater || op == KimCompareOp::GreaterEqual) {
+        range.hasLow = true;
+        range.lowInclusive = op == KimCompareOp::GreaterEqual;
+        range.low = value;
+    } else {
+        range.hasLow = true;
+        range.low = value;
+        range.hasHigh = true;
+        range.high = high;
+    }
+    return range;
+}
+
+static const std::string& valueOf(const KimSqlOperand& operand, const std::vector<std::string>& values) {
+    return operand.parameter ? values[operand.index] : operand.text;
+}
+
+static std::vector<std::string> listOf(const KimPlanPredicate& predicate, const std::vector<std::string>& values) {
+    std::vector<std::string> list;
+    list.reserve(predicate.list.size());
+    for (const auto& operand : predicate.list) {
+        list.push_back(valueOf(operand, values));
+    }
+    return list;
+}
+
+KimRange kimPredicateRange(const KimPlanPredicate& predicate, const std::vector<std::string>& values) {
+    return rangeFor(predicate.op, valueOf(predicate.value, values), valueOf(predicate.high, values));
+}
+
+static KimColumnFilter filterFor(const KimColumn& column, const KimPlanPredicate& predicate,
+                                 const std::vector<std::string>& values) {
+    switch (predicate.op) {
+        case KimCompareOp::Equal:
+            return column.equalFilter(valueOf(predicate.value, values));
+        case KimCompareOp::NotEqual:
+            return column.notEqualFilter(valueOf(predicate.value, values));
+        case KimCompareOp::In:
+            return column.inFilter(listOf(predicate, values));
+        default:
+            return column.rangeFilter(
+                rangeFor(predicate.op, valueOf(predicate.value, values), valueOf(predicate.high, values)));
+    }
+}
+
+// Literals are converted to each column's type once per execution
+bool kimCompileFilters(const KimTable& table, const KimQueryPlan& plan, const std::vector<std::string>& values,
+                           std::vector<KimColumnFilter>& filters) {
+    filters.clear();
+    filters.reserve(plan.predicates.size());
+    for (const auto& predicate : plan.predicates) {
+        filters.push_back(filterFor(table.columns[predicate.column], predicate, values));
+        if (filters.back().empty && !filters.back().negate) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// What one run of a plan read, gathered only while it is measured
+struct KimPlanCounts {
+    uint64_t scanned = 0; // rows the access path looked at
+    uint64_t skipped = 0; // blocks a scan passed over on their zone maps
+    uint64_t bytes = 0; // column bytes the access path read
+    uint64_t candidates = 0; // rows the access path produced
+    uint64_t filterBytes = 0;
+    uint64_t filterStart = 0; // clock reading when the Filter operator began
+    uint64_t nanos = 0; // time spent scanning, summed over threads
+};
+
+// Selects the matching rows of blocks [begin, end). Every predicate produces a
+// selection bitmap per block and the bitmaps are AND-ed, so no row is visited
+// one predicate at a time. Blocks whose zone map rules out any predicate are
+// not read at all.
+static void scanBlockRange(const KimTable& table, const KimQueryPlan& plan, const std::vector<KimColumnFilter>& filters,
+                           size_t begin, size_t end, std::vector<size_t>& out, size_t limit,
+                           KimPlanCounts* counts = nullptr) {
+    uint64_t selection[kKimBlockRows / 64];
+    uint64_t other[kKimBlockRows / 64];
+    const KimColumn& first = table.columns[plan.predicates.front().column];
+    size_t found = 0;
+    for (size_t b = begin; b < end && found < limit; ++b) {
+        bool possible = true;
+        for (size_t i = 0; i < filters.size() && possible; ++i) {
+            possible = table.columns[plan.predicates[i].column].mayMatch(filters[i], b);
+        }
+        if (!possible) {
+            if (counts) {
+                ++counts->skipped;
+            }
+            continue;
+        }
+        size_t count = first.blocks[b]->count;
+        first.selectBlock(filters.front(), b, selection);
+        for (size_t i = 1; i < filters.size(); ++i) {
+            table.columns[plan.predicates[i].column].selectBlock(filters[i], b, other);
+            for (size_t word = 0; word < kimSelectionWords(count); ++word) {
+                selection[word] &= other[word];
+            }
+        }
+        if (table.deletedCount > 0) {
+            kimClearDeleted(table.deletedRows, b, count, selection);
+        }
+        found += kimAppendSelection(selection, count, b * kKimBlockRows, out, limit - found);
+        if (counts) {
+            counts->scanned += count;
+            for (const auto& predicate : plan.predicates) {
+                counts->bytes += table.columns[predicate.column].blockBytes(b);
+            }
+        }
+    }
+}
+
+static std::vector<size_t> scanBlocks(const KimTable& table, const KimQueryPlan& plan,
+                                      const std::vector<KimColumnFilter>& filters, size_t limit, size_t parallelism,
+                                      KimPlanCounts* counts) {
+    std::vector<size_t> matches;
+    size_t blocks = table.columns[plan.predicates.front().column].blocks.size();
+    size_t morsels = (blocks + kKimMorselBlocks - 1) / kKimMorselBlocks;
+
+    // A LIMIT scan stops at its first hits, which only a serial scan finds
+    // without reading past them
+    KimThreadPool& pool = kimThreadPool();
+    if (limit != SIZE_MAX || parallelism == 1 || morsels <= 1 || pool.size() == 1) {
+        scanBlockRange(table, plan, filters, 0, blocks, matches, limit, counts);
+        return matches;
+    }
+
+    // Each thread appends to its own buffer; the morsels' slices are then
+    // concatenated in morsel order, which is row order
+    struct Slice {
+        size_t participant;
+        size_t begin;
+        size_t end;
+    };
+    std::vector<std::vector<size_t>> buffers(pool.size());
+    std::vector<KimPlanCounts> participantCounts(counts ? pool.size() : 0);
+    std::vector<Slice> slices(morsels);
+    pool.run(morsels, parallelism, [&](size_t participant, size_t morsel) {
+        std::vector<size_t>& buffer = buffers[participant];
+        size_t begin = buffer.size();
+        size_t firstBlock = morsel * kKimMorselBlocks;
+        scanBlockRange(table, plan, filters, firstBlock, std::min(blocks, firstBlock + kKimMorselBlocks), buffer,
+                       SIZE_MAX, counts ? &participantCounts[participant] : nullptr);
+        slices[morsel] = {participant, begin, buffer.size()};
+    });
+    for (const auto& participant : participantCounts) {
+        counts->scanned += participant.scanned;
+        counts->bytes += participant.bytes;
+        counts->skipped += participant.skipped;
+    }
+
+    size_t total = 0;
+    for (const auto& slice : slices) {
+        total += slice.end - slice.begin;
+    }
+    matches.reserve(total);
+    for (const auto& slice : slices) {
+        const std::vector<size_t>& buffer = buffers[slice.participant];
+        matches.insert(matches.end(), buffer.begin() + slice.begin, buffer.begin() + slice.end);
+    }
+    return matches;
+}
+
+static std::vector<size_t> executePlan(const KimTable& table, const KimQueryPlan& plan,
+                                       const std::vector<std::string>& values, size_t limit, size_t parallelism,
+                                       KimPlanCounts* counts) {
+    std::vector<size_t> matches;
+    if (plan.predicates.empty()) {
+        matches.reserve(std::min(table.liveRowCount(), limit));
+        size_t row = 0;
+        for (; row < table.rowCount() && matches.size() < limit; ++row) {
+            if (!table.isDeleted(row)) {
+                matches.push_back(row);
+            }
+        }
+        if (counts) {
+            counts->scanned = row;
+            counts->candidates = matches.size();
+        }
+        return matches;
+    }
+
+    std::vector<KimColumnFilter> filters;
+    if (!kimCompileFilters(table, plan, values, filters)) {
+        return matches;
+    }
+
+    if (plan.access == KimAccessPath::FullScan) {
+        matches = scanBlocks(table, plan, filters, limit, parallelism, counts);
+        if (counts) {
+            counts->candidates = matches.size();
+        }
+        return matches;
+    }
+
+    // The index yields candidates in row order; the other predicates only
+    // ever look at those rows
+    const KimPlanPredicate& access = plan.predicates[plan.accessPredicate];
+    bool filtered = plan.predicates.size() > 1;
+    size_t candidateLimit = filtered ? SIZE_MAX : limit;
+    const std::string& value = valueOf(access.value, values);
+    if (plan.access == KimAccessPath::HashProbe && access.op == KimCompareOp::In) {
+        // One probe per distinct value; the rows of different values are merged into row order
+        std::vector<std::string> list = listOf(access, values);
+        std::sort(list.begin(), list.end());
+        list.erase(std::unique(list.begin(), list.end()), list.end());
+        for (const auto& item : list) {
+            std::vector<size_t> rows = table.findEqualRows(access.column, item, candidateLimit);
+            matches.insert(matches.end(), rows.begin(), rows.end());
+        }
+        std::sort(matches.begin(), matches.end());
+        matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
+        if (matches.size() > candidateLimit) {
+            matches.resize(candidateLimit);
+        }
+    } else if (plan.access == KimAccessPath::HashProbe) {
+        matches = table.findEqualRows(access.column, value, candidateLimit);
+    } else {
+        matches = table.findRangeRows(access.column, rangeFor(access.op, value, valueOf(access.high, values)),
+                                      candidateLimit);
+    }
+    if (counts) {
+        counts->scanned = matches.size();
+        counts->candidates = matches.size();
+    }
+    if (!filtered) {
+        return matches;
+    }
+
+    if (counts) {
+        counts->filterStart = kimNowNanos();
+    }
+    size_t kept = 0;
+    for (size_t row : matches) {
+        if (kept == limit) {
+            break;
+        }
+        bool keep = true;
+        for (size_t i = 0; i < filters.size() && keep; ++i) {
+            if (i == plan.accessPredicate) {
+                continue;
+            }
+            const KimColumn& column = table.columns[plan.predicates[i].column];
+            keep = column.matches(filters[i], row);
+            if (counts) {
+                counts->filterBytes += column.width ? column.width : column.getView(row).size();
+            }
+        }
+        if (keep) {
+            matches[kept++] = row;
+        }
+    }
+    matches.resize(kept);
+    return matches;
+}
+
+static std::string skippedBlocks(uint64_t skipped) {
+    return skipped ? ", " + std::to_string(skipped) + " blocks skipped by zone maps" : std::string();
+}
+
+std::vector<size_t> kimExecutePlan(const KimTable& table, const KimQueryPlan& plan,
+                                   const std::vector<std::string>& values, size_t limit, size_t parallelism,
+                                   KimQueryStats* stats) {
+    if (!stats) {
+        return executePlan(table, plan, values, limit, parallelism, nullptr);
+    }
+
+    size_t first = stats->operators.size();
+    kimDescribePlan(table, plan, values, stats->operators);
+    KimPlanCounts counts;
+    uint64_t start = kimNowNanos();
+    std::vector<size_t> matches = executePlan(table, plan, values, limit, parallelism, &counts);
+    uint64_t end = kimNowNanos();
+
+    KimOperatorStats& access = stats->operators[first];
+    access.rowsIn = counts.scanned;
+    access.rowsOut = counts.candidates;
+    access.bytesRead = counts.bytes;
+    access.detail += skippedBlocks(counts.skipped);
+    access.nanos = (counts.filterStart ? counts.filterStart : end) - start;
+    if (stats->operators.size() > first + 1) {
+        KimOperatorStats& filter = stats->operators[first + 1];
+        filter.rowsIn = counts.candidates;
+        filter.rowsOut = matches.size();
+        filter.bytesRead = counts.filterBytes;
+        filter.nanos = counts.filterStart ? end - counts.filterStart : 0;
+    }
+    stats->access = plan.access;
+    stats->rowsScanned += counts.scanned;
+    stats->bytesRead += counts.bytes + counts.filterBytes;
+    return matches;
+}
+
+void kimForEachMorsel(const KimTable& table, const KimQueryPlan& plan, const std::vector<std::string>& values,
+                      size_t parallelism, const std::function<void(size_t, const std::vector<size_t>&)>& consume,
+                      KimQueryStats* stats) {
+    KimThreadPool& pool = kimThreadPool();
+    std::vector<std::vector<size_t>> buffers(pool.size());
+    if (!plan.predicates.empty() && plan.access != KimAccessPath::FullScan) {
+        // Index probes find their rows up front; they are dealt out in morsel-sized slices
+        std::vector<size_t> rows = kimExecutePlan(table, plan, values, SIZE_MAX, parallelism, stats);
+        constexpr size_t kMorselRows = kKimMorselBlocks * kKimBlockRows;
+        pool.run((rows.size() + kMorselRows - 1) / kMorselRows, parallelism, [&](size_t participant, size_t morsel) {
+            std::vector<size_t>& buffer = buffers[participant];
+            auto begin = rows.begin() + morsel * kMorselRows;
+            buffer.assign(begin, begin + std::min(kMorselRows, static_cast<size_t>(rows.end() - begin)));
+            consume(participant, buffer);
+        });
+        return;
+    }
+
+    size_t first = stats ? stats->operators.size() : 0;
+    if (stats) {
+        kimDescribePlan(table, plan, values, stats->operators);
+    }
+    std::vector<KimColumnFilter> filters;
+    if (!plan.predicates.empty() && !kimCompileFilters(table, plan, values, filters)) {
+        return;
+    }
+
+    // The scan of each morsel feeds its consumer straight away, on the same thread
+    size_t blocks = table.columns.empty() ? 0 : table.columns.front().blocks.size();
+    size_t morsels = (blocks + kKimMorselBlocks - 1) / kKimMorselBlocks;
+    std::vector<KimPlanCounts> participantCounts(stats ? pool.size() : 0);
+    pool.run(morsels, parallelism, [&](size_t participant, size_t morsel) {
+        std::vector<size_t>& buffer = buffers[participant];
+        KimPlanCounts* counts = stats ? &participantCounts[participant] : nullptr;
+        uint64_t start = counts ? kimNowNanos() : 0;
+        size_t firstBlock = morsel * kKimMorselBlocks;
+        size_t endBlock = std::min(blocks, firstBlock + kKimMorselBlocks);
+        buffer.clear();
+        if (plan.predicates.empty()) {
+            size_t end = std::min(table.rowCount(), endBlock * kKimBlockRows);
+            for (size_t row = firstBlock * kKimBlockRows; row < end; ++row) {
+                if (!table.isDeleted(row)) {
+                    buffer.push_back(row);
+                }
+            }
+            if (counts) {
+                counts->scanned += end - firstBlock * kKimBlockRows;
+            }
+        } else {
+            scanBlockRange(table, plan, filters, firstBlock, endBlock, buffer, SIZE_MAX, counts);
+        }
+        if (counts) {
+            counts->candidates += buffer.size();
+            counts->nanos += kimNowNanos() - start;
+        }
+        if (!buffer.empty()) {
+            consume(participant, buffer);
+        }
+    });
+
+    if (stats) {
+        KimOperatorStats& scan = stats->operators[first];
+        uint64_t skipped = 0;
+        for (const auto& counts : participantCounts) {
+            scan.rowsIn += counts.scanned;
+            scan.rowsOut += counts.candidates;
+            scan.bytesRead += counts.bytes;
+            scan.nanos += counts.nanos;
+            skipped += counts.skipped;
+        }
+        scan.detail += skippedBlocks(skipped);
+        stats->access = plan.access;
+        stats->rowsScanned += scan.rowsIn;
+        stats->bytesRead += scan.bytesRead;
+    }
+}
+
+std::string kimDescribePredicate(const KimTable& table, const KimPlanPredicate& predicate,
+                                 const std::vector<std::string>& values) {
+    static const char* const kOperators[] = {" = ", " != ", " < ", " <= ", " > ", " >= "};
+    std::string text = table.columnHeaders[predicate.column].ColumnName;
+    if (predicate.op == KimCompareOp::Between) {
+        return text + " BETWEEN " + valueOf(predicate.value, values) + " AND " + valueOf(predicate.high, values);
+    }
+    if (predicate.op == KimCompareOp::In) {
+        text += " IN (";
+        for (size_t i = 0; i < predicate.list.size(); ++i) {
+            text += (i ? ", " : "") + valueOf(predicate.list[i], values);
+        }
+        return text + ")";
+    }
+    return text + kOperators[static_cast<size_t>(predicate.op)] + valueOf(predicate.value, values);
+}
+
+void kimDescribePlan(const KimTable& table, const KimQueryPlan& plan, const std::vector<std::string>& values,
+                     std::vector<KimOperatorStats>& operators) {
+    std::string name = table.header.TableName;
+    // An aggregate's LIMIT applies to its groups, and an ordered query's to
+    // its ranked rows, not to the rows scanned
+    bool limited = plan.hasLimit && plan.outputs.empty() && plan.orderBy.empty();
+    std::string limit = limited ? " LIMIT " + valueOf(plan.limit, values) : std::string();
+    bool indexed = plan.access != KimAccessPath::FullScan && !plan.predicates.empty();
+    std::string conditions;
+    for (size_t i = 0; i < plan.predicates.size(); ++i) {
+        if (!indexed || i != plan.accessPredicate) {
+            conditions += (conditions.empty() ? "" : " AND ") + kimDescribePredicate(table, plan.predicates[i], values);
+        }
+    }
+
+    if (!indexed) {
+        operators.push_back({"FullScan", name + (conditions.empty() ? "" : ": " + conditions) + limit});
+        return;
+    }
+    const char* access = plan.access == KimAccessPath::HashProbe ? "HashProbe" : "TreeRange";
+    std::string probe = name + "." + kimDescribePredicate(table, plan.predicates[plan.accessPredicate], values);
+    if (conditions.empty()) {
+        operators.push_back({access, probe + limit});
+    } else {
+        operators.push_back({access, probe});
+        operators.push_back({"Filter", conditions + limit});
+    }
+}
+
+static KimOperatorStats joinOperator(const KimTable& left, const KimTable& right, const KimJoinPlan& plan) {
+    std::string leftColumn = std::string(left.header.TableName) + "." + left.columnHeaders[plan.leftColumn].ColumnName;
+    std::string rightColumn =
+        std::string(right.header.TableName) + "." + right.columnHeaders[plan.rightColumn].ColumnName;
+    return {"HashJoin", leftColumn + " = " + rightColumn};
+}
+
+KimJoinPairs kimExecuteJoin(const KimTable& left, const KimTable& right, const KimJoinPlan& plan,
+                            const std::vector<std::string>& values, size_t parallelism, KimQueryStats* stats,
+                            size_t limit) {
+    // Each side's own conditions are applied first, through its indexes
+    // where it has them; an unfiltered side joins with all of its rows
+    std::vector<size_t> leftRows, rightRows;
+    bool leftFiltered = !plan.left.predicates.empty();
+    bool rightFiltered = !plan.right.predicates.empty();
+    if (leftFiltered) {
+        leftRows = kimExecutePlan(left, plan.left, values, SIZE_MAX, parallelism, stats);
+    }
+    KimAccessPath leftAccess = stats ? stats->access : KimAccessPath::FullScan;
+    if (rightFiltered) {
+        rightRows = kimExecutePlan(right, plan.right, values, SIZE_MAX, parallelism, stats);
+    }
+    KimJoinInput leftInput{&left, plan.leftColumn, leftFiltered ? &leftRows : nullptr};
+    KimJoinInput rightInput{&right, plan.rightColumn, rightFiltered ? &rightRows : nullptr};
+    if (!stats) {
+        return kimHashJoin(leftInput, rightInput, parallelism, limit);
+    }
+
+    KimOperatorStats join = joinOperator(left, right, plan);
+    uint64_t start = kimNowNanos();
+    KimJoinPairs pairs = kimHashJoin(leftInput, rightInput, parallelism, limit);
+    join.nanos = kimNowNanos() - start;
+    join.rowsIn = (leftFiltered ? leftRows.size() : left.liveRowCount()) +
+                  (rightFiltered ? rightRows.size() : right.liveRowCount());
+    join.rowsOut = pairs.size();
+    stats->operators.push_back(join);
+    stats->join = true;
+    stats->access = leftFiltered ? leftAccess : KimAccessPath::FullScan;
+    return pairs;
+}
+
+void kimDescribeJoin(const KimTable& left, const KimTable& right, const KimJoinPlan& plan,
+                     const std::vector<std::string>& values, std::vector<KimOperatorStats>& operators) {
+    if (!plan.left.predicates.empty()) {
+        kimDescribePlan(left, plan.left, values, operators);
+    }
+    if (!plan.right.predicates.empty()) {
+        kimDescribePlan(right, plan.right, values, operators);
+    }
+    operators.push_back(joinOperator(left, right, plan));
+}
+
+KimOperatorStats kimProjectOperator(size_t columns, const std::vector<std::vector<std::string>>& rows,
+                                    uint64_t nanos) {
+    KimOperatorStats project{"Project", std::to_string(columns) + " columns"};
+    project.rowsIn = rows.size();
+    project.rowsOut = rows.size();
+    for (const auto& row : rows) {
+        for (const auto& value : row) {
+            project.bytesRead += value.size();
+        }
+    }
+    project.nanos = nanos;
+    return project;
+}
+
+static std::string formatMillis(uint64_t nanos) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.3f", nanos / 1e6);
+    return text;
+}
+
+std::vector<std::vector<std::string>> kimExplainRows(const KimQueryStats& stats, bool analyze) {
+    std::vector<std::vector<std::string>> rows;
+    for (const auto& op : stats.operators) {
+        if (!analyze) {
+            rows.push_back({op.name, op.detail});
+            continue;
+        }
+        rows.push_back({op.name, op.detail, std::to_string(op.rowsIn), std::to_string(op.rowsOut),
+                        std::to_string(op.bytesRead), formatMillis(op.nanos)});
+    }
+    if (analyze) {
+        std::string prepare = "prepare " + formatMillis(stats.prepareNanos) + " ms" +
+                              (stats.planCached ? ", plan cached" : "");
+        rows.push_back({"Total", prepare, std::to_string(stats.rowsScanned), std::to_string(stats.rowsMatched),
+                        std::to_string(stats.bytesRead), formatMillis(stats.nanos)});
+    }
+    return rows;
+}
+
+// The registry entries queries report to, looked up once
+struct KimQueryMetrics {
+    KimCounter& queries = kimMetrics().counter("kimdb_queries_total", "Queries executed");
+    KimCounter& errors = kimMetrics().counter("kimdb_query_errors_total",
+                                              "Queries that could not be prepared or bound");
+    KimCounter& fullScans = kimMetrics().counter("kimdb_full_scans_total", "Queries that scanned their FROM table");
+    KimCounter& hashProbes = kimMetrics().counter("kimdb_hash_probes_total", "Queries answered by a hash index probe");
+    KimCounter& treeRanges = kimMetrics().counter("kimdb_tree_ranges_total", "Queries answered by a B+tree range walk");
+    KimCounter& joins = kimMetrics().counter("kimdb_joins_total", "Join queries executed");
+    KimCounter& cacheHits = kimMetrics().counter("kimdb_plan_cache_hits_total",
+                                                 "Prepared queries found in a plan cache");
+    KimCounter& cacheMisses = kimMetrics().counter("kimdb_plan_cache_misses_total",
+                                                   "Prepared queries parsed and planned");
+    KimCounter& resultHits = kimMetrics().counter("kimdb_result_cache_hits_total",
+                                                  "Queries answered from a result cache");
+    KimCounter& resultMisses = kimMetrics().counter("kimdb_result_cache_misses_total",
+                                                    "Queries a result cache did not hold");
+    KimCounter& resultEvictions = kimMetrics().counter("kimdb_result_cache_evictions_total",
+                                                       "Results evicted from result caches");
+    KimCounter& rowsScanned = kimMetrics().counter("kimdb_rows_scanned_total", "Rows looked at by access paths");
+    KimCounter& rowsMatched = kimMetrics().counter("kimdb_rows_matched_total", "Result rows");
+    KimCounter& bytesRead = kimMetrics().counter("kimdb_bytes_read_total",
+                                                 "Column bytes read by scans, filters and result assembly");
+    KimHistogram& duration = kimMetrics().histogram("kimdb_query_duration_seconds", "Query execution time");
+    KimHistogram& prepare = kimMetrics().histogram("kimdb_prepare_duration_seconds", "Query preparation time");
+};
+
+static KimQueryMetrics& queryMetrics() {
+    static KimQueryMetrics metrics;
+    return metrics;
+}
+
+void kimRecordQuery(const KimQueryStats& stats) {
+    if (!kimMetrics().enabled()) {
+        return;
+    }
+    KimQueryMetrics& metrics = queryMetrics();
+    metrics.queries.add();
+    if (stats.join) {
+        metrics.joins.add();
+    }
+    if (stats.access == KimAccessPath::HashProbe) {
+        metrics.hashProbes.add();
+    } else if (stats.access == KimAccessPath::TreeRange) {
+        metrics.treeRanges.add();
+    } else {
+        metrics.fullScans.add();
+    }
+    metrics.rowsScanned.add(stats.rowsScanned);
+    metrics.rowsMatched.add(stats.rowsMatched);
+    metrics.bytesRead.add(stats.bytesRead);
+    metrics.duration.record(stats.nanos);
+}
+
+void kimRecordQueryError() {
+    if (kimMetrics().enabled()) {
+        queryMetrics().errors.add();
+    }
+}
+
+void kimRecordPrepare(uint64_t nanos, bool cached) {
+    if (!kimMetrics().enabled()) {
+        return;
+    }
+    KimQueryMetrics& metrics = queryMetrics();
+    (cached ? metrics.cacheHits : metrics.cacheMisses).add();
+    metrics.prepare.record(nanos);
+}
+
+KimResultCache& KimResultCache::operator=(const KimResultCache& other) {
+    if (this != &other) {
+        size_t budget = other.budget();
+        std::lock_guard<std::mutex> lock(mutex);
+        limit = budget;
+        dropAll();
+    }
+    return *this;
+}
+
+size_t KimResultCache::budget() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return limit;
+}
+
+void KimResultCache::setBudget(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    limit = bytes;
+    evict(0);
+}
+
+std::shared_ptr<const KimResultCache::Rows> KimResultCache::find(const std::string& key, uint64_t newVersion) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = advance(newVersion) ? lookup.find(key) : lookup.end();
+    bool hit = it != lookup.end();
+    ++(hit ? counts.hits : counts.misses);
+    if (kimMetrics().enabled()) {
+        (hit ? queryMetrics().resultHits : queryMetrics().resultMisses).add();
+    }
+    if (!hit) {
+        return nullptr;
+    }
+    entries.splice(entries.begin(), entries, it->second);
+    return it->second->rows;
+}
+
+// Rough heap footprint of a result: the strings, the vectors holding them
+// and the key
+static size_t resultBytes(const std::string& key, const KimResultCache::Rows& rows) {
+    size_t bytes = key.size() + sizeof(KimResultCache::Rows) + 64;
+    for (const auto& row : rows) {
+        bytes += sizeof(row) + row.size() * sizeof(std::string);
+        for (const auto& value : row) {
+            bytes += value.size() < sizeof(std::string) ? 0 : value.size() + 1;
+        }
+    }
+    return bytes;
+}
+
+void KimResultCache::insert(const std::string& key, uint64_t newVersion, std::shared_ptr<const Rows> rows) {
+    size_t bytes = resultBytes(key, *rows);
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!advance(newVersion) || bytes > limit) {
+        return;
+    }
+    auto it = lookup.find(key);
+    if (it != lookup.end()) {
+        used -= it->second->bytes;
+        entries.erase(it->second);
+        lookup.erase(it);
+    }
+    evict(bytes);
+    entries.push_front({key, std::move(rows), bytes});
+    lookup[key] = entries.begin();
+    used += bytes;
+}
+
+void KimResultCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    dropAll();
+}
+
+KimResultCacheStats KimResultCache::stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    KimResultCacheStats current = counts;
+    current.bytes = used;
+    current.entries = entries.size();
+    return current;
+}
+
+void KimResultCache::resetStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    counts = KimResultCacheStats();
+}
+
+bool KimResultCache::advance(uint64_t newVersion) {
+    if (newVersion < version) {
+        return false;
+    }
+    if (newVersion > version) {
+        dropAll();
+        version = newVersion;
+    }
+    return true;
+}
+
+void KimResultCache::evict(size_t incoming) {
+    uint64_t evicted = 0;
+    while (!entries.empty() && used + incoming > limit) {
+        used -= entries.back().bytes;
+        lookup.erase(entries.back().key);
+        entries.pop_back();
+        ++evicted;
+    }
+    counts.evictions += evicted;
+    if (evicted && kimMetrics().enabled()) {
+        queryMetrics().resultEvictions.add(evicted);
+    }
+}
+
+void KimResultCache::dropAll() {
+    entries.clear();
+    lookup.clear();
+    used = 0;
+}
+
+KimPreparedStatement::KimPreparedStatement(const KimTable* table, uint64_t schemaVersion,
+                                           std::shared_ptr<const KimQueryPlan> plan,
+                                           std::vector<KimSqlArgument> arguments, size_t callerParameters,
+                                           uint64_t prepareNanos, bool planCached, std::string sqlKey)
+    : table(table), schemaVersion(schemaVersion), plan(std::move(plan)), arguments(std::move(arguments)),
+      callerParameters(callerParameters), parallelism(table ? table->parallelism : 1), prepareTime(prepareNanos),
+      cached(planCached), key(std::move(sqlKey)) {}
+
+bool kimBindLimit(const KimSqlOperand& operand, const std::vector<std::string>& values, size_t& limit) {
+    int64_t bound;
+    if (!kimParseInt(valueOf(operand, values), bound) || bound < 0) {
+        std::cerr << "Invalid LIMIT: " << valueOf(operand, values) << std::endl;
+        return false;
+    }
+    limit = std::min(limit, static_cast<size_t>(bound));
+    return true;
+}
+
+bool KimPreparedStatement::bind(const std::vector<std::string>& parameters, std::vector<std::string>& values,
+                                size_t& limit) const {
+    if (!plan) {
+        std::cerr << "Invalid prepared statement" << std::endl;
+        return false;
+    }
+    if (table->schemaVersion != schemaVersion) {
+        std::cerr << "Prepared statement is out of date; the table was redefined" << std::endl;
+        return false;
+    }
+    if (parameters.size() != callerParameters) {
+        std::cerr << "Expected " << callerParameters << " parameters, got " << parameters.size() << std::endl;
+        return false;
+    }
+
+    // Lifted literals and caller parameters share one list, in query order
+    values.clear();
+    values.reserve(arguments.size());
+    for (const auto& argument : arguments) {
+        values.push_back(argument.fromCaller ? parameters[argument.callerIndex] : argument.literal);
+    }
+    return !plan->hasLimit || kimBindLimit(plan->limit, values, limit);
+}
+
+std::vector<size_t> KimPreparedStatement::rowIds(const std::vector<std::string>& parameters, size_t limit,
+                                                 KimQueryStats* stats) const {
+    std::vector<std::string> values;
+    if (!bind(parameters, values, limit)) {
+        kimRecordQueryError();
+        return {};
+    }
+    if (stats) {
+        stats->prepareNanos = prepareTime;
+        stats->planCached = cached;
+    }
+    if (!plan->orderBy.empty()) {
+        return kimOrderRows(*table, *plan, values, limit, parallelism, stats);
+    }
+    return kimExecutePlan(*table, *plan, values, limit, parallelism, stats);
+}
+
+std::vector<size_t> KimPreparedStatement::executeRowIds(const std::vector<std::string>& parameters, size_t limit,
+                                                        KimQueryStats* stats) const {
+    if (plan && (plan->explain || !plan->outputs.empty())) {
+        std::cerr << (plan->explain ? "EXPLAIN" : "An aggregate query")
+                  << " returns its rows from executeWith, not row ids" << std::endl;
+        return {};
+    }
+    // Measured only when someone looks at the numbers
+    KimQueryStats local;
+    KimQueryStats* measured = stats ? stats : kimMetrics().enabled() ? &local : nullptr;
+    if (!measured) {
+        return rowIds(parameters, limit, nullptr);
+    }
+    uint64_t start = kimNowNanos();
+    std::vector<size_t> matches = rowIds(parameters, limit, measured);
+    measured->nanos = kimNowNanos() - start;
+    measured->rowsMatched = matches.size();
+    kimRecordQuery(*measured);
+    return matches;
+}
+
+KimCursor KimPreparedStatement::openWith(const std::vector<std::string>& parameters, size_t limit) const {
+    std::vector<std::string> values;
+    if (plan && (plan->explain || !plan->outputs.empty())) {
+        std::cerr << (plan->explain ? "EXPLAIN" : "An aggregate query")
+                  << " returns its rows from executeWith, not a cursor" << std::endl;
+        return KimCursor();
+    }
+    if (!bind(parameters, values, limit)) {
+        kimRecordQueryError();
+        return KimCursor();
+    }
+    return KimCursor(table, plan, std::move(values), limit);
+}
+
+std::vector<std::vector<std::string>> KimPreparedStatement::executeWith(const std::vector<std::string>& parameters,
+                                                                        KimQueryStats* stats) const {
+    if (plan && plan->explain) {
+        return explain(parameters, stats);
+    }
+    KimQueryStats local;
+    KimQueryStats* measured = stats ? stats : kimMetrics().enabled() ? &local : nullptr;
+    if (stats || key.empty() || !table || !table->resultCache.enabled()) {
+        return run(parameters, measured);
+    }
+
+    // Keyed by the query's shape and every value bound to it, each prefixed
+    // by its length so no two bindings run together
+    std::vector<std::string> values;
+    size_t limit = SIZE_MAX;
+    if (!bind(parameters, values, limit)) {
+        kimRecordQueryError();
+        return {};
+    }
+    std::string resultKey = key;
+    for (const auto& value : values) {
+        resultKey += '\0' + std::to_string(value.size()) + ':' + value;
+    }
+    // Taken before running, so a result is never tagged newer than the rows it read
+    uint64_t version;
+    {
+        std::lock_guard<std::recursive_mutex> lock(table->versions.mutex);
+        version = table->versions.version;
+    }
+    if (auto rows = table->resultCache.find(resultKey, version)) {
+        return *rows;
+    }
+    auto rows = std::make_shared<const KimResultCache::Rows>(run(parameters, measured));
+    table->resultCache.insert(resultKey, version, rows);
+    return *rows;
+}
+
+static size_t projectedColumns(const KimTable& table, const KimQueryPlan& plan) {
+    return plan.columns.empty() ? table.columns.size() : plan.columns.size();
+}
+
+std::vector<std::vector<std::string>> KimPreparedStatement::run(const std::vector<std::string>& parameters,
+                                                                KimQueryStats* stats) const {
+    uint64_t start = stats ? kimNowNanos() : 0;
+    if (plan && !plan->outputs.empty()) {
+        return aggregate(parameters, stats, start);
+    }
+    std::vector<size_t> matches = rowIds(parameters, SIZE_MAX, stats);
+    uint64_t projectStart = stats ? kimNowNanos() : 0;
+    std::vector<std::vector<std::string>> result(matches.size());
+    size_t morsels = (matches.size() + kKimBlockRows - 1) / kKimBlockRows;
+    kimThreadPool().run(morsels, parallelism, [&](size_t, size_t morsel) {
+        size_t end = std::min(matches.size(), (morsel + 1) * kKimBlockRows);
+        for (size_t i = morsel * kKimBlockRows; i < end; ++i) {
+            result[i] = plan->columns.empty() ? table->selectRow(*table, matches[i])
+                                              : table->selectRow(*table, matches[i], plan->columns);
+        }
+    });
+    if (stats) {
+        uint64_t end = kimNowNanos();
+        stats->operators.push_back(kimProjectOperator(projectedColumns(*table, *plan), result, end - projectStart));
+        stats->bytesRead += stats->operators.back().bytesRead;
+        stats->nanos = end - start;
+        stats->rowsMatched = result.size();
+        kimRecordQuery(*stats);
+    }
+    return result;
+}
+
+std::vector<std::vector<std::string>> KimPreparedStatement::aggregate(const std::vector<std::string>& parameters,
+                                                                      KimQueryStats* stats, uint64_t start) const {
+    std::vector<std::string> values;
+    size_t limit = SIZE_MAX;
+    if (!bind(parameters, values, limit)) {
+        kimRecordQueryError();
+        return {};
+    }
+    if (stats) {
+        stats->prepareNanos = prepareTime;
+        stats->planCached = cached;
+    }
+    std::vector<std::vector<std::string>> result = kimAggregate(*table, *plan, values, limit, parallelism, stats);
+    if (stats) {
+        stats->nanos = kimNowNanos() - start;
+        stats->rowsMatched = result.size();
+        kimRecordQuery(*stats);
+    }
+    return result;
+}
+
+std::vector<std::vector<std::string>> KimPreparedStatement::explain(const std::vector<std::string>& parameters,
+                                                                    KimQueryStats* stats) const {
+    KimQueryStats local;
+    KimQueryStats& explained = stats ? *stats : local;
+    if (plan->analyze) {
+        run(parameters, &explained);
+        return kimExplainRows(explained, true);
+    }
+
+    std::vector<std::string> values;
+    size_t limit = SIZE_MAX;
+    if (!bind(parameters, values, limit)) {
+        kimRecordQueryError();
+        return {};
+    }
+    explained.prepareNanos = prepareTime;
+    explained.planCached = cached;
+    if (!plan->orderBy.empty()) {
+        kimDescribeOrder(*table, *plan, values, limit, explained.operators);
+        explained.operators.push_back({"Project", std::to_string(projectedColumns(*table, *plan)) + " columns"});
+    } else if (plan->outputs.empty()) {
+        kimDescribePlan(*table, *plan, values, explained.operators);
+        explained.operators.push_back({"Project", std::to_string(projectedColumns(*table, *plan)) + " columns"});
+    } else {
+        kimDescribeAggregate(*table, *plan, values, explained.operators);
+    }
+    return kimExplainRows(explained, false);
+}
+
+KimCursor::KimCursor(const KimTable* table, std::shared_ptr<const KimQueryPlan> plan, std::vector<std::string> values,
+                     size_t limit)
+    : table(table), plan(std::move(plan)), limit(limit), exhausted(false) {
+    const KimQueryPlan& query = *this->plan;
+    if (!query.orderBy.empty()) {
+        source = Source::Rows;
+        pending = kimOrderRows(*table, query, values, limit);
+        exhausted = true;
+    } else if (query.predicates.empty()) {
+        source = Source::AllRows;
+    } else if (!kimCompileFilters(*table, query, values, filters)) {
+        exhausted = true;
+    } else if (query.access == KimAccessPath::FullScan) {
+        source = Source::Scan;
+    } else {
+        source = Source::Rows;
+        pending = kimExecutePlan(*table, query, values, limit);
+        exhausted = true;
+    }
+}
+
+bool KimCursor::refill() {
+    pending.clear();
+    position = 0;
+    size_t blocks = table->columns.empty() ? 0 : table->columns.front().blocks.size();
+    while (pending.empty() && !exhausted) {
+        if (limit == 0 || nextBlock >= blocks) {
+            exhausted = true;
+            break;
+        }
+        size_t end = std::min(blocks, nextBlock + kKimMorselBlocks);
+        if (source == Source::Scan) {
+            scanBlockRange(*table, *plan, filters, nextBlock, end, pending, limit);
+        } else {
+            size_t last = std::min(table->rowCount(), end * kKimBlockRows);
+            for (size_t row = nextBlock * kKimBlockRows; row < last && pending.size() < limit; ++row) {
+                if (!table->isDeleted(row)) {
+                    pending.push_back(row);
+                }
+            }
+        }
+        limit -= pending.size();
+        nextBlock = end;
+    }
+    return !pending.empty();
+}
+
+size_t KimCursor::nextBatch(std::vector<KimRowView>& batch, size_t max) {
+    batch.clear();
+    while (batch.size() < max && plan) {
+        if (position == pending.size() && !refill()) {
+            break;
+        }
+        size_t take = std::min(max - batch.size(), pending.size() - position);
+        for (size_t i = 0; i < take; ++i) {
+            batch.emplace_back(table, pending[position + i], &plan->columns);
+        }
+        position += take;
+    }
+    pinRows(batch.data(), batch.size());
+    returned += batch.size();
+    return batch.size();
+}
+
+bool KimCursor::next(KimRowView& row) {
+    if (!plan || (position == pending.size() && !refill())) {
+        return false;
+    }
+    row = KimRowView(table, pending[position++], &plan->columns);
+    if (row.id() / kKimBlockRows != pinnedBlock) {
+        pinRows(&row, 1);
+    }
+    ++returned;
+    return true;
+}
+
+void KimCursor::pinRows(const KimRowView* rows, size_t count) {
+    pins.clear();
+    pinnedBlock = SIZE_MAX;
+    if (!table->pagedFile) {
+        return;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        size_t b = rows[i].id() / kKimBlockRows;
+        if (b != pinnedBlock) {
+            for (size_t c = 0; c < rows[i].size(); ++c) {
+                pins.push_back(table->columns[rows[i].tableColumn(c)].pinBlock(b));
+            }
+            pinnedBlock = b;
+        }
+    }
+}
+
+size_t KimRowView::size() const {
+    return columns ? columns->size() : table->columns.size();
+}
+
+std::string_view KimRowView::view(size_t column) const {
+    return table->columns[tableColumn(column)].getView(row);
+}
+
+int64_t KimRowView::getInt(size_t column) const {
+    return table->columns[tableColumn(column)].getInt(row);
+}
+
+double KimRowView::getFloat(size_t column) const {
+    return table->columns[tableColumn(column)].getFloat(row);
+}
+
+std::string KimRowView::getString(size_t column) const {
+    return table->columns[tableColumn(column)].getString(row);
+}
+
+std::vector<std::string> KimRowView::toStrings() const {
+    std::vector<std::string> values;
+    values.reserve(size());
+    for (size_t column = 0; column < size(); ++column) {
+        values.push_back(getString(column));
+    }
+    return values;
+}
@@ -0,0 +1,417 @@
+//
+// Query plans, the plan cache and prepared statements for KimTable.
+//
+
+#ifndef KIMDB_KIMQUERY_H
+#define KIMDB_KIMQUERY_H
+
+#include "KimColumnStore.h"
+#include "KimJoin.h"
+#include "KimMetrics.h"
+#include "KimSqlParser.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+class KimTable;
+
+// Column blocks per unit of work in a parallel scan.
+constexpr size_t kKimMorselBlocks = 4;
+
+// How the rows for a query are found before the remaining predicates filter them.
+enum class KimAccessPath {
+    FullScan,
+    HashProbe,
+    TreeRange,
+};
+
+// A WHERE condition with its column resolved to an index.
+struct KimPlanPredicate {
+    size_t column;
+    KimCompareOp op;
+    KimSqlOperand value;
+    KimSqlOperand high;
+    std::vector<KimSqlOperand> list; // IN values
+};
+
+// A result column of an aggregate query: a GROUP BY column or an aggregate.
+struct KimPlanOutput {
+    KimAggregate aggregate = KimAggregate::None; // None: the value of a GROUP BY column
+    size_t column = SIZE_MAX; // SIZE_MAX for COUNT(*)
+    std::string name; // as written, for EXPLAIN
+};
+
+// An ORDER BY column resolved to an index.
+struct KimPlanOrder {
+    size_t column;
+    bool descending;
+};
+
+// A parsed and resolved query. Plans hold no literal values, only operands
+// that refer to the arguments of a normalised query, so one plan serves
+// every query with the same shape.
+struct KimQueryPlan {
+    std::vector<KimPlanPredicate> predicates; // AND-ed together
+    KimAccessPath access = KimAccessPath::FullScan;
+    size_t accessPredicate = 0; // predicate answered by the access path
+    size_t parameterCount = 0;
+    bool hasLimit = false;
+    KimSqlOperand limit;
+    bool explain = false;
+    bool analyze = false;
+    std::vector<KimPlanOutput> outputs; // aggregate queries only
+    std::vector<size_t> groupBy;
+    // Columns of a select list without aggregates, in its order; empty for
+    // SELECT *. Only these are read when the result rows are assembled.
+    std::vector<size_t> columns;
+    std::vector<KimPlanOrder> orderBy;
+    // ORDER BY one B+tree column with a LIMIT: walk the tree in key order and
+    // stop at the limit instead of collecting and ranking every match
+    bool treeOrder = false;
+};
+
+// What one operator of an executed query did. Access paths (FullScan,
+// HashProbe, TreeRange, TreeOrder) read rows from the table or an index,
+// Filter checks the remaining predicates on them, HashJoin matches two
+// inputs, TopK and Sort order the rows and Project assembles the results.
+struct KimOperatorStats {
+    std::string name; // an access path, Filter, HashJoin, (Hash)Aggregate, TopK, Sort or Project
+    std::string detail; // table, predicates with their bound values, LIMIT
+    uint64_t rowsIn = 0;
+    uint64_t rowsOut = 0;
+    uint64_t bytesRead = 0; // column bytes read; index lookups count none
+    uint64_t nanos = 0; // wall time
+};
+
+// Measurements of one query execution, filled when a caller passes one to
+// execute or the query is run by EXPLAIN ANALYZE, and reported to
+// kimMetrics() when that is enabled.
+struct KimQueryStats {
+    uint64_t prepareNanos = 0; // tokenising, normalising and, unless cached, parsing and planning
+    bool planCached = false;
+    bool join = false;
+    KimAccessPath access = KimAccessPath::FullScan; // of the FROM table
+    uint64_t rowsScanned = 0; // rows the access paths looked at
+    uint64_t rowsMatched = 0; // result rows
+    uint64_t bytesRead = 0;
+    uint64_t nanos = 0; // wall time of the execution, preparing excluded
+    std::vector<KimOperatorStats> operators; // in the order they ran
+};
+
+// A two-table equi-join. Each table's WHERE conditions form a plan of their
+// own that runs before the join; the tables are matched on one column each.
+struct KimJoinPlan {
+    KimQueryPlan left;
+    KimQueryPlan right;
+    size_t leftColumn = 0;
+    size_t rightColumn = 0;
+    // Select list, numbering the left table's columns before the right's;
+    // empty for SELECT *
+    std::vector<size_t> columns;
+    bool hasLimit = false;
+    KimSqlOperand limit;
+    bool explain = false;
+    bool analyze = false;
+};
+
+// Least-recently-used cache of compiled plans keyed by normalised SQL. Each
+// table owns its own cache; copying a table starts a new, empty one.
+class KimPlanCache {
+public:
+    explicit KimPlanCache(size_t capacity = 128) : capacity(capacity) {}
+    KimPlanCache(const KimPlanCache& other) : capacity(other.capacity) {}
+    KimPlanCache& operator=(const KimPlanCache& other);
+
+    std::shared_ptr<const KimQueryPlan> find(const std::string& key);
+    void insert(const std::string& key, std::shared_ptr<const KimQueryPlan> plan);
+    void clear();
+    void setCapacity(size_t newCapacity);
+    size_t size() const;
+
+private:
+    using Entry = std::pair<std::string, std::shared_ptr<const KimQueryPlan>>;
+
+    mutable std::mutex mutex;
+    size_t capacity;
+    std::list<Entry> entries; // most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> lookup;
+
+    void evict();
+};
+
+struct KimResultCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    size_t bytes = 0; // estimated size of the cached results
+    size_t entries = 0;
+};
+
+// Least-recently-used cache of query results keyed by normalised SQL and the
+// values bound to it. Results are kept for one table version at a time: the
+// first lookup or insert at a newer version drops them all, so a change to
+// the table costs nothing until it is queried again. Results are charged an
+// estimate of their size and evicted to stay within a byte budget, which is
+// 0, caching nothing, until set. Each table owns its own cache; copying a
+// table starts a new, empty one with the same budget.
+class KimResultCache {
+public:
+    using Rows = std::vector<std::vector<std::string>>;
+
+    KimResultCache() = default;
+    KimResultCache(const KimResultCache& other) : limit(other.budget()) {}
+    KimResultCache& operator=(const KimResultCache& other);
+
+    bool enabled() const { return budget() > 0; }
+    size_t budget() const;
+    // Evicts down to the new budget; 0 turns the cache off and empties it
+    void setBudget(size_t bytes);
+
+    // The result cached under key at version, or null
+    std::shared_ptr<const Rows> find(const std::string& key, uint64_t version);
+    // Caches rows computed at version, unless the table has moved past it or
+    // they alone exceed the budget
+    void insert(const std::string& key, uint64_t version, std::shared_ptr<const Rows> rows);
+    void clear();
+
+    KimResultCacheStats stats() const;
+    void resetStats();
+
+private:
+    struct Entry {
+        std::string key;
+        std::shared_ptr<const Rows> rows;
+        size_t bytes = 0;
+    };
+
+    mutable std::mutex mutex;
+    size_t limit = 0;
+    size_t used = 0;
+    uint64_t version = 0; // of every cached result
+    std::list<Entry> entries; // most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> lookup;
+    KimResultCacheStats counts;
+
+    // Empties the cache when version is newer than its results; false when
+    // version is older, so results computed at it are stale
+    bool advance(uint64_t newVersion);
+    void evict(size_t incoming);
+    void dropAll();
+};
+
+// Text form of a value passed to KimPreparedStatement::execute.
+template <typename T>
+std::string kimSqlParameter(const T& value) {
+    if constexpr (std::is_same_v<T, bool>) {
+        return value ? "1" : "0";
+    } else if constexpr (std::is_integral_v<T>) {
+        return std::to_string(value);
+    } else if constexpr (std::is_floating_point_v<T>) {
+        return kimFormatFloat(static_cast<double>(value));
+    } else {
+        return std::string(value);
+    }
+}
+
+// One row of a table, read in place. Views into string values stay valid
+// until the table changes; nothing is copied unless getString is called. A
+// row of a query with a select list shows only those columns, numbered in
+// its order, and refers to the plan that lists them.
+class KimRowView {
+public:
+    KimRowView() = default;
+    KimRowView(const KimTable* table, size_t row, const std::vector<size_t>* columns = nullptr)
+        : table(table), row(row), columns(columns && !columns->empty() ? columns : nullptr) {}
+
+    size_t id() const { return row; }
+    size_t size() const; // columns
+    size_t tableColumn(size_t column) const { return columns ? (*columns)[column] : column; }
+    // The text of string columns; the stored bytes of int and float columns
+    std::string_view view(size_t column) const;
+    int64_t getInt(size_t column) const; // int columns
+    double getFloat(size_t column) const; // float columns
+    std::string getString(size_t column) const; // any column, formatted as selectRow does
+    std::vector<std::string> toStrings() const;
+
+private:
+    const KimTable* table = nullptr;
+    size_t row = 0;
+    const std::vector<size_t>* columns = nullptr; // select list, null for every column
+};
+
+// Streams the rows of a query in row order, or in ORDER BY order. Full scans are evaluated a
+// morsel of column blocks at a time as rows are asked for, so a caller that
+// stops early, or a LIMIT, leaves the rest of the table unread; the row ids
+// of one morsel are the only buffer. Index probes and ordered queries find
+// their rows up front.
+// On a paged table the blocks of the selected columns of the rows last
+// returned stay pinned, so views into them are valid until the next call.
+// The table must not change while a cursor is open.
+class KimCursor {
+public:
+    KimCursor() = default;
+    KimCursor(const KimTable* table, std::shared_ptr<const KimQueryPlan> plan, std::vector<std::string> values,
+              size_t limit);
+
+    bool valid() const { return plan != nullptr; }
+    // Replaces batch with up to `max` rows, reusing its storage; returns how
+    // many, 0 once the query is exhausted
+    size_t nextBatch(std::vector<KimRowView>& batch, size_t max = kKimBlockRows);
+    bool next(KimRowView& row);
+    size_t rowsReturned() const { return returned; }
+
+private:
+    enum class Source {
+        Scan, // full scan, one morsel per refill
+        AllRows, // no predicates: every live row, one morsel per refill
+        Rows, // found up front by an index
+    };
+
+    const KimTable* table = nullptr;
+    std::shared_ptr<const KimQueryPlan> plan;
+    std::vector<KimColumnFilter> filters;
+    Source source = Source::Rows;
+    size_t limit = 0; // rows still allowed into `pending`
+    size_t nextBlock = 0;
+    bool exhausted = true;
+    std::vector<size_t> pending;
+    size_t position = 0;
+    size_t returned = 0;
+    std::vector<KimBlockPin> pins; // paged tables: the selected columns' blocks of the rows last returned
+    size_t pinnedBlock = SIZE_MAX;
+
+    bool refill();
+    void pinRows(const KimRowView* rows, size_t count);
+};
+
+// A query compiled against one table. Executing it binds the parameters and
+// runs the plan without lexing, parsing or resolving column names again.
+class KimPreparedStatement {
+public:
+    KimPreparedStatement() = default;
+    KimPreparedStatement(const KimTable* table, uint64_t schemaVersion, std::shared_ptr<const KimQueryPlan> plan,
+                         std::vector<KimSqlArgument> arguments, size_t callerParameters, uint64_t prepareNanos = 0,
+                         bool planCached = false, std::string sqlKey = std::string());
+
+    bool valid() const { return plan != nullptr; }
+    size_t parameterCount() const { return callerParameters; }
+    // Threads a scan may use, 0 for every core; starts at KimTable::parallelism.
+    void setParallelism(size_t threads) { parallelism = threads; }
+    const KimQueryPlan* queryPlan() const { return plan.get(); }
+    uint64_t prepareNanos() const { return prepareTime; }
+    bool planCached() const { return cached; }
+
+    template <typename... Args>
+    std::vector<std::vector<std::string>> execute(const Args&... args) const {
+        return executeWith(std::vector<std::string>{kimSqlParameter(args)...});
+    }
+    // The matching rows, one row per group for a select list with aggregates,
+    // or for EXPLAIN the plan; `stats`, when given, receives what the
+    // execution did. Without `stats`, a table with a result cache answers a
+    // query it has run since it last changed from the cache.
+    std::vector<std::vector<std::string>> executeWith(const std::vector<std::string>& parameters,
+                                                      KimQueryStats* stats = nullptr) const;
+    // Matching row ids in row order, or in ORDER BY order, at most `limit` of them.
+    std::vector<size_t> executeRowIds(const std::vector<std::string>& parameters, size_t limit = SIZE_MAX,
+                                      KimQueryStats* stats = nullptr) const;
+    // Binds the parameters and streams the matching rows; see KimCursor
+    template <typename... Args>
+    KimCursor open(const Args&... args) const {
+        return openWith(std::vector<std::string>{kimSqlParameter(args)...});
+    }
+    KimCursor openWith(const std::vector<std::string>& parameters, size_t limit = SIZE_MAX) const;
+
+private:
+    const KimTable* table = nullptr;
+    uint64_t schemaVersion = 0;
+    std::shared_ptr<const KimQueryPlan> plan;
+    std::vector<KimSqlArgument> arguments;
+    size_t callerParameters = 0;
+    size_t parallelism = 1;
+    uint64_t prepareTime = 0;
+    bool cached = false;
+    std::string key; // normalised SQL, empty when the results are not to be cached
+
+    std::vector<std::vector<std::string>> run(const std::vector<std::string>& parameters, KimQueryStats* stats) const;
+    std::vector<size_t> rowIds(const std::vector<std::string>& parameters, size_t limit, KimQueryStats* stats) const;
+    std::vector<std::vector<std::string>> aggregate(const std::vector<std::string>& parameters, KimQueryStats* stats,
+                                                    uint64_t start) const;
+    std::vector<std::vector<std::string>> explain(const std::vector<std::string>& parameters,
+                                                  KimQueryStats* stats) const;
+    // The bound values of every operand, and `limit` lowered to the query's
+    // LIMIT; false, with the reason reported, when they cannot be bound
+    bool bind(const std::vector<std::string>& parameters, std::vector<std::string>& values, size_t& limit) const;
+};
+
+// Compiles the predicates of plan against their columns; false when one of
+// them admits no row
+bool kimCompileFilters(const KimTable& table, const KimQueryPlan& plan, const std::vector<std::string>& values,
+                       std::vector<KimColumnFilter>& filters);
+// The range a <, <=, >, >= or BETWEEN predicate admits
+KimRange kimPredicateRange(const KimPlanPredicate& predicate, const std::vector<std::string>& values);
+// Value of a LIMIT operand; false when it is not a non-negative integer
+bool kimBindLimit(const KimSqlOperand& operand, const std::vector<std::string>& values, size_t& limit);
+
+// Builds a plan for a parsed statement, or reports why it cannot run on table.
+std::shared_ptr<KimQueryPlan> kimPlanQuery(const KimTable& table, const KimSelectStatement& statement,
+                                           std::string& error);
+// Runs plan with every operand already bound to its value. Full scans
+// without a limit are split into morsels over up to `parallelism` threads.
+// With `stats` the plan's operators are appended to it with their counts.
+std::vector<size_t> kimExecutePlan(const KimTable& table, const KimQueryPlan& plan,
+                                   const std::vector<std::string>& values, size_t limit = SIZE_MAX,
+                                   size_t parallelism = 1, KimQueryStats* stats = nullptr);
+// Runs plan like kimExecutePlan, but hands the matching rows to
+// consume(participant, rows) a morsel at a time, on up to `parallelism`
+// threads, instead of collecting them; each call's rows ascend. A scan feeds
+// each morsel to its consumer on the thread that scanned it. The time of a
+// scan in `stats` is summed over its threads.
+void kimForEachMorsel(const KimTable& table, const KimQueryPlan& plan, const std::vector<std::string>& values,
+                      size_t parallelism, const std::function<void(size_t, const std::vector<size_t>&)>& consume,
+                      KimQueryStats* stats = nullptr);
+// Appends the operators plan would run, without running them
+void kimDescribePlan(const KimTable& table, const KimQueryPlan& plan, const std::vector<std::string>& values,
+                     std::vector<KimOperatorStats>& operators);
+// A predicate with its bound values, as EXPLAIN shows it
+std::string kimDescribePredicate(const KimTable& table, const KimPlanPredicate& predicate,
+                                 const std::vector<std::string>& values);
+
+// Resolves a JOIN statement whose FROM table is `left` and JOIN table `right`.
+// Without an ON clause the join columns come from the tables' link keys.
+std::shared_ptr<KimJoinPlan> kimPlanJoin(const KimTable& left, const KimTable& right,
+                                         const KimSelectStatement& statement, std::string& error);
+// Picks the join columns from the link keys: a link column of one table paired
+// with the other's same-named column, else with the other's primary key, else
+// the first link column of each.
+bool kimChooseLinkColumns(const KimTable& left, const KimTable& right, size_t& leftColumn, size_t& rightColumn);
+// Runs a join plan; with a `limit` only the first pairs are produced, and
+// left rows past them are never probed.
+KimJoinPairs kimExecuteJoin(const KimTable& left, const KimTable& right, const KimJoinPlan& plan,
+                            const std::vector<std::string>& values, size_t parallelism = 1,
+                            KimQueryStats* stats = nullptr, size_t limit = SIZE_MAX);
+void kimDescribeJoin(const KimTable& left, const KimTable& right, const KimJoinPlan& plan,
+                     const std::vector<std::string>& values, std::vector<KimOperatorStats>& operators);
+
+// The Project operator of a result of `rows` rows of `columns` columns
+KimOperatorStats kimProjectOperator(size_t columns, const std::vector<std::vector<std::string>>& rows,
+                                    uint64_t nanos);
+// Result rows of EXPLAIN, one per operator: name and detail, followed under
+// ANALYZE by rows in, rows out, bytes read and milliseconds, and a Total row
+std::vector<std::vector<std::string>> kimExplainRows(const KimQueryStats& stats, bool analyze);
+// Adds one execution to the registry, when it is enabled
+void kimRecordQuery(const KimQueryStats& stats);
+// Counts a query that could not be prepared or bound, when the registry is enabled
+void kimRecordQueryError();
+// Counts a plan cache lookup, when the registry is enabled
+void kimRecordPrepare(uint64_t nanos, bool cached);
+
+#endif //KIMDB_KIMQUERY_H
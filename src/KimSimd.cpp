@@ -0,0 +1,591 @@
+//
+// Vectorised predicate kernels for fixed-width column blocks.
+//
+
+#include "KimSimd.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define KIM_SIMD_X86 1
+#include <immintrin.h>
+#else
+#define KIM_SIMD_X86 0
+#endif
+
+// The vector kernels are compiled for their instruction set function by
+// function, so the rest of the library keeps the baseline target.
+#if defined(__GNUC__)
+#define KIM_TARGET(isa) __attribute__((target(isa)))
+#else
+#define KIM_TARGET(isa)
+#endif
+
+static KimSimdLevel detectLevel() {
+#if KIM_SIMD_X86 && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    bool sse42 = (info[2] & (1 << 20)) != 0;
+    bool osSavesAvx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+    bool avx2 = false;
+    if (maxLeaf >= 7 && osSavesAvx) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+    return avx2 ? KimSimdLevel::Avx2 : sse42 ? KimSimdLevel::Sse42 : KimSimdLevel::Scalar;
+#elif KIM_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return KimSimdLevel::Avx2;
+    }
+    return __builtin_cpu_supports("sse4.2") ? KimSimdLevel::Sse42 : KimSimdLevel::Scalar;
+#else
+    return KimSimdLevel::Scalar;
+#endif
+}
+
+static KimSimdLevel supportedLevel() {
+    static const KimSimdLevel level = detectLevel();
+    return level;
+}
+
+static std::atomic<int> activeLevel{-1};
+
+KimSimdLevel kimSimdLevel() {
+    int level = activeLevel.load(std::memory_order_relaxed);
+    if (level < 0) {
+        level = static_cast<int>(supportedLevel());
+        activeLevel.store(level, std::memory_order_relaxed);
+    }
+    return static_cast<KimSimdLevel>(level);
+}
+
+void kimSetSimdLevel(KimSimdLevel level) {
+    activeLevel.store(static_cast<int>(std::min(level, supportedLevel())), std::memory_order_relaxed);
+}
+
+const char* kimSimdLevelName(KimSimdLevel level) {
+    switch (level) {
+        case KimSimdLevel::Avx2:
+            return "avx2";
+        case KimSimdLevel::Sse42:
+            return "sse4.2";
+        default:
+            return "scalar";
+    }
+}
+
+template <typename T>
+static void betweenScalar(const T* values, size_t count, T low, T high, uint64_t* selection) {
+    for (size_t word = 0; word < kimSelectionWords(count); ++word) {
+        size_t begin = word * 64;
+        size_t end = std::min(count, begin + 64);
+        uint64_t bits = 0;
+        for (size_t i = begin; i < end; ++i) {
+            bits |= uint64_t(values[i] >= low && values[i] <= high) << (i - begin);
+        }
+        selection[word] = bits;
+    }
+}
+
+static void equalBytesScalar(const char* values, size_t begin, size_t count, size_t width, const char* needle,
+                             uint64_t* selection) {
+    uint64_t bits = 0;
+    for (size_t i = begin; i < count; ++i) {
+        bits |= uint64_t(std::memcmp(values + i * width, needle, width) == 0) << (i % 64);
+        if (i % 64 == 63 || i + 1 == count) {
+            selection[i / 64] |= bits;
+            bits = 0;
+        }
+    }
+}
+
+// Records of 8 to 16 bytes: their first and last 8 bytes, which overlap
+static bool equalOverlappingWords(const char* value, const char* needle, size_t width) {
+    uint64_t a, b, c, d;
+    std::memcpy(&a, value, 8);
+    std::memcpy(&b, needle, 8);
+    std::memcpy(&c, value + width - 8, 8);
+    std::memcpy(&d, needle + width - 8, 8);
+    return ((a ^ b) | (c ^ d)) == 0;
+}
+
+// Records narrower than a vector are compared several per load against the
+// needle repeated with period `width`; a record matches when the byte mask
+// holds a run of `width` ones at its position. Adding the low bit of each
+// record to the mask without its high bits carries into a record's high bit
+// exactly when its other bytes matched, so one add tests every record.
+namespace {
+struct RecordLanes {
+    size_t width;
+    size_t perVector; // whole records in one vector
+    uint64_t lowBits = 0; // first byte of each record
+    uint64_t highBits = 0; // last byte of each record
+
+    RecordLanes(size_t recordWidth, size_t vectorBytes) : width(recordWidth), perVector(vectorBytes / recordWidth) {
+        for (size_t r = 0; r < perVector; ++r) {
+            lowBits |= uint64_t(1) << (r * width);
+            highBits |= uint64_t(1) << (r * width + width - 1);
+        }
+    }
+
+    // Bit r set when record r of a vector whose byte mask is `equal` matched
+    uint64_t matches(uint64_t equal) const {
+        uint64_t hits = ((equal & ~highBits) + lowBits) & equal & highBits;
+        if (width == 1) {
+            return hits;
+        }
+        uint64_t records = 0;
+        for (; hits != 0; hits &= hits - 1) {
+            records |= uint64_t(1) << (kimCountTrailingZeros(hits) / width);
+        }
+        return records;
+    }
+};
+} // namespace
+
+// Collects the bits of consecutive runs of records and stores each
+// selection word once it is complete
+namespace {
+struct SelectionWriter {
+    uint64_t* selection;
+    uint64_t bits = 0; // of the word holding the next record
+
+    // Bits of the `count` records from i
+    void add(size_t i, uint64_t records, size_t count) {
+        size_t shift = i % 64;
+        bits |= records << shift;
+        if (shift + count >= 64) {
+            selection[i / 64] = bits;
+            bits = shift == 0 ? 0 : records >> (64 - shift);
+        }
+    }
+
+    // end is the record after the last one added
+    void finish(size_t end) {
+        if (end % 64 != 0) {
+            selection[end / 64] = bits;
+        }
+    }
+};
+} // namespace
+
+#if KIM_SIMD_X86
+
+// Each kernel fills one 64-bit word at a time from whole vectors and finishes
+// a partial last word with scalar comparisons.
+
+KIM_TARGET("sse4.2")
+static void betweenInt32Sse(const int32_t* values, size_t count, int32_t low, int32_t high, uint64_t* selection) {
+    __m128i lo = _mm_set1_epi32(low);
+    __m128i hi = _mm_set1_epi32(high);
+    for (size_t word = 0; word < kimSelectionWords(count); ++word) {
+        size_t begin = word * 64;
+        size_t end = std::min(count, begin + 64);
+        uint64_t bits = 0;
+        size_t i = begin;
+        for (; i + 4 <= end; i += 4) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+            __m128i outside = _mm_or_si128(_mm_cmpgt_epi32(lo, v), _mm_cmpgt_epi32(v, hi));
+            uint64_t inside = ~static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(outside))) & 0xF;
+            bits |= inside << (i - begin);
+        }
+        for (; i < end; ++i) {
+            bits |= uint64_t(values[i] >= low && values[i] <= high) << (i - begin);
+        }
+        selection[word] = bits;
+    }
+}
+
+KIM_TARGET("sse4.2")
+static void betweenInt64Sse(const int64_t* values, size_t count, int64_t low, int64_t high, uint64_t* selection) {
+    __m128i lo = _mm_set1_epi64x(low);
+    __m128i hi = _mm_set1_epi64x(high);
+    for (size_t word = 0; word < kimSelectionWords(count); ++word) {
+        size_t begin = word * 64;
+        size_t end = std::min(count, begin + 64);
+        uint64_t bits = 0;
+        size_t i = begin;
+        for (; i + 2 <= end; i += 2) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+            __m128i outside = _mm_or_si128(_mm_cmpgt_epi64(lo, v), _mm_cmpgt_epi64(v, hi));
+            uint64_t inside = ~static_cast<unsigned>(_mm_movemask_pd(_mm_castsi128_pd(outside))) & 0x3;
+            bits |= inside << (i - begin);
+        }
+        for (; i < end; ++i) {
+            bits |= uint64_t(values[i] >= low && values[i] <= high) << (i - begin);
+        }
+        selection[word] = bits;
+    }
+}
+
+KIM_TARGET("sse4.2")
+static void betweenFloatSse(const float* values, size_t count, float low, float high, uint64_t* selection) {
+    __m128 lo = _mm_set1_ps(low);
+    __m128 hi = _mm_set1_ps(high);
+    for (size_t word = 0; word < kimSelectionWords(count); ++word) {
+        size_t begin = word * 64;
+        size_t end = std::min(count, begin + 64);
+        uint64_t bits = 0;
+        size_t i = begin;
+        for (; i + 4 <= end; i += 4) {
+            __m128 v = _mm_loadu_ps(values + i);
+            __m128 inside = _mm_and_ps(_mm_cmpge_ps(v, lo), _mm_cmple_ps(v, hi));
+            bits |= uint64_t(static_cast<unsigned>(_mm_movemask_ps(inside))) << (i - begin);
+        }
+        for (; i < end; ++i) {
+            bits |= uint64_t(values[i] >= low && values[i] <= high) << (i - begin);
+        }
+        selection[word] = bits;
+    }
+}
+
+KIM_TARGET("sse4.2")
+static void betweenDoubleSse(const double* values, size_t count, double low, double high, uint64_t* selection) {
+    __m128d lo = _mm_set1_pd(low);
+    __m128d hi = _mm_set1_pd(high);
+    for (size_t word = 0; word < kimSelectionWords(count); ++word) {
+        size_t begin = word * 64;
+        size_t end = std::min(count, begin + 64);
+        uint64_t bits = 0;
+        size_t i = begin;
+        for (; i + 2 <= end; i += 2) {
+            __m128d v = _mm_loadu_pd(values + i);
+            __m128d inside = _mm_and_pd(_mm_cmpge_pd(v, lo), _mm_cmple_pd(v, hi));
+            bits |= uint64_t(static_cast<unsigned>(_mm_movemask_pd(inside))) << (i - begin);
+        }
+        for (; i < end; ++i) {
+            bits |= uint64_t(values[i] >= low && values[i] <= high) << (i - begin);
+        }
+        selection[word] = bits;
+    }
+}
+
+// Records of at least a vector compare a vector at a time, the last one
+// overlapping the one before so no byte is left to memcmp
+KIM_TARGET("sse4.2")
+static void equalBytesSse(const char* values, size_t count, size_t width, const char* needle, uint64_t* selection) {
+    size_t i = 0;
+    if (width <= 8) {
+        char pattern[16];
+        for (size_t j = 0; j < sizeof(pattern); ++j) {
+            pattern[j] = needle[j % width];
+        }
+        __m128i key = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern));
+        RecordLanes lanes(width, 16);
+        SelectionWriter writer{selection};
+        for (; i * width + 16 <= count * width; i += lanes.perVector) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i * width));
+            auto equal = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, key)));
+            writer.add(i, lanes.matches(equal), lanes.perVector);
+        }
+        writer.finish(i);
+    } else if (width < 16) {
+        uint64_t bits = 0;
+        for (; i < count; ++i) {
+            bits |= uint64_t(equalOverlappingWords(values + i * width, needle, width)) << (i % 64);
+            if (i % 64 == 63 || i + 1 == count) {
+                selection[i / 64] = bits;
+                bits = 0;
+            }
+        }
+    } else {
+        __m128i last = _mm_loadu_si128(reinterpret_cast<const __m128i*>(needle + width - 16));
+        uint64_t bits = 0;
+        for (; i < count; ++i) {
+            const char* value = values + i * width;
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(value + width - 16));
+            __m128i same = _mm_cmpeq_epi8(v, last);
+            for (size_t j = 0; j + 16 < width; j += 16) {
+                __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(value + j));
+                __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(needle + j));
+                same = _mm_and_si128(same, _mm_cmpeq_epi8(a, b));
+            }
+            bits |= uint64_t(_mm_movemask_epi8(same) == 0xFFFF) << (i % 64);
+            if (i % 64 == 63 || i + 1 == count) {
+                selection[i / 64] = bits;
+                bits = 0;
+            }
+        }
+    }
+    equalBytesScalar(values, i, count, width, needle, selection);
+}
+
+KIM_TARGET("avx2")
+static void betweenInt32Avx2(const int32_t* values, size_t count, int32_t low, int32_t high, uint64_t* selection) {
+    __m256i lo = _mm256_set1_epi32(low);
+    __m256i hi = _mm256_set1_epi32(high);
+    for (size_t word = 0; word < kimSelectionWords(count); ++word) {
+        size_t begin = word * 64;
+        size_t end = std::min(count, begin + 64);
+        uint64_t bits = 0;
+        size_t i = begin;
+        for (; i + 8 <= end; i += 8) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+            __m256i outside = _mm256_or_si256(_mm256_cmpgt_epi32(lo, v), _mm256_cmpgt_epi32(v, hi));
+            uint64_t inside = ~static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(outside))) & 0xFF;
+            bits |= inside << (i - begin);
+        }
+        for (; i < end; ++i) {
+            bits |= uint64_t(values[i] >= low && values[i] <= high) << (i - begin);
+        }
+        selection[word] = bits;
+    }
+}
+
+KIM_TARGET("avx2")
+static void betweenInt64Avx2(const int64_t* values, size_t count, int64_t low, int64_t high, uint64_t* selection) {
+    __m256i lo = _mm256_set1_epi64x(low);
+    __m256i hi = _mm256_set1_epi64x(high);
+    for (size_t word = 0; word < kimSelectionWords(count); ++word) {
+        size_t begin = word * 64;
+        size_t end = std::min(count, begin + 64);
+        uint64_t bits = 0;
+        size_t i = begin;
+        for (; i + 4 <= end; i += 4) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+            __m256i outside = _mm256_or_si256(_mm256_cmpgt_epi64(lo, v), _mm256_cmpgt_epi64(v, hi));
+            uint64_t inside = ~static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(outside))) & 0xF;
+            bits |= inside << (i - begin);
+        }
+        for (; i < end; ++i) {
+            bits |= uint64_t(values[i] >= low && values[i] <= high) << (i - begin);
+        }
+        selection[word] = bits;
+    }
+}
+
+KIM_TARGET("avx2")
+static void betweenFloatAvx2(const float* values, size_t count, float low, float high, uint64_t* selection) {
+    __m256 lo = _mm256_set1_ps(low);
+    __m256 hi = _mm256_set1_ps(high);
+    for (size_t word = 0; word < kimSelectionWords(count); ++word) {
+        size_t begin = word * 64;
+        size_t end = std::min(count, begin + 64);
+        uint64_t bits = 0;
+        size_t i = begin;
+        for (; i + 8 <= end; i += 8) {
+            __m256 v = _mm256_loadu_ps(values + i);
+            __m256 inside = _mm256_and_ps(_mm256_cmp_ps(v, lo, _CMP_GE_OQ), _mm256_cmp_ps(v, hi, _CMP_LE_OQ));
+            bits |= uint64_t(static_cast<unsigned>(_mm256_movemask_ps(inside))) << (i - begin);
+        }
+        for (; i < end; ++i) {
+            bits |= uint64_t(values[i] >= low && values[i] <= high) << (i - begin);
+        }
+        selection[word] = bits;
+    }
+}
+
+KIM_TARGET("avx2")
+static void betweenDoubleAvx2(const double* values, size_t count, double low, double high, uint64_t* selection) {
+    __m256d lo = _mm256_set1_pd(low);
+    __m256d hi = _mm256_set1_pd(high);
+    for (size_t word = 0; word < kimSelectionWords(count); ++word) {
+        size_t begin = word * 64;
+        size_t end = std::min(count, begin + 64);
+        uint64_t bits = 0;
+        size_t i = begin;
+        for (; i + 4 <= end; i += 4) {
+            __m256d v = _mm256_loadu_pd(values + i);
+            __m256d inside = _mm256_and_pd(_mm256_cmp_pd(v, lo, _CMP_GE_OQ), _mm256_cmp_pd(v, hi, _CMP_LE_OQ));
+            bits |= uint64_t(static_cast<unsigned>(_mm256_movemask_pd(inside))) << (i - begin);
+        }
+        for (; i < end; ++i) {
+            bits |= uint64_t(values[i] >= low && values[i] <= high) << (i - begin);
+        }
+        selection[word] = bits;
+    }
+}
+
+KIM_TARGET("avx2")
+static void equalBytesAvx2(const char* values, size_t count, size_t width, const char* needle, uint64_t* selection) {
+    size_t i = 0;
+    if (width <= 16) {
+        char pattern[32];
+        for (size_t j = 0; j < sizeof(pattern); ++j) {
+            pattern[j] = needle[j % width];
+        }
+        __m256i key = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pattern));
+        RecordLanes lanes(width, 32);
+        SelectionWriter writer{selection};
+        for (; i * width + 32 <= count * width; i += lanes.perVector) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i * width));
+            auto equal = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, key)));
+            writer.add(i, lanes.matches(equal), lanes.perVector);
+        }
+        writer.finish(i);
+    } else if (width < 32) {
+        // The first and last 16 bytes, overlapping
+        __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(needle));
+        __m128i last = _mm_loadu_si128(reinterpret_cast<const __m128i*>(needle + width - 16));
+        uint64_t bits = 0;
+        for (; i < count; ++i) {
+            const char* value = values + i * width;
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(value));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(value + width - 16));
+            __m128i same = _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last));
+            bits |= uint64_t(_mm_movemask_epi8(same) == 0xFFFF) << (i % 64);
+            if (i % 64 == 63 || i + 1 == count) {
+                selection[i / 64] = bits;
+                bits = 0;
+            }
+        }
+    } else {
+        __m256i last = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(needle + width - 32));
+        uint64_t bits = 0;
+        for (; i < count; ++i) {
+            const char* value = values + i * width;
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(value + width - 32));
+            __m256i same = _mm256_cmpeq_epi8(v, last);
+            for (size_t j = 0; j + 32 < width; j += 32) {
+                __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(value + j));
+                __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(needle + j));
+                same = _mm256_and_si256(same, _mm256_cmpeq_epi8(a, b));
+            }
+            bits |= uint64_t(static_cast<unsigned>(_mm256_movemask_epi8(same)) == 0xFFFFFFFFu) << (i % 64);
+            if (i % 64 == 63 || i + 1 == count) {
+                selection[i / 64] = bits;
+                bits = 0;
+            }
+        }
+    }
+    equalBytesScalar(values, i, count, width, needle, selection);
+}
+
+#endif
+
+void kimSelectBetween(const int32_t* values, size_t count, int32_t low, int32_t high, uint64_t* selection) {
+#if KIM_SIMD_X86
+    switch (kimSimdLevel()) {
+        case KimSimdLevel::Avx2:
+            return betweenInt32Avx2(values, count, low, high, selection);
+        case KimSimdLevel::Sse42:
+            return betweenInt32Sse(values, count, low, high, selection);
+        default:
+            break;
+    }
+#endif
+    betweenScalar(values, count, low, high, selection);
+}
+
+void kimSelectBetween(const int64_t* values, size_t count, int64_t low, int64_t high, uint64_t* selection) {
+#if KIM_SIMD_X86
+    switch (kimSimdLevel()) {
+        case KimSimdLevel::Avx2:
+            return betweenInt64Avx2(values, count, low, high, selection);
+        case KimSimdLevel::Sse42:
+            return betweenInt64Sse(values, count, low, high, selection);
+        default:
+            break;
+    }
+#endif
+    betweenScalar(values, count, low, high, selection);
+}
+
+void kimSelectBetween(const float* values, size_t count, float low, float high, uint64_t* selection) {
+#if KIM_SIMD_X86
+    switch (kimSimdLevel()) {
+        case KimSimdLevel::Avx2:
+            return betweenFloatAvx2(values, count, low, high, selection);
+        case KimSimdLevel::Sse42:
+            return betweenFloatSse(values, count, low, high, selection);
+        default:
+            break;
+    }
+#endif
+    betweenScalar(values, count, low, high, selection);
+}
+
+void kimSelectBetween(const double* values, size_t count, double low, double high, uint64_t* selection) {
+#if KIM_SIMD_X86
+    switch (kimSimdLevel()) {
+        case KimSimdLevel::Avx2:
+            return betweenDoubleAvx2(values, count, low, high, selection);
+        case KimSimdLevel::Sse42:
+            return betweenDoubleSse(values, count, low, high, selection);
+        default:
+            break;
+    }
+#endif
+    betweenScalar(values, count, low, high, selection);
+}
+
+void kimSelectEqualBytes(const char* values, size_t count, size_t width, const char* needle, uint64_t* selection) {
+    // Records of 4 or 8 bytes compare as whole integers, several per vector
+    if (width == 4 || width == 8) {
+        if (width == 4) {
+            int32_t key;
+            std::memcpy(&key, needle, sizeof(key));
+            kimSelectBetween(reinterpret_cast<const int32_t*>(values), count, key, key, selection);
+        } else {
+            int64_t key;
+            std::memcpy(&key, needle, sizeof(key));
+            kimSelectBetween(reinterpret_cast<const int64_t*>(values), count, key, key, selection);
+        }
+        return;
+    }
+
+    std::fill(selection, selection + kimSelectionWords(count), 0);
+#if KIM_SIMD_X86
+    switch (width == 0 ? KimSimdLevel::Scalar : kimSimdLevel()) {
+        case KimSimdLevel::Avx2:
+            return equalBytesAvx2(values, count, width, needle, selection);
+        case KimSimdLevel::Sse42:
+            return equalBytesSse(values, count, width, needle, selection);
+        default:
+            break;
+    }
+#endif
+    equalBytesScalar(values, 0, count, width, needle, selection);
+}
+
+static uint32_t crc32cScalar(const unsigned char* data, size_t size, uint32_t crc) {
+    static const auto table = [] {
+        std::array<uint32_t, 256> entries{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                value = (value >> 1) ^ (0x82F63B78u & (0u - (value & 1)));
+            }
+            entries[i] = value;
+        }
+        return entries;
+    }();
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if KIM_SIMD_X86
+KIM_TARGET("sse4.2") static uint32_t crc32cSse(const unsigned char* data, size_t size, uint32_t crc) {
+    uint64_t value = crc;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        value = _mm_crc32_u64(value, word);
+    }
+    crc = static_cast<uint32_t>(value);
+    for (; i < size; ++i) {
+        crc = _mm_crc32_u8(crc, data[i]);
+    }
+    return crc;
+}
+#endif
+
+uint32_t kimCrc32c(const void* data, size_t size, uint32_t crc) {
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+#if KIM_SIMD_X86
+    if (kimSimdLevel() != KimSimdLevel::Scalar) {
+        return ~crc32cSse(bytes, size, crc);
+    }
+#endif
+    return ~crc32cScalar(bytes, size, crc);
+}
@@ -0,0 +1,70 @@
+//
+// Vectorised predicate kernels for fixed-width column blocks.
+//
+
+#ifndef KIMDB_KIMSIMD_H
+#define KIMDB_KIMSIMD_H
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Instruction sets the kernels are compiled for. The best one the CPU
+// supports is picked the first time a kernel runs, so a single binary runs
+// on every x86-64 host and falls back to plain C++ elsewhere.
+enum class KimSimdLevel {
+    Scalar,
+    Sse42,
+    Avx2,
+};
+
+KimSimdLevel kimSimdLevel();
+const char* kimSimdLevelName(KimSimdLevel level);
+// Caps the level used by the kernels, e.g. to compare them against the
+// scalar path; a level the CPU lacks is lowered to the best supported one.
+void kimSetSimdLevel(KimSimdLevel level);
+
+// Selection bitmaps: bit i of word i / 64 is set when values[i] satisfies the
+// predicate. The kernels write (count + 63) / 64 words and leave the bits past
+// `count` clear.
+inline size_t kimSelectionWords(size_t count) {
+    return (count + 63) / 64;
+}
+
+// low <= values[i] <= high. Float kernels use ordered comparisons, so NaN
+// never lies between two bounds.
+void kimSelectBetween(const int32_t* values, size_t count, int32_t low, int32_t high, uint64_t* selection);
+void kimSelectBetween(const int64_t* values, size_t count, int64_t low, int64_t high, uint64_t* selection);
+void kimSelectBetween(const float* values, size_t count, float low, float high, uint64_t* selection);
+void kimSelectBetween(const double* values, size_t count, double low, double high, uint64_t* selection);
+
+// values holds `count` records of `width` bytes back to back; selects the
+// records equal to the `width` bytes at needle.
+void kimSelectEqualBytes(const char* values, size_t count, size_t width, const char* needle, uint64_t* selection);
+
+// CRC-32C (Castagnoli) of data, continuing from crc; uses the SSE4.2 crc32
+// instruction when the CPU has it. Checksums log records and file sections.
+uint32_t kimCrc32c(const void* data, size_t size, uint32_t crc = 0);
+
+inline unsigned kimPopCount(uint64_t bits) {
+#if defined(_MSC_VER)
+    return static_cast<unsigned>(__popcnt64(bits));
+#else
+    return static_cast<unsigned>(__builtin_popcountll(bits));
+#endif
+}
+
+inline unsigned kimCountTrailingZeros(uint64_t bits) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctzll(bits));
+#endif
+}
+
+#endif //KIMDB_KIMSIMD_H
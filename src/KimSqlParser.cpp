@@ -0,0 +1,440 @@
+//
+// Hand-written lexer and parser for the SQL accepted by KimTable.
+//
+
+#include "KimSqlParser.h"
+
+#include <cctype>
+#include <utility>
+
+static const char* const kKeywords[] = {"SELECT", "FROM", "WHERE", "AND", "BETWEEN", "IN", "INNER", "JOIN", "ON", "LIMIT",
+                                       "EXPLAIN", "ANALYZE", "GROUP", "BY", "ORDER", "ASC", "DESC"};
+
+static bool equalsIgnoreCase(const std::string& text, const char* word) {
+    size_t i = 0;
+    for (; i < text.size() && word[i] != '\0'; ++i) {
+        if (std::toupper(static_cast<unsigned char>(text[i])) != word[i]) {
+            return false;
+        }
+    }
+    return i == text.size() && word[i] == '\0';
+}
+
+static bool isKeyword(const KimToken& token, const char* word) {
+    return token.type == KimTokenType::Identifier && equalsIgnoreCase(token.text, word);
+}
+
+static bool isSymbol(const KimToken& token, const char* symbol) {
+    return token.type == KimTokenType::Symbol && token.text == symbol;
+}
+
+static bool isIdentifierStart(char c) {
+    return std::isalpha(static_cast<unsigned char>(c)) || c == '_';
+}
+
+static bool isIdentifierChar(char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+static bool isDigit(char c) {
+    return std::isdigit(static_cast<unsigned char>(c)) != 0;
+}
+
+bool kimTokenize(const std::string& sql, std::vector<KimToken>& tokens, std::string& error) {
+    tokens.clear();
+    size_t i = 0;
+    while (i < sql.size()) {
+        char c = sql[i];
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            ++i;
+            continue;
+        }
+
+        size_t start = i;
+        // A sign starts a number only where an operand is expected
+        bool operandExpected = tokens.empty() || tokens.back().type == KimTokenType::Symbol ||
+                               (tokens.back().type == KimTokenType::Identifier &&
+                                (isKeyword(tokens.back(), "AND") || isKeyword(tokens.back(), "BETWEEN")));
+        bool signedNumber = (c == '-' || c == '+') && operandExpected && i + 1 < sql.size() &&
+                            (isDigit(sql[i + 1]) || sql[i + 1] == '.');
+
+        if (isIdentifierStart(c)) {
+            while (i < sql.size() && isIdentifierChar(sql[i])) {
+                ++i;
+            }
+            tokens.push_back({KimTokenType::Identifier, sql.substr(start, i - start), start});
+        } else if (isDigit(c) || signedNumber || (c == '.' && i + 1 < sql.size() && isDigit(sql[i + 1]))) {
+            if (signedNumber) {
+                ++i;
+            }
+            while (i < sql.size() && (isDigit(sql[i]) || sql[i] == '.')) {
+                ++i;
+            }
+            if (i < sql.size() && (sql[i] == 'e' || sql[i] == 'E')) {
+                size_t exponent = i + 1;
+                if (exponent < sql.size() && (sql[exponent] == '+' || sql[exponent] == '-')) {
+                    ++exponent;
+                }
+                if (exponent < sql.size() && isDigit(sql[exponent])) {
+                    i = exponent;
+                    while (i < sql.size() && isDigit(sql[i])) {
+                        ++i;
+                    }
+                }
+            }
+            tokens.push_back({KimTokenType::Number, sql.substr(start, i - start), start});
+        } else if (c == '\'' || c == '"') {
+            std::string text;
+            ++i;
+            while (true) {
+                if (i >= sql.size()) {
+                    error = "unterminated string literal";
+                    return false;
+                }
+                if (sql[i] == c) {
+                    if (i + 1 < sql.size() && sql[i + 1] == c) {
+                        text += c; // doubled quote
+                        i += 2;
+                        continue;
+                    }
+                    ++i;
+                    break;
+                }
+                text += sql[i++];
+            }
+            tokens.push_back({KimTokenType::String, text, start});
+        } else if (c == '?') {
+            ++i;
+            tokens.push_back({KimTokenType::Parameter, "?", start});
+        } else if ((c == '<' || c == '>' || c == '!') && i + 1 < sql.size() && sql[i + 1] == '=') {
+            i += 2;
+            tokens.push_back({KimTokenType::Symbol, sql.substr(start, 2), start});
+        } else if (c == '<' && i + 1 < sql.size() && sql[i + 1] == '>') {
+            i += 2;
+            tokens.push_back({KimTokenType::Symbol, "<>", start});
+        } else if (c == '*' || c == ',' || c == '(' || c == ')' || c == '.' || c == '=' || c == '<' ||
+                   c == '>' || c == ';') {
+            ++i;
+            tokens.push_back({KimTokenType::Symbol, std::string(1, c), start});
+        } else {
+            error = std::string("unexpected character '") + c + "' at position " + std::to_string(start);
+            return false;
+        }
+    }
+    tokens.push_back({KimTokenType::End, "", sql.size()});
+    return true;
+}
+
+void kimNormalize(const std::vector<KimToken>& tokens, KimNormalizedSql& normalized) {
+    normalized.key.clear();
+    normalized.tokens.clear();
+    normalized.arguments.clear();
+    normalized.callerParameters = 0;
+
+    for (const auto& token : tokens) {
+        if (token.type == KimTokenType::End || isSymbol(token, ";")) {
+            continue;
+        }
+        KimToken out = token;
+        if (token.type == KimTokenType::Number || token.type == KimTokenType::String) {
+            KimSqlArgument argument;
+            argument.literal = token.text;
+            normalized.arguments.push_back(argument);
+            out = {KimTokenType::Parameter, "?", token.position};
+        } else if (token.type == KimTokenType::Parameter) {
+            KimSqlArgument argument;
+            argument.fromCaller = true;
+            argument.callerIndex = normalized.callerParameters++;
+            normalized.arguments.push_back(argument);
+        } else if (token.type == KimTokenType::Identifier) {
+            for (const char* keyword : kKeywords) {
+                if (equalsIgnoreCase(token.text, keyword)) {
+                    out.text = keyword;
+                    break;
+                }
+            }
+        }
+        if (!normalized.key.empty()) {
+            normalized.key += ' ';
+        }
+        normalized.key += out.text;
+        normalized.tokens.push_back(out);
+    }
+    normalized.tokens.push_back({KimTokenType::End, "", tokens.empty() ? 0 : tokens.back().position});
+}
+
+namespace {
+
+class KimSqlParser {
+public:
+    KimSqlParser(const std::vector<KimToken>& tokens, std::string& error) : tokens(tokens), error(error) {}
+
+    bool parseSelect(KimSelectStatement& statement) {
+        if (isKeyword(peek(), "EXPLAIN")) {
+            next();
+            statement.explain = true;
+            if (isKeyword(peek(), "ANALYZE")) {
+                next();
+                statement.analyze = true;
+            }
+        }
+        if (!expectKeyword("SELECT")) {
+            return false;
+        }
+        if (isSymbol(peek(), "*")) {
+            next();
+        } else {
+            while (true) {
+                statement.items.emplace_back();
+                if (!parseSelectItem(statement.items.back())) {
+                    return false;
+                }
+                if (!isSymbol(peek(), ",")) {
+                    break;
+                }
+                next();
+            }
+        }
+        if (!expectKeyword("FROM")) {
+            return false;
+        }
+        if (peek().type != KimTokenType::Identifier) {
+            return fail("expected table name");
+        }
+        statement.table = next().text;
+
+        if (isKeyword(peek(), "INNER") || isKeyword(peek(), "JOIN")) {
+            if (isKeyword(peek(), "INNER")) {
+                next();
+            }
+            if (!expectKeyword("JOIN")) {
+                return false;
+            }
+            if (peek().type != KimTokenType::Identifier) {
+                return fail("expected table name");
+            }
+            statement.join = true;
+            statement.joinTable = next().text;
+            if (isKeyword(peek(), "ON")) {
+                next();
+                statement.hasOn = true;
+                if (!parseColumn(statement.onLeft) || !expectSymbol("=") || !parseColumn(statement.onRight)) {
+                    return false;
+                }
+            }
+        }
+
+        if (isKeyword(peek(), "WHERE")) {
+            next();
+            while (true) {
+                KimSqlCondition condition;
+                if (!parseCondition(condition)) {
+                    return false;
+                }
+                statement.where.push_back(condition);
+                if (!isKeyword(peek(), "AND")) {
+                    break;
+                }
+                next();
+            }
+        }
+        if (isKeyword(peek(), "GROUP")) {
+            next();
+            if (!expectKeyword("BY")) {
+                return false;
+            }
+            while (true) {
+                statement.groupBy.emplace_back();
+                if (!parseColumn(statement.groupBy.back())) {
+                    return false;
+                }
+                if (!isSymbol(peek(), ",")) {
+                    break;
+                }
+                next();
+            }
+        }
+        if (isKeyword(peek(), "ORDER")) {
+            next();
+            if (!expectKeyword("BY")) {
+                return false;
+            }
+            while (true) {
+                statement.orderBy.emplace_back();
+                KimSqlOrderItem& item = statement.orderBy.back();
+                if (!parseColumn(item.column)) {
+                    return false;
+                }
+                if (isKeyword(peek(), "ASC") || isKeyword(peek(), "DESC")) {
+                    item.descending = isKeyword(next(), "DESC");
+                }
+                if (!isSymbol(peek(), ",")) {
+                    break;
+                }
+                next();
+            }
+        }
+        if (isKeyword(peek(), "LIMIT")) {
+            next();
+            statement.hasLimit = true;
+            if (!parseOperand(statement.limit)) {
+                return false;
+            }
+        }
+        if (isSymbol(peek(), ";")) {
+            next();
+        }
+        if (peek().type != KimTokenType::End) {
+            return fail("unexpected '" + peek().text + "'");
+        }
+        return true;
+    }
+
+private:
+    const std::vector<KimToken>& tokens;
+    std::string& error;
+    size_t current = 0;
+    size_t parameters = 0;
+
+    const KimToken& peek() const { return tokens[current]; }
+    const KimToken& next() { return tokens[current < tokens.size() - 1 ? current++ : current]; }
+
+    bool fail(const std::string& message) {
+        error = message + " at position " + std::to_string(peek().position);
+        return false;
+    }
+
+    bool expectKeyword(const char* word) {
+        if (!isKeyword(peek(), word)) {
+            return fail(std::string("expected ") + word);
+        }
+        next();
+        return true;
+    }
+
+    bool expectSymbol(const char* symbol) {
+        if (!isSymbol(peek(), symbol)) {
+            return fail(std::string("expected '") + symbol + "'");
+        }
+        next();
+        return true;
+    }
+
+    bool parseOperand(KimSqlOperand& operand) {
+        const KimToken& token = peek();
+        if (token.type == KimTokenType::Parameter) {
+            operand.parameter = true;
+            operand.index = parameters++;
+        } else if (token.type == KimTokenType::Number || token.type == KimTokenType::String ||
+                   token.type == KimTokenType::Identifier) {
+            operand.text = token.text; // bare words are taken as string literals
+        } else {
+            return fail("expected a value");
+        }
+        next();
+        return true;
+    }
+
+    bool parseColumn(KimSqlColumnRef& column) {
+        if (peek().type != KimTokenType::Identifier) {
+            return fail("expected column name");
+        }
+        column.column = next().text;
+        if (isSymbol(peek(), ".")) {
+            next();
+            if (peek().type != KimTokenType::Identifier) {
+                return fail("expected column name");
+            }
+            column.table = column.column;
+            column.column = next().text;
+        }
+        return true;
+    }
+
+    bool parseSelectItem(KimSqlSelectItem& item) {
+        // Function names are not reserved; a name followed by ( is a call
+        static const std::pair<const char*, KimAggregate> kFunctions[] = {
+            {"COUNT", KimAggregate::Count}, {"SUM", KimAggregate::Sum}, {"MIN", KimAggregate::Min},
+            {"MAX", KimAggregate::Max},     {"AVG", KimAggregate::Avg}};
+        if (peek().type == KimTokenType::Identifier && isSymbol(tokens[current + 1], "(")) {
+            for (const auto& function : kFunctions) {
+                if (isKeyword(peek(), function.first)) {
+                    item.aggregate = function.second;
+                }
+            }
+            if (item.aggregate == KimAggregate::None) {
+                return fail("unknown function '" + peek().text + "'");
+            }
+            next();
+            next();
+            if (item.aggregate == KimAggregate::Count && isSymbol(peek(), "*")) {
+                next();
+                item.star = true;
+            } else if (!parseColumn(item.column)) {
+                return false;
+            }
+            return expectSymbol(")");
+        }
+        return parseColumn(item.column);
+    }
+
+    bool parseCondition(KimSqlCondition& condition) {
+        KimSqlColumnRef column;
+        if (!parseColumn(column)) {
+            return false;
+        }
+        condition.table = column.table;
+        condition.column = column.column;
+
+        if (isKeyword(peek(), "BETWEEN")) {
+            next();
+            condition.op = KimCompareOp::Between;
+            return parseOperand(condition.value) && expectKeyword("AND") && parseOperand(condition.high);
+        }
+        if (isKeyword(peek(), "IN")) {
+            next();
+            condition.op = KimCompareOp::In;
+            if (!expectSymbol("(")) {
+                return false;
+            }
+            while (true) {
+                condition.list.emplace_back();
+                if (!parseOperand(condition.list.back())) {
+                    return false;
+                }
+                if (!isSymbol(peek(), ",")) {
+                    break;
+                }
+                next();
+            }
+            return expectSymbol(")");
+        }
+
+        const KimToken& op = peek();
+        if (isSymbol(op, "=")) {
+            condition.op = KimCompareOp::Equal;
+        } else if (isSymbol(op, "!=") || isSymbol(op, "<>")) {
+            condition.op = KimCompareOp::NotEqual;
+        } else if (isSymbol(op, "<")) {
+            condition.op = KimCompareOp::Less;
+        } else if (isSymbol(op, "<=")) {
+            condition.op = KimCompareOp::LessEqual;
+        } else if (isSymbol(op, ">")) {
+            condition.op = KimCompareOp::Greater;
+        } else if (isSymbol(op, ">=")) {
+            condition.op = KimCompareOp::GreaterEqual;
+        } else {
+            return fail("expected comparison operator");
+        }
+        next();
+        return parseOperand(condition.value);
+    }
+};
+
+} // namespace
+
+bool kimParseSelect(const std::vector<KimToken>& tokens, KimSelectStatement& statement, std::string& error) {
+    statement = KimSelectStatement();
+    KimSqlParser parser(tokens, error);
+    return parser.parseSelect(statement);
+}
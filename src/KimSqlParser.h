@@ -0,0 +1,136 @@
+//
+// Hand-written lexer and parser for the SQL accepted by KimTable.
+//
+
+#ifndef KIMDB_KIMSQLPARSER_H
+#define KIMDB_KIMSQLPARSER_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+enum class KimTokenType {
+    Identifier,
+    Number,
+    String,
+    Parameter,
+    Symbol,
+    End,
+};
+
+struct KimToken {
+    KimTokenType type;
+    std::string text; // string literals without their quotes
+    size_t position;
+};
+
+bool kimTokenize(const std::string& sql, std::vector<KimToken>& tokens, std::string& error);
+
+// One value in a query: a `?` placeholder or a bare word taken literally.
+// Number and string literals are turned into placeholders by normalisation.
+struct KimSqlOperand {
+    bool parameter = false;
+    size_t index = 0;
+    std::string text;
+};
+
+// The value bound to each placeholder of a normalised query, in order: either
+// a literal lifted out of the original text or one of the caller's parameters.
+struct KimSqlArgument {
+    bool fromCaller = false;
+    size_t callerIndex = 0;
+    std::string literal;
+};
+
+// Cache key for a query: keywords upper-cased, whitespace collapsed and every
+// number or string literal replaced by `?`, so queries that differ only in
+// their literals share one plan.
+struct KimNormalizedSql {
+    std::string key;
+    std::vector<KimToken> tokens;
+    std::vector<KimSqlArgument> arguments;
+    size_t callerParameters = 0;
+};
+
+void kimNormalize(const std::vector<KimToken>& tokens, KimNormalizedSql& normalized);
+
+enum class KimCompareOp {
+    Equal,
+    NotEqual,
+    Less,
+    LessEqual,
+    Greater,
+    GreaterEqual,
+    Between,
+    In,
+};
+
+// A column reference, optionally qualified by its table: `table.column`.
+struct KimSqlColumnRef {
+    std::string table;
+    std::string column;
+};
+
+struct KimSqlCondition {
+    std::string table; // qualifier, empty when the column is not qualified
+    std::string column;
+    KimCompareOp op;
+    KimSqlOperand value;
+    KimSqlOperand high; // BETWEEN only
+    std::vector<KimSqlOperand> list; // IN only
+};
+
+enum class KimAggregate {
+    None,
+    Count,
+    Sum,
+    Min,
+    Max,
+    Avg,
+};
+
+// One entry of a select list: a column, or an aggregate over one.
+struct KimSqlSelectItem {
+    KimAggregate aggregate = KimAggregate::None;
+    bool star = false; // COUNT(*)
+    KimSqlColumnRef column;
+};
+
+// One ORDER BY column.
+struct KimSqlOrderItem {
+    KimSqlColumnRef column;
+    bool descending = false;
+};
+
+//   [EXPLAIN [ANALYZE]]
+//   SELECT (* | item [, item]...) FROM table [[INNER] JOIN table [ON column = column]]
+//            [WHERE condition [AND condition]...] [GROUP BY column [, column]...]
+//            [ORDER BY column [ASC | DESC] [, column [ASC | DESC]]...] [LIMIT operand]
+//   item      := column | COUNT ( * ) | (COUNT | SUM | MIN | MAX | AVG) ( column )
+//   condition := column (= | != | <> | < | <= | > | >=) operand
+//              | column BETWEEN operand AND operand
+//              | column IN ( operand [, operand]... )
+//   column    := [table .] name
+struct KimSelectStatement {
+    std::vector<KimSqlSelectItem> items; // empty for *
+    std::string table;
+    std::vector<KimSqlCondition> where;
+    std::vector<KimSqlColumnRef> groupBy;
+    std::vector<KimSqlOrderItem> orderBy;
+
+    bool join = false;
+    std::string joinTable;
+    bool hasOn = false; // without ON the tables are joined on their link keys
+    KimSqlColumnRef onLeft;
+    KimSqlColumnRef onRight;
+
+    bool hasLimit = false;
+    KimSqlOperand limit;
+
+    bool explain = false; // return the plan instead of the rows
+    bool analyze = false; // EXPLAIN ANALYZE: run the query and return what each operator did
+};
+
+bool kimParseSelect(const std::vector<KimToken>& tokens, KimSelectStatement& statement, std::string& error);
+
+#endif //KIMDB_KIMSQLPARSER_H
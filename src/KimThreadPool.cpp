@@ -0,0 +1,158 @@
+//
+// Worker threads shared by the parallel query paths.
+//
+
+#include "KimThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace {
+
+// Morsels not yet claimed by the owner (front) or a thief (back).
+struct MorselRange {
+    std::mutex mutex;
+    size_t begin = 0;
+    size_t end = 0;
+
+    bool popFront(size_t& morsel) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (begin == end) {
+            return false;
+        }
+        morsel = begin++;
+        return true;
+    }
+
+    bool popBack(size_t& morsel) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (begin == end) {
+            return false;
+        }
+        morsel = --end;
+        return true;
+    }
+};
+
+} // namespace
+
+struct KimThreadPool::Job {
+    const std::function<void(size_t, size_t)>* task;
+    std::vector<MorselRange> ranges;
+    std::atomic<size_t> nextParticipant{1};
+
+    // Helpers that picked up a ticket before the caller ran out of work; the
+    // caller waits for exactly those, and later tickets are dropped
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t started = 0;
+    size_t finished = 0;
+    bool closed = false;
+
+    explicit Job(size_t participants) : ranges(participants) {}
+};
+
+KimThreadPool::KimThreadPool(size_t workers) {
+    threads.reserve(workers);
+    for (size_t i = 0; i < workers; ++i) {
+        threads.emplace_back([this] { workerLoop(); });
+    }
+}
+
+KimThreadPool::~KimThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+void KimThreadPool::workerLoop() {
+    while (true) {
+        std::shared_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return stopping || !tickets.empty(); });
+            if (tickets.empty()) {
+                return;
+            }
+            job = std::move(tickets.front());
+            tickets.pop_front();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(job->mutex);
+            if (job->closed) {
+                continue;
+            }
+            ++job->started;
+        }
+        participate(*job, job->nextParticipant++);
+        {
+            std::lock_guard<std::mutex> lock(job->mutex);
+            ++job->finished;
+        }
+        job->done.notify_one();
+    }
+}
+
+void KimThreadPool::participate(Job& job, size_t participant) {
+    size_t morsel;
+    size_t count = job.ranges.size();
+    while (true) {
+        if (job.ranges[participant].popFront(morsel)) {
+            (*job.task)(participant, morsel);
+            continue;
+        }
+        // Own range drained: steal from the back of the next non-empty one
+        bool stolen = false;
+        for (size_t i = 1; i < count && !stolen; ++i) {
+            stolen = job.ranges[(participant + i) % count].popBack(morsel);
+        }
+        if (!stolen) {
+            return;
+        }
+        (*job.task)(participant, morsel);
+    }
+}
+
+void KimThreadPool::run(size_t morsels, size_t parallelism, const std::function<void(size_t, size_t)>& task) {
+    if (parallelism == 0 || parallelism > size()) {
+        parallelism = size();
+    }
+    size_t participants = std::min(parallelism, morsels);
+    if (participants <= 1) {
+        for (size_t morsel = 0; morsel < morsels; ++morsel) {
+            task(0, morsel);
+        }
+        return;
+    }
+
+    auto job = std::make_shared<Job>(participants);
+    job->task = &task;
+    for (size_t p = 0; p < participants; ++p) {
+        job->ranges[p].begin = morsels * p / participants;
+        job->ranges[p].end = morsels * (p + 1) / participants;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t p = 1; p < participants; ++p) {
+            tickets.push_back(job);
+        }
+    }
+    wake.notify_all();
+
+    participate(*job, 0);
+
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->closed = true;
+    job->done.wait(lock, [&] { return job->finished == job->started; });
+}
+
+KimThreadPool& kimThreadPool() {
+    static KimThreadPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    return pool;
+}
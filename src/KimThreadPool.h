@@ -0,0 +1,53 @@
+//
+// Worker threads shared by the parallel query paths.
+//
+
+#ifndef KIMDB_KIMTHREADPOOL_H
+#define KIMDB_KIMTHREADPOOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs morsel-driven jobs: the morsels of a job are dealt out as contiguous
+// ranges, one per participating thread, and a thread that runs out of work
+// steals from the far end of another's range. The calling thread always takes
+// part, so a job finishes even when every worker is busy elsewhere.
+class KimThreadPool {
+public:
+    explicit KimThreadPool(size_t workers);
+    ~KimThreadPool();
+    KimThreadPool(const KimThreadPool&) = delete;
+    KimThreadPool& operator=(const KimThreadPool&) = delete;
+
+    // Threads available to one job, the caller included.
+    size_t size() const { return threads.size() + 1; }
+
+    // Calls task(participant, morsel) once for every morsel in [0, morsels)
+    // on at most `parallelism` threads (0 for all of them) and returns when
+    // all calls are done. Participant ids are dense from 0, so they can index
+    // per-thread buffers.
+    void run(size_t morsels, size_t parallelism, const std::function<void(size_t, size_t)>& task);
+
+private:
+    struct Job;
+
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::shared_ptr<Job>> tickets; // one per helper a job asked for
+    bool stopping = false;
+
+    void workerLoop();
+    static void participate(Job& job, size_t participant);
+};
+
+// Process-wide pool with one thread per hardware thread, created on first use.
+KimThreadPool& kimThreadPool();
+
+#endif //KIMDB_KIMTHREADPOOL_H
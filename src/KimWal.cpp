@@ -0,0 +1,481 @@
+//
+// Write-ahead log of table mutations.
+//
+
+#include "KimWal.h"
+#include "KimSimd.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const char kLogMagic[8] = {'K', 'I', 'M', 'W', 'A', 'L', '0', '1'};
+// payloadSize, checksum, sequence, type
+static constexpr size_t kRecordHeaderSize = 4 + 4 + 8 + 1;
+
+#ifdef _WIN32
+
+static int openFile(const std::string& path) {
+    return _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_BINARY, _S_IREAD | _S_IWRITE);
+}
+
+static bool truncateFile(int fd, uint64_t length) {
+    return _chsize_s(fd, static_cast<__int64>(length)) == 0 && _lseeki64(fd, 0, SEEK_END) >= 0;
+}
+
+static bool writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        int written = _write(fd, data, static_cast<unsigned>(std::min<size_t>(size, 1u << 30)));
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+static bool syncFile(int fd) {
+    return _commit(fd) == 0;
+}
+
+void kimSyncDirectoryOf(const std::string&) {
+    // NTFS journals the rename itself
+}
+
+bool kimRenameOver(const std::string& from, const std::string& to) {
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+}
+
+static void closeFile(int fd) {
+    _close(fd);
+}
+
+#else
+
+static int openFile(const std::string& path) {
+    return ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+}
+
+static bool truncateFile(int fd, uint64_t length) {
+    return ftruncate(fd, static_cast<off_t>(length)) == 0 && lseek(fd, 0, SEEK_END) >= 0;
+}
+
+static bool writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+static bool syncFile(int fd) {
+#if defined(__APPLE__)
+    return fsync(fd) == 0;
+#else
+    return fdatasync(fd) == 0;
+#endif
+}
+
+void kimSyncDirectoryOf(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    int fd = ::open(directory.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        fsync(fd);
+        ::close(fd);
+    }
+}
+
+bool kimRenameOver(const std::string& from, const std::string& to) {
+    return std::rename(from.c_str(), to.c_str()) == 0;
+}
+
+static void closeFile(int fd) {
+    ::close(fd);
+}
+
+#endif
+
+bool kimSyncFile(const std::string& path) {
+    int file = openFile(path);
+    if (file < 0) {
+        return false;
+    }
+    bool ok = syncFile(file);
+    closeFile(file);
+    return ok;
+}
+
+template <typename T>
+static void put(std::vector<char>& out, T value) {
+    const char* bytes = reinterpret_cast<const char*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+static void putString(std::vector<char>& out, const std::string& value) {
+    put(out, static_cast<uint32_t>(value.size()));
+    out.insert(out.end(), value.begin(), value.end());
+}
+
+static void encodeRecord(const KimLogRecord& record, std::vector<char>& out) {
+    size_t start = out.size();
+    out.resize(start + kRecordHeaderSize);
+    switch (record.type) {
+        case KimLogRecordType::AddRow:
+            put(out, static_cast<uint32_t>(record.values.size()));
+            for (const auto& value : record.values) {
+                putString(out, value);
+            }
+            break;
+        case KimLogRecordType::UpdateRow:
+            put(out, record.row);
+            put(out, record.column);
+            putString(out, record.values.empty() ? std::string() : record.values[0]);
+            break;
+        case KimLogRecordType::DeleteRow:
+            put(out, record.row);
+            break;
+        case KimLogRecordType::Compact:
+            put(out, record.row);
+            put(out, static_cast<uint32_t>(record.rows.size()));
+            for (uint64_t row : record.rows) {
+                put(out, row);
+            }
+            break;
+    }
+
+    char* header = out.data() + start;
+    uint32_t payloadSize = static_cast<uint32_t>(out.size() - start - kRecordHeaderSize);
+    auto type = static_cast<uint8_t>(record.type);
+    std::memcpy(header, &payloadSize, 4);
+    std::memcpy(header + 8, &record.sequence, 8);
+    std::memcpy(header + 16, &type, 1);
+    uint32_t checksum = kimCrc32c(header + 8, out.size() - start - 8);
+    std::memcpy(header + 4, &checksum, 4);
+}
+
+// Bounds-checked reader over one record's payload
+namespace {
+struct PayloadReader {
+    const char* data;
+    size_t size;
+    size_t position = 0;
+
+    template <typename T>
+    bool get(T& value) {
+        if (sizeof(T) > size - position) {
+            return false;
+        }
+        std::memcpy(&value, data + position, sizeof(T));
+        position += sizeof(T);
+        return true;
+    }
+
+    bool getString(std::string& value) {
+        uint32_t length;
+        if (!get(length) || length > size - position) {
+            return false;
+        }
+        value.assign(data + position, length);
+        position += length;
+        return true;
+    }
+};
+} // namespace
+
+static bool decodePayload(const char* data, size_t size, KimLogRecord& record) {
+    PayloadReader reader{data, size};
+    record.values.clear();
+    record.rows.clear();
+    switch (record.type) {
+        case KimLogRecordType::AddRow: {
+            uint32_t count;
+            if (!reader.get(count) || count > size / sizeof(uint32_t)) {
+                return false;
+            }
+            record.values.resize(count);
+            for (auto& value : record.values) {
+                if (!reader.getString(value)) {
+                    return false;
+                }
+            }
+            break;
+        }
+        case KimLogRecordType::UpdateRow:
+            record.values.resize(1);
+            if (!reader.get(record.row) || !reader.get(record.column) || !reader.getString(record.values[0])) {
+                return false;
+            }
+            break;
+        case KimLogRecordType::DeleteRow:
+            if (!reader.get(record.row)) {
+                return false;
+            }
+            break;
+        case KimLogRecordType::Compact: {
+            uint32_t count;
+            if (!reader.get(record.row) || !reader.get(count) || count > size / sizeof(uint64_t)) {
+                return false;
+            }
+            record.rows.resize(count);
+            for (auto& row : record.rows) {
+                if (!reader.get(row)) {
+                    return false;
+                }
+            }
+            break;
+        }
+        default:
+            return false;
+    }
+    return reader.position == size;
+}
+
+KimWriteAheadLog::~KimWriteAheadLog() {
+    close();
+}
+
+bool KimWriteAheadLog::open(const std::string& logPath, uint64_t validLength, uint64_t firstSequence,
+                            const KimWalOptions& options) {
+    close();
+    int file = openFile(logPath);
+    if (file < 0) {
+        std::cerr << "Failed to open log file: " << logPath << std::endl;
+        return false;
+    }
+    // Records after a torn or corrupt one are unreachable, so they are cut off
+    // before new ones are appended behind them
+    bool fresh = validLength < sizeof(kLogMagic);
+    if (!truncateFile(file, fresh ? 0 : validLength) ||
+        (fresh && (!writeAll(file, kLogMagic, sizeof(kLogMagic)) || !syncFile(file)))) {
+        std::cerr << "Failed to prepare log file: " << logPath << std::endl;
+        closeFile(file);
+        return false;
+    }
+    if (fresh) {
+        kimSyncDirectoryOf(logPath);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    path = logPath;
+    settings = options;
+    fd = file;
+    buffer.clear();
+    nextSequence = firstSequence;
+    appended = durable = firstSequence - 1;
+    fileBytes = fresh ? sizeof(kLogMagic) : validLength;
+    failed = false;
+    stopping = false;
+    if (settings.sync == KimLogSync::Grouped) {
+        flusher = std::thread([this] { flusherLoop(); });
+    }
+    return true;
+}
+
+void KimWriteAheadLog::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    flusherWake.notify_all();
+    if (flusher.joinable()) {
+        flusher.join();
+    }
+    if (isOpen()) {
+        sync();
+        std::lock_guard<std::mutex> lock(mutex);
+        closeFile(fd);
+        fd = -1;
+    }
+}
+
+bool KimWriteAheadLog::isOpen() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return fd >= 0;
+}
+
+uint64_t KimWriteAheadLog::append(KimLogRecord& record) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (failed) {
+        return 0;
+    }
+    record.sequence = nextSequence++;
+    size_t before = buffer.size();
+    encodeRecord(record, buffer);
+    fileBytes += buffer.size() - before;
+    appended = record.sequence;
+    if (settings.sync == KimLogSync::Off && buffer.size() >= settings.bufferBytes && !syncing && fd >= 0) {
+        writeOut(lock, false);
+    }
+    return record.sequence;
+}
+
+// Writes the whole buffer and optionally syncs it, with the lock released so
+// appends carry on meanwhile. Callers make sure no other thread is syncing.
+bool KimWriteAheadLog::writeOut(std::unique_lock<std::mutex>& lock, bool fsync) {
+    syncing = true;
+    std::vector<char> data;
+    data.swap(buffer);
+    uint64_t upTo = appended;
+    int file = fd;
+    lock.unlock();
+    bool ok = writeAll(file, data.data(), data.size()) && (!fsync || syncFile(file));
+    lock.lock();
+    syncing = false;
+    if (!ok) {
+        if (!failed) {
+            std::cerr << "Failed to write log file: " << path << std::endl;
+        }
+        failed = true;
+    } else if (fsync) {
+        durable = std::max(durable, upTo);
+    }
+    synced.notify_all();
+    return ok;
+}
+
+bool KimWriteAheadLog::sync(uint64_t sequence) {
+    std::unique_lock<std::mutex> lock(mutex);
+    sequence = std::min(sequence, appended);
+    // Group commit: one thread writes and syncs everything buffered so far
+    // while the others wait, and all of them are covered by that one fsync
+    while (durable < sequence && !failed && fd >= 0) {
+        if (syncing) {
+            synced.wait(lock);
+        } else {
+            writeOut(lock, true);
+        }
+    }
+    return durable >= sequence;
+}
+
+void KimWriteAheadLog::flusherLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping) {
+        flusherWake.wait_for(lock, settings.groupWindow);
+        if (durable < appended && !syncing && !failed) {
+            writeOut(lock, true);
+        }
+    }
+}
+
+bool KimWriteAheadLog::rotate(const std::string& retiredPath) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (fd < 0) {
+        return false;
+    }
+    while (durable < appended && !failed) {
+        if (syncing) {
+            synced.wait(lock);
+        } else {
+            writeOut(lock, true);
+        }
+    }
+    while (syncing) {
+        synced.wait(lock);
+    }
+    if (failed) {
+        return false;
+    }
+
+    // Appends wait on the lock until the new file is in place
+    closeFile(fd);
+    fd = -1;
+    std::remove(retiredPath.c_str());
+    bool renamed = std::rename(path.c_str(), retiredPath.c_str()) == 0;
+    int file = openFile(path);
+    if (!renamed || file < 0 || !truncateFile(file, 0) || !writeAll(file, kLogMagic, sizeof(kLogMagic)) ||
+        !syncFile(file)) {
+        std::cerr << "Failed to rotate log file: " << path << std::endl;
+        if (file >= 0) {
+            closeFile(file);
+        }
+        failed = true;
+        return false;
+    }
+    kimSyncDirectoryOf(path);
+    fd = file;
+    fileBytes = sizeof(kLogMagic);
+    return true;
+}
+
+bool KimWriteAheadLog::hasFailed() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return failed;
+}
+
+uint64_t KimWriteAheadLog::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return fileBytes;
+}
+
+bool KimWriteAheadLog::replay(const std::string& logPath, const std::function<void(const KimLogRecord&)>& apply,
+                              uint64_t& validLength) {
+    validLength = 0;
+    std::ifstream ifs(logPath, std::ios::binary | std::ios::ate);
+    if (!ifs) {
+        return true;
+    }
+    uint64_t fileSize = static_cast<uint64_t>(ifs.tellg());
+    ifs.seekg(0);
+    char magic[sizeof(kLogMagic)];
+    if (fileSize < sizeof(kLogMagic)) {
+        return true; // torn before the header was complete
+    }
+    if (!ifs.read(magic, sizeof(magic)) || std::memcmp(magic, kLogMagic, sizeof(magic)) != 0) {
+        std::cerr << "Not a log file: " << logPath << std::endl;
+        return false;
+    }
+    validLength = sizeof(kLogMagic);
+
+    char header[kRecordHeaderSize];
+    std::vector<char> payload;
+    KimLogRecord record;
+    while (fileSize - validLength >= kRecordHeaderSize && ifs.read(header, sizeof(header))) {
+        uint32_t payloadSize, checksum;
+        uint8_t type;
+        std::memcpy(&payloadSize, header, 4);
+        std::memcpy(&checksum, header + 4, 4);
+        std::memcpy(&record.sequence, header + 8, 8);
+        std::memcpy(&type, header + 16, 1);
+        if (payloadSize > fileSize - validLength - kRecordHeaderSize) {
+            break;
+        }
+        payload.resize(payloadSize);
+        if (!ifs.read(payload.data(), payloadSize) ||
+            kimCrc32c(payload.data(), payloadSize, kimCrc32c(header + 8, kRecordHeaderSize - 8)) != checksum) {
+            break;
+        }
+        record.type = static_cast<KimLogRecordType>(type);
+        if (!decodePayload(payload.data(), payloadSize, record)) {
+            break;
+        }
+        apply(record);
+        validLength += kRecordHeaderSize + payloadSize;
+    }
+    return true;
+}
@@ -0,0 +1,129 @@
+//
+// Write-ahead log of table mutations.
+//
+
+#ifndef KIMDB_KIMWAL_H
+#define KIMDB_KIMWAL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class KimLogRecordType : uint8_t {
+    AddRow = 1,
+    UpdateRow = 2,
+    DeleteRow = 3,
+    Compact = 4,
+};
+
+// One mutation. `row` and `column` are used by updates and deletes, `values`
+// holds the cells of an added row or the new value of an update. A compaction
+// dropped the deleted rows below `row` except those in `rows`.
+struct KimLogRecord {
+    KimLogRecordType type = KimLogRecordType::AddRow;
+    uint64_t sequence = 0;
+    uint64_t row = 0;
+    uint32_t column = 0;
+    std::vector<std::string> values;
+    std::vector<uint64_t> rows;
+};
+
+// When appended records reach the disk:
+//   EveryCommit  every mutation waits for an fsync; concurrent writers share one
+//   Grouped      a flusher thread syncs once per window, so a crash loses at
+//                most the last window of mutations
+//   Off          records are written when the buffer fills and synced only on
+//                rotate and close
+enum class KimLogSync {
+    EveryCommit,
+    Grouped,
+    Off,
+};
+
+struct KimWalOptions {
+    KimLogSync sync = KimLogSync::EveryCommit;
+    std::chrono::milliseconds groupWindow{5};
+    size_t bufferBytes = 1 << 20; // Off: buffered bytes that trigger a write
+    size_t checkpointBytes = 64 << 20; // log size that starts a background checkpoint, 0 never
+};
+
+// Append-only file of checksummed records:
+//
+//   "KIMWAL01", then per record
+//   uint32 payloadSize, uint32 crc32c(sequence, type, payload), uint64 sequence,
+//   uint8 type, payload
+//
+// Payloads: AddRow uint32 count then count × (uint32 length, bytes); UpdateRow
+// uint64 row, uint32 column, uint32 length, bytes; DeleteRow uint64 row;
+// Compact uint64 row, uint32 count, uint64 rows[count].
+// Appends go to a memory buffer; sync() writes the buffer with one write and
+// one fsync for every record appended so far.
+class KimWriteAheadLog {
+public:
+    KimWriteAheadLog() = default;
+    ~KimWriteAheadLog();
+    KimWriteAheadLog(const KimWriteAheadLog&) = delete;
+    KimWriteAheadLog& operator=(const KimWriteAheadLog&) = delete;
+
+    // Opens path for appending after its first validLength bytes, dropping
+    // anything past them (a torn tail), and numbers new records from
+    // nextSequence. A missing or empty file is started afresh.
+    bool open(const std::string& path, uint64_t validLength, uint64_t nextSequence, const KimWalOptions& options);
+    // Syncs everything appended and closes the file
+    void close();
+    bool isOpen() const;
+
+    // Buffers a record and returns its sequence number, or 0 once the log has failed
+    uint64_t append(KimLogRecord& record);
+    // Returns once every record up to `sequence` is on disk
+    bool sync(uint64_t sequence = UINT64_MAX);
+    // Syncs, renames the file to retiredPath and continues in a new empty file
+    bool rotate(const std::string& retiredPath);
+    // Bytes in the current file, buffered records included
+    uint64_t size() const;
+    const KimWalOptions& options() const { return settings; }
+    // A write, sync or rotation failed; nothing more is appended
+    bool hasFailed() const;
+
+    // Calls apply for each intact record of path in order, stopping at the
+    // first truncated or corrupt one. Returns false only when the file exists
+    // but is not a log; validLength is where the intact records end.
+    static bool replay(const std::string& path, const std::function<void(const KimLogRecord&)>& apply,
+                       uint64_t& validLength);
+
+private:
+    std::string path;
+    KimWalOptions settings;
+    int fd = -1;
+    mutable std::mutex mutex;
+    std::condition_variable synced;
+    std::vector<char> buffer; // encoded records not yet written
+    uint64_t nextSequence = 1;
+    uint64_t appended = 0; // last sequence in buffer or file
+    uint64_t durable = 0; // last sequence known to be on disk
+    uint64_t fileBytes = 0;
+    bool syncing = false; // a thread is writing and syncing for the group
+    bool failed = false;
+
+    std::thread flusher; // Grouped: syncs once per window
+    std::condition_variable flusherWake;
+    bool stopping = false;
+
+    bool writeOut(std::unique_lock<std::mutex>& lock, bool fsync);
+    void flusherLoop();
+};
+
+// Flushes a written file to disk
+bool kimSyncFile(const std::string& path);
+// Makes renames and removals in the directory holding path durable
+void kimSyncDirectoryOf(const std::string& path);
+// Renames from to `to`, atomically replacing a file already there; on
+// failure both are left as they were
+bool kimRenameOver(const std::string& from, const std::string& to);
+
+#endif //KIMDB_KIMWAL_H
@@ -0,0 +1,263 @@
+//
+// kimbench: times the engine's main paths on synthetic customers/orders
+// tables and prints the results as JSON.
+//
+#include "KimFileHead.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+struct KimBenchOptions {
+    size_t customers = 100000;
+    size_t ordersPerCustomer = 10;
+    size_t lookups = 100000;
+    size_t scans = 50;
+    size_t updates = 100000;
+    size_t deletes = 10000;
+    size_t joins = 20;
+    size_t repeats = 3; // of the file writes and loads
+    uint64_t seed = 42;
+    std::string directory = std::filesystem::temp_directory_path().string();
+};
+
+// Latencies of one operation, in nanoseconds
+struct KimBenchResult {
+    std::string name;
+    std::vector<double> latencies;
+    double seconds = 0;
+    size_t rows = 0; // rows produced or touched, where that means something
+};
+
+static size_t peakResidentBytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.PeakWorkingSetSize : 0;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss); // bytes
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024; // kilobytes
+#endif
+#endif
+}
+
+// Runs op(i) for i in [0, count) and records the latency of each call
+static KimBenchResult measure(const std::string& name, size_t count, const std::function<size_t(size_t)>& op) {
+    KimBenchResult result;
+    result.name = name;
+    result.latencies.reserve(count);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; ++i) {
+        auto before = std::chrono::steady_clock::now();
+        result.rows += op(i);
+        result.latencies.push_back(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - before).count());
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+static ColumnHeader column(const char* name, KimDataType type, uint16_t size) {
+    ColumnHeader header{};
+    std::strncpy(header.ColumnName, name, sizeof(header.ColumnName) - 1);
+    header.DataType = static_cast<uint8_t>(type);
+    header.DataSize = size;
+    return header;
+}
+
+// The customers and orders tables of example/Customers3.0.txt, linked on customer_id
+static void createCustomers(KimTable& customers) {
+    std::vector<ColumnHeader> headers = {
+            column("customer_id", KimDataType::Int, 4), column("name", KimDataType::String, 64),
+            column("email", KimDataType::String, 128), column("phone", KimDataType::String, 32),
+            column("unicol", KimDataType::Int, 4), column("unikey", KimDataType::Int, 4)};
+    headers[0].IsLinkKey = true;
+    headers[2].IsIndexed = true;
+    headers[4].IsIndexed = true;
+    headers[4].IsUnique = true;
+    headers[5].IsPrimaryKey = true;
+    customers.createTable(headers);
+    customers.setTableName("customers");
+}
+
+static void createOrders(KimTable& orders) {
+    std::vector<ColumnHeader> headers = {
+            column("order_id", KimDataType::Int, 4), column("customer_id", KimDataType::Int, 4),
+            column("product_id", KimDataType::Int, 4), column("quantity", KimDataType::Int, 4),
+            column("unicol", KimDataType::Int, 4)};
+    headers[0].IsIndexed = true;
+    headers[1].IsLinkKey = true;
+    headers[4].IsIndexed = true;
+    headers[4].IsUnique = true;
+    orders.createTable(headers);
+    orders.setTableName("orders");
+    orders.linkKeys.push_back(KimLinkKey{1, 1});
+}
+
+static void generate(const KimBenchOptions& options, KimTable& customers, KimTable& orders,
+                     std::vector<KimBenchResult>& results) {
+    std::mt19937_64 random(options.seed);
+    createCustomers(customers);
+    createOrders(orders);
+    results.push_back(measure("addRow.customers", options.customers, [&](size_t i) {
+        std::string id = std::to_string(i);
+        customers.addRow({id, "customer " + id, "user" + id + "@example.com",
+                          "555-" + std::to_string(1000000 + random() % 9000000), id, std::to_string(i * 7 + 3)});
+        return 1;
+    }));
+    size_t numOrders = options.customers * options.ordersPerCustomer;
+    results.push_back(measure("addRow.orders", numOrders, [&](size_t i) {
+        orders.addRow({std::to_string(i), std::to_string(random() % options.customers),
+                       std::to_string(random() % 10000), std::to_string(1 + random() % 100), std::to_string(i)});
+        return 1;
+    }));
+}
+
+static std::string formatJson(const KimBenchOptions& options, const std::vector<KimBenchResult>& results) {
+    std::ostringstream out;
+    out << "{\n  \"config\": {\"customers\": " << options.customers
+        << ", \"ordersPerCustomer\": " << options.ordersPerCustomer << ", \"seed\": " << options.seed
+        << ", \"hardwareThreads\": " << std::thread::hardware_concurrency() << "},\n  \"results\": [\n";
+    for (size_t r = 0; r < results.size(); ++r) {
+        const KimBenchResult& result = results[r];
+        std::vector<double> sorted = result.latencies;
+        std::sort(sorted.begin(), sorted.end());
+        auto percentile = [&](double p) {
+            return sorted.empty() ? 0.0 : sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()))] / 1000;
+        };
+        double total = 0;
+        for (double latency : sorted) {
+            total += latency;
+        }
+        size_t ops = sorted.size();
+        out << "    {\"name\": \"" << result.name << "\", \"ops\": " << ops << ", \"rows\": " << result.rows
+            << ", \"seconds\": " << result.seconds
+            << ", \"opsPerSecond\": " << (result.seconds > 0 ? ops / result.seconds : 0)
+            << ", \"rowsPerSecond\": " << (result.seconds > 0 ? result.rows / result.seconds : 0)
+            << ", \"latencyMicros\": {\"mean\": " << (ops ? total / ops / 1000 : 0) << ", \"p50\": " << percentile(0.5)
+            << ", \"p90\": " << percentile(0.9) << ", \"p99\": " << percentile(0.99)
+            << ", \"max\": " << (sorted.empty() ? 0 : sorted.back() / 1000) << "}}"
+            << (r + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ],\n  \"peakRssBytes\": " << peakResidentBytes() << "\n}\n";
+    return out.str();
+}
+
+static void usage() {
+    std::cerr << "Usage: kimbench [--customers=N] [--orders-per-customer=N] [--lookups=N] [--scans=N]\n"
+                 "                [--updates=N] [--deletes=N] [--joins=N] [--repeats=N] [--seed=N] [--dir=PATH]\n"
+                 "Prints throughput, latency percentiles and peak RSS as JSON.\n";
+}
+
+int main(int argc, char** argv) {
+    KimBenchOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        size_t equals = arg.find('=');
+        std::string name = arg.substr(0, equals);
+        std::string value = equals == std::string::npos ? std::string() : arg.substr(equals + 1);
+        size_t number = std::strtoull(value.c_str(), nullptr, 10);
+        if (name == "--customers") {
+            options.customers = std::max<size_t>(1, number);
+        } else if (name == "--orders-per-customer") {
+            options.ordersPerCustomer = number;
+        } else if (name == "--lookups") {
+            options.lookups = number;
+        } else if (name == "--scans") {
+            options.scans = number;
+        } else if (name == "--updates") {
+            options.updates = number;
+        } else if (name == "--deletes") {
+            options.deletes = number;
+        } else if (name == "--joins") {
+            options.joins = number;
+        } else if (name == "--repeats") {
+            options.repeats = std::max<size_t>(1, number);
+        } else if (name == "--seed") {
+            options.seed = number;
+        } else if (name == "--dir" && !value.empty()) {
+            options.directory = value;
+        } else {
+            usage();
+            return 2;
+        }
+    }
+
+    std::vector<KimBenchResult> results;
+    KimTable customers;
+    KimTable orders;
+    generate(options, customers, orders, results);
+
+    // Files: written and read back whole
+    std::string customersFile = (std::filesystem::path(options.directory) / "kimbench_customers.kim").string();
+    std::string ordersFile = (std::filesystem::path(options.directory) / "kimbench_orders.kim").string();
+    results.push_back(measure("writeToFile", options.repeats * 2, [&](size_t i) {
+        KimTable& table = i % 2 ? orders : customers;
+        table.writeFileImage(i % 2 ? ordersFile : customersFile, false);
+        return table.rowCount();
+    }));
+    results.push_back(measure("loadFromFile", options.repeats * 2, [&](size_t i) {
+        KimTable& table = i % 2 ? orders : customers;
+        table.loadFromFile(i % 2 ? ordersFile : customersFile);
+        return table.rowCount();
+    }));
+    results.push_back(measure("openMapped", options.repeats * 2, [&](size_t i) {
+        KimTable mapped;
+        mapped.openMapped(i % 2 ? ordersFile : customersFile);
+        return mapped.rowCount();
+    }));
+
+    std::mt19937_64 random(options.seed + 1);
+    KimPreparedStatement lookup = customers.prepare("SELECT * FROM customers WHERE unikey = ?");
+    results.push_back(measure("pointLookup", options.lookups, [&](size_t) {
+        return lookup.execute(static_cast<int64_t>(random() % options.customers * 7 + 3)).size();
+    }));
+    KimPreparedStatement scan = orders.prepare("SELECT * FROM orders WHERE quantity = ? AND product_id < ?");
+    results.push_back(measure("filteredScan", options.scans, [&](size_t) {
+        return scan.execute(static_cast<int64_t>(1 + random() % 100), static_cast<int64_t>(random() % 10000)).size();
+    }));
+    results.push_back(measure("join", options.joins, [&](size_t) {
+        size_t first = random() % options.customers;
+        std::string query = "SELECT * FROM customers JOIN orders WHERE customers.customer_id >= " +
+                            std::to_string(first) + " AND customers.customer_id < " + std::to_string(first + 1000);
+        return customers.selectRowsWithSQL(customers, orders, query).size();
+    }));
+    // With no orders there is nothing to update or delete. Deletes go to
+    // distinct live rows, picked beforehand, so each call deletes one.
+    if (orders.rowCount() > 0) {
+        results.push_back(measure("updateRow", options.updates, [&](size_t) {
+            return orders.updateRow(orders, random() % orders.rowCount(), 3, std::to_string(1 + random() % 100)) ? 1 : 0;
+        }));
+        std::vector<size_t> liveRows;
+        for (size_t row = 0; row < orders.rowCount(); ++row) {
+            if (!orders.isDeleted(row)) {
+                liveRows.push_back(row);
+            }
+        }
+        std::shuffle(liveRows.begin(), liveRows.end(), random);
+        liveRows.resize(std::min(options.deletes, liveRows.size()));
+        results.push_back(measure("deleteRow", liveRows.size(), [&](size_t i) {
+            return orders.deleteRow(liveRows[i]) ? 1 : 0;
+        }));
+    }
+
+    std::remove(customersFile.c_str());
+    std::remove(ordersFile.c_str());
+    std::cout << formatJson(options, results);
+    return 0;
+}
@@ -0,0 +1,36 @@
+//
+// kimconvert: rewrites .kim table files in the current format, or checks them.
+//
+#include "KimFileHead.h"
+
+#include <iostream>
+
+static void usage() {
+    std::cerr << "Usage: kimconvert <source.kim> [target.kim]\n"
+                 "       kimconvert --verify <file.kim>...\n"
+                 "Rewrites a table file of an earlier version in the current one, in place when no\n"
+                 "target is given. --verify checks files against their checksums instead.\n";
+}
+
+int main(int argc, char** argv) {
+    if (argc >= 3 && std::string(argv[1]) == "--verify") {
+        int failed = 0;
+        for (int i = 2; i < argc; ++i) {
+            bool ok = kimVerifyFile(argv[i]);
+            std::cout << argv[i] << (ok ? ": ok" : ": FAILED") << std::endl;
+            failed += ok ? 0 : 1;
+        }
+        return failed == 0 ? 0 : 1;
+    }
+    if (argc < 2 || argc > 3 || argv[1][0] == '-') {
+        usage();
+        return 2;
+    }
+    std::string source = argv[1];
+    std::string target = argc == 3 ? argv[2] : source;
+    if (!kimConvertFile(source, target)) {
+        return 1;
+    }
+    std::cout << "Converted " << source << " to " << target << std::endl;
+    return 0;
+}
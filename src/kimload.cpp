@@ -0,0 +1,167 @@
+//
+// kimload: appends a CSV or TSV file to a .kim table.
+//
+#include "KimFileHead.h"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+static void usage() {
+    std::cerr << "Usage: kimload [options] <input.csv|input.tsv> <table.kim>\n"
+                 "  --header            skip the first record; a new table takes its column names from it\n"
+                 "  --delimiter=C       field delimiter, or 'tab' (default: tab for .tsv/.tab, else comma)\n"
+                 "  --threads=N         parsing threads (default: every core)\n"
+                 "  --columns=SPEC      columns of a new table: name:type,... where type is string,\n"
+                 "                      int, int32, float, float32, dict or charN (default: string)\n"
+                 "  --table=NAME        name of a new table (default: the input file name)\n"
+                 "Rows are appended when table.kim exists; otherwise it is created.\n";
+}
+
+// Parses one name[:type] column of --columns
+static bool parseColumn(const std::string& spec, ColumnHeader& column) {
+    std::memset(&column, 0, sizeof(column));
+    size_t colon = spec.find(':');
+    std::string name = spec.substr(0, colon);
+    std::string type = colon == std::string::npos ? "string" : spec.substr(colon + 1);
+    if (name.empty() || name.size() >= sizeof(column.ColumnName)) {
+        return false;
+    }
+    std::strncpy(column.ColumnName, name.c_str(), sizeof(column.ColumnName) - 1);
+    if (type == "string") {
+        column.DataType = static_cast<uint8_t>(KimDataType::String);
+    } else if (type == "int" || type == "int32") {
+        column.DataType = static_cast<uint8_t>(KimDataType::Int);
+        column.DataSize = type == "int" ? 8 : 4;
+    } else if (type == "float" || type == "float32") {
+        column.DataType = static_cast<uint8_t>(KimDataType::Float);
+        column.DataSize = type == "float" ? 8 : 4;
+    } else if (type == "dict") {
+        column.DataType = static_cast<uint8_t>(KimDataType::Dictionary);
+    } else if (type.compare(0, 4, "char") == 0 && type.size() > 4 &&
+               type.find_first_not_of("0123456789", 4) == std::string::npos && std::stoul(type.substr(4)) <= UINT16_MAX) {
+        column.DataType = static_cast<uint8_t>(KimDataType::FixedString);
+        column.DataSize = static_cast<uint16_t>(std::stoul(type.substr(4)));
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Column names from the header record, with surrounding quotes removed
+static std::vector<std::string> headerNames(const std::string& inputFile, char delimiter) {
+    std::ifstream ifs(inputFile, std::ios::binary);
+    std::string line;
+    std::getline(ifs, line);
+    if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+    }
+    if (line.compare(0, 3, "\xEF\xBB\xBF") == 0) {
+        line.erase(0, 3);
+    }
+    std::vector<std::string> names;
+    std::stringstream fields(line);
+    std::string name;
+    while (std::getline(fields, name, delimiter)) {
+        if (name.size() >= 2 && name.front() == '"' && name.back() == '"') {
+            name = name.substr(1, name.size() - 2);
+        }
+        names.push_back(name);
+    }
+    return names;
+}
+
+int main(int argc, char** argv) {
+    KimLoadOptions options;
+    std::string columnSpec;
+    std::string tableName;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--header") {
+            options.header = true;
+        } else if (arg.compare(0, 12, "--delimiter=") == 0) {
+            std::string value = arg.substr(12);
+            if (value != "tab" && value.size() != 1) {
+                usage();
+                return 2;
+            }
+            options.delimiter = value == "tab" ? '\t' : value[0];
+        } else if (arg.compare(0, 10, "--threads=") == 0) {
+            options.parallelism = std::strtoul(arg.c_str() + 10, nullptr, 10);
+        } else if (arg.compare(0, 10, "--columns=") == 0) {
+            columnSpec = arg.substr(10);
+        } else if (arg.compare(0, 8, "--table=") == 0) {
+            tableName = arg.substr(8);
+        } else if (arg.compare(0, 2, "--") == 0) {
+            usage();
+            return 2;
+        } else {
+            files.push_back(arg);
+        }
+    }
+    if (files.size() != 2) {
+        usage();
+        return 2;
+    }
+    const std::string& inputFile = files[0];
+    const std::string& tableFile = files[1];
+
+    KimTable table;
+    if (std::ifstream(tableFile, std::ios::binary)) {
+        table.loadFromFile(tableFile);
+        if (table.columnHeaders.empty()) {
+            return 1;
+        }
+    } else {
+        std::vector<ColumnHeader> headers;
+        if (!columnSpec.empty()) {
+            std::stringstream specs(columnSpec);
+            std::string spec;
+            while (std::getline(specs, spec, ',')) {
+                headers.emplace_back();
+                if (!parseColumn(spec, headers.back())) {
+                    std::cerr << "Invalid column: " << spec << std::endl;
+                    return 2;
+                }
+            }
+        } else if (options.header) {
+            char delimiter = options.delimiter;
+            if (delimiter == 0) {
+                bool tabs = inputFile.size() > 4 && (inputFile.compare(inputFile.size() - 4, 4, ".tsv") == 0 ||
+                                                     inputFile.compare(inputFile.size() - 4, 4, ".tab") == 0);
+                delimiter = tabs ? '\t' : ',';
+            }
+            for (const auto& name : headerNames(inputFile, delimiter)) {
+                headers.emplace_back();
+                if (!parseColumn(name, headers.back())) {
+                    std::cerr << "Invalid column name: " << name << std::endl;
+                    return 2;
+                }
+            }
+        }
+        if (headers.empty()) {
+            std::cerr << "A new table needs --columns or --header" << std::endl;
+            return 2;
+        }
+        table.createTable(headers);
+        if (tableName.empty()) {
+            size_t slash = inputFile.find_last_of("/\\");
+            tableName = inputFile.substr(slash == std::string::npos ? 0 : slash + 1);
+            tableName = tableName.substr(0, tableName.find('.'));
+        }
+        table.setTableName(tableName);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    size_t rows = table.loadDelimited(inputFile, options);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!table.writeFileImage(tableFile, true)) {
+        std::cerr << "Failed to write file: " << tableFile << std::endl;
+        return 1;
+    }
+    std::cout << "Loaded " << rows << " rows in " << seconds << " s ("
+              << static_cast<uint64_t>(seconds > 0 ? rows / seconds : 0) << " rows/s)" << std::endl;
+    return 0;
+}
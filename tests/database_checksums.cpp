@@ -0,0 +1,92 @@
+//
+// A table of a version 6 database whose image has a flipped byte is refused
+// when it is first used, mapped or copied; the other tables still load.
+// kimVerifyFile passes the intact database and fails the flipped one.
+//
+#include "KimDatabase.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+static const char* kFile = "database_checksums.kim";
+static const char* kFlipped = "database_checksums_flipped.kim";
+
+static std::unique_ptr<KimTable> buildTable(const std::string& name) {
+    auto table = std::make_unique<KimTable>();
+    table->createTable(std::vector<std::string>{"name"});
+    table->setTableName(name);
+    for (int i = 0; i < 100; ++i) {
+        table->addRow({name + " " + std::to_string(i)});
+    }
+    return table;
+}
+
+int main() {
+    {
+        KimDatabase database;
+        database.addTable(buildTable("first"));
+        database.addTable(buildTable("second"));
+        if (!database.writeToFile(kFile)) {
+            std::cerr << "writeToFile failed" << std::endl;
+            return 1;
+        }
+    }
+
+    // Flip the last byte of the second image, which is column data
+    std::ifstream ifs(kFile, std::ios::binary);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    ifs.close();
+    KimDirectoryTrailer trailer{};
+    std::memcpy(&trailer, bytes.data() + bytes.size() - sizeof(trailer), sizeof(trailer));
+    KimTableEntry second{};
+    std::memcpy(&second, bytes.data() + trailer.DirectoryOffset + sizeof(KimTableEntry), sizeof(second));
+    bytes[second.Offset + second.Size - 1] ^= 0x10;
+    {
+        std::ofstream ofs(kFlipped, std::ios::binary | std::ios::trunc);
+        ofs.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    }
+
+    bool ok = true;
+    if (!kimVerifyFile(kFile)) {
+        std::cerr << "the intact database failed verification" << std::endl;
+        ok = false;
+    }
+    std::cerr.setstate(std::ios::failbit);
+    bool verified = kimVerifyFile(kFlipped);
+    std::cerr.clear();
+    if (verified) {
+        std::cerr << "the flipped database passed verification" << std::endl;
+        ok = false;
+    }
+    for (bool mapTables : {false, true}) {
+        const char* mode = mapTables ? "mapped" : "copied";
+        KimDatabase intact;
+        if (!intact.open(kFile, mapTables) || !intact.table("first") || !intact.table("second")) {
+            std::cerr << mode << ": the intact database does not load" << std::endl;
+            ok = false;
+        }
+        KimDatabase flipped;
+        if (!flipped.open(kFlipped, mapTables)) {
+            std::cerr << mode << ": the directory of the flipped database was refused" << std::endl;
+            ok = false;
+            continue;
+        }
+        KimTable* first = flipped.table("first");
+        if (!first || first->rowCount() != 100) {
+            std::cerr << mode << ": the intact table was refused" << std::endl;
+            ok = false;
+        }
+        std::cerr.setstate(std::ios::failbit);
+        bool refused = flipped.table("second") == nullptr;
+        std::cerr.clear();
+        if (!refused) {
+            std::cerr << mode << ": the flipped table loaded" << std::endl;
+            ok = false;
+        }
+    }
+    std::remove(kFile);
+    std::remove(kFlipped);
+    return ok ? 0 : 1;
+}
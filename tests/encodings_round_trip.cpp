@@ -0,0 +1,121 @@
+//
+// Every block encoding answers the same queries whether the file is loaded,
+// mapped or paged.
+//
+#include "KimFileHead.h"
+
+#include <cstdio>
+#include <iostream>
+
+static const char* kFile = "encodings_round_trip.kim";
+static const size_t kRows = 10000; // two full blocks and a partial one
+
+static uint64_t mix(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+struct EncodedColumn {
+    const char* name;
+    KimBlockEncoding encoding; // what the data is shaped to be stored with
+    std::string (*value)(size_t row);
+};
+
+static const EncodedColumn kColumns[] = {
+        // Random integers would be stored as Delta, one value shorter, so floats
+        {"plain", KimBlockEncoding::Plain, [](size_t row) { return std::to_string(double(mix(row) % 1000000) / 8); }},
+        {"rle", KimBlockEncoding::Rle, [](size_t row) { return std::to_string(int64_t(mix(row / 512))); }},
+        {"fref", KimBlockEncoding::FrameOfReference,
+         [](size_t row) { return std::to_string(1000000000000ll + int64_t(mix(row) % 1000)); }},
+        {"delta", KimBlockEncoding::Delta, [](size_t row) { return std::to_string(1000000000000ll + 7 * int64_t(row)); }},
+        {"lz", KimBlockEncoding::Lz,
+         [](size_t row) { return "customer " + std::to_string(row % 50) + " lives on the long main street of town"; }},
+};
+
+static KimTable buildTable() {
+    std::vector<ColumnHeader> headers;
+    for (const auto& column : kColumns) {
+        ColumnHeader columnHeader{};
+        std::strncpy(columnHeader.ColumnName, column.name, sizeof(columnHeader.ColumnName) - 1);
+        if (column.encoding == KimBlockEncoding::Plain) {
+            columnHeader.DataType = static_cast<uint8_t>(KimDataType::Float);
+            columnHeader.DataSize = 8;
+        } else if (column.encoding != KimBlockEncoding::Lz) {
+            columnHeader.DataType = static_cast<uint8_t>(KimDataType::Int);
+            columnHeader.DataSize = 8;
+        }
+        headers.push_back(columnHeader);
+    }
+    KimTable table;
+    table.createTable(headers);
+    table.setTableName("encoded");
+    for (size_t row = 0; row < kRows; ++row) {
+        std::vector<std::string> cells;
+        for (const auto& column : kColumns) {
+            cells.push_back(column.value(row));
+        }
+        table.addRow(cells);
+    }
+    return table;
+}
+
+static std::vector<std::string> queries() {
+    std::vector<std::string> sql = {"SELECT * FROM encoded"};
+    for (const auto& column : kColumns) {
+        std::string name = column.name;
+        sql.push_back("SELECT * FROM encoded WHERE " + name + " = '" + column.value(5000) + "'");
+        sql.push_back("SELECT * FROM encoded WHERE " + name + " >= '" + column.value(4125) + "'");
+        if (column.encoding != KimBlockEncoding::Lz) {
+            std::string low = column.value(100), high = column.value(9000);
+            if (std::stod(low) > std::stod(high)) {
+                std::swap(low, high);
+            }
+            sql.push_back("SELECT * FROM encoded WHERE " + name + " BETWEEN " + low + " AND " + high);
+        }
+    }
+    return sql;
+}
+
+int main() {
+    KimTable original = buildTable();
+    original.writeToFile(kFile);
+
+    bool ok = true;
+    KimTable mapped;
+    mapped.openMapped(kFile);
+    for (size_t c = 0; c < std::size(kColumns); ++c) {
+        // Plain blocks are mapped as they are, without a block header
+        bool stored = c < mapped.columns.size() && !mapped.columns[c].blocks.empty();
+        if (stored) {
+            const KimColumnBlock& block = *mapped.columns[c].blocks[0];
+            auto encoding = block.isEncoded() ? static_cast<KimBlockEncoding>(block.header.Encoding)
+                                              : KimBlockEncoding::Plain;
+            stored = encoding == kColumns[c].encoding;
+        }
+        if (!stored) {
+            std::cerr << "column " << kColumns[c].name << " is not stored with its encoding" << std::endl;
+            ok = false;
+        }
+    }
+
+    KimTable loaded;
+    loaded.loadFromFile(kFile);
+    KimTable paged;
+    paged.openPaged(kFile);
+    const std::pair<const char*, const KimTable*> opened[] = {{"loaded", &loaded}, {"mapped", &mapped}, {"paged", &paged}};
+    for (const auto& query : queries()) {
+        auto expected = original.selectRowsWithSQL(original, query);
+        for (const auto& [mode, table] : opened) {
+            auto actual = table->selectRowsWithSQL(*table, query);
+            if (actual != expected) {
+                std::cerr << mode << ": " << query << ": " << actual.size() << " rows, expected " << expected.size()
+                          << std::endl;
+                ok = false;
+            }
+        }
+    }
+    std::remove(kFile);
+    return ok ? 0 : 1;
+}
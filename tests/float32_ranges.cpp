@@ -0,0 +1,44 @@
+//
+// Float32 range regression test.
+//
+#include "KimFileHead.h"
+
+#include <iostream>
+
+// Equality and range conditions must agree on a literal a Float32 column
+// cannot hold exactly, on a scan (h) and on a B+tree (g) alike
+static bool checkFloat32Ranges() {
+    std::vector<ColumnHeader> headers(2);
+    for (size_t i = 0; i < headers.size(); ++i) {
+        std::memset(&headers[i], 0, sizeof(ColumnHeader));
+        std::memcpy(headers[i].ColumnName, i == 0 ? "g" : "h", 1);
+        headers[i].DataType = static_cast<uint8_t>(KimDataType::Float);
+        headers[i].DataSize = 4;
+    }
+    headers[0].IsIndexed = true;
+    KimTable floats;
+    floats.createTable(headers);
+    floats.setTableName("floats");
+    for (const char* value : {"0.05", "0.1", "0.2"}) {
+        floats.addRow({value, value});
+    }
+
+    const std::vector<std::pair<std::string, size_t>> expected = {
+            {"= 0.1", 1}, {"<= 0.1", 2}, {">= 0.1", 2}, {"< 0.1", 1}, {"> 0.1", 1}, {"BETWEEN 0.1 AND 0.1", 1}};
+    bool ok = true;
+    for (const char* column : {"g", "h"}) {
+        for (const auto& [condition, count] : expected) {
+            std::string query = std::string("SELECT * FROM floats WHERE ") + column + " " + condition;
+            size_t found = floats.selectRowsWithSQL(floats, query).size();
+            if (found != count) {
+                std::cerr << query << ": expected " << count << " rows, got " << found << std::endl;
+                ok = false;
+            }
+        }
+    }
+    return ok;
+}
+
+int main() {
+    return checkFloat32Ranges() ? 0 : 1;
+}
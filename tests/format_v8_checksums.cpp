@@ -0,0 +1,88 @@
+//
+// A version 8 file with any one byte flipped is rejected by loadFromFile,
+// and one with a flipped header byte by openMapped and openPaged as well.
+//
+#include "KimFileHead.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+static const char* kFile = "format_v8_checksums.kim";
+static const char* kFlipped = "format_v8_checksums_flipped.kim";
+
+static void writeBytes(const char* fileName, const std::vector<char>& bytes) {
+    std::ofstream ofs(fileName, std::ios::binary | std::ios::trunc);
+    ofs.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+}
+
+int main() {
+    std::vector<ColumnHeader> headers(2);
+    for (auto& columnHeader : headers) {
+        std::memset(&columnHeader, 0, sizeof(ColumnHeader));
+    }
+    std::memcpy(headers[0].ColumnName, "id", 2);
+    headers[0].DataType = static_cast<uint8_t>(KimDataType::Int);
+    headers[0].DataSize = 8;
+    headers[0].IsIndexed = true; // adds index sections
+    std::memcpy(headers[1].ColumnName, "name", 4);
+    KimTable table;
+    table.createTable(headers);
+    table.setTableName("checked");
+    for (int i = 0; i < 100; ++i) {
+        table.addRow({std::to_string(i), "name " + std::to_string(i)});
+    }
+    table.writeToFile(kFile);
+
+    std::ifstream ifs(kFile, std::ios::binary);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    ifs.close();
+    KimFileHeaderV8 fileHeader{};
+    if (bytes.size() < sizeof(fileHeader)) {
+        std::cerr << "file too short" << std::endl;
+        return 1;
+    }
+    std::memcpy(&fileHeader, bytes.data(), sizeof(fileHeader));
+    bool ok = fileHeader.FileFormatVersion == kKimFormatChecked;
+    if (!ok) {
+        std::cerr << "writeToFile wrote version " << int(fileHeader.FileFormatVersion) << std::endl;
+    }
+
+    KimTable intact;
+    intact.loadFromFile(kFile);
+    if (intact.rowCount() != 100) {
+        std::cerr << "the intact file does not load" << std::endl;
+        ok = false;
+    }
+
+    // Rejections are expected, so their messages are not shown
+    std::cerr.setstate(std::ios::failbit);
+    size_t undetected = 0;
+    for (size_t i = 0; i < bytes.size(); ++i) {
+        std::vector<char> flipped = bytes;
+        flipped[i] ^= 0x10;
+        writeBytes(kFlipped, flipped);
+        KimTable loaded;
+        loaded.loadFromFile(kFlipped);
+        bool rejected = loaded.columnHeaders.empty();
+        if (i < fileHeader.HeaderSize) {
+            KimTable mapped;
+            mapped.openMapped(kFlipped);
+            KimTable paged;
+            paged.openPaged(kFlipped);
+            rejected = rejected && mapped.columnHeaders.empty() && paged.columnHeaders.empty();
+        }
+        if (!rejected) {
+            ++undetected;
+        }
+    }
+    std::cerr.clear();
+    if (undetected != 0) {
+        std::cerr << undetected << " of " << bytes.size() << " flipped bytes went undetected" << std::endl;
+        ok = false;
+    }
+    std::remove(kFile);
+    std::remove(kFlipped);
+    return ok ? 0 : 1;
+}
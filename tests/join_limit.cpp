@@ -0,0 +1,82 @@
+//
+// A join with a LIMIT returns the first rows of the same join without one,
+// whether the right table is probed through its index or a hash table.
+//
+#include "KimFileHead.h"
+
+#include <iostream>
+
+static const size_t kOrders = 20000; // several morsels on the probe side
+static const size_t kCustomers = 600;
+
+static ColumnHeader column(const char* name, KimDataType type, uint16_t size) {
+    ColumnHeader header{};
+    std::strncpy(header.ColumnName, name, sizeof(header.ColumnName) - 1);
+    header.DataType = static_cast<uint8_t>(type);
+    header.DataSize = size;
+    return header;
+}
+
+// Two customers share every id, and only some ids have orders
+static KimTable customers(bool indexed, KimDataType idType) {
+    std::vector<ColumnHeader> headers = {column("customer_id", idType, 8), column("name", KimDataType::String, 0)};
+    headers[0].IsIndexed = indexed;
+    KimTable table;
+    table.createTable(headers);
+    table.setTableName("customers");
+    for (size_t i = 0; i < kCustomers; ++i) {
+        table.addRow({std::to_string(i % (kCustomers / 2)), "customer " + std::to_string(i)});
+    }
+    return table;
+}
+
+static KimTable orders() {
+    std::vector<ColumnHeader> headers = {column("order_id", KimDataType::Int, 8),
+                                         column("customer_id", KimDataType::Int, 8)};
+    headers[1].IsLinkKey = true;
+    KimTable table;
+    table.createTable(headers);
+    table.setTableName("orders");
+    for (size_t i = 0; i < kOrders; ++i) {
+        table.addRow({std::to_string(i), std::to_string(i * 7 % 1000)});
+    }
+    for (size_t row = 0; row < kOrders; row += 5) {
+        table.deleteRow(row);
+    }
+    return table;
+}
+
+int main() {
+    KimTable left = orders();
+    const std::pair<const char*, KimTable> rights[] = {
+            {"indexed", customers(true, KimDataType::Int)},
+            {"hashed", customers(false, KimDataType::Int)},
+            {"text ids", customers(false, KimDataType::String)},
+    };
+    const char* queries[] = {"SELECT * FROM orders JOIN customers",
+                             "SELECT * FROM orders JOIN customers WHERE orders.order_id >= 9000"};
+    bool ok = true;
+    for (size_t parallelism : {size_t(1), size_t(0)}) {
+        left.parallelism = parallelism;
+        for (const auto& [name, right] : rights) {
+            for (const char* query : queries) {
+                auto all = left.selectRowsWithSQL(left, right, query);
+                if (all.empty()) {
+                    std::cerr << name << ": " << query << " joined nothing" << std::endl;
+                    ok = false;
+                }
+                for (size_t limit : {size_t(0), size_t(1), size_t(7), size_t(5000), all.size() + 10}) {
+                    auto limited = left.selectRowsWithSQL(left, right, query + (" LIMIT " + std::to_string(limit)));
+                    std::vector<std::vector<std::string>> expected(all.begin(),
+                                                                   all.begin() + std::min(limit, all.size()));
+                    if (limited != expected) {
+                        std::cerr << name << ": " << query << " LIMIT " << limit << ": " << limited.size()
+                                  << " rows, expected " << expected.size() << std::endl;
+                        ok = false;
+                    }
+                }
+            }
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,54 @@
+//
+// Fixed-width equality kernels against memcmp, at every SIMD level.
+//
+#include "KimSimd.h"
+
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+static bool checkWidth(size_t width, size_t count, std::mt19937& random) {
+    // Two byte values, so records often share prefixes with the needle
+    std::vector<char> values(count * width);
+    std::vector<char> needle(width);
+    for (auto& byte : needle) {
+        byte = static_cast<char>('a' + random() % 2);
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (random() % 4 == 0) {
+            std::memcpy(values.data() + i * width, needle.data(), width);
+        } else {
+            for (size_t j = 0; j < width; ++j) {
+                values[i * width + j] = static_cast<char>('a' + random() % 2);
+            }
+        }
+    }
+
+    std::vector<uint64_t> selection(kimSelectionWords(count) + 1, ~uint64_t(0));
+    kimSelectEqualBytes(values.data(), count, width, needle.data(), selection.data());
+    for (size_t i = 0; i < selection.size() * 64 - 64; ++i) {
+        bool expected = i < count && std::memcmp(values.data() + i * width, needle.data(), width) == 0;
+        bool selected = (selection[i / 64] >> (i % 64)) & 1;
+        if (selected != expected) {
+            std::cerr << kimSimdLevelName(kimSimdLevel()) << ": width " << width << ", " << count
+                      << " records: row " << i << " selected " << selected << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main() {
+    std::mt19937 random(42);
+    bool ok = true;
+    for (KimSimdLevel level : {KimSimdLevel::Scalar, KimSimdLevel::Sse42, KimSimdLevel::Avx2}) {
+        kimSetSimdLevel(level);
+        for (size_t width = 1; width <= 70; ++width) {
+            for (size_t count : {0, 1, 5, 63, 64, 65, 200, 4096}) {
+                ok = checkWidth(width, count, random) && ok;
+            }
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,106 @@
+//
+// Replaying a log across a background compaction gives back the same row ids.
+//
+#include "KimFileHead.h"
+
+#include <cstdio>
+#include <iostream>
+
+static const char* kFile = "wal_compaction_replay.kim";
+
+static void removeFiles() {
+    for (std::string suffix : {"", ".wal", ".wal.1"}) {
+        std::remove((kFile + suffix).c_str());
+    }
+}
+
+static std::vector<ColumnHeader> columnHeaders() {
+    std::vector<ColumnHeader> headers(2);
+    for (auto& columnHeader : headers) {
+        std::memset(&columnHeader, 0, sizeof(ColumnHeader));
+    }
+    std::memcpy(headers[0].ColumnName, "id", 2);
+    headers[0].DataType = static_cast<uint8_t>(KimDataType::Int);
+    headers[0].DataSize = 8;
+    headers[0].IsPrimaryKey = true;
+    std::memcpy(headers[1].ColumnName, "name", 4);
+    return headers;
+}
+
+// Every row id, deleted ones marked, with its cells
+static std::vector<std::string> contents(const KimTable& table) {
+    std::vector<std::string> rows;
+    for (size_t row = 0; row < table.rowCount(); ++row) {
+        if (table.isDeleted(row)) {
+            rows.push_back("deleted");
+            continue;
+        }
+        std::string line = "live";
+        for (const auto& cell : table.selectRow(table, row)) {
+            line += "|" + cell;
+        }
+        rows.push_back(line);
+    }
+    return rows;
+}
+
+int main() {
+    removeFiles();
+    std::vector<std::string> expected;
+    {
+        KimTable table;
+        table.createTable(columnHeaders());
+        table.setTableName("people");
+        table.compactionThreshold = 0;
+        if (!table.openLogged(kFile)) {
+            std::cerr << "openLogged failed" << std::endl;
+            return 1;
+        }
+        for (int i = 0; i < 300; ++i) {
+            table.addRow({std::to_string(i), "name " + std::to_string(i)});
+        }
+        for (size_t row = 0; row < 300; row += 3) {
+            table.deleteRow(row);
+        }
+
+        // Changes made while the compaction runs are carried over when it is
+        // installed, and logged before its Compact record
+        table.compactInBackground();
+        table.deleteRow(1);
+        table.updateRow(table, 4, 1, "renamed");
+        table.finishCompaction(true);
+        for (int i = 300; i < 320; ++i) {
+            table.addRow({std::to_string(i), "name " + std::to_string(i)});
+        }
+        table.deleteRow(5);
+        table.updateRow(table, 7, 1, "after compaction");
+        if (table.compactionCount != 1) {
+            std::cerr << "the compaction was not installed" << std::endl;
+            return 1;
+        }
+        expected = contents(table);
+        table.closeLog();
+    }
+
+    KimTable replayed;
+    replayed.compactionThreshold = 0;
+    if (!replayed.openLogged(kFile)) {
+        std::cerr << "reopening failed" << std::endl;
+        return 1;
+    }
+    std::vector<std::string> actual = contents(replayed);
+    replayed.closeLog();
+    removeFiles();
+
+    if (actual != expected) {
+        std::cerr << "replayed " << actual.size() << " rows, expected " << expected.size() << std::endl;
+        for (size_t row = 0; row < std::min(actual.size(), expected.size()); ++row) {
+            if (actual[row] != expected[row]) {
+                std::cerr << "row " << row << ": " << actual[row] << " instead of " << expected[row] << std::endl;
+                break;
+            }
+        }
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,58 @@
+//
+// A snapshot taken while a logged change waits for the log is not reused
+// once the change is applied.
+//
+#include "KimFileHead.h"
+
+#include <atomic>
+#include <cstdio>
+#include <iostream>
+#include <thread>
+
+static const char* kFile = "wal_snapshot_during_write.kim";
+
+static void removeFiles() {
+    for (std::string suffix : {"", ".wal", ".wal.1"}) {
+        std::remove((kFile + suffix).c_str());
+    }
+}
+
+int main() {
+    removeFiles();
+    KimTable table;
+    table.createTable(std::vector<std::string>{"name"});
+    table.setTableName("snapshots");
+    table.compactionThreshold = 0;
+    if (!table.openLogged(kFile)) {
+        std::cerr << "openLogged failed" << std::endl;
+        return 1;
+    }
+
+    // The reader snapshots as fast as it can, so it often lands while the
+    // writer waits for an fsync
+    std::atomic<bool> done{false};
+    std::thread reader([&] {
+        while (!done) {
+            table.snapshot();
+        }
+    });
+    size_t stale = 0;
+    for (int i = 0; i < 200; ++i) {
+        table.addRow({"row " + std::to_string(i)});
+        table.updateRow(table, 0, 0, "update " + std::to_string(i));
+        std::shared_ptr<const KimTable> snapshot = table.snapshot();
+        if (snapshot->rowCount() != size_t(i) + 1 ||
+            snapshot->select(*snapshot, 0, 0) != "update " + std::to_string(i)) {
+            ++stale;
+        }
+    }
+    done = true;
+    reader.join();
+    table.closeLog();
+    removeFiles();
+    if (stale != 0) {
+        std::cerr << stale << " of 200 snapshots missed a committed change" << std::endl;
+        return 1;
+    }
+    return 0;
+}
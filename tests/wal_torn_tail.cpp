@@ -0,0 +1,93 @@
+//
+// A log whose last record was torn, or is followed by garbage, replays the
+// intact records and takes new ones after them.
+//
+#include "KimFileHead.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+static const char* kFile = "wal_torn_tail.kim";
+
+static void removeFiles() {
+    for (std::string suffix : {"", ".wal", ".wal.1"}) {
+        std::remove((kFile + suffix).c_str());
+    }
+}
+
+static std::vector<std::string> names(const KimTable& table) {
+    std::vector<std::string> values;
+    for (size_t row = 0; row < table.rowCount(); ++row) {
+        values.push_back(table.select(table, row, 0));
+    }
+    return values;
+}
+
+static bool expect(const std::vector<std::string>& actual, const std::vector<std::string>& expected,
+                   const char* step) {
+    if (actual != expected) {
+        std::cerr << step << ": " << actual.size() << " rows, expected " << expected.size() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main() {
+    removeFiles();
+    std::vector<std::string> expected;
+    {
+        KimTable table;
+        table.createTable(std::vector<std::string>{"name"});
+        table.setTableName("torn");
+        if (!table.openLogged(kFile)) {
+            std::cerr << "openLogged failed" << std::endl;
+            return 1;
+        }
+        for (int i = 0; i < 10; ++i) {
+            expected.push_back("row " + std::to_string(i));
+            table.addRow({expected.back()});
+        }
+        table.closeLog();
+    }
+
+    // Cut the last record short: the nine before it survive
+    std::string logPath = std::string(kFile) + ".wal";
+    std::filesystem::resize_file(logPath, std::filesystem::file_size(logPath) - 3);
+    expected.pop_back();
+    bool ok = true;
+    {
+        KimTable table;
+        ok = table.openLogged(kFile) && expect(names(table), expected, "torn record") && ok;
+        // The torn bytes are cut off, so this record is reachable on replay
+        expected.push_back("after the tear");
+        ok = table.addRow({expected.back()}) && ok;
+        table.closeLog();
+    }
+    {
+        KimTable table;
+        ok = table.openLogged(kFile) && expect(names(table), expected, "appended after the tear") && ok;
+        table.closeLog();
+    }
+
+    // Bytes that are not a record are ignored the same way
+    {
+        std::ofstream log(logPath, std::ios::binary | std::ios::app);
+        log << "not a record at all, just garbage";
+    }
+    {
+        KimTable table;
+        ok = table.openLogged(kFile) && expect(names(table), expected, "garbage tail") && ok;
+        expected.push_back("after the garbage");
+        ok = table.addRow({expected.back()}) && ok;
+        table.closeLog();
+    }
+    {
+        KimTable table;
+        ok = table.openLogged(kFile) && expect(names(table), expected, "appended after the garbage") && ok;
+        table.closeLog();
+    }
+    removeFiles();
+    return ok ? 0 : 1;
+}